@@ -0,0 +1,421 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <peff/advutils/arena_alloc.h>
+#include <peff/advutils/buffer_alloc.h>
+#include <peff/advutils/paged_buffer_alloc.h>
+#include <peff/advutils/slab_alloc.h>
+#include <peff/advutils/thread_caching_alloc.h>
+#include <peff/advutils/trace_recorder_alloc.h>
+#include <peff/advutils/tracking_alloc.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <vector>
+
+#if defined(_WIN32)
+	#include <Windows.h>
+#else
+	#include <sys/mman.h>
+	#include <unistd.h>
+#endif
+
+// Replays allocation traces recorded by peff::TraceRecorderAlloc against the allocators.
+//
+// The footprint of an allocator is the memory it draws from the system:
+// the peak of what it requested from its upstream allocator plus the pages
+// it has touched in its fixed buffer, if any. The fragmentation ratio is
+// the peak footprint divided by the peak of the live requested bytes, the
+// overhead of malloc itself is not visible, so it is always 1 for "std".
+
+constexpr static size_t DEFAULT_BUFFER_SIZE = (size_t)1 << 30;
+
+static const char *const ALLOCATOR_NAMES[] = {
+	"std",
+	"slab",
+	"arena",
+	"thread_caching",
+	"buffer",
+	"upstreamed_buffer",
+	"paged_buffer"
+};
+
+static uint64_t get_time_ns() {
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static size_t get_page_size() {
+#if defined(_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwPageSize;
+#else
+	return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+/// @brief Buffer for the buffer allocators, which is backed by the pages lazily, so the touched pages can be counted.
+struct LazyBuffer {
+	char *data = nullptr;
+	size_t size = 0;
+
+	LazyBuffer(size_t size) : size(size) {
+#if defined(_WIN32)
+		data = (char *)VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+		void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		data = p == MAP_FAILED ? nullptr : (char *)p;
+#endif
+	}
+
+	~LazyBuffer() {
+		if (!data)
+			return;
+#if defined(_WIN32)
+		VirtualFree(data, 0, MEM_RELEASE);
+#else
+		munmap(data, size);
+#endif
+	}
+
+	/// @brief Count the bytes of the resident pages, the whole size is returned if it cannot be queried.
+	size_t count_resident_size() const {
+#if defined(__linux__) || defined(__APPLE__)
+		const size_t page_size = get_page_size();
+		const size_t num_pages = (size + page_size - 1) / page_size;
+		std::vector<char> residency(num_pages);
+
+	#if defined(__APPLE__)
+		if (mincore(data, size, residency.data()))
+	#else
+		if (mincore(data, size, (unsigned char *)residency.data()))
+	#endif
+			return size;
+
+		size_t n = 0;
+		for (size_t i = 0; i < num_pages; ++i)
+			n += residency[i] & 1;
+		return n * page_size;
+#else
+		return size;
+#endif
+	}
+};
+
+/// @brief Allocator under test and what it is built on.
+struct Candidate {
+	// The system allocator must be destructed after the others, which hold references to it.
+	peff::TrackingAlloc system_alloc;
+	std::unique_ptr<LazyBuffer> buffer;
+	std::unique_ptr<peff::BufferAlloc> buffer_alloc;
+	std::unique_ptr<peff::Alloc> alloc;
+
+	Candidate() : system_alloc(peff::default_allocator()) {}
+
+	bool init(const char *name, size_t buffer_size) {
+		if (!strcmp(name, "std"))
+			return true;
+		if (!strcmp(name, "slab")) {
+			alloc = std::make_unique<peff::SlabAlloc>(&system_alloc);
+			return true;
+		}
+		if (!strcmp(name, "arena")) {
+			alloc = std::make_unique<peff::ArenaAlloc>(&system_alloc);
+			return true;
+		}
+		if (!strcmp(name, "thread_caching")) {
+			alloc = std::make_unique<peff::ThreadCachingAlloc>(&system_alloc);
+			return true;
+		}
+
+		buffer = std::make_unique<LazyBuffer>(buffer_size);
+		if (!buffer->data)
+			return false;
+
+		if (!strcmp(name, "buffer")) {
+			alloc = std::make_unique<peff::BufferAlloc>(buffer->data, buffer->size);
+			return true;
+		}
+		if (!strcmp(name, "upstreamed_buffer")) {
+			buffer_alloc = std::make_unique<peff::BufferAlloc>(buffer->data, buffer->size);
+			alloc = std::make_unique<peff::UpstreamedBufferAlloc>(buffer_alloc.get(), &system_alloc);
+			return true;
+		}
+		if (!strcmp(name, "paged_buffer")) {
+			alloc = std::make_unique<peff::PagedBufferAlloc>(buffer->data, buffer->size, &system_alloc);
+			return true;
+		}
+
+		return false;
+	}
+
+	peff::Alloc *get() {
+		return alloc ? alloc.get() : &system_alloc;
+	}
+};
+
+struct Block {
+	void *ptr = nullptr;
+	size_t size = 0;
+	size_t alignment = 0;
+};
+
+static bool load_trace(const char *path, std::vector<peff::TraceRecord> &records, uint64_t &max_id) {
+	FILE *fp = fopen(path, "rb");
+	if (!fp) {
+		fprintf(stderr, "Error opening trace file: %s\n", path);
+		return false;
+	}
+
+	peff::TraceReader reader(fp);
+	if (!reader.read_header()) {
+		fprintf(stderr, "Not a trace file or unsupported version: %s\n", path);
+		fclose(fp);
+		return false;
+	}
+
+	peff::TraceRecord record;
+	max_id = 0;
+	while (reader.read(record)) {
+		records.push_back(record);
+		max_id = std::max(max_id, record.id);
+	}
+
+	fclose(fp);
+
+	if (reader.is_malformed)
+		fprintf(stderr, "Warning: the trace is truncated after %zu records\n", records.size());
+
+	return true;
+}
+
+static void replay(const char *name, const std::vector<peff::TraceRecord> &records, uint64_t max_id, size_t buffer_size) {
+	Candidate candidate;
+	if (!candidate.init(name, buffer_size)) {
+		fprintf(stderr, "Error initializing allocator: %s\n", name);
+		return;
+	}
+
+	peff::Alloc *alloc = candidate.get();
+	std::vector<Block> blocks(max_id + 1);
+	std::vector<uint32_t> latencies;
+	latencies.reserve(records.size());
+
+	size_t num_failed = 0, num_in_place_misses = 0;
+	size_t live_size = 0, peak_live_size = 0;
+
+	const uint64_t begin_time = get_time_ns();
+
+	for (const peff::TraceRecord &record : records) {
+		Block &block = blocks[record.id];
+
+		// Requests on the blocks which have failed to allocate are skipped.
+		if ((record.op != peff::TraceOp::Alloc) && !block.ptr)
+			continue;
+
+		const uint64_t op_begin_time = get_time_ns();
+
+		switch (record.op) {
+			case peff::TraceOp::Alloc: {
+				if (!(block.ptr = alloc->alloc(record.size, record.alignment))) {
+					++num_failed;
+					break;
+				}
+				block.size = record.size;
+				block.alignment = record.alignment;
+				live_size += record.size;
+				break;
+			}
+			case peff::TraceOp::Realloc:
+			case peff::TraceOp::ReallocInPlace: {
+				void *p = nullptr;
+
+				if (record.op == peff::TraceOp::ReallocInPlace) {
+					if (!(p = alloc->realloc_in_place(block.ptr, block.size, block.alignment, record.size, record.alignment)))
+						++num_in_place_misses;
+				}
+
+				if (!p && !(p = alloc->realloc(block.ptr, block.size, block.alignment, record.size, record.alignment))) {
+					++num_failed;
+					break;
+				}
+
+				live_size = live_size - block.size + record.size;
+				block.ptr = p;
+				block.size = record.size;
+				block.alignment = record.alignment;
+				break;
+			}
+			case peff::TraceOp::Release: {
+				alloc->release(block.ptr, block.size, block.alignment);
+				live_size -= block.size;
+				block.ptr = nullptr;
+				break;
+			}
+		}
+
+		const uint64_t op_time = get_time_ns() - op_begin_time;
+		latencies.push_back(op_time > UINT32_MAX ? UINT32_MAX : (uint32_t)op_time);
+
+		peak_live_size = std::max(peak_live_size, live_size);
+	}
+
+	const uint64_t total_time = get_time_ns() - begin_time;
+
+	size_t peak_footprint = candidate.system_alloc.snapshot().peak_size;
+	if (candidate.buffer)
+		peak_footprint += candidate.buffer->count_resident_size();
+
+	for (Block &block : blocks) {
+		if (block.ptr)
+			alloc->release(block.ptr, block.size, block.alignment);
+	}
+
+	std::sort(latencies.begin(), latencies.end());
+
+	auto percentile = [&latencies](double p) -> uint32_t {
+		if (latencies.empty())
+			return 0;
+		return latencies[std::min(latencies.size() - 1, (size_t)(p * (double)latencies.size()))];
+	};
+
+	printf("%-18s %10zu %8zu %8zu %10.2f %8u %8u %8u %10u %12zu %12zu %8.3f\n",
+		name,
+		latencies.size(),
+		num_failed,
+		num_in_place_misses,
+		total_time ? (double)latencies.size() * 1000.0 / (double)total_time : 0.0,
+		percentile(0.5),
+		percentile(0.99),
+		percentile(0.999),
+		latencies.empty() ? 0 : latencies.back(),
+		peak_live_size,
+		peak_footprint,
+		peak_live_size ? (double)peak_footprint / (double)peak_live_size : 0.0);
+}
+
+/// @brief Record a synthetic workload, which mixes short-lived small objects, growing arrays and long-lived large blocks.
+static bool record_synthetic(const char *path, size_t num_ops, uint32_t seed) {
+	FILE *fp = fopen(path, "wb");
+	if (!fp) {
+		fprintf(stderr, "Error opening trace file: %s\n", path);
+		return false;
+	}
+
+	bool succeeded;
+	{
+		peff::TraceRecorderAlloc recorder(peff::default_allocator(), fp);
+		std::mt19937 rng(seed);
+		std::vector<Block> live;
+
+		for (size_t i = 0; i < num_ops; ++i) {
+			const uint32_t r = rng() % 100;
+
+			if ((r < 45) || live.empty()) {
+				Block block;
+				const uint32_t kind = rng() % 100;
+
+				if (kind < 80)
+					block.size = 8 + rng() % 248;
+				else if (kind < 98)
+					block.size = 256 + rng() % 3840;
+				else
+					block.size = 4096 + rng() % 262144;
+				block.alignment = (kind % 7) ? alignof(std::max_align_t) : 64;
+
+				if ((block.ptr = recorder.alloc(block.size, block.alignment)))
+					live.push_back(block);
+			} else if (r < 55) {
+				Block &block = live[rng() % live.size()];
+				const size_t new_size = block.size + block.size / 2 + 1;
+
+				if (void *p = recorder.realloc_in_place(block.ptr, block.size, block.alignment, new_size, block.alignment); p) {
+					block.size = new_size;
+				} else if ((p = recorder.realloc(block.ptr, block.size, block.alignment, new_size, block.alignment))) {
+					block.ptr = p;
+					block.size = new_size;
+				}
+			} else {
+				const size_t index = rng() % live.size();
+
+				recorder.release(live[index].ptr, live[index].size, live[index].alignment);
+				live[index] = live.back();
+				live.pop_back();
+			}
+		}
+
+		for (Block &block : live)
+			recorder.release(block.ptr, block.size, block.alignment);
+
+		succeeded = recorder.flush();
+	}
+
+	fclose(fp);
+
+	if (!succeeded)
+		fprintf(stderr, "Error writing trace file: %s\n", path);
+	return succeeded;
+}
+
+static void print_usage() {
+	puts("Usage:");
+	puts("  peff_alloc_replay record <trace> [num_ops] [seed]");
+	puts("      Record a synthetic workload into a trace file.");
+	puts("  peff_alloc_replay replay <trace> [--buffer-size <bytes>] [allocator...]");
+	puts("      Replay a trace against the allocators, all of them by default.");
+	fputs("Allocators:", stdout);
+	for (const char *name : ALLOCATOR_NAMES)
+		printf(" %s", name);
+	putchar('\n');
+}
+
+int main(int argc, char **argv) {
+#ifdef _MSC_VER
+	_CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
+#endif
+
+	if (argc < 3) {
+		print_usage();
+		return 1;
+	}
+
+	if (!strcmp(argv[1], "record")) {
+		const size_t num_ops = argc > 3 ? strtoull(argv[3], nullptr, 10) : 1000000;
+		const uint32_t seed = argc > 4 ? (uint32_t)strtoul(argv[4], nullptr, 10) : 1;
+
+		return record_synthetic(argv[2], num_ops, seed) ? 0 : 1;
+	}
+
+	if (strcmp(argv[1], "replay")) {
+		print_usage();
+		return 1;
+	}
+
+	size_t buffer_size = DEFAULT_BUFFER_SIZE;
+	std::vector<const char *> names;
+
+	for (int i = 3; i < argc; ++i) {
+		if (!strcmp(argv[i], "--buffer-size") && (i + 1 < argc))
+			buffer_size = strtoull(argv[++i], nullptr, 10);
+		else
+			names.push_back(argv[i]);
+	}
+
+	if (names.empty())
+		names.assign(std::begin(ALLOCATOR_NAMES), std::end(ALLOCATOR_NAMES));
+
+	std::vector<peff::TraceRecord> records;
+	uint64_t max_id;
+	if (!load_trace(argv[2], records, max_id))
+		return 1;
+
+	printf("%zu records, %llu blocks\n", records.size(), (unsigned long long)max_id);
+	printf("%-18s %10s %8s %8s %10s %8s %8s %8s %10s %12s %12s %8s\n",
+		"allocator", "ops", "failed", "ip_miss", "Mops/s", "p50(ns)", "p99(ns)", "p999(ns)", "max(ns)", "peak_live", "peak_fp", "frag");
+
+	for (const char *name : names)
+		replay(name, records, max_id, buffer_size);
+
+	return 0;
+}
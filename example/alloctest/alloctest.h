@@ -0,0 +1,133 @@
+#ifndef _ALLOCTEST_ALLOCTEST_H_
+#define _ALLOCTEST_ALLOCTEST_H_
+
+// The checks are done with assert(), keep them in the release builds.
+#undef NDEBUG
+#include <cassert>
+#include <peff/base/alloc.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+/// @brief Upstream allocator which fails when its budget runs out, and counts the live bytes so the leaks can be detected.
+class LimitedAlloc : public peff::Alloc {
+protected:
+	std::atomic_size_t _ref_count = 0;
+
+public:
+	/// @brief Maximum of the total size of the live blocks, SIZE_MAX for no limit.
+	size_t budget;
+	size_t live_size = 0;
+	size_t num_live_blocks = 0;
+
+	LimitedAlloc(size_t budget = SIZE_MAX) : budget(budget) {}
+
+	virtual size_t inc_ref(size_t global_ref_count) noexcept override {
+		return ++_ref_count;
+	}
+	virtual size_t dec_ref(size_t global_ref_count) noexcept override {
+		return --_ref_count;
+	}
+
+	virtual void *alloc(size_t size, size_t alignment) noexcept override {
+		if (size > budget - live_size)
+			return nullptr;
+
+		void *ptr = peff::default_allocator()->alloc(size, alignment);
+		if (ptr) {
+			live_size += size;
+			++num_live_blocks;
+		}
+		return ptr;
+	}
+	virtual void *realloc(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override {
+		if ((new_size > size) && (new_size - size > budget - live_size))
+			return nullptr;
+
+		void *p = peff::default_allocator()->realloc(ptr, size, alignment, new_size, new_alignment);
+		if (p)
+			live_size = live_size - size + new_size;
+		return p;
+	}
+	virtual void *realloc_in_place(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override {
+		if ((new_size > size) && (new_size - size > budget - live_size))
+			return nullptr;
+
+		void *p = peff::default_allocator()->realloc_in_place(ptr, size, alignment, new_size, new_alignment);
+		if (p)
+			live_size = live_size - size + new_size;
+		return p;
+	}
+	virtual void release(void *ptr, size_t size, size_t alignment) noexcept override {
+		assert(live_size >= size);
+		assert(num_live_blocks);
+		live_size -= size;
+		--num_live_blocks;
+		peff::default_allocator()->release(ptr, size, alignment);
+	}
+
+	virtual bool is_replaceable(const peff::Alloc *rhs) const noexcept override {
+		return rhs == this;
+	}
+
+	virtual peff::UUID type_identity() const noexcept override {
+		return PEFF_UUID(5d0c1f3a, 7b2e, 4a91, 9c4d, 2e8f6a1b3c70);
+	}
+};
+
+/// @brief Fill a block with a pattern derived from the seed.
+inline void fill_block(void *ptr, size_t size, uint8_t seed) {
+	for (size_t i = 0; i < size; ++i)
+		((uint8_t *)ptr)[i] = (uint8_t)(seed + i * 7);
+}
+
+/// @brief Check if a block still holds the pattern written by fill_block().
+inline bool check_block(const void *ptr, size_t size, uint8_t seed) {
+	for (size_t i = 0; i < size; ++i) {
+		if (((const uint8_t *)ptr)[i] != (uint8_t)(seed + i * 7))
+			return false;
+	}
+	return true;
+}
+
+inline bool is_aligned(const void *ptr, size_t alignment) {
+	return !(((uintptr_t)ptr) % (alignment ? alignment : 1));
+}
+
+/// @brief Allocate, fill, check and release a block of each pair of the sizes and the alignments.
+/// @param check_block_placement Callable which checks the allocator-specific invariants of each block with its pointer, size and alignment.
+template <size_t NUM_SIZES, size_t NUM_ALIGNMENTS, typename Checker>
+inline void test_sizes_and_alignments(peff::Alloc *alloc, const size_t (&sizes)[NUM_SIZES], const size_t (&alignments)[NUM_ALIGNMENTS], Checker &&check_block_placement) {
+	for (size_t size : sizes) {
+		for (size_t alignment : alignments) {
+			void *ptr = alloc->alloc(size, alignment);
+			assert(ptr);
+			assert(is_aligned(ptr, alignment));
+			check_block_placement(ptr, size, alignment);
+
+			fill_block(ptr, size, (uint8_t)size);
+			assert(check_block(ptr, size, (uint8_t)size));
+
+			alloc->release(ptr, size, alignment);
+		}
+	}
+}
+
+template <size_t NUM_SIZES, size_t NUM_ALIGNMENTS>
+inline void test_sizes_and_alignments(peff::Alloc *alloc, const size_t (&sizes)[NUM_SIZES], const size_t (&alignments)[NUM_ALIGNMENTS]) {
+	test_sizes_and_alignments(alloc, sizes, alignments, [](void *ptr, size_t size, size_t alignment) {});
+}
+
+void test_slab_alloc();
+void test_arena_alloc();
+void test_buffer_alloc();
+void test_paged_buffer_alloc();
+void test_thread_caching_alloc();
+void test_mmap_alloc();
+void test_tiered_alloc();
+void test_scratch_alloc();
+void test_mapped_file_alloc();
+void test_sampling_profiler_alloc();
+void test_tracking_alloc();
+
+#endif
@@ -0,0 +1,174 @@
+#include "alloctest.h"
+#include <peff/advutils/arena_alloc.h>
+#include <iterator>
+
+static void test_alloc_and_alignment() {
+	LimitedAlloc upstream;
+	peff::ArenaAlloc alloc(&upstream, 4096);
+
+	assert(alloc.get_caps().is_monotonic);
+
+	constexpr size_t NUM_BLOCKS = 64;
+	const size_t alignments[] = { 0, 1, 2, 8, 16, 64, 256, 4096 };
+	char *blocks[NUM_BLOCKS];
+
+	for (size_t i = 0; i < NUM_BLOCKS; ++i) {
+		const size_t size = 1 + i * 13, alignment = alignments[i % std::size(alignments)];
+
+		blocks[i] = (char *)alloc.alloc(size, alignment);
+		assert(blocks[i]);
+		assert(is_aligned(blocks[i], alignment));
+		fill_block(blocks[i], size, (uint8_t)i);
+
+		// Releasing does nothing, the data stays until the arena is reset.
+		alloc.release(blocks[i], size, alignment);
+	}
+
+	// None of the blocks overlaps with the others.
+	for (size_t i = 0; i < NUM_BLOCKS; ++i)
+		assert(check_block(blocks[i], 1 + i * 13, (uint8_t)i));
+
+	// A request larger than the block size gets a dedicated block.
+	void *large = alloc.alloc(100000, 64);
+	assert(large);
+	assert(is_aligned(large, 64));
+	fill_block(large, 100000, 3);
+	assert(check_block(large, 100000, 3));
+
+	// Resetting retains the first block only.
+	assert(upstream.num_live_blocks > 1);
+	alloc.reset();
+	assert(upstream.num_live_blocks == 1);
+}
+
+static void test_realloc() {
+	LimitedAlloc upstream;
+	peff::ArenaAlloc alloc(&upstream, 4096);
+
+	// The most recent allocation grows and shrinks in place.
+	char *ptr = (char *)alloc.alloc(100, 8);
+	fill_block(ptr, 100, 1);
+	assert(alloc.realloc_in_place(ptr, 100, 8, 1000, 8) == ptr);
+	assert(alloc.realloc_in_place(ptr, 1000, 8, 50, 8) == ptr);
+	assert(alloc.realloc(ptr, 50, 8, 2000, 8) == ptr);
+	assert(check_block(ptr, 50, 1));
+
+	// It cannot grow beyond its block, or to an alignment it does not satisfy.
+	assert(!alloc.realloc_in_place(ptr, 2000, 8, 4096, 8));
+	if (!is_aligned(ptr, 4096))
+		assert(!alloc.realloc_in_place(ptr, 2000, 8, 2000, 4096));
+
+	// Once another block follows it, it can only shrink in place.
+	char *next = (char *)alloc.alloc(16, 0);
+	assert(next >= ptr + 2000);
+	assert(!alloc.realloc_in_place(ptr, 2000, 8, 2001, 8));
+	assert(alloc.realloc_in_place(ptr, 2000, 8, 10, 8) == ptr);
+
+	// Growing it moves the data into a new block.
+	char *moved = (char *)alloc.realloc(ptr, 10, 8, 3000, 16);
+	assert(moved && (moved != ptr));
+	assert(is_aligned(moved, 16));
+	assert(check_block(moved, 10, 1));
+}
+
+static void test_batch() {
+	LimitedAlloc upstream;
+	peff::ArenaAlloc alloc(&upstream, 4096);
+
+	constexpr size_t NUM_BLOCKS = 100;
+	void *blocks[NUM_BLOCKS];
+
+	// The batch is a contiguous run of blocks rounded up to the alignment.
+	assert(alloc.alloc_batch(NUM_BLOCKS, 20, 8, blocks) == NUM_BLOCKS);
+	for (size_t i = 0; i < NUM_BLOCKS; ++i) {
+		assert(is_aligned(blocks[i], 8));
+		if (i)
+			assert((char *)blocks[i] == (char *)blocks[i - 1] + 24);
+		fill_block(blocks[i], 20, (uint8_t)i);
+	}
+	for (size_t i = 0; i < NUM_BLOCKS; ++i)
+		assert(check_block(blocks[i], 20, (uint8_t)i));
+
+	// Only the last one of the batch can be grown in place.
+	assert(!alloc.realloc_in_place(blocks[0], 20, 8, 24, 8));
+	assert(alloc.realloc_in_place(blocks[NUM_BLOCKS - 1], 20, 8, 200, 8) == blocks[NUM_BLOCKS - 1]);
+
+	alloc.release_batch(blocks, NUM_BLOCKS, 20, 8);
+	assert(check_block(blocks[0], 20, 0));
+
+	// A batch larger than a block takes a dedicated one.
+	static void *many_blocks[1000];
+	assert(alloc.alloc_batch(1000, 64, 64, many_blocks) == 1000);
+	assert((char *)many_blocks[999] == (char *)many_blocks[0] + 999 * 64);
+}
+
+static void test_rewind_and_trim() {
+	LimitedAlloc upstream;
+	peff::ArenaAlloc alloc(&upstream, 65536);
+
+	char *first = (char *)alloc.alloc(100, 0);
+	fill_block(first, 100, 5);
+
+	const peff::ArenaAlloc::Marker marker = alloc.mark();
+	char *second = (char *)alloc.alloc(1000, 0);
+	assert(second);
+	for (size_t i = 0; i < 10; ++i)
+		assert(alloc.alloc(60000, 0));
+	assert(upstream.num_live_blocks > 1);
+
+	// Rewinding releases the blocks after the marker and reuses the space after it.
+	alloc.rewind(marker);
+	assert(upstream.num_live_blocks == 1);
+	assert(alloc.alloc(1000, 0) == second);
+	assert(check_block(first, 100, 5));
+
+	// Trimming purges the unused pages of the current block, the used part is kept.
+	const size_t trimmed_size = alloc.trim(0, peff::PurgePolicy::Eager);
+#ifdef __linux__
+	assert(trimmed_size);
+#else
+	(void)trimmed_size;
+#endif
+	assert(check_block(first, 100, 5));
+	char *after_trim = (char *)alloc.alloc(30000, 0);
+	assert(after_trim);
+	fill_block(after_trim, 30000, 6);
+	assert(check_block(after_trim, 30000, 6));
+
+	// Nothing is purged if the free part is within keep_bytes.
+	assert(!alloc.trim(65536));
+}
+
+static void test_exhaustion() {
+	LimitedAlloc upstream(3 * 4096);
+	peff::ArenaAlloc alloc(&upstream, 4096);
+
+	size_t total_size = 0;
+	void *last = nullptr;
+	for (void *ptr; (ptr = alloc.alloc(100, 0)); last = ptr)
+		total_size += 100;
+	assert(total_size > 2 * 4096);
+	assert(total_size <= 3 * 4096);
+
+	// Neither the batches nor the reallocations can get another block.
+	void *blocks[10];
+	assert(!alloc.alloc_batch(10, 1000, 0, blocks));
+	assert(!alloc.realloc(last, 100, 0, 5000, 0));
+
+	// The arena is usable again after resetting.
+	alloc.reset();
+	assert(alloc.alloc(1000, 0));
+
+	// Sizes which would overflow the block size are rejected.
+	assert(!alloc.alloc(SIZE_MAX - 8, 0));
+	assert(!alloc.alloc(SIZE_MAX / 2, 4096));
+}
+
+void test_arena_alloc() {
+	test_alloc_and_alignment();
+	test_realloc();
+	test_batch();
+	test_rewind_and_trim();
+	test_exhaustion();
+	puts("ArenaAlloc: passed");
+}
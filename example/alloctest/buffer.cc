@@ -0,0 +1,389 @@
+#include "alloctest.h"
+#include <peff/advutils/buffer_alloc.h>
+#include <peff/containers/dynarray.h>
+
+constexpr static size_t BUFFER_SIZE = 65536;
+alignas(4096) static char g_buffer[BUFFER_SIZE];
+
+constexpr static size_t DESC_SIZE = sizeof(peff::BufferAlloc::AllocDesc);
+
+static void test_alloc_and_realloc() {
+	peff::BufferAlloc alloc(g_buffer, BUFFER_SIZE);
+
+	const size_t sizes[] = { 1, 7, 8, 100, 1000, 4096 };
+	const size_t alignments[] = { 0, 1, 8, 64, 256, 4096 };
+
+	test_sizes_and_alignments(&alloc, sizes, alignments);
+
+	// Everything has been coalesced back into a single extent.
+	assert(alloc.get_fragmentation_stats().num_free_extents == 1);
+	assert(alloc.get_fragmentation_stats().free_size == BUFFER_SIZE);
+
+	// A block grows in place into the free space after it, but not over the next block.
+	void *head = alloc.alloc(8, 8);
+	char *ptr = (char *)alloc.alloc(100, 16);
+	char *next = (char *)alloc.alloc(100, 16);
+	fill_block(ptr, 100, 1);
+	assert(alloc.realloc_in_place(ptr, 100, 16, 64, 16) == ptr);
+	assert(!alloc.realloc_in_place(ptr, 64, 16, 1000, 16));
+	alloc.release(next, 100, 16);
+	assert(alloc.realloc_in_place(ptr, 64, 16, 1000, 16) == ptr);
+	assert(check_block(ptr, 64, 1));
+
+	// A stricter alignment which the block does not satisfy needs a move.
+	assert(!is_aligned(ptr, 4096));
+	assert(!alloc.realloc_in_place(ptr, 1000, 16, 1000, 4096));
+	char *moved = (char *)alloc.realloc(ptr, 1000, 16, 2000, 4096);
+	assert(moved && is_aligned(moved, 4096));
+	assert(check_block(moved, 64, 1));
+
+	// The batch falls back to allocating one by one.
+	void *blocks[16];
+	assert(alloc.alloc_batch(16, 40, 8, blocks) == 16);
+	for (size_t i = 0; i < 16; ++i)
+		fill_block(blocks[i], 40, (uint8_t)i);
+	for (size_t i = 0; i < 16; ++i)
+		assert(check_block(blocks[i], 40, (uint8_t)i));
+	alloc.release_batch(blocks, 16, 40, 8);
+
+	alloc.release(moved, 2000, 4096);
+	alloc.release(head, 8, 8);
+	assert(alloc.get_fragmentation_stats().num_allocs == 0);
+}
+
+static void test_size_index() {
+	peff::BufferAlloc alloc(g_buffer, BUFFER_SIZE);
+
+	// Gaps of 100, 300 and 200 bytes separated by small blocks, the best fit is taken.
+	void *a = alloc.alloc(100, 8);
+	void *sep_a = alloc.alloc(8, 8);
+	void *c = alloc.alloc(300, 8);
+	void *sep_c = alloc.alloc(8, 8);
+	void *e = alloc.alloc(200, 8);
+	void *sep_e = alloc.alloc(8, 8);
+
+	alloc.release(a, 100, 8);
+	alloc.release(c, 300, 8);
+	alloc.release(e, 200, 8);
+
+	assert(alloc.alloc(180, 8) == e);
+	assert(alloc.alloc(250, 8) == c);
+	assert(alloc.alloc(50, 8) == a);
+
+	alloc.release(a, 50, 8);
+	alloc.release(c, 250, 8);
+	alloc.release(e, 180, 8);
+	alloc.release(sep_a, 8, 8);
+	alloc.release(sep_c, 8, 8);
+	alloc.release(sep_e, 8, 8);
+	assert(alloc.get_fragmentation_stats().num_free_extents == 1);
+}
+
+static void test_aligned_candidates() {
+	constexpr size_t BIG_ALIGNMENT = 256;
+	peff::BufferAlloc alloc(g_buffer, 4096);
+
+	// Gap A: large enough for the request, but its base is not aligned well enough.
+	void *head = alloc.alloc(24, 1);
+	char *gap_a = (char *)alloc.alloc(128, 1);
+	void *sep = alloc.alloc(24, 1);
+
+	// Gap B: larger than A but smaller than the worst case of the request, and aligned.
+	char *const cursor = (char *)sep + 24 + DESC_SIZE;
+	const size_t pad_size = ((((uintptr_t)cursor + DESC_SIZE + BIG_ALIGNMENT) & ~(uintptr_t)(BIG_ALIGNMENT - 1)) - (uintptr_t)cursor) - DESC_SIZE;
+	void *pad = alloc.alloc(pad_size, 1);
+	char *gap_b = (char *)alloc.alloc(160, BIG_ALIGNMENT);
+	assert(gap_b == (char *)pad + pad_size + DESC_SIZE);
+	assert(is_aligned(gap_b, BIG_ALIGNMENT));
+	void *tail = alloc.alloc(24, 1);
+
+	// Fill up the rest of the buffer.
+	size_t num_fillers = 0;
+	void *fillers[4096 / 8];
+	while ((fillers[num_fillers] = alloc.alloc(8, 1)))
+		++num_fillers;
+
+	alloc.release(gap_a, 128, 1);
+	alloc.release(gap_b, 160, BIG_ALIGNMENT);
+	char *const aligned_in_gap_a = (char *)(((uintptr_t)gap_a + BIG_ALIGNMENT - 1) & ~(uintptr_t)(BIG_ALIGNMENT - 1));
+	assert(aligned_in_gap_a + 100 + DESC_SIZE > (char *)sep);
+
+	// The smallest candidate does not fit after alignment, the next one does.
+	assert(alloc.alloc(100, BIG_ALIGNMENT) == gap_b);
+	alloc.release(gap_b, 100, BIG_ALIGNMENT);
+
+	for (size_t i = 0; i < num_fillers; ++i)
+		alloc.release(fillers[i], 8, 1);
+	alloc.release(head, 24, 1);
+	alloc.release(sep, 24, 1);
+	alloc.release(pad, pad_size, 1);
+	alloc.release(tail, 24, 1);
+}
+
+static void test_trim_and_exhaustion() {
+	peff::BufferAlloc alloc(g_buffer, BUFFER_SIZE);
+
+	// Nothing fits into a full buffer.
+	assert(!alloc.alloc(BUFFER_SIZE, 0));
+	void *whole = alloc.alloc(BUFFER_SIZE - DESC_SIZE, 1);
+	assert(whole);
+	assert(!alloc.alloc(1, 1));
+	void *blocks[4];
+	assert(!alloc.alloc_batch(4, 1, 1, blocks));
+	alloc.release(whole, BUFFER_SIZE - DESC_SIZE, 1);
+
+	// Trimming purges the free pages, the live data is kept.
+	void *ptr = alloc.alloc(1000, 0);
+	fill_block(ptr, 1000, 9);
+	const size_t trimmed_size = alloc.trim(0, peff::PurgePolicy::Eager);
+#ifdef __linux__
+	assert(trimmed_size >= BUFFER_SIZE - 2 * 4096);
+#else
+	(void)trimmed_size;
+#endif
+	assert(check_block(ptr, 1000, 9));
+	assert(!alloc.trim(BUFFER_SIZE));
+
+	// The allocator keeps working after the pages are purged.
+	void *big = alloc.alloc(30000, 64);
+	assert(big);
+	fill_block(big, 30000, 10);
+	assert(check_block(big, 30000, 10));
+
+	alloc.release(big, 30000, 64);
+	alloc.release(ptr, 1000, 0);
+}
+
+struct Handle {
+	void *ptr;
+	size_t size;
+	size_t alignment;
+	bool pinned;
+};
+
+struct HandleTable {
+	Handle handles[64];
+	size_t num_handles = 0;
+	size_t num_relocated = 0;
+
+	Handle &add(peff::BufferAlloc &alloc, size_t size, size_t alignment) {
+		Handle &handle = handles[num_handles];
+		handle.ptr = alloc.alloc(size, alignment);
+		assert(handle.ptr);
+		handle.size = size;
+		handle.alignment = alignment;
+		handle.pinned = false;
+		fill_block(handle.ptr, size, (uint8_t)num_handles);
+		++num_handles;
+		return handle;
+	}
+
+	void release(peff::BufferAlloc &alloc, size_t index) {
+		alloc.release(handles[index].ptr, handles[index].size, handles[index].alignment);
+		handles[index].ptr = nullptr;
+	}
+
+	bool check() const {
+		for (size_t i = 0; i < num_handles; ++i) {
+			if (handles[i].ptr && ((!check_block(handles[i].ptr, handles[i].size, (uint8_t)i)) || (!is_aligned(handles[i].ptr, handles[i].alignment))))
+				return false;
+		}
+		return true;
+	}
+};
+
+static bool relocate_handle(void *user_data, void *old_ptr, void *new_ptr, size_t size) noexcept {
+	HandleTable *table = (HandleTable *)user_data;
+
+	for (size_t i = 0; i < table->num_handles; ++i) {
+		Handle &handle = table->handles[i];
+		if (handle.ptr != old_ptr)
+			continue;
+
+		assert(handle.size == size);
+		assert(new_ptr < old_ptr);
+		if (handle.pinned)
+			return false;
+
+		handle.ptr = new_ptr;
+		++table->num_relocated;
+		return true;
+	}
+
+	// Every live block has a handle.
+	assert(false);
+	return false;
+}
+
+static void test_compaction() {
+	peff::BufferAlloc alloc(g_buffer, BUFFER_SIZE);
+	HandleTable table;
+
+	// Every other block is released, which leaves the free space in small gaps.
+	// The alignments do not exceed the one of the descriptors, so the blocks can be packed without padding.
+	for (size_t i = 0; i < 32; ++i)
+		table.add(alloc, 1000 + i * 16, (size_t)1 << (i % 4));
+	for (size_t i = 0; i < 32; i += 2)
+		table.release(alloc, i);
+
+	peff::BufferAlloc::FragmentationStats stats = alloc.get_fragmentation_stats();
+	assert(stats.num_allocs == 16);
+	assert(stats.num_free_extents == 17);
+	assert(stats.used_size + stats.free_size == BUFFER_SIZE);
+	assert(stats.largest_free_extent_size < stats.free_size);
+	assert(stats.fragmentation > 0);
+
+	// Nothing moves without a relocation callback.
+	assert(!alloc.compact());
+	assert(table.check());
+
+	alloc.set_relocation_callback(relocate_handle, &table);
+	assert(alloc.compact() == 16);
+	assert(table.num_relocated == 16);
+	assert(table.check());
+
+	// All the free space is at the end now.
+	stats = alloc.get_fragmentation_stats();
+	assert(stats.num_allocs == 16);
+	assert(stats.num_free_extents == 1);
+	assert(stats.fragmentation == 0);
+
+	// Compacting a compact buffer moves nothing.
+	assert(!alloc.compact());
+
+	// The moved blocks keep working with the allocator.
+	Handle &handle = table.handles[1];
+	assert(alloc.realloc_in_place(handle.ptr, handle.size, handle.alignment, 8, handle.alignment) == handle.ptr);
+	handle.size = 8;
+	assert(table.check());
+
+	for (size_t i = 1; i < 32; i += 2)
+		table.release(alloc, i);
+	assert(alloc.get_fragmentation_stats().free_size == BUFFER_SIZE);
+}
+
+static void test_compaction_with_pinned_blocks() {
+	peff::BufferAlloc alloc(g_buffer, BUFFER_SIZE);
+	HandleTable table;
+
+	void *slots[8];
+	for (size_t i = 0; i < 8; ++i)
+		slots[i] = table.add(alloc, 2000, 64).ptr;
+	table.release(alloc, 0);
+	table.release(alloc, 2);
+	table.release(alloc, 5);
+
+	// The block refused by the callback stays, the following blocks slide up to it.
+	table.handles[3].pinned = true;
+
+	alloc.set_relocation_callback(relocate_handle, &table);
+	assert(alloc.compact() == 3);
+	assert(table.check());
+	assert(table.handles[1].ptr == slots[0]);
+	assert(table.handles[3].ptr == slots[3]);
+	assert(table.handles[4].ptr == slots[4]);
+	assert(table.handles[6].ptr == slots[5]);
+	assert(table.handles[7].ptr == slots[6]);
+
+	// The gap before the pinned block is the only hole left.
+	const peff::BufferAlloc::FragmentationStats stats = alloc.get_fragmentation_stats();
+	assert(stats.num_free_extents == 2);
+	assert(stats.fragmentation > 0);
+
+	table.handles[3].pinned = false;
+	assert(alloc.compact() == 4);
+	assert(table.check());
+	assert(table.handles[7].ptr == slots[4]);
+	assert(alloc.get_fragmentation_stats().num_free_extents == 1);
+
+	for (size_t i : { 1, 3, 4, 6, 7 })
+		table.release(alloc, i);
+}
+
+static void test_compact_on_alloc_failure() {
+	peff::BufferAlloc alloc(g_buffer, BUFFER_SIZE);
+	HandleTable table;
+
+	// Fill the buffer with blocks and release every other one, no gap is larger than a block.
+	constexpr size_t BLOCK_SIZE = 2000;
+	while ((table.num_handles < 64) && (alloc.get_fragmentation_stats().largest_free_extent_size >= BLOCK_SIZE + DESC_SIZE + 16))
+		table.add(alloc, BLOCK_SIZE, 16);
+	for (size_t i = 0; i < table.num_handles; i += 2)
+		table.release(alloc, i);
+
+	const size_t big_size = BUFFER_SIZE / 3;
+	assert(alloc.get_fragmentation_stats().free_size > big_size + DESC_SIZE);
+	assert(!alloc.alloc(big_size, 16));
+
+	// The flag takes effect only with a relocation callback.
+	alloc.compact_on_alloc_failure = true;
+	assert(!alloc.alloc(big_size, 16));
+
+	alloc.set_relocation_callback(relocate_handle, &table);
+
+	// realloc() must not compact, the block being reallocated would move under it.
+	Handle &handle = table.handles[1];
+	assert(!alloc.realloc(handle.ptr, handle.size, handle.alignment, big_size, 16));
+	assert(!table.num_relocated);
+
+	void *big = alloc.alloc(big_size, 16);
+	assert(big);
+	assert(table.num_relocated);
+	assert(table.check());
+	fill_block(big, big_size, 11);
+	assert(table.check());
+	alloc.release(big, big_size, 16);
+
+	for (size_t i = 1; i < table.num_handles; i += 2)
+		table.release(alloc, i);
+}
+
+static bool relocate_array(void *user_data, void *old_ptr, void *new_ptr, size_t size) noexcept {
+	peff::DynArray<uint32_t> *arr = (peff::DynArray<uint32_t> *)user_data;
+	assert(arr->data() == old_ptr);
+
+	arr->on_data_relocated(new_ptr);
+	return true;
+}
+
+static void test_compaction_with_dynarray() {
+	peff::BufferAlloc alloc(g_buffer, BUFFER_SIZE);
+
+	void *gap = alloc.alloc(4000, 0);
+	{
+		peff::DynArray<uint32_t> arr(&alloc);
+		for (uint32_t i = 0; i < 500; ++i) {
+			bool result = arr.push_back(+i);
+			assert(result);
+		}
+		alloc.release(gap, 4000, 0);
+
+		alloc.set_relocation_callback(relocate_array, &arr);
+		assert(alloc.compact() == 1);
+		assert(arr.data() == (uint32_t *)g_buffer);
+
+		for (uint32_t i = 0; i < 500; ++i)
+			assert(arr.at(i) == i);
+
+		// The array keeps growing and releasing its moved data.
+		for (uint32_t i = 500; i < 1000; ++i) {
+			bool result = arr.push_back(+i);
+			assert(result);
+		}
+		for (uint32_t i = 0; i < 1000; ++i)
+			assert(arr.at(i) == i);
+	}
+	assert(!alloc.get_fragmentation_stats().num_allocs);
+}
+
+void test_buffer_alloc() {
+	test_alloc_and_realloc();
+	test_size_index();
+	test_aligned_candidates();
+	test_trim_and_exhaustion();
+	test_compaction();
+	test_compaction_with_pinned_blocks();
+	test_compact_on_alloc_failure();
+	test_compaction_with_dynarray();
+	puts("BufferAlloc: passed");
+}
@@ -0,0 +1,26 @@
+#include "alloctest.h"
+
+// Exercises the allocators in peff/advutils: the allocations with various
+// sizes and alignments, the reallocations, the batch APIs, trimming and the
+// behavior when the upstream allocator runs out of memory.
+
+int main() {
+#ifdef _MSC_VER
+	_CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
+#endif
+
+	test_slab_alloc();
+	test_arena_alloc();
+	test_buffer_alloc();
+	test_paged_buffer_alloc();
+	test_thread_caching_alloc();
+	test_mmap_alloc();
+	test_tiered_alloc();
+	test_scratch_alloc();
+	test_mapped_file_alloc();
+	test_sampling_profiler_alloc();
+	test_tracking_alloc();
+
+	puts("All allocator tests passed");
+	return 0;
+}
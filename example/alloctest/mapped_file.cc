@@ -0,0 +1,194 @@
+#include "alloctest.h"
+
+#if defined(_WIN32)
+void test_mapped_file_alloc() {
+	puts("MappedFileAlloc: skipped, not available on Windows");
+}
+#else
+	#include <peff/advutils/mapped_file_alloc.h>
+	#include <peff/containers/dynarray.h>
+	#include <filesystem>
+	#include <sys/mman.h>
+
+using MappedFileAlloc = peff::MappedFileAlloc;
+
+constexpr static size_t MAX_FILE_SIZE = 64 * 1024 * 1024;
+constexpr static size_t NUM_SMALL_BLOCKS = 1000, LARGE_BLOCK_SIZE = 3 * 1024 * 1024;
+
+/// @brief Root object of the test file, which is found again after reopening.
+struct Root {
+	void *small_blocks[NUM_SMALL_BLOCKS];
+	char *large_block;
+	peff::DynArray<uint32_t> numbers;
+
+	Root(MappedFileAlloc *alloc) : numbers(alloc) {}
+};
+
+/// @brief Find an address at which the file can be mapped, it is free once the probing mapping is gone.
+static void *find_free_address_range(size_t size) {
+	void *ptr = mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	assert(ptr != MAP_FAILED);
+	munmap(ptr, size);
+	return ptr;
+}
+
+static void fill_file(MappedFileAlloc *alloc) {
+	Root *root = (Root *)alloc->alloc(sizeof(Root), alignof(Root));
+	assert(root);
+	peff::construct_at<Root>(root, alloc);
+	alloc->set_root(root);
+
+	for (size_t i = 0; i < NUM_SMALL_BLOCKS; ++i) {
+		const size_t size = 1 + i % 300;
+		root->small_blocks[i] = alloc->alloc(size, i % 2 ? 8 : 0);
+		assert(root->small_blocks[i]);
+		fill_block(root->small_blocks[i], size, (uint8_t)i);
+	}
+
+	// The file grows beyond the initial size.
+	root->large_block = (char *)alloc->alloc(LARGE_BLOCK_SIZE, 0);
+	assert(root->large_block);
+	assert(is_aligned(root->large_block, MappedFileAlloc::PAGE_SIZE));
+	fill_block(root->large_block, LARGE_BLOCK_SIZE, 1);
+
+	for (uint32_t i = 0; i < 10000; ++i) {
+		bool result = root->numbers.push_back(+i);
+		assert(result);
+	}
+}
+
+static void check_file(MappedFileAlloc *alloc) {
+	const Root *root = (const Root *)alloc->root();
+	assert(root);
+
+	for (size_t i = 0; i < NUM_SMALL_BLOCKS; ++i)
+		assert(check_block(root->small_blocks[i], 1 + i % 300, (uint8_t)i));
+	assert(check_block(root->large_block, LARGE_BLOCK_SIZE, 1));
+
+	assert(root->numbers.size() == 10000);
+	for (uint32_t i = 0; i < 10000; ++i)
+		assert(root->numbers.at(i) == i);
+}
+
+static void test_reopen(const char *path) {
+	void *const base = find_free_address_range(MAX_FILE_SIZE);
+
+	MappedFileAlloc *alloc = MappedFileAlloc::open(path, MAX_FILE_SIZE, base);
+	assert(alloc);
+	assert(alloc->header->base == base);
+	assert((void *)alloc == (char *)base + MappedFileAlloc::get_alloc_offset());
+	assert(!alloc->root());
+
+	fill_file(alloc);
+	check_file(alloc);
+	assert(alloc->sync());
+	alloc->close();
+
+	// The file is mapped at the base it was created at, the arguments only apply to new files.
+	alloc = MappedFileAlloc::open(path, MAX_FILE_SIZE * 2, nullptr);
+	assert(alloc);
+	assert(alloc->header->base == base);
+	assert(alloc->header->max_size == MAX_FILE_SIZE);
+	check_file(alloc);
+
+	// The containers in the file keep working with the reopened allocator.
+	Root *root = (Root *)alloc->root();
+	for (uint32_t i = 10000; i < 20000; ++i) {
+		bool result = root->numbers.push_back(+i);
+		assert(result);
+	}
+	for (uint32_t i = 0; i < 20000; ++i)
+		assert(root->numbers.at(i) == i);
+	bool result = root->numbers.resize(10000);
+	assert(result);
+	alloc->close();
+
+	// The file cannot be opened while its base is occupied.
+	void *occupied = mmap(base, 4096, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+	assert(occupied == base);
+	assert(!MappedFileAlloc::open(path, MAX_FILE_SIZE, nullptr));
+	munmap(occupied, 4096);
+
+	alloc = MappedFileAlloc::open(path, MAX_FILE_SIZE, nullptr);
+	assert(alloc && (alloc->header->base == base));
+	check_file(alloc);
+	alloc->close();
+}
+
+static void test_alloc_realloc_and_trim(const char *path) {
+	MappedFileAlloc *alloc = MappedFileAlloc::open(path, MAX_FILE_SIZE);
+	assert(alloc);
+
+	const size_t sizes[] = { 0, 1, 16, 100, peff::SIZE_CLASS_MAX_SIZE, peff::SIZE_CLASS_MAX_SIZE + 1, 100000 };
+	const size_t alignments[] = { 0, 1, 8, 64, MappedFileAlloc::PAGE_SIZE };
+
+	test_sizes_and_alignments(alloc, sizes, alignments);
+
+	// Alignments beyond a page are not supported.
+	assert(!alloc->alloc(100000, MappedFileAlloc::PAGE_SIZE * 2));
+
+	// Within a size class, and the run at the end of the allocated space.
+	char *ptr = (char *)alloc->alloc(36, 0);
+	fill_block(ptr, 36, 2);
+	assert(alloc->realloc_in_place(ptr, 36, 0, 40, 0) == ptr);
+	ptr = (char *)alloc->realloc(ptr, 40, 0, 10000, 0);
+	assert(ptr && check_block(ptr, 36, 2));
+	assert(alloc->realloc_in_place(ptr, 10000, 0, 100000, 0) == ptr);
+	assert(alloc->realloc_in_place(ptr, 100000, 0, 5000, 0) == ptr);
+	assert(check_block(ptr, 36, 2));
+
+	// Runs which are not at the end are moved.
+	char *next = (char *)alloc->alloc(10000, 0);
+	assert(!alloc->realloc_in_place(ptr, 5000, 0, 100000, 0));
+	ptr = (char *)alloc->realloc(ptr, 5000, 0, 100000, 0);
+	assert(ptr && check_block(ptr, 36, 2));
+	alloc->release(next, 10000, 0);
+
+	// The batch APIs allocate one by one.
+	void *blocks[64];
+	assert(alloc->alloc_batch(64, 5000, 0, blocks) == 64);
+	for (size_t i = 0; i < 64; ++i)
+		fill_block(blocks[i], 5000, (uint8_t)i);
+	for (size_t i = 0; i < 64; ++i)
+		assert(check_block(blocks[i], 5000, (uint8_t)i));
+	alloc->release_batch(blocks, 64, 5000, 0);
+
+	// Growing the file, trimming shrinks it back while the live data is kept.
+	char *large = (char *)alloc->alloc(LARGE_BLOCK_SIZE, 0);
+	assert(large);
+	const size_t grown_file_size = alloc->header->file_size;
+	alloc->release(large, LARGE_BLOCK_SIZE, 0);
+	assert(alloc->trim(0));
+	assert(alloc->header->file_size < grown_file_size);
+	assert(std::filesystem::file_size(path) == alloc->header->file_size);
+	assert(check_block(ptr, 36, 2));
+
+	// The file grows again after trimming.
+	large = (char *)alloc->alloc(LARGE_BLOCK_SIZE, 0);
+	assert(large);
+	fill_block(large, LARGE_BLOCK_SIZE, 3);
+	assert(check_block(large, LARGE_BLOCK_SIZE, 3));
+	alloc->release(large, LARGE_BLOCK_SIZE, 0);
+
+	// Exhaustion of the reserved range.
+	assert(!alloc->alloc(MAX_FILE_SIZE, 0));
+	assert(!alloc->realloc(ptr, 100000, 0, MAX_FILE_SIZE, 0));
+	assert(check_block(ptr, 36, 2));
+	alloc->release(ptr, 100000, 0);
+
+	alloc->close();
+}
+
+void test_mapped_file_alloc() {
+	const std::filesystem::path path = std::filesystem::temp_directory_path() / "peff_alloctest_mapped_file";
+
+	std::filesystem::remove(path);
+	test_reopen(path.string().c_str());
+
+	std::filesystem::remove(path);
+	test_alloc_realloc_and_trim(path.string().c_str());
+
+	std::filesystem::remove(path);
+	puts("MappedFileAlloc: passed");
+}
+#endif
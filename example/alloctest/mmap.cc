@@ -0,0 +1,156 @@
+#include "alloctest.h"
+#include <peff/advutils/mmap_alloc.h>
+
+using MmapAlloc = peff::MmapAlloc;
+
+constexpr static size_t THRESHOLD = 64 * 1024;
+
+static void test_alloc_and_alignment() {
+	LimitedAlloc upstream;
+	MmapAlloc alloc(&upstream, THRESHOLD);
+
+	// Smaller requests are forwarded to the upstream allocator.
+	void *small_ptr = alloc.alloc(THRESHOLD - 1, 16);
+	assert(small_ptr && is_aligned(small_ptr, 16));
+	assert(upstream.num_live_blocks == 1);
+	alloc.release(small_ptr, THRESHOLD - 1, 16);
+	assert(!upstream.num_live_blocks);
+
+	// The threshold is raised to at least a page.
+	assert(MmapAlloc(&upstream, 1).threshold == MmapAlloc::get_page_size());
+
+	const size_t alignments[] = { 0, 1, 64, MmapAlloc::get_page_size(), 65536, 1024 * 1024 };
+	for (size_t alignment : alignments) {
+		const size_t size = THRESHOLD + 123;
+
+		void *ptr = alloc.alloc(size, alignment);
+		assert(ptr);
+		assert(is_aligned(ptr, alignment));
+		assert(is_aligned(ptr, MmapAlloc::get_page_size()));
+		fill_block(ptr, size, (uint8_t)alignment);
+		assert(check_block(ptr, size, (uint8_t)alignment));
+		alloc.release(ptr, size, alignment);
+	}
+	assert(!upstream.num_live_blocks);
+
+	MmapAlloc huge_page_alloc(&upstream, THRESHOLD, true);
+	void *ptr = huge_page_alloc.alloc(MmapAlloc::HUGE_PAGE_SIZE * 2, MmapAlloc::HUGE_PAGE_SIZE);
+	assert(ptr && is_aligned(ptr, MmapAlloc::HUGE_PAGE_SIZE));
+	fill_block(ptr, MmapAlloc::HUGE_PAGE_SIZE * 2, 3);
+	assert(check_block(ptr, MmapAlloc::HUGE_PAGE_SIZE * 2, 3));
+	huge_page_alloc.release(ptr, MmapAlloc::HUGE_PAGE_SIZE * 2, MmapAlloc::HUGE_PAGE_SIZE);
+}
+
+static void test_realloc() {
+	LimitedAlloc upstream;
+	MmapAlloc alloc(&upstream, THRESHOLD);
+	const size_t page_size = MmapAlloc::get_page_size();
+
+	char *ptr = (char *)alloc.alloc(THRESHOLD + 1, 0);
+	assert(ptr);
+	fill_block(ptr, THRESHOLD + 1, 1);
+
+	// Sizes within the same pages never move the mapping.
+	const size_t mapping_size = MmapAlloc::calc_mapping_size(THRESHOLD + 1);
+	assert(alloc.realloc_in_place(ptr, THRESHOLD + 1, 0, mapping_size, 0) == ptr);
+
+	// Shrinking unmaps the tail pages in place.
+	assert(alloc.realloc_in_place(ptr, mapping_size, 0, mapping_size - page_size, 0) == ptr);
+	assert(check_block(ptr, mapping_size - page_size, 1));
+
+	// Growing in place only succeeds if the address space after the mapping is free, and needs mremap().
+#if defined(__linux__)
+	assert(alloc.get_caps().supports_realloc_in_place);
+#else
+	assert(alloc.get_caps().supports_realloc_in_place == upstream.get_caps().supports_realloc_in_place);
+#endif
+	if (!alloc.realloc_in_place(ptr, mapping_size - page_size, 0, THRESHOLD * 2, 0)) {
+		ptr = (char *)alloc.realloc(ptr, mapping_size - page_size, 0, THRESHOLD * 2, 0);
+		assert(ptr);
+	}
+	assert(check_block(ptr, THRESHOLD, 1));
+	fill_block(ptr, THRESHOLD * 2, 1);
+
+	// A mapping which is not aligned enough is moved.
+	assert(!alloc.realloc_in_place(ptr, THRESHOLD * 2, 0, THRESHOLD * 2, (size_t)1 << 40));
+	ptr = (char *)alloc.realloc(ptr, THRESHOLD * 2, 0, THRESHOLD * 64, 1024 * 1024);
+	assert(ptr && is_aligned(ptr, 1024 * 1024));
+	assert(check_block(ptr, THRESHOLD * 2, 1));
+	fill_block(ptr, THRESHOLD * 64, 2);
+
+	// Growing a large mapping moves the pages instead of copying them where supported.
+	ptr = (char *)alloc.realloc(ptr, THRESHOLD * 64, 1024 * 1024, THRESHOLD * 256, 0);
+	assert(ptr && check_block(ptr, THRESHOLD * 64, 2));
+
+	// Crossing the threshold cannot be done in place.
+	assert(!alloc.realloc_in_place(ptr, THRESHOLD * 256, 0, 100, 0));
+	ptr = (char *)alloc.realloc(ptr, THRESHOLD * 256, 0, 100, 0);
+	assert(ptr && check_block(ptr, 100, 2));
+	assert(upstream.num_live_blocks == 1);
+
+	// Small blocks are reallocated by the upstream allocator.
+	ptr = (char *)alloc.realloc(ptr, 100, 0, 1000, 0);
+	assert(ptr && check_block(ptr, 100, 2));
+	assert(upstream.num_live_blocks == 1);
+
+	assert(!alloc.realloc_in_place(ptr, 1000, 0, THRESHOLD, 0));
+	ptr = (char *)alloc.realloc(ptr, 1000, 0, THRESHOLD, 0);
+	assert(ptr && check_block(ptr, 100, 2));
+	assert(!upstream.num_live_blocks);
+
+	alloc.release(ptr, THRESHOLD, 0);
+}
+
+static void test_batch_and_trim() {
+	LimitedAlloc upstream;
+	MmapAlloc alloc(&upstream, THRESHOLD);
+
+	void *blocks[16];
+	assert(alloc.alloc_batch(16, THRESHOLD, 65536, blocks) == 16);
+	for (size_t i = 0; i < 16; ++i) {
+		assert(is_aligned(blocks[i], 65536));
+		fill_block(blocks[i], THRESHOLD, (uint8_t)i);
+	}
+	for (size_t i = 0; i < 16; ++i)
+		assert(check_block(blocks[i], THRESHOLD, (uint8_t)i));
+	alloc.release_batch(blocks, 16, THRESHOLD, 65536);
+
+	assert(alloc.alloc_batch(16, 64, 0, blocks) == 16);
+	assert(upstream.num_live_blocks == 16);
+
+	// Nothing is retained by the allocator itself.
+	assert(!alloc.trim(0));
+	assert(upstream.num_live_blocks == 16);
+
+	alloc.release_batch(blocks, 16, 64, 0);
+	assert(!upstream.num_live_blocks);
+}
+
+static void test_exhaustion() {
+	LimitedAlloc upstream(1024);
+	MmapAlloc alloc(&upstream, THRESHOLD);
+
+	assert(!alloc.alloc(2048, 0));
+	assert(!alloc.alloc(SIZE_MAX / 2, 0));
+
+	// The sizes would overflow when rounded up to whole pages.
+	assert(!alloc.alloc(SIZE_MAX, 0));
+	assert(!alloc.alloc(SIZE_MAX - 100, 65536));
+
+	char *ptr = (char *)alloc.alloc(THRESHOLD, 0);
+	assert(ptr);
+	fill_block(ptr, THRESHOLD, 4);
+	assert(!alloc.realloc_in_place(ptr, THRESHOLD, 0, SIZE_MAX, 0));
+	assert(!alloc.realloc(ptr, THRESHOLD, 0, SIZE_MAX, 0));
+	assert(!alloc.realloc(ptr, THRESHOLD, 0, SIZE_MAX / 2, 0));
+	assert(check_block(ptr, THRESHOLD, 4));
+	alloc.release(ptr, THRESHOLD, 0);
+}
+
+void test_mmap_alloc() {
+	test_alloc_and_alignment();
+	test_realloc();
+	test_batch_and_trim();
+	test_exhaustion();
+	puts("MmapAlloc: passed");
+}
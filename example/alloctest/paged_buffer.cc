@@ -0,0 +1,186 @@
+#include "alloctest.h"
+#include <peff/advutils/paged_buffer_alloc.h>
+
+using PagedBufferAlloc = peff::PagedBufferAlloc;
+
+constexpr static size_t NUM_PAGES = 256;
+constexpr static size_t PAGE_SIZE = PagedBufferAlloc::PAGE_SIZE;
+// One more page for the tests with an unaligned buffer.
+alignas(65536) static char g_buffer[(NUM_PAGES + 1) * PAGE_SIZE];
+
+static void test_alloc_and_alignment() {
+	LimitedAlloc metadata_alloc;
+
+	{
+		// The buffer is not page-aligned, the pages start from the next page boundary.
+		PagedBufferAlloc alloc(g_buffer + 100, sizeof(g_buffer) - 100, &metadata_alloc);
+
+		// The metadata is allocated lazily.
+		assert(!metadata_alloc.num_live_blocks);
+
+		const size_t sizes[] = { 0, 1, 16, 17, 500, peff::SIZE_CLASS_MAX_SIZE, peff::SIZE_CLASS_MAX_SIZE + 1, PAGE_SIZE, 3 * PAGE_SIZE + 1 };
+		const size_t alignments[] = { 0, 1, 16, 64, 1024, PAGE_SIZE, 8 * PAGE_SIZE };
+
+		test_sizes_and_alignments(&alloc, sizes, alignments, [&alloc](void *ptr, size_t size, size_t alignment) {
+			assert((char *)ptr >= g_buffer + PAGE_SIZE);
+
+			// The pagemap tells which span the pointer is in.
+			PagedBufferAlloc::Span *span = alloc.get_span(ptr);
+			if (peff::size_to_size_class(size, alignment) != peff::INVALID_SIZE_CLASS) {
+				assert(span->state == PagedBufferAlloc::SpanState::Small);
+				assert(span->size_class == peff::size_to_size_class(size, alignment));
+			} else {
+				assert(span->state == PagedBufferAlloc::SpanState::Large);
+				assert(alloc.get_page_ptr(span->first_page) == ptr);
+			}
+		});
+
+		assert(is_aligned(alloc.pages_base, PAGE_SIZE));
+		assert(alloc.num_pages == NUM_PAGES);
+
+		// All pages have been coalesced back into a single span.
+		void *whole = alloc.alloc(NUM_PAGES * PAGE_SIZE, 0);
+		assert(whole);
+		alloc.release(whole, NUM_PAGES * PAGE_SIZE, 0);
+	}
+
+	assert(!metadata_alloc.num_live_blocks);
+}
+
+static void test_realloc() {
+	LimitedAlloc metadata_alloc;
+	PagedBufferAlloc alloc(g_buffer, NUM_PAGES * PAGE_SIZE, &metadata_alloc);
+
+	// Sizes in the same size class share the slot.
+	char *ptr = (char *)alloc.alloc(100, 0);
+	fill_block(ptr, 100, 1);
+	assert(alloc.realloc_in_place(ptr, 100, 0, 112, 0) == ptr);
+	assert(!alloc.realloc_in_place(ptr, 112, 0, 200, 0));
+
+	// From a size class to whole pages.
+	char *large = (char *)alloc.realloc(ptr, 112, 0, 2 * PAGE_SIZE, 0);
+	assert(large && is_aligned(large, PAGE_SIZE));
+	assert(check_block(large, 100, 1));
+
+	// Large blocks grow into the free pages after them, and shrink by giving the tail pages back.
+	// The page of the small span has been freed, it is the best fit for a single page, not for two.
+	char *next = (char *)alloc.alloc(2 * PAGE_SIZE, 0);
+	assert(next == large + 2 * PAGE_SIZE);
+	assert(!alloc.realloc_in_place(large, 2 * PAGE_SIZE, 0, 3 * PAGE_SIZE, 0));
+	assert(alloc.realloc_in_place(large, 2 * PAGE_SIZE, 0, PAGE_SIZE, 0) == large);
+	assert(alloc.get_span(large)->num_pages == 1);
+	alloc.release(next, 2 * PAGE_SIZE, 0);
+	assert(alloc.realloc_in_place(large, PAGE_SIZE, 0, 10 * PAGE_SIZE, 0) == large);
+	assert(alloc.get_span(large + 9 * PAGE_SIZE) == alloc.get_span(large));
+	assert(check_block(large, 100, 1));
+
+	// A stricter alignment than the pages have needs a move.
+	if (!is_aligned(large, 16 * PAGE_SIZE))
+		assert(!alloc.realloc_in_place(large, 10 * PAGE_SIZE, 0, 10 * PAGE_SIZE, 16 * PAGE_SIZE));
+	char *moved = (char *)alloc.realloc(large, 10 * PAGE_SIZE, 0, 10 * PAGE_SIZE, 16 * PAGE_SIZE);
+	assert(moved && is_aligned(moved, 16 * PAGE_SIZE));
+	assert(check_block(moved, 100, 1));
+
+	// And back into a size class.
+	char *small = (char *)alloc.realloc(moved, 10 * PAGE_SIZE, 16 * PAGE_SIZE, 64, 0);
+	assert(small);
+	assert(alloc.get_span(small)->state == PagedBufferAlloc::SpanState::Small);
+	assert(check_block(small, 64, 1));
+	alloc.release(small, 64, 0);
+}
+
+static void test_batch_and_trim() {
+	LimitedAlloc metadata_alloc;
+	PagedBufferAlloc alloc(g_buffer, NUM_PAGES * PAGE_SIZE, &metadata_alloc);
+
+	constexpr size_t NUM_BLOCKS = 1000;
+	static void *blocks[NUM_BLOCKS];
+
+	assert(alloc.alloc_batch(NUM_BLOCKS, 32, 16, blocks) == NUM_BLOCKS);
+	for (size_t i = 0; i < NUM_BLOCKS; ++i) {
+		assert(is_aligned(blocks[i], 16));
+		fill_block(blocks[i], 32, (uint8_t)i);
+	}
+	for (size_t i = 0; i < NUM_BLOCKS; ++i)
+		assert(check_block(blocks[i], 32, (uint8_t)i));
+	alloc.release_batch(blocks, NUM_BLOCKS, 32, 16);
+
+	// Requests of whole pages are allocated one by one.
+	assert(alloc.alloc_batch(8, 5000, 0, blocks) == 8);
+	alloc.release_batch(blocks, 8, 5000, 0);
+
+	// The metadata is out of the pages, so all free pages can be purged.
+	void *ptr = alloc.alloc(PAGE_SIZE, 0);
+	fill_block(ptr, PAGE_SIZE, 2);
+	const size_t trimmed_size = alloc.trim(0, peff::PurgePolicy::Eager);
+#ifdef __linux__
+	assert(trimmed_size == (NUM_PAGES - 1) * PAGE_SIZE);
+#else
+	(void)trimmed_size;
+#endif
+	assert(check_block(ptr, PAGE_SIZE, 2));
+	assert(!alloc.trim(NUM_PAGES * PAGE_SIZE));
+	alloc.release(ptr, PAGE_SIZE, 0);
+}
+
+static void test_exhaustion() {
+	{
+		LimitedAlloc metadata_alloc;
+		PagedBufferAlloc alloc(g_buffer, NUM_PAGES * PAGE_SIZE, &metadata_alloc);
+
+		static void *blocks[NUM_PAGES];
+		size_t n = 0;
+		while ((n < NUM_PAGES) && (blocks[n] = alloc.alloc(2 * PAGE_SIZE, 0)))
+			++n;
+		assert(n == NUM_PAGES / 2);
+		assert(!alloc.alloc(1, 0));
+		assert(!alloc.alloc_batch(4, 16, 0, blocks + n));
+
+		for (size_t i = 0; i < n; ++i)
+			alloc.release(blocks[i], 2 * PAGE_SIZE, 0);
+
+		// The small spans take the pages one by one until there is none.
+		static void *slots[NUM_PAGES * PAGE_SIZE / 64];
+		const size_t num_slots = alloc.alloc_batch(std::size(slots), 64, 0, slots);
+		assert(num_slots == std::size(slots));
+		assert(!alloc.alloc(64, 0));
+		alloc.release_batch(slots, num_slots, 64, 0);
+	}
+
+	{
+		// Without the span descriptors, the free spans are handed out without splitting.
+		LimitedAlloc metadata_alloc(sizeof(PagedBufferAlloc::Span *) * NUM_PAGES + sizeof(PagedBufferAlloc::SpanChunk));
+		PagedBufferAlloc alloc(g_buffer, NUM_PAGES * PAGE_SIZE, &metadata_alloc);
+
+		static void *blocks[NUM_PAGES];
+		size_t n = 0;
+		while ((n < NUM_PAGES) && (blocks[n] = alloc.alloc(PAGE_SIZE, 0)))
+			++n;
+		assert(n < NUM_PAGES);
+		assert(n >= PagedBufferAlloc::SPANS_PER_CHUNK - 1);
+
+		for (size_t i = 0; i < n; ++i)
+			alloc.release(blocks[i], PAGE_SIZE, 0);
+
+		void *whole = alloc.alloc(NUM_PAGES * PAGE_SIZE, 0);
+		assert(whole);
+		alloc.release(whole, NUM_PAGES * PAGE_SIZE, 0);
+	}
+
+	{
+		// Nothing can be allocated without the pagemap.
+		LimitedAlloc metadata_alloc(0);
+		PagedBufferAlloc alloc(g_buffer, NUM_PAGES * PAGE_SIZE, &metadata_alloc);
+		assert(!alloc.alloc(16, 0));
+		void *blocks[4];
+		assert(!alloc.alloc_batch(4, 16, 0, blocks));
+	}
+}
+
+void test_paged_buffer_alloc() {
+	test_alloc_and_alignment();
+	test_realloc();
+	test_batch_and_trim();
+	test_exhaustion();
+	puts("PagedBufferAlloc: passed");
+}
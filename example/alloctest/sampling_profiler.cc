@@ -0,0 +1,74 @@
+#include "alloctest.h"
+#include <peff/advutils/sampling_profiler_alloc.h>
+#include <peff/advutils/arena_alloc.h>
+
+using SamplingProfilerAlloc = peff::SamplingProfilerAlloc;
+
+constexpr static size_t SAMPLE_INTERVAL = 4096;
+constexpr static size_t NUM_BLOCKS = 16, GROWN_SIZE = 1024 * 1024;
+
+static size_t count_samples(SamplingProfilerAlloc &alloc, void *const *blocks, size_t num_blocks) {
+	std::lock_guard<std::mutex> samples_guard(alloc.samples_lock);
+
+	size_t n = 0;
+	for (size_t i = 0; i < num_blocks; ++i)
+		n += alloc.samples.contains((uintptr_t)blocks[i]);
+	return n;
+}
+
+static void test_growing_realloc() {
+	LimitedAlloc upstream;
+	SamplingProfilerAlloc alloc(&upstream, SAMPLE_INTERVAL);
+
+	// A 1-byte block is almost never sampled, but growing it by many intervals almost always samples it.
+	void *blocks[NUM_BLOCKS];
+	for (auto &i : blocks) {
+		i = alloc.alloc(1, 0);
+		assert(i);
+	}
+	for (auto &i : blocks) {
+		i = alloc.realloc(i, 1, 0, GROWN_SIZE, 0);
+		assert(i);
+		fill_block(i, GROWN_SIZE, 1);
+	}
+	assert(count_samples(alloc, blocks, NUM_BLOCKS) == NUM_BLOCKS);
+	assert(alloc.estimate_live_size() >= NUM_BLOCKS * GROWN_SIZE);
+
+	// Shrinking keeps the samples.
+	for (auto &i : blocks) {
+		i = alloc.realloc(i, GROWN_SIZE, 0, 100, 0);
+		assert(i && check_block(i, 100, 1));
+	}
+	assert(count_samples(alloc, blocks, NUM_BLOCKS) == NUM_BLOCKS);
+
+	for (auto &i : blocks)
+		alloc.release(i, 100, 0);
+	assert(!count_samples(alloc, blocks, NUM_BLOCKS));
+	assert(!alloc.estimate_live_size());
+	assert(!upstream.num_live_blocks);
+}
+
+static void test_growing_realloc_in_place() {
+	LimitedAlloc upstream;
+	// The most recent block of an arena grows in place.
+	peff::ArenaAlloc arena(&upstream, NUM_BLOCKS * GROWN_SIZE + 4096);
+	SamplingProfilerAlloc alloc(&arena, SAMPLE_INTERVAL);
+
+	void *blocks[NUM_BLOCKS];
+	for (auto &i : blocks) {
+		i = alloc.alloc(1, 0);
+		assert(i);
+		assert(alloc.realloc_in_place(i, 1, 0, GROWN_SIZE, 0) == i);
+	}
+	assert(count_samples(alloc, blocks, NUM_BLOCKS) == NUM_BLOCKS);
+
+	for (auto &i : blocks)
+		alloc.release(i, GROWN_SIZE, 0);
+	assert(!count_samples(alloc, blocks, NUM_BLOCKS));
+}
+
+void test_sampling_profiler_alloc() {
+	test_growing_realloc();
+	test_growing_realloc_in_place();
+	puts("SamplingProfilerAlloc: passed");
+}
@@ -0,0 +1,204 @@
+#include "alloctest.h"
+#include <peff/advutils/scratch_alloc.h>
+#include <thread>
+
+using ScratchAlloc = peff::ScratchAlloc;
+using ScratchScope = peff::ScratchScope;
+
+constexpr static size_t REGION_SIZE = 65536;
+
+static void test_alloc_and_rewind() {
+	LimitedAlloc upstream;
+	ScratchAlloc alloc(&upstream, REGION_SIZE);
+
+	// The region is allocated on the first request.
+	assert(!alloc.region);
+
+	const size_t alignments[] = { 0, 1, 2, 8, 64, 4096 };
+	{
+		ScratchScope scope(&alloc);
+
+		for (size_t alignment : alignments) {
+			void *ptr = alloc.alloc(33, alignment);
+			assert(ptr && alloc.contains(ptr));
+			assert(is_aligned(ptr, alignment));
+			fill_block(ptr, 33, (uint8_t)alignment);
+			assert(check_block(ptr, 33, (uint8_t)alignment));
+		}
+		assert(upstream.num_live_blocks == 1);
+		assert(alloc.get_used_size() > 6 * 33);
+	}
+	assert(!alloc.get_used_size());
+	assert(alloc.get_peak_used_size() > 6 * 33);
+
+	// Releasing the most recent block pops it, the others are kept until rolling back.
+	char *const marker = alloc.mark();
+	void *a = alloc.alloc(100, 8);
+	void *b = alloc.alloc(100, 8);
+	alloc.release(a, 100, 8);
+	assert(alloc.mark() == (char *)b + 100);
+	alloc.release(b, 100, 8);
+	assert(alloc.mark() == (char *)b);
+	alloc.rewind(marker);
+	assert(alloc.mark() == marker);
+
+	// The scopes nest.
+	{
+		ScratchScope outer(&alloc);
+		void *outer_ptr = alloc.alloc(100, 0);
+		{
+			ScratchScope inner(&alloc);
+			alloc.alloc(1000, 0);
+		}
+		assert(alloc.mark() == (char *)outer_ptr + 100);
+	}
+	assert(alloc.mark() == marker);
+
+	// Each thread has its own instance.
+	ScratchAlloc *const thread_local_alloc = ScratchAlloc::get_thread_local();
+	ScratchAlloc *other_thread_local_alloc = nullptr;
+	std::thread([&other_thread_local_alloc]() {
+		ScratchScope scope;
+		void *ptr = scope.allocator->alloc(100, 0);
+		assert(ptr && scope.allocator->contains(ptr));
+		other_thread_local_alloc = ScratchAlloc::get_thread_local();
+	}).join();
+	assert(thread_local_alloc != other_thread_local_alloc);
+}
+
+static void test_realloc() {
+	LimitedAlloc upstream;
+	ScratchAlloc alloc(&upstream, REGION_SIZE);
+	ScratchScope scope(&alloc);
+
+	// The most recent block grows and shrinks in place.
+	char *ptr = (char *)alloc.alloc(100, 16);
+	fill_block(ptr, 100, 1);
+	assert(alloc.realloc_in_place(ptr, 100, 16, 1000, 16) == ptr);
+	assert(alloc.realloc_in_place(ptr, 1000, 16, 50, 16) == ptr);
+	assert(alloc.mark() == ptr + 50);
+	assert(!alloc.realloc_in_place(ptr, 50, 16, REGION_SIZE + 1, 16));
+	if (!is_aligned(ptr, 4096))
+		assert(!alloc.realloc_in_place(ptr, 50, 16, 50, 4096));
+
+	// Other blocks can only shrink in place.
+	char *top = (char *)alloc.alloc(100, 0);
+	assert(alloc.realloc_in_place(ptr, 50, 16, 40, 16) == ptr);
+	assert(!alloc.realloc_in_place(ptr, 40, 16, 60, 16));
+
+	// The block is moved within the region, the old one is not reclaimed.
+	char *moved = (char *)alloc.realloc(ptr, 40, 16, 200, 16);
+	assert(moved && alloc.contains(moved));
+	assert(moved > top);
+	assert(check_block(moved, 40, 1));
+	assert(alloc.mark() == moved + 200);
+
+	// The most recent block which outgrows the region falls back to the upstream allocator and is popped.
+	char *const marker = moved;
+	char *fallback = (char *)alloc.realloc(moved, 200, 16, REGION_SIZE, 16);
+	assert(fallback && !alloc.contains(fallback));
+	assert(check_block(fallback, 40, 1));
+	assert(alloc.num_fallbacks == 1);
+	assert(alloc.mark() == marker);
+
+	// The blocks from the upstream allocator stay there.
+	fallback = (char *)alloc.realloc(fallback, REGION_SIZE, 16, REGION_SIZE * 2, 16);
+	assert(fallback && !alloc.contains(fallback));
+	assert(check_block(fallback, 40, 1));
+	assert(upstream.num_live_blocks == 2);
+	alloc.release(fallback, REGION_SIZE * 2, 16);
+	assert(upstream.num_live_blocks == 1);
+}
+
+static void test_batch_and_trim() {
+	LimitedAlloc upstream;
+	ScratchAlloc alloc(&upstream, REGION_SIZE);
+
+	// The batch spills over to the upstream allocator once the region is full.
+	constexpr size_t NUM_BLOCKS = 80;
+	void *blocks[NUM_BLOCKS];
+	{
+		ScratchScope scope(&alloc);
+
+		assert(alloc.alloc_batch(NUM_BLOCKS, 1000, 8, blocks) == NUM_BLOCKS);
+
+		size_t num_in_region = 0;
+		for (size_t i = 0; i < NUM_BLOCKS; ++i) {
+			assert(is_aligned(blocks[i], 8));
+			num_in_region += alloc.contains(blocks[i]);
+			fill_block(blocks[i], 1000, (uint8_t)i);
+		}
+		assert(num_in_region == REGION_SIZE / 1000);
+		assert(alloc.num_fallbacks == NUM_BLOCKS - num_in_region);
+		for (size_t i = 0; i < NUM_BLOCKS; ++i)
+			assert(check_block(blocks[i], 1000, (uint8_t)i));
+
+		alloc.release_batch(blocks, NUM_BLOCKS, 1000, 8);
+		assert(upstream.num_live_blocks == 1);
+	}
+	assert(!alloc.get_used_size());
+	assert(alloc.get_peak_used_size() == REGION_SIZE / 1000 * 1000);
+
+	// Trimming purges the touched part of the region, the live data is kept.
+	void *ptr = alloc.alloc(100, 0);
+	fill_block(ptr, 100, 2);
+	const size_t trimmed_size = alloc.trim(0, peff::PurgePolicy::Eager);
+#ifdef __linux__
+	assert(trimmed_size >= REGION_SIZE / 2);
+#else
+	(void)trimmed_size;
+#endif
+	assert(check_block(ptr, 100, 2));
+	assert(!alloc.trim(REGION_SIZE));
+	alloc.release(ptr, 100, 0);
+
+	// The region keeps working after the pages are purged.
+	ptr = alloc.alloc(REGION_SIZE, 0);
+	assert(ptr && alloc.contains(ptr));
+	fill_block(ptr, REGION_SIZE, 3);
+	assert(check_block(ptr, REGION_SIZE, 3));
+	alloc.release(ptr, REGION_SIZE, 0);
+}
+
+static void test_exhaustion() {
+	// The region cannot be allocated, every request falls back.
+	{
+		LimitedAlloc upstream(REGION_SIZE - 1);
+		ScratchAlloc alloc(&upstream, REGION_SIZE);
+
+		void *ptr = alloc.alloc(100, 0);
+		assert(ptr && !alloc.region);
+		assert(alloc.num_fallbacks == 1);
+		alloc.release(ptr, 100, 0);
+		assert(!alloc.alloc(REGION_SIZE, 0));
+		assert(!upstream.num_live_blocks);
+	}
+
+	LimitedAlloc upstream(REGION_SIZE + 1000);
+	ScratchAlloc alloc(&upstream, REGION_SIZE);
+	ScratchScope scope(&alloc);
+
+	// The rest of the region is too small, the aligned request falls back.
+	void *ptr = alloc.alloc(REGION_SIZE - 100, 0);
+	assert(ptr && alloc.contains(ptr));
+	void *aligned = alloc.alloc(200, 4096);
+	assert(aligned && !alloc.contains(aligned) && is_aligned(aligned, 4096));
+	alloc.release(aligned, 200, 4096);
+
+	// Neither the region nor the upstream allocator has the space.
+	assert(!alloc.alloc(2000, 0));
+	assert(!alloc.alloc(SIZE_MAX, 0));
+	fill_block(ptr, REGION_SIZE - 100, 4);
+	assert(!alloc.realloc(ptr, REGION_SIZE - 100, 0, REGION_SIZE + 100, 0));
+	assert(check_block(ptr, REGION_SIZE - 100, 4));
+	assert(alloc.mark() == (char *)ptr + REGION_SIZE - 100);
+	alloc.release(ptr, REGION_SIZE - 100, 0);
+}
+
+void test_scratch_alloc() {
+	test_alloc_and_rewind();
+	test_realloc();
+	test_batch_and_trim();
+	test_exhaustion();
+	puts("ScratchAlloc: passed");
+}
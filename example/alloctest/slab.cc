@@ -0,0 +1,130 @@
+#include "alloctest.h"
+#include <peff/advutils/slab_alloc.h>
+
+static void test_alloc_and_alignment() {
+	LimitedAlloc upstream;
+	peff::SlabAlloc alloc(&upstream);
+
+	const size_t sizes[] = { 1, 15, 16, 17, 100, 1000, peff::SIZE_CLASS_MAX_SIZE, peff::SIZE_CLASS_MAX_SIZE + 1, 100000 };
+	const size_t alignments[] = { 0, 1, 8, 16, 64, 256, 4096 };
+
+	test_sizes_and_alignments(&alloc, sizes, alignments);
+
+	// The slots of a size class are reused in the LIFO order.
+	void *ptr = alloc.alloc(48, 0);
+	alloc.release(ptr, 48, 0);
+	assert(alloc.alloc(48, 0) == ptr);
+	alloc.release(ptr, 48, 0);
+}
+
+static void test_realloc() {
+	LimitedAlloc upstream;
+	peff::SlabAlloc alloc(&upstream);
+
+	// Sizes in the same size class share the slot.
+	void *ptr = alloc.alloc(33, 0);
+	assert(ptr);
+	fill_block(ptr, 33, 1);
+	assert(alloc.realloc_in_place(ptr, 33, 0, 40, 0) == ptr);
+	assert(alloc.realloc(ptr, 40, 0, 36, 0) == ptr);
+	assert(check_block(ptr, 33, 1));
+
+	// Growing into another size class moves the block.
+	assert(!alloc.realloc_in_place(ptr, 36, 0, 100, 0));
+	void *p = alloc.realloc(ptr, 36, 0, 100, 0);
+	assert(p);
+	assert(check_block(p, 33, 1));
+
+	// From a size class to the upstream and back.
+	fill_block(p, 100, 2);
+	void *large = alloc.realloc(p, 100, 0, 10000, 0);
+	assert(large);
+	assert(check_block(large, 100, 2));
+	assert(!alloc.realloc_in_place(large, 10000, 0, 100, 0));
+	p = alloc.realloc(large, 10000, 0, 100, 16);
+	assert(p);
+	assert(is_aligned(p, 16));
+	assert(check_block(p, 100, 2));
+
+	// The slots of 48 bytes are only 16-byte aligned, a stricter alignment needs another size class.
+	void *q = alloc.alloc(48, 16);
+	assert(q);
+	assert(!alloc.realloc_in_place(q, 48, 16, 48, 32));
+	alloc.release(q, 48, 16);
+
+	alloc.release(p, 100, 16);
+	alloc.trim(0);
+	assert(!upstream.num_live_blocks);
+}
+
+static void test_batch_and_trim() {
+	LimitedAlloc upstream;
+	peff::SlabAlloc alloc(&upstream);
+
+	constexpr size_t NUM_BLOCKS = 1000;
+	static void *blocks[NUM_BLOCKS];
+
+	assert(alloc.alloc_batch(NUM_BLOCKS, 24, 8, blocks) == NUM_BLOCKS);
+	for (size_t i = 0; i < NUM_BLOCKS; ++i) {
+		assert(is_aligned(blocks[i], 8));
+		fill_block(blocks[i], 24, (uint8_t)i);
+	}
+	for (size_t i = 0; i < NUM_BLOCKS; ++i)
+		assert(check_block(blocks[i], 24, (uint8_t)i));
+
+	alloc.release_batch(blocks, NUM_BLOCKS, 24, 8);
+
+	// Requests larger than the size classes are forwarded as a batch.
+	assert(alloc.alloc_batch(4, 5000, 64, blocks) == 4);
+	for (size_t i = 0; i < 4; ++i)
+		assert(is_aligned(blocks[i], 64));
+	alloc.release_batch(blocks, 4, 5000, 64);
+
+	// One empty slab is retained, trimming gives it back.
+	assert(upstream.num_live_blocks == 1);
+	assert(alloc.trim(0) == peff::SlabAlloc::calc_slab_size(peff::size_to_size_class(24, 8)));
+	assert(!upstream.num_live_blocks);
+	assert(!alloc.trim(0));
+
+	// The retained slabs within keep_bytes are not released.
+	void *ptr = alloc.alloc(24, 8);
+	alloc.release(ptr, 24, 8);
+	assert(!alloc.trim(SIZE_MAX));
+	assert(upstream.num_live_blocks == 1);
+}
+
+static void test_exhaustion() {
+	const size_t slab_size = peff::SlabAlloc::calc_slab_size(peff::size_to_size_class(64, 0));
+	LimitedAlloc upstream(slab_size * 2);
+	peff::SlabAlloc alloc(&upstream);
+
+	constexpr size_t MAX_BLOCKS = 4096;
+	static void *blocks[MAX_BLOCKS];
+
+	size_t n = 0;
+	while ((n < MAX_BLOCKS) && (blocks[n] = alloc.alloc(64, 0)))
+		++n;
+	assert(n < MAX_BLOCKS);
+	assert(n == 2 * ((slab_size - sizeof(peff::SlabAlloc::SlabHeader)) / 64));
+
+	// The batch stops at the same point and returns what it has got.
+	alloc.release_batch(blocks, n, 64, 0);
+	assert(alloc.alloc_batch(MAX_BLOCKS, 64, 0, blocks) == n);
+
+	// Requests of other sizes fail as well, until the memory is given back.
+	assert(!alloc.alloc(256, 0));
+	alloc.release_batch(blocks, n, 64, 0);
+	alloc.trim(0);
+	assert(!upstream.live_size);
+	void *ptr = alloc.alloc(256, 0);
+	assert(ptr);
+	alloc.release(ptr, 256, 0);
+}
+
+void test_slab_alloc() {
+	test_alloc_and_alignment();
+	test_realloc();
+	test_batch_and_trim();
+	test_exhaustion();
+	puts("SlabAlloc: passed");
+}
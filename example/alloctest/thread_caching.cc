@@ -0,0 +1,172 @@
+#include "alloctest.h"
+#include <peff/advutils/thread_caching_alloc.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using ThreadCachingAlloc = peff::ThreadCachingAlloc;
+
+static void test_alloc_and_realloc() {
+	LimitedAlloc upstream;
+	ThreadCachingAlloc alloc(&upstream);
+
+	assert(alloc.get_caps().is_thread_safe);
+
+	const size_t sizes[] = { 0, 1, 16, 100, peff::SIZE_CLASS_MAX_SIZE, peff::SIZE_CLASS_MAX_SIZE + 1, 100000 };
+	// Alignments above MAX_CACHED_ALIGNMENT are forwarded to the upstream allocator.
+	const size_t alignments[] = { 0, 1, 8, ThreadCachingAlloc::MAX_CACHED_ALIGNMENT, 64, 4096 };
+
+	test_sizes_and_alignments(&alloc, sizes, alignments);
+
+	// The freed block is cached and handed out again.
+	void *ptr = alloc.alloc(36, 8);
+	alloc.release(ptr, 36, 8);
+	assert(alloc.alloc(36, 8) == ptr);
+
+	// Within the size class, the block stays in place.
+	fill_block(ptr, 36, 1);
+	assert(alloc.realloc_in_place(ptr, 36, 8, 40, 8) == ptr);
+	assert(!alloc.realloc_in_place(ptr, 40, 8, 100, 8));
+
+	// Across the size classes and to the upstream allocator and back.
+	void *p = alloc.realloc(ptr, 40, 8, 100, 8);
+	assert(p && check_block(p, 36, 1));
+	p = alloc.realloc(p, 100, 8, 10000, 64);
+	assert(p && is_aligned(p, 64) && check_block(p, 36, 1));
+	p = alloc.realloc(p, 10000, 64, 20000, 64);
+	assert(p && check_block(p, 36, 1));
+	p = alloc.realloc(p, 20000, 64, 36, 0);
+	assert(p && check_block(p, 36, 1));
+	alloc.release(p, 36, 0);
+
+	alloc.flush_thread_cache();
+	assert(!upstream.num_live_blocks);
+}
+
+static void test_batch_and_trim() {
+	LimitedAlloc upstream;
+	ThreadCachingAlloc alloc(&upstream);
+
+	constexpr size_t NUM_BLOCKS = 1000;
+	static void *blocks[NUM_BLOCKS];
+
+	// The batch refills the magazine as many times as needed.
+	assert(alloc.alloc_batch(NUM_BLOCKS, 48, 16, blocks) == NUM_BLOCKS);
+	for (size_t i = 0; i < NUM_BLOCKS; ++i) {
+		assert(is_aligned(blocks[i], 16));
+		fill_block(blocks[i], 48, (uint8_t)i);
+	}
+	for (size_t i = 0; i < NUM_BLOCKS; ++i)
+		assert(check_block(blocks[i], 48, (uint8_t)i));
+	alloc.release_batch(blocks, NUM_BLOCKS, 48, 16);
+
+	// Batches which cannot be cached are forwarded.
+	assert(alloc.alloc_batch(4, 5000, 0, blocks) == 4);
+	alloc.release_batch(blocks, 4, 5000, 0);
+
+	// The freed blocks stay in the cache until it is trimmed.
+	assert(upstream.num_live_blocks);
+	assert(!alloc.trim(SIZE_MAX));
+	const size_t live_size = upstream.live_size;
+	assert(alloc.trim(0) == live_size);
+	assert(!upstream.num_live_blocks);
+}
+
+static void test_cache_limit() {
+	constexpr size_t MAX_CACHE_SIZE = 2048;
+	LimitedAlloc upstream;
+	ThreadCachingAlloc alloc(&upstream, MAX_CACHE_SIZE);
+
+	constexpr size_t NUM_BLOCKS = 256;
+	static void *blocks[NUM_BLOCKS];
+	assert(alloc.alloc_batch(NUM_BLOCKS, 64, 0, blocks) == NUM_BLOCKS);
+
+	// Releasing flushes the cache whenever it grows beyond the limit.
+	for (size_t i = 0; i < NUM_BLOCKS; ++i) {
+		alloc.release(blocks[i], 64, 0);
+
+		const size_t num_in_use_blocks = NUM_BLOCKS - i - 1;
+		assert(upstream.live_size - num_in_use_blocks * 64 <= MAX_CACHE_SIZE);
+	}
+
+	alloc.flush_thread_cache();
+	assert(!upstream.num_live_blocks);
+}
+
+static void test_threads() {
+	constexpr size_t NUM_THREADS = 4, NUM_ROUNDS = 20000;
+	LimitedAlloc upstream;
+	ThreadCachingAlloc alloc(&upstream, 16384);
+
+	// Blocks are passed between the threads, so many of them are released by another thread than the allocating one.
+	std::atomic<void *> mailboxes[NUM_THREADS] = {};
+
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < NUM_THREADS; ++i) {
+		threads.emplace_back([&alloc, &mailboxes, i]() {
+			uint32_t seed = (uint32_t)i + 1;
+
+			for (size_t j = 0; j < NUM_ROUNDS; ++j) {
+				seed = seed * 1103515245 + 12345;
+				const size_t size = 16 + (seed >> 16) % 200;
+
+				char *ptr = (char *)alloc.alloc(size, 0);
+				assert(ptr);
+				// The size is stored at the beginning so the receiver can release the block.
+				memcpy(ptr, &size, sizeof(size));
+				fill_block(ptr + sizeof(size), size - sizeof(size), (uint8_t)size);
+
+				if (char *received = (char *)mailboxes[(i + 1) % NUM_THREADS].exchange(ptr); received) {
+					size_t received_size;
+					memcpy(&received_size, received, sizeof(received_size));
+					assert(check_block(received + sizeof(received_size), received_size - sizeof(received_size), (uint8_t)received_size));
+					alloc.release(received, received_size, 0);
+				}
+			}
+		});
+	}
+	for (auto &i : threads)
+		i.join();
+
+	for (auto &i : mailboxes) {
+		if (char *ptr = (char *)i.load(); ptr) {
+			size_t size;
+			memcpy(&size, ptr, sizeof(size));
+			alloc.release(ptr, size, 0);
+		}
+	}
+
+	// The caches of the exited threads have been flushed.
+	alloc.flush_thread_cache();
+	assert(!upstream.num_live_blocks);
+}
+
+static void test_exhaustion() {
+	LimitedAlloc upstream(4096);
+	ThreadCachingAlloc alloc(&upstream);
+
+	static void *blocks[4096 / 64 + 1];
+	size_t n = 0;
+	while ((blocks[n] = alloc.alloc(64, 0)))
+		++n;
+	assert(n == 4096 / 64);
+	assert(!alloc.alloc(100000, 0));
+	assert(!alloc.alloc_batch(4, 16, 0, blocks + n));
+
+	// Once the blocks are back, they are reused from the cache without the upstream allocator.
+	alloc.release_batch(blocks, n, 64, 0);
+	assert(alloc.alloc_batch(n, 64, 0, blocks) == n);
+	alloc.release_batch(blocks, n, 64, 0);
+
+	alloc.flush_thread_cache();
+	assert(!upstream.live_size);
+}
+
+void test_thread_caching_alloc() {
+	test_alloc_and_realloc();
+	test_batch_and_trim();
+	test_cache_limit();
+	test_threads();
+	test_exhaustion();
+	puts("ThreadCachingAlloc: passed");
+}
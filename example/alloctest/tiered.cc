@@ -0,0 +1,239 @@
+#include "alloctest.h"
+#include <peff/advutils/tiered_alloc.h>
+#include <peff/advutils/buffer_alloc.h>
+
+constexpr static size_t BUFFER_SIZE = 16384;
+alignas(4096) static char g_buffer[BUFFER_SIZE];
+
+constexpr static size_t BUFFER_TIER_MAX_SIZE = 1024, BUFFER_TIER_MAX_ALIGNMENT = 256;
+constexpr static size_t SMALL_TIER_MAX_SIZE = 4096, SMALL_TIER_MAX_ALIGNMENT = 64;
+
+enum : size_t {
+	BUFFER_TIER = 0,
+	SMALL_TIER,
+	LARGE_TIER
+};
+
+/// @brief A fixed buffer for the small requests which falls back to the small tier, and a large tier for the rest.
+struct TierChain {
+	peff::BufferAlloc buffer_alloc;
+	LimitedAlloc small_alloc;
+	LimitedAlloc large_alloc;
+	peff::TieredAlloc alloc;
+
+	TierChain(size_t small_budget = SIZE_MAX) : buffer_alloc(g_buffer, BUFFER_SIZE), small_alloc(small_budget) {
+		bool result = alloc.add_tier(&buffer_alloc, 0, BUFFER_TIER_MAX_SIZE, BUFFER_TIER_MAX_ALIGNMENT, g_buffer, BUFFER_SIZE);
+		assert(result);
+		result = alloc.add_tier(&small_alloc, 0, SMALL_TIER_MAX_SIZE, SMALL_TIER_MAX_ALIGNMENT);
+		assert(result);
+		result = alloc.add_tier(&large_alloc);
+		assert(result);
+	}
+};
+
+static bool is_in_buffer(const void *ptr) {
+	return (ptr >= g_buffer) && (ptr < g_buffer + BUFFER_SIZE);
+}
+
+static void test_routing() {
+	TierChain chain;
+	peff::TieredAlloc &alloc = chain.alloc;
+
+	struct Request {
+		size_t size, alignment, tier;
+	};
+	const Request requests[] = {
+		{ 0, 0, BUFFER_TIER },
+		{ 100, 8, BUFFER_TIER },
+		{ BUFFER_TIER_MAX_SIZE, BUFFER_TIER_MAX_ALIGNMENT, BUFFER_TIER },
+		{ BUFFER_TIER_MAX_SIZE + 1, 0, SMALL_TIER },
+		{ 16, 512, LARGE_TIER },
+		{ SMALL_TIER_MAX_SIZE, SMALL_TIER_MAX_ALIGNMENT, SMALL_TIER },
+		{ SMALL_TIER_MAX_SIZE + 1, 0, LARGE_TIER },
+		{ 100000, 4096, LARGE_TIER }
+	};
+
+	for (const Request &i : requests) {
+		void *ptr = alloc.alloc(i.size, i.alignment);
+		assert(ptr && is_aligned(ptr, i.alignment));
+		assert(is_in_buffer(ptr) == (i.tier == BUFFER_TIER));
+		assert(alloc.find_owner(ptr, i.size, i.alignment) == i.tier);
+		fill_block(ptr, i.size, (uint8_t)i.tier);
+		assert(check_block(ptr, i.size, (uint8_t)i.tier));
+		alloc.release(ptr, i.size, i.alignment);
+	}
+	assert(!chain.small_alloc.num_live_blocks && !chain.large_alloc.num_live_blocks);
+
+	// The ranged tier passes the requests on when the buffer is full.
+	void *blocks[BUFFER_SIZE / BUFFER_TIER_MAX_SIZE * 2];
+	size_t num_blocks = 0;
+	while (is_in_buffer(blocks[num_blocks] = alloc.alloc(BUFFER_TIER_MAX_SIZE, 0)))
+		++num_blocks;
+	assert(blocks[num_blocks] && (chain.small_alloc.num_live_blocks == 1));
+	assert(alloc.get_tier_stats(BUFFER_TIER).num_misses == 1);
+	assert(alloc.find_owner(blocks[num_blocks], BUFFER_TIER_MAX_SIZE, 0) == SMALL_TIER);
+	++num_blocks;
+
+	for (size_t i = 0; i < num_blocks; ++i)
+		alloc.release(blocks[i], BUFFER_TIER_MAX_SIZE, 0);
+	assert(!chain.buffer_alloc.get_fragmentation_stats().num_allocs);
+	assert(!chain.small_alloc.num_live_blocks);
+
+	// Nothing can be allocated without a tier.
+	peff::TieredAlloc empty_alloc;
+	assert(!empty_alloc.alloc(16, 0));
+
+	peff::TieredAlloc full_alloc;
+	for (size_t i = 0; i < peff::TieredAlloc::MAX_TIERS; ++i) {
+		bool result = full_alloc.add_tier(&chain.large_alloc);
+		assert(result);
+	}
+	assert(!full_alloc.add_tier(&chain.large_alloc));
+}
+
+static void test_realloc() {
+	TierChain chain;
+	peff::TieredAlloc &alloc = chain.alloc;
+
+	// Within the ranged tier.
+	char *ptr = (char *)alloc.alloc(100, 8);
+	assert(is_in_buffer(ptr));
+	fill_block(ptr, 100, 1);
+	assert(alloc.realloc_in_place(ptr, 100, 8, 500, 8) == ptr);
+	ptr = (char *)alloc.realloc(ptr, 500, 8, 800, 128);
+	assert(is_in_buffer(ptr) && is_aligned(ptr, 128));
+	assert(check_block(ptr, 100, 1));
+
+	// Blocks cannot move to other tiers in place.
+	assert(!alloc.realloc_in_place(ptr, 800, 128, 2000, 128));
+	assert(!alloc.realloc_in_place(ptr, 800, 128, 800, 512));
+
+	// From the ranged tier to the small tier, and on to the large tier.
+	ptr = (char *)alloc.realloc(ptr, 800, 128, 2000, 8);
+	assert(ptr && !is_in_buffer(ptr));
+	assert(check_block(ptr, 100, 1));
+	assert(chain.small_alloc.num_live_blocks == 1);
+	assert(!chain.buffer_alloc.get_fragmentation_stats().num_allocs);
+
+	ptr = (char *)alloc.realloc(ptr, 2000, 8, 3000, 8);
+	assert(ptr && check_block(ptr, 100, 1));
+	assert(chain.small_alloc.live_size == 3000);
+
+	ptr = (char *)alloc.realloc(ptr, 3000, 8, 50000, 4096);
+	assert(ptr && is_aligned(ptr, 4096) && check_block(ptr, 100, 1));
+	assert(!chain.small_alloc.num_live_blocks);
+	assert(chain.large_alloc.num_live_blocks == 1);
+
+	// And back to the ranged tier.
+	ptr = (char *)alloc.realloc(ptr, 50000, 4096, 100, 0);
+	assert(is_in_buffer(ptr) && check_block(ptr, 100, 1));
+	assert(!chain.large_alloc.num_live_blocks);
+
+	// A block which does not fit into the buffer any more goes to the next tier.
+	void *fillers[BUFFER_SIZE / 256];
+	size_t num_fillers = 0;
+	while ((fillers[num_fillers] = chain.buffer_alloc.alloc(256, 0)))
+		++num_fillers;
+	ptr = (char *)alloc.realloc(ptr, 100, 0, BUFFER_TIER_MAX_SIZE, 0);
+	assert(ptr && !is_in_buffer(ptr) && check_block(ptr, 100, 1));
+	alloc.release(ptr, BUFFER_TIER_MAX_SIZE, 0);
+	for (size_t i = 0; i < num_fillers; ++i)
+		alloc.release(fillers[i], 256, 0);
+
+	assert(!chain.buffer_alloc.get_fragmentation_stats().num_allocs);
+	assert(!chain.small_alloc.num_live_blocks && !chain.large_alloc.num_live_blocks);
+}
+
+static void test_batch_trim_and_stats() {
+	TierChain chain;
+	peff::TieredAlloc &alloc = chain.alloc;
+
+	// The batch spills over from the buffer into the small tier.
+	constexpr size_t NUM_BLOCKS = 64;
+	void *blocks[NUM_BLOCKS];
+	assert(alloc.alloc_batch(NUM_BLOCKS, 512, 16, blocks) == NUM_BLOCKS);
+
+	size_t num_in_buffer = 0;
+	for (size_t i = 0; i < NUM_BLOCKS; ++i) {
+		assert(is_aligned(blocks[i], 16));
+		num_in_buffer += is_in_buffer(blocks[i]);
+		fill_block(blocks[i], 512, (uint8_t)i);
+	}
+	assert(num_in_buffer && (num_in_buffer < NUM_BLOCKS));
+	assert(chain.small_alloc.num_live_blocks == NUM_BLOCKS - num_in_buffer);
+
+	peff::TieredAlloc::TierStats stats = alloc.get_tier_stats(BUFFER_TIER);
+	assert(stats.num_hits == num_in_buffer);
+	assert(stats.hit_size == num_in_buffer * 512);
+	assert(stats.num_misses == NUM_BLOCKS - num_in_buffer);
+	stats = alloc.get_tier_stats(SMALL_TIER);
+	assert(stats.num_hits == NUM_BLOCKS - num_in_buffer);
+	assert(!stats.num_misses);
+
+	// Trimming purges the rest of the buffer, the live data is kept.
+	alloc.trim(0);
+	for (size_t i = 0; i < NUM_BLOCKS; ++i)
+		assert(check_block(blocks[i], 512, (uint8_t)i));
+
+	alloc.release_batch(blocks, NUM_BLOCKS, 512, 16);
+	assert(alloc.get_tier_stats(BUFFER_TIER).num_releases == num_in_buffer);
+	assert(alloc.get_tier_stats(SMALL_TIER).num_releases == NUM_BLOCKS - num_in_buffer);
+	assert(!chain.small_alloc.num_live_blocks);
+
+	alloc.reset_tier_stats();
+	for (size_t i = 0; i < alloc.num_tiers; ++i) {
+		stats = alloc.get_tier_stats(i);
+		assert(!stats.num_hits && !stats.num_misses && !stats.hit_size && !stats.num_releases);
+	}
+
+	// The alignment limits of the tiers are merged.
+	assert(alloc.get_caps().max_alignment == SIZE_MAX);
+	assert(!alloc.get_caps().is_thread_safe);
+}
+
+static void test_exhaustion() {
+	TierChain chain(SMALL_TIER_MAX_SIZE);
+	peff::TieredAlloc &alloc = chain.alloc;
+
+	void *small[2];
+	for (auto &i : small) {
+		i = alloc.alloc(2000, 0);
+		assert(i && !is_in_buffer(i));
+	}
+
+	// The small tier is final for its requests, they do not go on to the large tier.
+	assert(!alloc.alloc(2000, 0));
+	assert(alloc.get_tier_stats(SMALL_TIER).num_misses == 1);
+	assert(!alloc.get_tier_stats(LARGE_TIER).num_hits);
+
+	// A failing realloc keeps the block.
+	fill_block(small[0], 2000, 2);
+	assert(!alloc.realloc(small[0], 2000, 0, 3000, 0));
+	assert(check_block(small[0], 2000, 2));
+
+	// The block moves to the large tier if the small tier does not own the new alignment.
+	small[0] = alloc.realloc(small[0], 2000, 0, 2000, 128);
+	assert(small[0] && is_aligned(small[0], 128));
+	assert(check_block(small[0], 2000, 2));
+	assert(chain.large_alloc.num_live_blocks == 1);
+
+	// The other tiers still work.
+	void *in_buffer = alloc.alloc(100, 0);
+	assert(is_in_buffer(in_buffer));
+	void *large = alloc.alloc(SMALL_TIER_MAX_SIZE * 2, 0);
+	assert(large);
+
+	alloc.release(large, SMALL_TIER_MAX_SIZE * 2, 0);
+	alloc.release(in_buffer, 100, 0);
+	alloc.release(small[0], 2000, 128);
+	alloc.release(small[1], 2000, 0);
+	assert(!chain.small_alloc.num_live_blocks && !chain.large_alloc.num_live_blocks);
+}
+
+void test_tiered_alloc() {
+	test_routing();
+	test_realloc();
+	test_batch_trim_and_stats();
+	test_exhaustion();
+	puts("TieredAlloc: passed");
+}
@@ -0,0 +1,130 @@
+#include "alloctest.h"
+#include <peff/advutils/tracking_alloc.h>
+#include <peff/advutils/arena_alloc.h>
+#include <peff/containers/dynarray.h>
+
+using TrackingAlloc = peff::TrackingAlloc;
+
+static void test_counters() {
+	LimitedAlloc upstream(4096);
+	TrackingAlloc alloc(&upstream);
+
+	void *p = alloc.alloc(100, 8);
+	assert(p);
+	fill_block(p, 100, 1);
+
+	// Failed requests are counted but do not change the live size.
+	assert(!alloc.alloc(8192, 0));
+
+	void *q = alloc.alloc(200, 16);
+	assert(q);
+	fill_block(q, 200, 2);
+
+	TrackingAlloc::Stats stats = alloc.snapshot();
+	assert(stats.num_allocs == 3);
+	assert(stats.num_failed_allocs == 1);
+	assert(stats.live_size == 300);
+	assert(stats.peak_size == 300);
+	assert(stats.size_histogram[TrackingAlloc::get_size_bin(100)]);
+	assert(stats.size_histogram[TrackingAlloc::get_size_bin(8192)]);
+	assert(stats.alignment_histogram[TrackingAlloc::get_alignment_bin(8)]);
+	assert(stats.alignment_histogram[TrackingAlloc::get_alignment_bin(16)]);
+
+	assert(check_block(p, 100, 1));
+	alloc.release(p, 100, 8);
+
+	stats = alloc.snapshot();
+	assert(stats.num_releases == 1);
+	assert(stats.live_size == 200);
+	assert(stats.peak_size == 300);
+
+	// The peak size restarts from the current live size.
+	alloc.reset_stats();
+	stats = alloc.snapshot();
+	assert(!stats.num_allocs && !stats.num_releases);
+	assert(stats.live_size == 200);
+	assert(stats.peak_size == 200);
+
+	assert(check_block(q, 200, 2));
+	alloc.release(q, 200, 16);
+	assert(!alloc.snapshot().live_size);
+	assert(!upstream.num_live_blocks);
+}
+
+static void test_reallocs() {
+	LimitedAlloc upstream;
+	// Only the most recent block of an arena grows in place.
+	peff::ArenaAlloc arena(&upstream, 4096);
+	TrackingAlloc alloc(&arena);
+
+	void *a = alloc.alloc(64, 0), *b = alloc.alloc(64, 0);
+	assert(a && b);
+	fill_block(a, 64, 1);
+
+	assert(alloc.realloc(b, 64, 0, 256, 0) == b);
+
+	void *new_a = alloc.realloc(a, 64, 0, 128, 0);
+	assert(new_a && new_a != a);
+	assert(check_block(new_a, 64, 1));
+	a = new_a;
+
+	assert(!alloc.realloc_in_place(a, 128, 0, 8192, 0));
+
+	TrackingAlloc::Stats stats = alloc.snapshot();
+	assert(stats.num_reallocs == 3);
+	assert(stats.num_failed_reallocs == 1);
+	assert(stats.num_in_place_reallocs == 1);
+	assert(stats.num_moving_reallocs == 1);
+	assert(stats.realloc_copy_size == 64);
+	assert(stats.live_size == 128 + 256);
+
+	alloc.release(a, 128, 0);
+	alloc.release(b, 256, 0);
+	assert(!alloc.snapshot().live_size);
+}
+
+static void test_attach() {
+	// The array is built before the tracking allocator is attached.
+	peff::DynArray<int> arr(peff::default_allocator());
+	for (int i = 0; i < 1000; ++i) {
+		bool result = arr.push_back(+i);
+		assert(result);
+	}
+
+	TrackingAlloc alloc(peff::default_allocator());
+	arr.replace_allocator(&alloc);
+
+	// Releasing the block allocated before the attachment must not wrap the live size.
+	arr.clear_and_shrink();
+	assert(!alloc.snapshot().live_size);
+
+	for (int i = 0; i < 100; ++i) {
+		bool result = arr.push_back(+i);
+		assert(result);
+	}
+	TrackingAlloc::Stats stats = alloc.snapshot();
+	assert(stats.live_size >= 100 * sizeof(int));
+	assert(stats.peak_size == stats.live_size);
+
+	// The decorators around the same upstream allocator are interchangeable.
+	TrackingAlloc other_alloc(peff::default_allocator());
+	arr.replace_allocator(&other_alloc);
+	arr.replace_allocator(&alloc);
+
+	LimitedAlloc limited_alloc;
+	TrackingAlloc limited_tracking_alloc(&limited_alloc);
+	assert(limited_tracking_alloc.is_replaceable(&limited_alloc));
+	assert(!limited_tracking_alloc.is_replaceable(&alloc));
+
+	// Detach and release the block allocated through the tracking allocator elsewhere.
+	arr.replace_allocator(peff::default_allocator());
+	arr.clear_and_shrink();
+	assert(alloc.snapshot().live_size == stats.live_size);
+}
+
+void test_tracking_alloc() {
+	test_counters();
+	test_reallocs();
+	test_attach();
+	puts("TrackingAlloc: passed");
+}
@@ -1,5 +1,6 @@
 #include <cstdio>
 #include <peff/advutils/buffer_alloc.h>
+#include <peff/advutils/coroutine_frame_alloc.h>
 #include <peff/containers/dynarray.h>
 #include <iostream>
 #include <string>
@@ -10,7 +11,7 @@ struct Coroutine {
 
 	using Handle = std::coroutine_handle<promise_type>;
 
-	struct promise_type {
+	struct promise_type : public peff::CoroutineFramePromiseMixin {
 		int result;
 
 		static Coroutine get_return_object_on_allocation_failure() noexcept {
@@ -39,46 +40,6 @@ struct Coroutine {
 		}
 
 		void unhandled_exception() { std::terminate(); }
-
-		struct AllocatorInfo {
-			peff::Alloc *allocator;
-#if PEFF_ENABLE_RCOBJ_DEBUGGING
-			size_t c;
-#endif
-		};
-
-		static void *operator new(size_t size, peff::Alloc *allocator, int n) noexcept {
-			char *p = (char *)allocator->alloc(size + sizeof(AllocatorInfo), sizeof(std::max_align_t));
-
-			if (!p)
-				return nullptr;
-
-			AllocatorInfo allocator_info = {
-				allocator
-#if PEFF_ENABLE_RCOBJ_DEBUGGING
-				,
-				peff::g_rcobj_ptr_counter
-#endif
-			};
-
-			memcpy(p + size, &allocator_info, sizeof(allocator_info));
-#if PEFF_ENABLE_RCOBJ_DEBUGGING
-			allocator->inc_ref(peff::g_rcobj_ptr_counter++);
-#endif
-
-			return p;
-		}
-
-		static void operator delete(void *p, size_t size) noexcept {
-			AllocatorInfo allocator_info;
-
-			memcpy(&allocator_info, (char *)p + size, sizeof(allocator_info));
-
-			allocator_info.allocator->release(p, size, sizeof(std::max_align_t));
-#if PEFF_ENABLE_RCOBJ_DEBUGGING
-			allocator_info.allocator->dec_ref(allocator_info.c);
-#endif
-		}
 	};
 
 	Handle coro_handle;
@@ -120,10 +81,25 @@ int main() {
 	_CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
 #endif
 
-	Coroutine co = coroutine(peff::default_allocator(), 100);
+	{
+		Coroutine co = coroutine(peff::default_allocator(), 100);
+
+		while (!co.done()) {
+			printf("%d\n", co.resume());
+		}
+	}
+
+	{
+		peff::CoroutineFrameAlloc frame_alloc(peff::default_allocator());
 
-	while (!co.done()) {
-		printf("%d\n", co.resume());
+		// The frames are recycled by the frame allocator.
+		for (int i = 0; i < 10; ++i) {
+			Coroutine co = coroutine(&frame_alloc, 10);
+
+			while (!co.done()) {
+				co.resume();
+			}
+		}
 	}
 
 	return 0;
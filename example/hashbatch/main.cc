@@ -0,0 +1,100 @@
+#include <cstdio>
+#include <cstdlib>
+#include <peff/containers/hashset.h>
+#include <peff/containers/flat_hashset.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+// Compares the per-key contains() with contains_batch() of the hash sets.
+//
+// The sets are filled with random keys and probed with as many random
+// queries, half of which present. The sets are much larger than the
+// caches, so almost every probe misses, which is what the batched lookups
+// overlap.
+
+constexpr static size_t DEFAULT_NUM_ELEMENTS = (size_t)1 << 22;
+constexpr static size_t DEFAULT_NUM_ROUNDS = 3;
+
+static uint64_t get_time_ns() {
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static size_t count_bits(const std::vector<uint8_t> &bitmap) {
+	size_t n = 0;
+	for (uint8_t i : bitmap) {
+		for (; i; i &= i - 1)
+			++n;
+	}
+	return n;
+}
+
+template <typename S>
+static bool run_bench(const char *name, const std::vector<uint64_t> &keys, const std::vector<uint64_t> &queries, size_t num_rounds) {
+	S set(peff::default_allocator());
+
+	for (uint64_t i : keys) {
+		if (!set.insert(+i)) {
+			fprintf(stderr, "%s: out of memory\n", name);
+			return false;
+		}
+	}
+
+	std::vector<uint8_t> bitmap((queries.size() + 7) / 8);
+	uint64_t best_single_ns = UINT64_MAX, best_batch_ns = UINT64_MAX;
+	size_t num_single_hits = 0, num_batch_hits = 0;
+
+	for (size_t i = 0; i < num_rounds; ++i) {
+		uint64_t begin_time = get_time_ns();
+		num_single_hits = 0;
+		for (uint64_t j : queries)
+			num_single_hits += set.contains(j);
+		if (uint64_t t = get_time_ns() - begin_time; t < best_single_ns)
+			best_single_ns = t;
+
+		begin_time = get_time_ns();
+		set.contains_batch(queries.data(), queries.size(), bitmap.data());
+		if (uint64_t t = get_time_ns() - begin_time; t < best_batch_ns)
+			best_batch_ns = t;
+		num_batch_hits = count_bits(bitmap);
+	}
+
+	if (num_single_hits != num_batch_hits) {
+		fprintf(stderr, "%s: results mismatch, %zu hits vs %zu hits\n", name, num_single_hits, num_batch_hits);
+		return false;
+	}
+
+	printf("%-12s contains %7.2f ns/key, contains_batch %7.2f ns/key, speedup %.2fx (%zu hits)\n",
+		name,
+		(double)best_single_ns / queries.size(),
+		(double)best_batch_ns / queries.size(),
+		(double)best_single_ns / best_batch_ns,
+		num_batch_hits);
+	return true;
+}
+
+int main(int argc, char **argv) {
+#ifdef _MSC_VER
+	_CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
+#endif
+
+	const size_t num_elements = argc > 1 ? strtoull(argv[1], nullptr, 10) : DEFAULT_NUM_ELEMENTS;
+	const size_t num_rounds = argc > 2 ? strtoull(argv[2], nullptr, 10) : DEFAULT_NUM_ROUNDS;
+
+	std::mt19937_64 rng(1);
+	std::vector<uint64_t> keys(num_elements), queries(num_elements);
+
+	for (auto &i : keys)
+		i = rng();
+	for (auto &i : queries)
+		i = (rng() & 1) ? keys[rng() % num_elements] : rng();
+
+	printf("%zu elements, %zu queries\n", keys.size(), queries.size());
+
+	if (!run_bench<peff::HashSet<uint64_t>>("HashSet", keys, queries, num_rounds))
+		return 1;
+	if (!run_bench<peff::FlatHashSet<uint64_t>>("FlatHashSet", keys, queries, num_rounds))
+		return 1;
+
+	return 0;
+}
@@ -0,0 +1,263 @@
+#include "hashtest.h"
+#include <peff/containers/flat_hashset.h>
+#include <peff/containers/string.h>
+#include <string>
+
+using StringSet = peff::FlatHashSet<peff::String, std::equal_to<std::string_view>, peff::Hasher<std::string_view>>;
+
+static peff::String make_string(int i) {
+	peff::String s(peff::default_allocator());
+	bool result = s.build(std::to_string(i));
+	assert(result);
+	return s;
+}
+
+static void test_growth() {
+	peff::FlatHashSet<int> set(peff::default_allocator());
+
+	assert(!set.capacity());
+	assert(!set.contains(0));
+
+	// The table is grown when it is 7/8 full.
+	for (int i = 0; i < 14; ++i) {
+		bool result = set.insert(+i);
+		assert(result);
+	}
+	assert(set.capacity() == 16);
+
+	bool result = set.insert(14);
+	assert(result);
+	assert(set.capacity() == 32);
+
+	for (int i = 15; i < 28; ++i) {
+		result = set.insert(+i);
+		assert(result);
+	}
+	assert(set.capacity() == 32);
+
+	result = set.insert(28);
+	assert(result);
+	assert(set.capacity() == 64);
+
+	// Inserting an existing key replaces the element.
+	result = set.insert(0);
+	assert(result);
+	assert(set.size() == 29);
+
+	for (int i = 0; i < 29; ++i)
+		assert(set.contains(i));
+	assert(!set.contains(29));
+}
+
+static void test_tombstones() {
+	peff::FlatHashSet<int, std::equal_to<int>, CollidingHasher> set(peff::default_allocator());
+
+	// All keys are probed from the same group, which is filled by the first 16 keys.
+	bool result = set.reserve(28);
+	assert(result);
+	assert(set.capacity() == 32);
+	for (int i = 0; i < 28; ++i) {
+		result = set.insert(+i);
+		assert(result);
+	}
+	assert(set.capacity() == 32);
+
+	// The slots of the full group are marked as deleted, the probes must go on past them.
+	for (int i = 0; i < 4; ++i) {
+		set.remove(i);
+		assert(!set.contains(i));
+	}
+	assert(set.size() == 24);
+	for (int i = 4; i < 28; ++i)
+		assert(set.contains(i));
+
+	// The deleted slots are reused without growing.
+	for (int i = 100; i < 104; ++i) {
+		result = set.insert(+i);
+		assert(result);
+	}
+	assert(set.capacity() == 32);
+	assert(set.size() == 28);
+
+	result = set.insert(104);
+	assert(result);
+	assert(set.capacity() == 64);
+
+	for (int i = 4; i < 28; ++i)
+		assert(set.contains(i));
+	for (int i = 100; i < 105; ++i)
+		assert(set.contains(i));
+	for (int i = 0; i < 4; ++i)
+		assert(!set.contains(i));
+}
+
+static void test_shrink() {
+	peff::FlatHashSet<int> set(peff::default_allocator());
+
+	for (int i = 0; i < 1000; ++i) {
+		bool result = set.insert(+i);
+		assert(result);
+	}
+	const size_t capacity = set.capacity();
+	assert(capacity >= 1024);
+
+	for (int i = 10; i < 1000; ++i)
+		set.remove(i);
+	assert(set.capacity() == capacity);
+
+	bool result = set.shrink_to_fit();
+	assert(result);
+	assert(set.capacity() == 16);
+	assert(set.size() == 10);
+	for (int i = 0; i < 1000; ++i)
+		assert(set.contains(i) == (i < 10));
+
+	for (int i = 0; i < 10; ++i)
+		set.remove(i);
+	result = set.shrink_buckets();
+	assert(result);
+	assert(!set.capacity());
+	assert(!set.contains(0));
+
+	result = set.insert(1);
+	assert(result);
+	assert(set.contains(1));
+}
+
+static void test_iteration_after_erase() {
+	peff::FlatHashSet<int> set(peff::default_allocator());
+
+	for (int i = 0; i < 100; ++i) {
+		bool result = set.insert(+i);
+		assert(result);
+	}
+
+	// The iterator to the next element stays valid when an element is removed.
+	for (auto it = set.begin(); it != set.end();) {
+		if (!(*it & 1)) {
+			auto cur = it++;
+			set.remove(cur);
+		} else
+			++it;
+	}
+	assert(set.size() == 50);
+
+	size_t num_iterated = 0;
+	int sum = 0;
+	for (auto it = set.begin_const(); it != set.end_const(); ++it) {
+		assert(*it & 1);
+		++num_iterated;
+		sum += *it;
+	}
+	assert(num_iterated == 50);
+	assert(sum == 50 * 50);
+
+	num_iterated = 0;
+	for (auto it = set.begin_reversed(); it != set.end_reversed(); ++it)
+		++num_iterated;
+	assert(num_iterated == 50);
+}
+
+static void test_with_hash() {
+	peff::FlatHashSet<int> set(peff::default_allocator());
+	const peff::FlatHashSet<int> &const_set = set;
+	const peff::Hasher<int> hasher;
+
+	for (int i = 0; i < 100; ++i) {
+		bool result = set.insert(+i);
+		assert(result);
+	}
+
+	for (int i = 0; i < 100; ++i) {
+		assert(set.contains_with_hash(i, hasher(i)));
+		assert(set.at_with_hash(i, hasher(i)) == i);
+		assert(*set.find_with_hash(i, hasher(i)) == i);
+		assert(*const_set.find_with_hash(i, hasher(i)) == i);
+	}
+	assert(!set.contains_with_hash(100, hasher(100)));
+	assert(set.find_with_hash(100, hasher(100)) == set.end());
+
+	// The keys of another type are hashed and compared without converting.
+	StringSet string_set(peff::default_allocator());
+	for (int i = 0; i < 16; ++i) {
+		bool result = string_set.insert(make_string(i));
+		assert(result);
+	}
+	const peff::Hasher<std::string_view> string_hasher;
+	for (int i = 0; i < 16; ++i) {
+		const std::string s = std::to_string(i);
+		assert(string_set.contains_alt(std::string_view(s)));
+		assert(string_set.contains_with_hash(std::string_view(s), string_hasher(s)));
+	}
+	assert(!string_set.contains_alt(std::string_view("16")));
+}
+
+static void test_fallible() {
+	peff::FallibleFlatHashSet<int, peff::FallibleEq<int>, NegativeFailingHasher> set(peff::default_allocator());
+
+	for (int i = 0; i < 100; ++i) {
+		bool result = set.insert(+i);
+		assert(result);
+	}
+
+	// The failures of the hasher are reported instead of being treated as absent keys.
+	assert(!set.insert(-1));
+	assert(set.size() == 100);
+	assert(!set.contains(-1).has_value());
+	assert(!set.at(-1).has_value());
+	assert(!set.remove(-1));
+
+	assert(set.contains(1).value());
+	assert(!set.contains(100).value());
+	assert(set.at(1).value() == 1);
+	assert(set.contains_with_hash(1, 1).value());
+
+	for (int i = 0; i < 50; ++i) {
+		bool result = set.remove(i);
+		assert(result);
+	}
+	assert(set.size() == 50);
+
+	bool result = set.shrink_to_fit();
+	assert(result);
+	for (int i = 0; i < 100; ++i)
+		assert(set.contains(i).value() == (i >= 50));
+}
+
+static void test_move() {
+	StringSet set(peff::default_allocator());
+
+	for (int i = 0; i < 100; ++i) {
+		bool result = set.insert(make_string(i));
+		assert(result);
+	}
+
+	StringSet moved_set(std::move(set));
+	assert(!set.size() && !set.capacity());
+	assert(moved_set.size() == 100);
+	for (int i = 0; i < 100; ++i)
+		assert(moved_set.contains_alt(std::string_view(std::to_string(i))));
+
+	// The elements of the assigned set are released.
+	StringSet assigned_set(peff::default_allocator());
+	bool result = assigned_set.insert(make_string(1000));
+	assert(result);
+
+	assigned_set = std::move(moved_set);
+	assert(!moved_set.size() && !moved_set.capacity());
+	assert(assigned_set.size() == 100);
+	assert(!assigned_set.contains_alt(std::string_view("1000")));
+	for (int i = 0; i < 100; ++i)
+		assert(assigned_set.contains_alt(std::string_view(std::to_string(i))));
+}
+
+void test_flat_hash_set() {
+	test_growth();
+	test_tombstones();
+	test_shrink();
+	test_iteration_after_erase();
+	test_with_hash();
+	test_fallible();
+	test_move();
+	puts("FlatHashSet: passed");
+}
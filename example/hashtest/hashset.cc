@@ -0,0 +1,172 @@
+#include "hashtest.h"
+#include <peff/containers/hashset.h>
+
+// The cases are run with each bucket indexing policy, the mask indexer is
+// only paired with MixHasher since it takes the low bits of the hash code.
+
+constexpr static int NUM_KEYS = 1000;
+/// @brief Stride of the keys, the keys which only differ in their high bits are the worst case of the mask indexer.
+constexpr static int KEY_STRIDE = 1024;
+
+template <typename Set>
+static void insert_keys(Set &set, int num_keys) {
+	for (int i = 0; i < num_keys; ++i) {
+		bool result = set.insert(i * KEY_STRIDE);
+		assert(result);
+	}
+}
+
+template <typename Hasher, typename BucketIndexer>
+static void test_insert_and_remove() {
+	peff::HashSet<int, std::equal_to<int>, Hasher, BucketIndexer> set(peff::default_allocator());
+
+	insert_keys(set, NUM_KEYS);
+	assert(set.size() == NUM_KEYS);
+
+	for (int i = 0; i < NUM_KEYS; ++i) {
+		assert(set.contains(i * KEY_STRIDE));
+		assert(!set.contains(i * KEY_STRIDE + 1));
+	}
+
+	for (int i = 0; i < NUM_KEYS; i += 2)
+		set.remove(i * KEY_STRIDE);
+	assert(set.size() == NUM_KEYS / 2);
+
+	size_t num_iterated = 0;
+	for (auto it = set.begin(); it != set.end(); ++it) {
+		assert((*it / KEY_STRIDE) & 1);
+		++num_iterated;
+	}
+	assert(num_iterated == NUM_KEYS / 2);
+
+	for (int i = 0; i < NUM_KEYS; ++i)
+		assert(set.contains(i * KEY_STRIDE) == (bool)(i & 1));
+}
+
+template <typename Hasher, typename BucketIndexer>
+static void test_incremental_resize() {
+	peff::HashSet<int, std::equal_to<int>, Hasher, BucketIndexer> set(peff::default_allocator());
+	const auto &const_set = set;
+
+	set.set_incremental_resize(true);
+
+	int num_keys = 0;
+	do {
+		bool result = set.insert(num_keys * KEY_STRIDE);
+		assert(result);
+		++num_keys;
+	} while (!set.is_resizing() || num_keys < 64);
+
+	// The keys are found in either bucket array during the migration.
+	for (int i = 0; i < num_keys; ++i)
+		assert(const_set.contains(i * KEY_STRIDE));
+	assert(set.is_resizing());
+
+	for (int i = 0; i < num_keys; i += 2)
+		set.remove(i * KEY_STRIDE);
+	for (int i = 0; i < num_keys; ++i)
+		assert(const_set.contains(i * KEY_STRIDE) == (bool)(i & 1));
+
+	set.set_incremental_resize(false);
+	assert(!set.is_resizing());
+	for (int i = 0; i < num_keys; ++i)
+		assert(set.contains(i * KEY_STRIDE) == (bool)(i & 1));
+}
+
+template <typename Hasher, typename BucketIndexer>
+static void test_with_hash() {
+	peff::HashSet<int, std::equal_to<int>, Hasher, BucketIndexer> set(peff::default_allocator());
+	const Hasher hasher;
+
+	insert_keys(set, NUM_KEYS);
+
+	for (int i = 0; i < NUM_KEYS; ++i) {
+		const int key = i * KEY_STRIDE;
+		assert(set.contains_with_hash(key, hasher(key)));
+		assert(set.at_with_hash(key, hasher(key)) == key);
+		assert(*set.find_with_hash(key, hasher(key)) == key);
+	}
+	assert(!set.contains_with_hash(1, hasher(1)));
+}
+
+template <typename Hasher, typename BucketIndexer>
+static void test_shrink() {
+	peff::HashSet<int, std::equal_to<int>, Hasher, BucketIndexer> set(peff::default_allocator());
+
+	insert_keys(set, NUM_KEYS);
+	const size_t bucket_count = set.bucket_count();
+	assert(bucket_count >= NUM_KEYS / 2);
+
+	// The removals do not shrink the buckets.
+	for (int i = 10; i < NUM_KEYS; ++i)
+		set.remove(i * KEY_STRIDE);
+	assert(set.bucket_count() == bucket_count);
+
+	bool result = set.shrink_to_fit();
+	assert(result);
+	assert(set.size() == 10);
+	assert(set.bucket_count() == (BucketIndexer::POWER_OF_TWO_BUCKETS ? 8 : 5));
+	for (int i = 0; i < NUM_KEYS; ++i)
+		assert(set.contains(i * KEY_STRIDE) == (i < 10));
+
+	for (int i = 0; i < 10; ++i)
+		set.remove(i * KEY_STRIDE);
+	result = set.shrink_buckets();
+	assert(result);
+	assert(!set.bucket_count());
+	assert(!set.contains(0));
+
+	insert_keys(set, 10);
+	for (int i = 0; i < 10; ++i)
+		assert(set.contains(i * KEY_STRIDE));
+
+	// Shrinking finishes an incremental resize first.
+	set.set_incremental_resize(true);
+	int num_keys = 10;
+	do {
+		result = set.insert(num_keys * KEY_STRIDE);
+		assert(result);
+		++num_keys;
+	} while (!set.is_resizing());
+
+	for (int i = 1; i < num_keys; ++i)
+		set.remove(i * KEY_STRIDE);
+	result = set.shrink_buckets();
+	assert(result);
+	assert(!set.is_resizing());
+	assert(set.bucket_count() == 1);
+	for (int i = 0; i < num_keys; ++i)
+		assert(set.contains(i * KEY_STRIDE) == !i);
+}
+
+template <typename BucketIndexer>
+static void test_fallible() {
+	peff::FallibleHashSet<int, peff::FallibleEq<int>, NegativeFailingHasher, BucketIndexer> set(peff::default_allocator());
+
+	insert_keys(set, NUM_KEYS);
+
+	assert(!set.insert(-1));
+	assert(!set.contains(-1).has_value());
+	assert(!set.remove(-1));
+	assert(set.size() == NUM_KEYS);
+
+	for (int i = 0; i < NUM_KEYS; ++i)
+		assert(set.contains(i * KEY_STRIDE).value());
+}
+
+template <typename Hasher, typename BucketIndexer>
+static void test_hash_set_with(const char *name) {
+	test_insert_and_remove<Hasher, BucketIndexer>();
+	test_incremental_resize<Hasher, BucketIndexer>();
+	test_with_hash<Hasher, BucketIndexer>();
+	test_shrink<Hasher, BucketIndexer>();
+	test_fallible<BucketIndexer>();
+	printf("HashSet with %s: passed\n", name);
+}
+
+void test_hash_set() {
+	test_hash_set_with<peff::Hasher<int>, peff::ModuloBucketIndexer>("ModuloBucketIndexer");
+	test_hash_set_with<peff::MixHasher<int>, peff::MaskBucketIndexer>("MaskBucketIndexer and MixHasher");
+	test_hash_set_with<peff::Hasher<int>, peff::FibonacciBucketIndexer>("FibonacciBucketIndexer");
+	test_hash_set_with<peff::MixHasher<int>, peff::FibonacciBucketIndexer>("FibonacciBucketIndexer and MixHasher");
+}
@@ -0,0 +1,30 @@
+#ifndef _HASHTEST_HASHTEST_H_
+#define _HASHTEST_HASHTEST_H_
+
+// The checks are done with assert(), keep them in the release builds.
+#undef NDEBUG
+#include <cassert>
+#include <peff/utils/option.h>
+#include <cstdint>
+#include <cstdio>
+
+/// @brief Hasher which maps all keys to the same hash code, so every key collides with each other.
+struct CollidingHasher {
+	size_t operator()(int x) const {
+		return 0;
+	}
+};
+
+/// @brief Fallible hasher which fails on the negative keys.
+struct NegativeFailingHasher {
+	peff::Option<size_t> operator()(int x) const {
+		if (x < 0)
+			return peff::NULL_OPTION;
+		return (size_t)x;
+	}
+};
+
+void test_hash_set();
+void test_flat_hash_set();
+
+#endif
@@ -1,9 +1,9 @@
-#include <cstdio>
-#include <peff/advutils/buffer_alloc.h>
-#include <peff/containers/dynarray.h>
+#include "hashtest.h"
 #include <peff/utils/hash.h>
-#include <iostream>
-#include <string>
+
+// Exercises the hash functions and the hash containers: the insertions, the
+// removals, the growth and shrinking of the tables, the iterations and the
+// lookups with the precomputed hash codes.
 
 int main() {
 #ifdef _MSC_VER
@@ -12,5 +12,9 @@ int main() {
 
 	printf("%llu\n", peff::city_hash64("16", sizeof("16") - 1));
 
+	test_hash_set();
+	test_flat_hash_set();
+
+	puts("All hash tests passed");
 	return 0;
 }
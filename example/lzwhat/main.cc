@@ -8,6 +8,7 @@
 #include <peff/containers/map.h>
 #include <peff/containers/bitarray.h>
 #include <peff/advutils/shared_ptr.h>
+#include <peff/advutils/scratch_alloc.h>
 #include <iostream>
 #include <string>
 
@@ -529,8 +530,13 @@ int main() {
 
 	peff::DynArray<char> data(peff::default_allocator());
 
-	if (!lzwhat_decompress(bit_array, peff::default_allocator(), 7, data)) {
-		std::terminate();
+	{
+		// The dictionary is only used during the decompression.
+		peff::ScratchScope scratch_scope;
+
+		if (!lzwhat_decompress(bit_array, scratch_scope.allocator, 7, data)) {
+			std::terminate();
+		}
 	}
 
 	for (size_t i = 0; i < data.size(); ++i) {
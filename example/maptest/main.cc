@@ -6,6 +6,7 @@
 #include <peff/containers/list.h>
 #include <peff/containers/hashset.h>
 #include <peff/containers/hashmap.h>
+#include <peff/containers/flat_hashmap.h>
 #include <peff/containers/radix_tree.h>
 #include <peff/containers/map.h>
 #include <peff/containers/bitarray.h>
@@ -105,11 +106,81 @@ struct FallibleHasher {
 	}
 };
 
+/// @brief Allocator which fails after a number of allocations, and counts the live blocks so the leaks can be detected.
+class CountdownAlloc : public peff::Alloc {
+protected:
+	std::atomic_size_t _ref_count = 0;
+
+public:
+	size_t num_allowed_allocs;
+	size_t num_live_blocks = 0;
+
+	CountdownAlloc(size_t num_allowed_allocs) : num_allowed_allocs(num_allowed_allocs) {}
+
+	virtual size_t inc_ref(size_t global_ref_count) noexcept override {
+		return ++_ref_count;
+	}
+	virtual size_t dec_ref(size_t global_ref_count) noexcept override {
+		return --_ref_count;
+	}
+
+	virtual void *alloc(size_t size, size_t alignment) noexcept override {
+		if (!num_allowed_allocs)
+			return nullptr;
+
+		void *ptr = peff::g_std_allocator.alloc(size, alignment);
+		if (ptr) {
+			--num_allowed_allocs;
+			++num_live_blocks;
+		}
+		return ptr;
+	}
+	virtual void *realloc(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override {
+		return nullptr;
+	}
+	virtual void *realloc_in_place(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override {
+		return nullptr;
+	}
+	virtual void release(void *ptr, size_t size, size_t alignment) noexcept override {
+		assert(num_live_blocks);
+		--num_live_blocks;
+		peff::g_std_allocator.release(ptr, size, alignment);
+	}
+
+	virtual bool is_replaceable(const peff::Alloc *rhs) const noexcept override {
+		return rhs == this;
+	}
+
+	virtual peff::UUID type_identity() const noexcept override {
+		return PEFF_UUID(8e3b6f21, 4c7a, 4d5e, 9a10, 6b2f8c4d1e93);
+	}
+};
+
 int main() {
 #ifdef _MSC_VER
 	_CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
 #endif
 
+	{
+		// Shrink the storage of the elements which are not trivially movable.
+		peff::DynArray<peff::String> arr(&peff::g_std_allocator);
+
+		for (int i = 0; i < 5; ++i) {
+			peff::String s(&peff::g_std_allocator);
+			if (!s.build(std::to_string(i)))
+				throw std::bad_alloc();
+			if (!arr.push_back(std::move(s)))
+				throw std::bad_alloc();
+		}
+
+		if (!arr.shrink_to_fit())
+			throw std::bad_alloc();
+		assert(arr.size() == 5);
+		assert(arr.capacity() == 5);
+		for (int i = 0; i < 5; ++i)
+			assert(arr.at(i) == std::to_string(i));
+	}
+
 	peff::String s(&peff::g_std_allocator);
 	s.resize(3);
 	memcpy(s.data(), "123", 3);
@@ -204,9 +275,218 @@ int main() {
 			// map.dump(std::cout);
 		}
 	}
+	{
+		// Const lookups and iterations in the middle of an incremental resize.
+		peff::HashSet<int> set(&peff::g_std_allocator);
+		peff::HashMap<int, int> hash_map(&peff::g_std_allocator);
+		const peff::HashSet<int> &const_set = set;
+		const peff::HashMap<int, int> &const_hash_map = hash_map;
+
+		set.set_incremental_resize(true);
+		hash_map.set_incremental_resize(true);
+
+		int num_elements = 0;
+		do {
+			if (!set.insert(+num_elements))
+				throw std::bad_alloc();
+			if (!hash_map.insert(+num_elements, num_elements * 2))
+				throw std::bad_alloc();
+			++num_elements;
+		} while (!set.is_resizing() || !hash_map.is_resizing() || num_elements < 64);
+
+		for (int i = 0; i < num_elements; ++i) {
+			assert(const_set.contains(i));
+			assert(*const_set.find(i) == i);
+			assert(const_hash_map.find(i).value() == i * 2);
+		}
+		assert(!const_set.contains(num_elements));
+		assert(const_set.find(num_elements) == const_set.end_const());
+
+		size_t num_iterated = 0;
+		long long sum = 0;
+		for (auto i = const_set.begin_const(); i != const_set.end_const(); ++i) {
+			++num_iterated;
+			sum += *i;
+		}
+		assert(num_iterated == set.size());
+		assert(sum == (long long)num_elements * (num_elements - 1) / 2);
+
+		num_iterated = 0;
+		for (auto i = const_set.begin_const_reversed(); i != const_set.end_const_reversed(); ++i)
+			++num_iterated;
+		assert(num_iterated == set.size());
+
+		num_iterated = 0;
+		for (auto i = const_hash_map.begin_const(); i != const_hash_map.end_const(); ++i) {
+			assert(i.value() == i.key() * 2);
+			++num_iterated;
+		}
+		assert(num_iterated == hash_map.size());
+
+		assert(set.is_resizing());
+		assert(hash_map.is_resizing());
+
+		// Walking backwards from the end reaches every element as well.
+		num_iterated = 0;
+		auto it = set.end();
+		for (auto begin = const_set.begin_const()._iterator; it != begin;) {
+			--it;
+			++num_iterated;
+		}
+		assert(num_iterated == set.size());
+		assert(set.is_resizing());
+
+		// The non-const iteration finishes the migration.
+		num_iterated = 0;
+		for (auto i = set.begin(); i != set.end(); ++i)
+			++num_iterated;
+		assert(num_iterated == set.size());
+		assert(!set.is_resizing());
+	}
+	{
+		// Batched insertions: the duplicate keys replace the existing elements and take no node.
+		CountdownAlloc tree_alloc(4);
+		{
+			peff::RBTree<int> tree(&tree_alloc, std::less<int>());
+			int keys[] = { 3, 1, 3, 4, 1, 2, 4, 2 };
+
+			if (!tree.insert_batch(keys, std::size(keys)))
+				throw std::bad_alloc();
+			tree.verify();
+			assert(tree.size() == 4);
+			assert(tree_alloc.num_live_blocks == 4);
+
+			int expected = 1;
+			for (auto i = tree.begin(); i != tree.end(); ++i)
+				assert(*i == expected++);
+			assert(expected == 5);
+
+			// The allocations fail partway, the keys before the failed one are kept inserted.
+			tree_alloc.num_allowed_allocs = 3;
+			int more_keys[] = { 1, 10, 11, 2, 12, 13, 14 };
+			assert(!tree.insert_batch(more_keys, std::size(more_keys)));
+			tree.verify();
+			assert(tree.size() == 7);
+			assert(tree_alloc.num_live_blocks == 7);
+			for (int i : { 1, 2, 3, 4, 10, 11, 12 })
+				assert(tree.get(i));
+			assert(!tree.get(13));
+		}
+		assert(!tree_alloc.num_live_blocks);
+
+		CountdownAlloc set_alloc(3);
+		{
+			peff::Set<int> set(&set_alloc);
+			int keys[] = { 7, 7, 5, 6, 5, 8, 9 };
+
+			assert(!set.insert_batch(keys, std::size(keys)));
+			set.verify();
+			assert(set.size() == 3);
+			assert(set.contains(5) && set.contains(6) && set.contains(7));
+			assert(!set.contains(8));
+		}
+		assert(!set_alloc.num_live_blocks);
+
+		CountdownAlloc map_alloc(3);
+		{
+			peff::Map<int, int> map(&map_alloc);
+			int keys[] = { 1, 2, 1, 3 };
+			int values[] = { 10, 20, 30, 40 };
+
+			if (!map.insert_batch(keys, values, std::size(keys)))
+				throw std::bad_alloc();
+			assert(map.size() == 3);
+			assert(map.at(1) == 30);
+			assert(map.at(2) == 20);
+			assert(map.at(3) == 40);
+
+			int more_keys[] = { 2, 4 };
+			int more_values[] = { 50, 60 };
+			assert(!map.insert_batch(more_keys, more_values, std::size(more_keys)));
+			assert(map.size() == 3);
+			assert(map.at(2) == 50);
+			assert(!map.contains(4));
+		}
+		assert(!map_alloc.num_live_blocks);
+	}
+	{
+		// Open-addressing hash map: growth, tombstones, shrinking, iteration after removals and moves.
+		peff::FlatHashMap<int, peff::String> flat_map(&peff::g_std_allocator);
+
+		for (int i = 0; i < 1000; ++i) {
+			peff::String s(&peff::g_std_allocator);
+			if (!s.build(std::to_string(i)))
+				throw std::bad_alloc();
+			if (!flat_map.insert(+i, std::move(s)))
+				throw std::bad_alloc();
+		}
+		assert(flat_map.size() == 1000);
+		assert(flat_map.capacity() == 2048);
+
+		// Inserting an existing key replaces the value.
+		{
+			peff::String s(&peff::g_std_allocator);
+			if (!s.build("zero"))
+				throw std::bad_alloc();
+			if (!flat_map.insert(0, std::move(s)))
+				throw std::bad_alloc();
+		}
+		assert(flat_map.size() == 1000);
+		assert(flat_map.at(0) == std::string_view("zero"));
+
+		for (auto i = flat_map.begin(); i != flat_map.end();) {
+			if (i.key() >= 10) {
+				auto cur = i++;
+				flat_map.remove(cur);
+			} else
+				++i;
+		}
+		assert(flat_map.size() == 10);
+
+		size_t num_iterated = 0;
+		for (auto [k, v] : flat_map) {
+			assert(k < 10);
+			assert(k == 0 || v == std::to_string(k));
+			++num_iterated;
+		}
+		assert(num_iterated == 10);
+
+		if (!flat_map.shrink_to_fit())
+			throw std::bad_alloc();
+		assert(flat_map.capacity() == 16);
+		for (int i = 1; i < 1000; ++i) {
+			assert(flat_map.contains(i) == (i < 10));
+			assert(flat_map.contains_with_hash(i, peff::Hasher<int>()(i)) == (i < 10));
+		}
+		assert(flat_map.at_with_hash(1, peff::Hasher<int>()(1)) == std::string_view("1"));
+
+		peff::FlatHashMap<int, peff::String> moved_map(std::move(flat_map));
+		assert(!flat_map.size() && !flat_map.capacity());
+		assert(moved_map.size() == 10);
+
+		peff::FlatHashMap<int, peff::String> assigned_map(&peff::g_std_allocator);
+		{
+			peff::String s(&peff::g_std_allocator);
+			if (!s.build("1000"))
+				throw std::bad_alloc();
+			if (!assigned_map.insert(1000, std::move(s)))
+				throw std::bad_alloc();
+		}
+		assigned_map = std::move(moved_map);
+		assert(!moved_map.size());
+		assert(assigned_map.size() == 10);
+		assert(!assigned_map.contains(1000));
+		assert(assigned_map.at(9) == std::string_view("9"));
+
+		peff::FallibleFlatHashMap<int, int, peff::FallibleEq<int>, FallibleHasher<int>> fallible_map(&peff::g_std_allocator);
+		// The failures of the hasher are reported.
+		assert(!fallible_map.insert(1, 1));
+		assert(!fallible_map.size());
+	}
 	{
 		peff::Map<int, peff::String> map(&peff::g_std_allocator);
 		peff::Map<peff::String, int, std::less<std::string_view>> map2(&peff::g_std_allocator);
+		peff::HashMap<peff::String, int, std::equal_to<std::string_view>, peff::Hasher<std::string_view>> hash_map(&peff::g_std_allocator);
 
 		for (int i = 0; i < 16; i++) {
 			int j = i & 1 ? i : 32 - i;
@@ -221,6 +501,9 @@ int main() {
 			peff::String s2(&peff::g_std_allocator);
 			if (!s2.build(s))
 				throw std::bad_alloc();
+			peff::String s3(&peff::g_std_allocator);
+			if (!s3.build(s))
+				throw std::bad_alloc();
 
 			std::string_view sv = (std::string_view)s;
 			std::cout << "Dumping string: " << sv << std::endl;
@@ -234,6 +517,11 @@ int main() {
 			bool b = map2.contains_alt(sv);
 			// map2.remove_alt(sv);
 			assert(b);
+
+			if (!hash_map.insert(std::move(s3), +j))
+				throw std::bad_alloc();
+			assert(hash_map.contains_alt(sv));
+			assert(hash_map.at_with_hash(sv, peff::Hasher<std::string_view>()(sv)) == j);
 		}
 
 		for(auto i : map2) {
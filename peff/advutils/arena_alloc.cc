@@ -0,0 +1,234 @@
+#include "arena_alloc.h"
+#include "page_purge.h"
+#include <cstring>
+
+using namespace peff;
+
+PEFF_FORCEINLINE static char *_align_ptr(char *ptr, size_t alignment) {
+	if (size_t diff = ((uintptr_t)ptr) % alignment; diff) {
+		return ptr + (alignment - diff);
+	}
+	return ptr;
+}
+
+PEFF_ADVUTILS_API ArenaAlloc::ArenaAlloc(peff::Alloc *upstream, size_t block_size) : upstream(upstream), block_size(block_size) {
+}
+
+PEFF_ADVUTILS_API ArenaAlloc::ArenaAlloc(ArenaAlloc &&rhs) noexcept
+	: upstream(std::move(rhs.upstream)),
+	  block_size(rhs.block_size),
+	  cur_block(rhs.cur_block),
+	  cur_ptr(rhs.cur_ptr),
+	  cur_end(rhs.cur_end),
+	  last_alloc(rhs.last_alloc) {
+	rhs.cur_block = nullptr;
+	rhs.cur_ptr = nullptr;
+	rhs.cur_end = nullptr;
+	rhs.last_alloc = nullptr;
+}
+
+PEFF_ADVUTILS_API ArenaAlloc::~ArenaAlloc() {
+	rewind({});
+}
+
+PEFF_ADVUTILS_API ArenaAlloc &ArenaAlloc::operator=(ArenaAlloc &&rhs) noexcept {
+	rewind({});
+
+	upstream = std::move(rhs.upstream);
+	block_size = rhs.block_size;
+	cur_block = rhs.cur_block;
+	cur_ptr = rhs.cur_ptr;
+	cur_end = rhs.cur_end;
+	last_alloc = rhs.last_alloc;
+
+	rhs.cur_block = nullptr;
+	rhs.cur_ptr = nullptr;
+	rhs.cur_end = nullptr;
+	rhs.last_alloc = nullptr;
+
+	return *this;
+}
+
+PEFF_ADVUTILS_API size_t ArenaAlloc::dec_ref(size_t global_ref_count) noexcept {
+	if (!--_ref_count) {
+		on_ref_zero();
+		return 0;
+	}
+	return _ref_count;
+}
+
+PEFF_ADVUTILS_API size_t ArenaAlloc::inc_ref(size_t global_ref_count) noexcept {
+	return ++_ref_count;
+}
+
+PEFF_ADVUTILS_API void ArenaAlloc::on_ref_zero() noexcept {
+}
+
+PEFF_ADVUTILS_API void ArenaAlloc::_release_block(BlockHeader *block) noexcept {
+	upstream->release(block, block->size, BLOCK_ALIGNMENT);
+}
+
+PEFF_ADVUTILS_API void *ArenaAlloc::alloc(size_t size, size_t alignment) noexcept {
+	if (!alignment)
+		alignment = 1;
+
+	if (cur_block) {
+		char *ptr = _align_ptr(cur_ptr, alignment);
+
+		if ((ptr <= cur_end) && (size <= (size_t)(cur_end - ptr))) {
+			cur_ptr = ptr + size;
+			last_alloc = ptr;
+			return ptr;
+		}
+	}
+
+	if (size > SIZE_MAX - sizeof(BlockHeader) - alignment)
+		return nullptr;
+
+	size_t new_block_size = sizeof(BlockHeader) + size + alignment;
+	if (new_block_size < block_size)
+		new_block_size = block_size;
+
+	BlockHeader *block = (BlockHeader *)upstream->alloc(new_block_size, BLOCK_ALIGNMENT);
+	if (!block)
+		return nullptr;
+
+	block->prev = cur_block;
+	block->size = new_block_size;
+
+	cur_block = block;
+	cur_end = _get_block_end(block);
+
+	char *ptr = _align_ptr(_get_block_data(block), alignment);
+	cur_ptr = ptr + size;
+	last_alloc = ptr;
+
+	return ptr;
+}
+
+PEFF_ADVUTILS_API void *ArenaAlloc::realloc(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept {
+	void *p;
+
+	if ((p = realloc_in_place(ptr, size, alignment, new_size, new_alignment)))
+		return p;
+
+	if (!(p = alloc(new_size, new_alignment)))
+		return nullptr;
+
+	memcpy(p, ptr, size < new_size ? size : new_size);
+
+	return p;
+}
+
+PEFF_ADVUTILS_API void *ArenaAlloc::realloc_in_place(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept {
+	if (new_alignment && (((uintptr_t)ptr) % new_alignment))
+		return nullptr;
+
+	if (ptr == last_alloc) {
+		// The most recent allocation, extend or shrink it by moving the bump pointer.
+		if (new_size <= (size_t)(cur_end - (char *)ptr)) {
+			cur_ptr = ((char *)ptr) + new_size;
+			return ptr;
+		}
+		return nullptr;
+	}
+
+	if (new_size <= size)
+		return ptr;
+
+	return nullptr;
+}
+
+PEFF_ADVUTILS_API void ArenaAlloc::release(void *ptr, size_t size, size_t alignment) noexcept {
+}
+
+PEFF_ADVUTILS_API size_t ArenaAlloc::alloc_batch(size_t count, size_t size, size_t alignment, void **out) noexcept {
+	if (!count)
+		return 0;
+
+	if (!alignment)
+		alignment = 1;
+
+	const size_t stride = (size + alignment - 1) & ~(alignment - 1);
+
+	if (stride && (count > SIZE_MAX / stride))
+		return Alloc::alloc_batch(count, size, alignment, out);
+
+	char *ptr = (char *)alloc(stride * count, alignment);
+	if (!ptr)
+		return Alloc::alloc_batch(count, size, alignment, out);
+
+	for (size_t i = 0; i < count; ++i)
+		out[i] = ptr + stride * i;
+
+	// Only the last block can be grown in place.
+	last_alloc = (char *)out[count - 1];
+	cur_ptr = last_alloc + size;
+
+	return count;
+}
+
+PEFF_ADVUTILS_API void ArenaAlloc::release_batch(void *const *ptrs, size_t count, size_t size, size_t alignment) noexcept {
+}
+
+PEFF_ADVUTILS_API size_t ArenaAlloc::trim(size_t keep_bytes, PurgePolicy policy) noexcept {
+	size_t trimmed_size = 0;
+
+	// Only the unused part of the current block is free, the previous blocks are released by rewinding.
+	if (cur_block) {
+		if (const size_t free_size = (size_t)(cur_end - cur_ptr); free_size > keep_bytes)
+			trimmed_size = purge_pages(cur_ptr + keep_bytes, free_size - keep_bytes, policy);
+	}
+
+	return trimmed_size + upstream->trim(keep_bytes, policy);
+}
+
+PEFF_ADVUTILS_API void ArenaAlloc::rewind(const Marker &marker) noexcept {
+	while (cur_block != marker.block) {
+		assert(cur_block);
+
+		BlockHeader *prev = cur_block->prev;
+		_release_block(cur_block);
+		cur_block = prev;
+	}
+
+	if (cur_block) {
+		cur_ptr = marker.ptr;
+		cur_end = _get_block_end(cur_block);
+	} else {
+		cur_ptr = nullptr;
+		cur_end = nullptr;
+	}
+	last_alloc = nullptr;
+}
+
+PEFF_ADVUTILS_API void ArenaAlloc::reset() noexcept {
+	if (!cur_block)
+		return;
+
+	BlockHeader *first_block = cur_block;
+	while (first_block->prev)
+		first_block = first_block->prev;
+
+	rewind({ first_block, _get_block_data(first_block) });
+}
+
+PEFF_ADVUTILS_API AllocCaps ArenaAlloc::get_caps() const noexcept {
+	AllocCaps caps;
+
+	caps.is_monotonic = true;
+
+	return caps;
+}
+
+PEFF_ADVUTILS_API bool ArenaAlloc::is_replaceable(const Alloc *rhs) const noexcept {
+	if (rhs->type_identity() != type_identity()) {
+		return false;
+	}
+
+	return rhs == this;
+}
+
+PEFF_ADVUTILS_API UUID ArenaAlloc::type_identity() const noexcept {
+	return PEFF_UUID(789c2945, db7b, 4fc1, 8c13, e92ae5352f35);
+}
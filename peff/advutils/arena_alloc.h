@@ -0,0 +1,93 @@
+#ifndef _PEFF_ADVUTILS_ARENA_ALLOC_H_
+#define _PEFF_ADVUTILS_ARENA_ALLOC_H_
+
+#include "basedefs.h"
+#include <peff/base/alloc.h>
+
+namespace peff {
+	/// @brief Monotonic allocator which bump-allocates from chained blocks.
+	///
+	/// Releasing is a no-op, the memory is reclaimed all at once by reset()
+	/// or rewind(), the cost of which only depends on the number of blocks.
+	///
+	/// @note The allocator is not thread-safe.
+	class ArenaAlloc : public Alloc {
+	protected:
+		std::atomic_size_t _ref_count = 0;
+
+	public:
+		struct BlockHeader {
+			BlockHeader *prev;
+			/// @brief Total size of the block, including the header.
+			size_t size;
+		};
+
+		/// @brief Position of the arena, used for rewinding.
+		struct Marker {
+			BlockHeader *block = nullptr;
+			char *ptr = nullptr;
+		};
+
+		constexpr static size_t DEFAULT_BLOCK_SIZE = 65536;
+		constexpr static size_t BLOCK_ALIGNMENT = alignof(std::max_align_t);
+
+		peff::RcObjectPtr<peff::Alloc> upstream;
+		size_t block_size;
+		BlockHeader *cur_block = nullptr;
+		char *cur_ptr = nullptr, *cur_end = nullptr;
+		/// @brief The most recent allocation, which can be grown in place.
+		char *last_alloc = nullptr;
+
+		PEFF_ADVUTILS_API ArenaAlloc(peff::Alloc *upstream, size_t block_size = DEFAULT_BLOCK_SIZE);
+		PEFF_ADVUTILS_API ArenaAlloc(ArenaAlloc &&rhs) noexcept;
+		PEFF_ADVUTILS_API virtual ~ArenaAlloc();
+
+		PEFF_ADVUTILS_API ArenaAlloc &operator=(ArenaAlloc &&rhs) noexcept;
+
+		PEFF_ADVUTILS_API virtual size_t inc_ref(size_t global_ref_count) noexcept override;
+		PEFF_ADVUTILS_API virtual size_t dec_ref(size_t global_ref_count) noexcept override;
+		PEFF_ADVUTILS_API virtual void on_ref_zero() noexcept;
+
+		PEFF_ADVUTILS_API virtual void *alloc(size_t size, size_t alignment = 0) noexcept override;
+		PEFF_ADVUTILS_API virtual void *realloc(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override;
+		PEFF_ADVUTILS_API virtual void *realloc_in_place(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override;
+		PEFF_ADVUTILS_API virtual void release(void *ptr, size_t size, size_t alignment) noexcept override;
+		/// @brief Allocate the blocks as a contiguous run.
+		PEFF_ADVUTILS_API virtual size_t alloc_batch(size_t count, size_t size, size_t alignment, void **out) noexcept override;
+		PEFF_ADVUTILS_API virtual void release_batch(void *const *ptrs, size_t count, size_t size, size_t alignment) noexcept override;
+		/// @brief Purge the pages of the unused part of the current block.
+		PEFF_ADVUTILS_API virtual size_t trim(size_t keep_bytes, PurgePolicy policy = PurgePolicy::Lazy) noexcept override;
+
+		/// @brief The allocator is monotonic.
+		PEFF_ADVUTILS_API virtual AllocCaps get_caps() const noexcept override;
+
+		PEFF_ADVUTILS_API virtual bool is_replaceable(const Alloc *rhs) const noexcept override;
+
+		PEFF_ADVUTILS_API virtual UUID type_identity() const noexcept override;
+
+		/// @brief Get current position of the arena.
+		PEFF_FORCEINLINE Marker mark() const noexcept {
+			return { cur_block, cur_ptr };
+		}
+
+		/// @brief Roll the arena back to a marker, all allocations after the marker are invalidated.
+		/// @param marker Marker returned by mark().
+		PEFF_ADVUTILS_API void rewind(const Marker &marker) noexcept;
+
+		/// @brief Invalidate all allocations, the first block is retained for reusing.
+		PEFF_ADVUTILS_API void reset() noexcept;
+
+	protected:
+		PEFF_FORCEINLINE static char *_get_block_data(BlockHeader *block) noexcept {
+			return ((char *)block) + sizeof(BlockHeader);
+		}
+
+		PEFF_FORCEINLINE static char *_get_block_end(BlockHeader *block) noexcept {
+			return ((char *)block) + block->size;
+		}
+
+		PEFF_ADVUTILS_API void _release_block(BlockHeader *block) noexcept;
+	};
+}
+
+#endif
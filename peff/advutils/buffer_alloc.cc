@@ -1,22 +1,47 @@
 #include "buffer_alloc.h"
+#include "page_purge.h"
+#include <cstring>
 
 using namespace peff;
 
-PEFF_ADVUTILS_API BufferAlloc::BufferAlloc(char *buffer, size_t buffer_size) : buffer(buffer), buffer_size(buffer_size), alloc_descs(&g_void_alloc, AllocDescComparator()) {
+PEFF_ADVUTILS_API BufferAlloc::BufferAlloc(char *buffer, size_t buffer_size)
+	: buffer(buffer),
+	  buffer_size(buffer_size),
+	  alloc_descs(&g_void_alloc, AllocDescComparator()),
+	  free_extents_by_addr(&g_null_alloc, AllocDescComparator()),
+	  free_extents_by_size(&g_null_alloc, FreeExtentSizeKeyComparator()) {
+	_insert_free_extent(buffer, buffer + buffer_size);
 }
 
-PEFF_ADVUTILS_API BufferAlloc::BufferAlloc(BufferAlloc &&rhs) noexcept : buffer(rhs.buffer), buffer_size(rhs.buffer_size), alloc_descs(std::move(rhs.alloc_descs)) {
+PEFF_ADVUTILS_API BufferAlloc::BufferAlloc(BufferAlloc &&rhs) noexcept
+	: buffer(rhs.buffer),
+	  buffer_size(rhs.buffer_size),
+	  alloc_descs(std::move(rhs.alloc_descs)),
+	  free_extents_by_addr(std::move(rhs.free_extents_by_addr)),
+	  free_extents_by_size(std::move(rhs.free_extents_by_size)),
+	  relocation_callback(rhs.relocation_callback),
+	  relocation_user_data(rhs.relocation_user_data),
+	  compact_on_alloc_failure(rhs.compact_on_alloc_failure) {
 	rhs.buffer = nullptr;
 	rhs.buffer_size = 0;
+	rhs.relocation_callback = nullptr;
+	rhs.relocation_user_data = nullptr;
 }
 
 PEFF_ADVUTILS_API BufferAlloc &BufferAlloc::operator=(BufferAlloc &&rhs) noexcept {
 	buffer = rhs.buffer;
 	buffer_size = rhs.buffer_size;
 	alloc_descs = std::move(rhs.alloc_descs);
+	free_extents_by_addr = std::move(rhs.free_extents_by_addr);
+	free_extents_by_size = std::move(rhs.free_extents_by_size);
+	relocation_callback = rhs.relocation_callback;
+	relocation_user_data = rhs.relocation_user_data;
+	compact_on_alloc_failure = rhs.compact_on_alloc_failure;
 
 	rhs.buffer = nullptr;
 	rhs.buffer_size = 0;
+	rhs.relocation_callback = nullptr;
+	rhs.relocation_user_data = nullptr;
 
 	return *this;
 }
@@ -36,129 +61,118 @@ PEFF_ADVUTILS_API size_t BufferAlloc::inc_ref(size_t global_ref_count) noexcept
 PEFF_ADVUTILS_API void BufferAlloc::on_ref_zero() noexcept {
 }
 
-PEFF_ADVUTILS_API void *BufferAlloc::alloc(size_t size, size_t alignment) noexcept {
-	size_t off = 0, desc_off;
+PEFF_ADVUTILS_API void BufferAlloc::_insert_free_extent(char *base, char *end) noexcept {
+	FreeExtent *extent = _get_free_extent_by_base(base);
 
-	size_t actual_size = calc_alloc_size(size, alignment, &desc_off);
+	// Gaps that are too small to hold the descriptor are not indexed,
+	// they will be merged back when the neighbouring allocations are released.
+	if (((char *)extent) + sizeof(FreeExtent) > end)
+		return;
 
-	while (off + actual_size <= buffer_size) {
-		if (size_t aligned_diff = ((uintptr_t)(buffer + off)) % alignment; aligned_diff) {
-			off += alignment - aligned_diff;
-			continue;
-		}
+	peff::construct_at<FreeExtent>(extent, base, (size_t)(end - base));
+
+	[[maybe_unused]] bool result = free_extents_by_addr.insert(&extent->addr_node);
+	assert(result);
+	result = free_extents_by_size.insert(&extent->size_node);
+	assert(result);
+}
 
-		{
-			AllocDesc *bottom_desc = (AllocDesc *)alloc_descs.get_max_lteq(buffer + off);
+PEFF_ADVUTILS_API void BufferAlloc::_remove_free_extent(FreeExtent *extent) noexcept {
+	free_extents_by_addr.remove(&extent->addr_node, false);
+	free_extents_by_size.remove(&extent->size_node, false);
 
-			if (bottom_desc) {
-				size_t bottom_desc_off = (((char *)bottom_desc->desc_base) - buffer);
-				if (bottom_desc_off + sizeof(AllocDesc) > off) {
-					off = bottom_desc_off + sizeof(AllocDesc);
-					continue;
-				}
-			}
-		}
-		{
-			AllocDesc *top_desc = (AllocDesc *)alloc_descs.get_max_lteq(buffer + off + actual_size);
-
-			if (top_desc) {
-				size_t top_desc_off = (((char *)top_desc->desc_base) - buffer);
-				if (top_desc_off + sizeof(AllocDesc) > off) {
-					off = top_desc_off + sizeof(AllocDesc);
-					continue;
-				}
-			}
-		}
-		goto succeeded;
+	std::destroy_at<FreeExtent>(extent);
+}
+
+PEFF_ADVUTILS_API BufferAlloc::FreeExtent *BufferAlloc::_lookup_free_extent(char *base) noexcept {
+	if (!free_extents_by_addr.get((void *)base))
+		return nullptr;
+
+	return _get_free_extent_by_base(base);
+}
+
+PEFF_ADVUTILS_API BufferAlloc::FreeExtent *BufferAlloc::_find_free_extent(size_t size, size_t alignment) noexcept {
+	const size_t worst_case_size = size + sizeof(AllocDesc) + (alignof(AllocDesc) - 1) + (alignment - 1);
+
+	// The extents smaller than the worst case fit only if they are aligned well
+	// enough, try them from the smallest one.
+	auto node = free_extents_by_size.get_min_gteq(FreeExtentSizeKey{ size + sizeof(AllocDesc), nullptr });
+	for (; node && node->rb_value.size < worst_case_size; node = FreeExtentSizeTree::get_next_node(node, nullptr)) {
+		FreeExtent *extent = _get_free_extent_by_base(node->rb_value.base);
+
+		if (_calc_alloc_end(_align_ptr(extent->base(), alignment), size) <= extent->base() + extent->size())
+			return extent;
 	}
 
-	return nullptr;
+	// Any extent which is not smaller than the worst case is guaranteed to fit.
+	if (node)
+		return _get_free_extent_by_base(node->rb_value.base);
 
-succeeded:
-	char *ptr = buffer + off, *alloc_desc_raw_ptr = ptr + desc_off;
-	peff::construct_at<AllocDesc>((AllocDesc *)alloc_desc_raw_ptr, ptr);
+	return nullptr;
+}
 
-	AllocDesc *alloc_desc_ptr = (AllocDesc *)alloc_desc_raw_ptr;
+PEFF_ADVUTILS_API BufferAlloc::AllocDesc *BufferAlloc::_place_alloc_desc(char *ptr, size_t size, size_t alignment) noexcept {
+	AllocDesc *alloc_desc_ptr = (AllocDesc *)_align_ptr(ptr + size, alignof(AllocDesc));
+	peff::construct_at<AllocDesc>(alloc_desc_ptr, ptr);
 
 	alloc_desc_ptr->size = size;
 	alloc_desc_ptr->alignment = alignment;
 	alloc_desc_ptr->desc_base = alloc_desc_ptr;
 
-	assert(((uintptr_t)ptr + size) <= ((uintptr_t)alloc_desc_ptr));
-
-	bool result = alloc_descs.insert(alloc_desc_ptr);
+	[[maybe_unused]] bool result = alloc_descs.insert(alloc_desc_ptr);
 	assert(result);
 
-	return ptr;
+	return alloc_desc_ptr;
 }
 
-PEFF_ADVUTILS_API void *BufferAlloc::realloc(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept {
-	AllocDesc *old_desc = (AllocDesc *)alloc_descs.get(ptr);
-	assert(old_desc);
+PEFF_ADVUTILS_API void *BufferAlloc::_alloc(size_t size, size_t alignment) noexcept {
+	if (!alignment)
+		alignment = 1;
 
-	assert(size == old_desc->size);
-	assert(alignment == old_desc->alignment);
+	FreeExtent *extent = _find_free_extent(size, alignment);
+	if (!extent)
+		return nullptr;
 
-	size_t off = 0, desc_off;
+	char *const extent_base = extent->base(), *const extent_end = extent_base + extent->size();
+	_remove_free_extent(extent);
 
-	size_t actual_size = calc_alloc_size(new_size, new_alignment, &desc_off);
+	char *ptr = _align_ptr(extent_base, alignment);
+	char *const alloc_end = _calc_alloc_end(ptr, size);
+	assert(alloc_end <= extent_end);
 
-	alloc_descs.remove(old_desc, false);
+	_place_alloc_desc(ptr, size, alignment);
 
-	while (off + actual_size <= buffer_size) {
-		if (size_t aligned_diff = ((uintptr_t)(buffer + off)) % new_alignment; aligned_diff) {
-			off += new_alignment - aligned_diff;
-			continue;
-		}
+	_insert_free_extent(extent_base, ptr);
+	_insert_free_extent(alloc_end, extent_end);
 
-		{
-			AllocDesc *bottom_desc = (AllocDesc *)alloc_descs.get_max_lteq(buffer + off);
+	return ptr;
+}
 
-			if (bottom_desc) {
-				size_t bottom_desc_off = (((char *)bottom_desc->desc_base) - buffer);
-				if (bottom_desc_off + sizeof(AllocDesc) > off) {
-					off = bottom_desc_off + sizeof(AllocDesc);
-					continue;
-				}
-			}
-		}
-		{
-			AllocDesc *top_desc = (AllocDesc *)alloc_descs.get_max_lteq(buffer + off + actual_size);
-
-			if (top_desc) {
-				size_t top_desc_off = (((char *)top_desc->desc_base) - buffer);
-				if (top_desc_off + sizeof(AllocDesc) > off) {
-					off = top_desc_off + sizeof(AllocDesc);
-					continue;
-				}
-			}
-		}
-		goto succeeded;
-	}
+PEFF_ADVUTILS_API void *BufferAlloc::alloc(size_t size, size_t alignment) noexcept {
+	void *ptr;
 
-	{
-		bool restoration_result = alloc_descs.insert(old_desc);
-		assert(restoration_result);
-	}
+	if ((ptr = _alloc(size, alignment)))
+		return ptr;
 
-	return nullptr;
+	if (compact_on_alloc_failure && compact())
+		return _alloc(size, alignment);
 
-succeeded:
-	std::destroy_at<AllocDesc>(old_desc);
-	char *p = buffer + off, *alloc_desc_raw_ptr = p + desc_off;
+	return nullptr;
+}
 
-	memmove(p, ptr, size);
+PEFF_ADVUTILS_API void *BufferAlloc::realloc(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept {
+	void *p;
 
-	peff::construct_at<AllocDesc>((AllocDesc *)alloc_desc_raw_ptr, p);
+	if ((p = realloc_in_place(ptr, size, alignment, new_size, new_alignment)))
+		return p;
 
-	AllocDesc *alloc_desc_ptr = (AllocDesc *)alloc_desc_raw_ptr;
+	// The block being reallocated must not be moved by the compaction.
+	if (!(p = _alloc(new_size, new_alignment)))
+		return nullptr;
 
-	alloc_desc_ptr->size = new_size;
-	alloc_desc_ptr->alignment = new_alignment;
-	alloc_desc_ptr->desc_base = alloc_desc_ptr;
+	memcpy(p, ptr, size < new_size ? size : new_size);
 
-	bool result = alloc_descs.insert(alloc_desc_ptr);
-	assert(result);
+	release(ptr, size, alignment);
 
 	return p;
 }
@@ -168,41 +182,31 @@ PEFF_ADVUTILS_API void *BufferAlloc::realloc_in_place(void *ptr, size_t size, si
 	assert(old_desc);
 
 	assert(size == old_desc->size);
-	assert(alignment == old_desc->alignment);
-
-	size_t desc_off;
+	assert((alignment ? alignment : 1) == old_desc->alignment);
 
-	size_t actual_size = calc_alloc_size(new_size, new_alignment, &desc_off);
+	if (!new_alignment)
+		new_alignment = 1;
 
-	peff::ScopeGuard sg([this, old_desc]() noexcept {
-		bool restoration_result = alloc_descs.insert(old_desc);
-		assert(restoration_result);
-	});
-	alloc_descs.remove(old_desc, false);
-
-	if (new_alignment < alignment)
+	if (((uintptr_t)ptr) % new_alignment)
 		return nullptr;
 
-	{
-		AllocDesc *top_desc = (AllocDesc *)alloc_descs.get_max_lteq(((char *)ptr) + actual_size);
+	// The allocation can grow up to the next allocation or the end of the buffer.
+	AllocDesc *next_desc = (AllocDesc *)alloc_descs.get_next_node(old_desc, nullptr);
+	char *const limit = next_desc ? (char *)next_desc->rb_value : buffer + buffer_size;
 
-		if (top_desc) {
-			if ((char *)top_desc->desc_base >= ((char *)ptr) + actual_size)
-				return nullptr;
-		}
-	}
+	char *const new_alloc_end = _calc_alloc_end((char *)ptr, new_size);
+	if (new_alloc_end > limit)
+		return nullptr;
 
-	std::destroy_at<AllocDesc>((AllocDesc*)old_desc);
-	peff::construct_at<AllocDesc>((AllocDesc *)((char*)ptr) + desc_off, ptr);
+	if (FreeExtent *extent = _lookup_free_extent(_get_alloc_end(old_desc)); extent)
+		_remove_free_extent(extent);
 
-	AllocDesc *alloc_desc_ptr = (AllocDesc *)((char*)ptr) + desc_off;
+	alloc_descs.remove(old_desc, false);
+	std::destroy_at<AllocDesc>(old_desc);
 
-	alloc_desc_ptr->size = new_size;
-	alloc_desc_ptr->alignment = new_alignment;
-	alloc_desc_ptr->desc_base = alloc_desc_ptr;
+	_place_alloc_desc((char *)ptr, new_size, new_alignment);
 
-	bool result = alloc_descs.insert(alloc_desc_ptr);
-	assert(result);
+	_insert_free_extent(new_alloc_end, limit);
 
 	return ptr;
 }
@@ -216,10 +220,114 @@ PEFF_ADVUTILS_API void BufferAlloc::release(void *ptr, size_t size, size_t align
 
 	if (desc->size != size)
 		std::terminate();
-	if (desc->alignment != alignment)
+	if (desc->alignment != (alignment ? alignment : 1))
 		std::terminate();
 
+	// Coalesce the gaps around the allocation into a single free extent.
+	AllocDesc *prev_desc = (AllocDesc *)alloc_descs.get_prev_node(desc, nullptr),
+			  *next_desc = (AllocDesc *)alloc_descs.get_next_node(desc, nullptr);
+	char *const lower = prev_desc ? _get_alloc_end(prev_desc) : buffer,
+				*const upper = next_desc ? (char *)next_desc->rb_value : buffer + buffer_size;
+
+	if (FreeExtent *extent = _lookup_free_extent(lower); extent)
+		_remove_free_extent(extent);
+	if (FreeExtent *extent = _lookup_free_extent(_get_alloc_end(desc)); extent)
+		_remove_free_extent(extent);
+
 	alloc_descs.remove(desc, false);
+	std::destroy_at<AllocDesc>(desc);
+
+	_insert_free_extent(lower, upper);
+}
+
+PEFF_ADVUTILS_API size_t BufferAlloc::trim(size_t keep_bytes, PurgePolicy policy) noexcept {
+	size_t free_size = 0, trimmed_size = 0;
+
+	for (auto node = free_extents_by_size.begin_reversed().node; node; node = FreeExtentSizeTree::get_prev_node(node, nullptr))
+		free_size += node->rb_value.size;
+
+	// Purge the largest extents first, the descriptors at the beginning of the extents are kept.
+	for (auto node = free_extents_by_size.begin_reversed().node; node && (free_size > keep_bytes); node = FreeExtentSizeTree::get_prev_node(node, nullptr)) {
+		FreeExtent *extent = _get_free_extent_by_base(node->rb_value.base);
+		char *const extent_end = extent->base() + extent->size();
+
+		// Purge the tail of the extent if only a part of it exceeds the retained size.
+		char *purge_begin = ((char *)extent) + sizeof(FreeExtent);
+		if (const size_t excess_size = free_size - keep_bytes; excess_size < (size_t)(extent_end - purge_begin))
+			purge_begin = extent_end - excess_size;
+
+		trimmed_size += purge_pages(purge_begin, (size_t)(extent_end - purge_begin), policy);
+		free_size -= extent->size();
+	}
+
+	return trimmed_size;
+}
+
+PEFF_ADVUTILS_API void BufferAlloc::set_relocation_callback(RelocationCallback callback, void *user_data) noexcept {
+	relocation_callback = callback;
+	relocation_user_data = user_data;
+}
+
+PEFF_ADVUTILS_API size_t BufferAlloc::compact() noexcept {
+	if (!relocation_callback)
+		return 0;
+
+	// The free extents are stored in the free space which is going to be overwritten, they are rebuilt after the blocks are moved.
+	while (auto node = free_extents_by_addr.begin().node)
+		_remove_free_extent(_get_free_extent_by_base((char *)node->rb_value));
+
+	size_t num_moved = 0;
+	char *cursor = buffer;
+
+	for (AllocDesc *desc = (AllocDesc *)alloc_descs.begin().node, *next_desc; desc; desc = next_desc) {
+		next_desc = (AllocDesc *)alloc_descs.get_next_node(desc, nullptr);
+
+		char *const ptr = (char *)desc->rb_value;
+		const size_t size = desc->size, alignment = desc->alignment;
+		char *const new_ptr = _align_ptr(cursor, alignment);
+
+		// The block only moves down and stays after the previous one, so the order of the descriptors is kept.
+		if ((new_ptr < ptr) && relocation_callback(relocation_user_data, ptr, new_ptr, size)) {
+			alloc_descs.remove(desc, false);
+			std::destroy_at<AllocDesc>(desc);
+
+			memmove(new_ptr, ptr, size);
+
+			desc = _place_alloc_desc(new_ptr, size, alignment);
+			++num_moved;
+		}
+
+		cursor = _get_alloc_end(desc);
+	}
+
+	char *lower = buffer;
+	for (AllocDesc *desc = (AllocDesc *)alloc_descs.begin().node; desc; desc = (AllocDesc *)alloc_descs.get_next_node(desc, nullptr)) {
+		_insert_free_extent(lower, (char *)desc->rb_value);
+		lower = _get_alloc_end(desc);
+	}
+	_insert_free_extent(lower, buffer + buffer_size);
+
+	return num_moved;
+}
+
+PEFF_ADVUTILS_API BufferAlloc::FragmentationStats BufferAlloc::get_fragmentation_stats() noexcept {
+	FragmentationStats stats;
+
+	for (auto node = free_extents_by_size.begin().node; node; node = FreeExtentSizeTree::get_next_node(node, nullptr)) {
+		stats.free_size += node->rb_value.size;
+		++stats.num_free_extents;
+	}
+
+	if (auto node = free_extents_by_size.begin_reversed().node; node)
+		stats.largest_free_extent_size = node->rb_value.size;
+
+	stats.num_allocs = alloc_descs.size();
+	stats.used_size = buffer_size - stats.free_size;
+
+	if (stats.free_size)
+		stats.fragmentation = 1.0 - (double)stats.largest_free_extent_size / (double)stats.free_size;
+
+	return stats;
 }
 
 PEFF_ADVUTILS_API bool BufferAlloc::is_replaceable(const Alloc *rhs) const noexcept {
@@ -309,9 +417,7 @@ PEFF_ADVUTILS_API void *UpstreamedBufferAlloc::realloc(void *ptr, size_t size, s
 		size_t new_off_marker = _calc_marker_pos(new_size, alignof(size_t));
 
 		if ((p = buffer_alloc->realloc(ptr, size + off_marker + sizeof(uintptr_t), alignment, new_size + new_off_marker + sizeof(uintptr_t), new_alignment))) {
-			memmove(p, ptr, size);
-			;
-
+			// The buffer allocator has moved the data and may have reused the old space.
 			Alloc **new_marker_ptr = (Alloc **)(((char *)p) + new_off_marker);
 
 			*new_marker_ptr = buffer_alloc.get();
@@ -319,13 +425,13 @@ PEFF_ADVUTILS_API void *UpstreamedBufferAlloc::realloc(void *ptr, size_t size, s
 		}
 	}
 
-	if (!(p = upstream->alloc(new_size + off_marker + sizeof(uintptr_t), new_alignment))) {
+	size_t new_off_marker = _calc_marker_pos(new_size, alignof(size_t));
+
+	if (!(p = upstream->alloc(new_size + new_off_marker + sizeof(uintptr_t), new_alignment))) {
 		return nullptr;
 	}
 
-	memmove(p, ptr, size);
-
-	size_t new_off_marker = _calc_marker_pos(new_size, alignof(size_t));
+	memmove(p, ptr, size < new_size ? size : new_size);
 	{
 		Alloc **new_marker_ptr = (Alloc **)(((char *)p) + new_off_marker);
 
@@ -342,38 +448,16 @@ PEFF_ADVUTILS_API void *UpstreamedBufferAlloc::realloc_in_place(void *ptr, size_
 	Alloc **marker_ptr = ((Alloc **)((char *)ptr + off_marker));
 	Alloc *marker = *marker_ptr;
 
-	void *p;
-
-	if (marker == buffer_alloc.get()) {
-		size_t new_off_marker = _calc_marker_pos(new_size, alignof(size_t));
-
-		if ((p = buffer_alloc->realloc_in_place(ptr, size + off_marker + sizeof(uintptr_t), alignment, new_size + new_off_marker + sizeof(uintptr_t), new_alignment))) {
-			memmove(p, ptr, size);
-			;
-
-			Alloc **new_marker_ptr = (Alloc **)(((char *)p) + new_off_marker);
-
-			*new_marker_ptr = buffer_alloc.get();
-			return p;
-		}
-	}
-
-	if (!(p = upstream->alloc(new_size + off_marker + sizeof(uintptr_t), new_alignment))) {
-		return nullptr;
-	}
-
-	memmove(p, ptr, size);
-
 	size_t new_off_marker = _calc_marker_pos(new_size, alignof(size_t));
-	{
-		Alloc **new_marker_ptr = (Alloc **)(((char *)p) + new_off_marker);
 
-		*new_marker_ptr = upstream.get();
-	}
+	// The block must not move, the callers rely on the elements staying where they are.
+	if (!marker->realloc_in_place(ptr, size + off_marker + sizeof(uintptr_t), alignment, new_size + new_off_marker + sizeof(uintptr_t), new_alignment))
+		return nullptr;
 
-	marker->release(ptr, size + off_marker + sizeof(uintptr_t), alignment);
+	Alloc **new_marker_ptr = (Alloc **)(((char *)ptr) + new_off_marker);
 
-	return p;
+	*new_marker_ptr = marker;
+	return ptr;
 }
 
 PEFF_ADVUTILS_API void UpstreamedBufferAlloc::release(void *ptr, size_t size, size_t alignment) noexcept {
@@ -384,6 +468,10 @@ PEFF_ADVUTILS_API void UpstreamedBufferAlloc::release(void *ptr, size_t size, si
 	marker->release(ptr, size + off_marker + sizeof(uintptr_t), alignment);
 }
 
+PEFF_ADVUTILS_API size_t UpstreamedBufferAlloc::trim(size_t keep_bytes, PurgePolicy policy) noexcept {
+	return buffer_alloc->trim(keep_bytes, policy) + upstream->trim(keep_bytes, policy);
+}
+
 PEFF_ADVUTILS_API bool UpstreamedBufferAlloc::is_replaceable(const Alloc *rhs) const noexcept {
 	if (rhs->type_identity() != type_identity()) {
 		return false;
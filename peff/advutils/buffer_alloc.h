@@ -6,6 +6,11 @@
 #include <peff/containers/rbtree.h>
 
 namespace peff {
+	/// @brief Allocator which allocates from a fixed buffer.
+	///
+	/// Allocations are tracked by the descriptors trailing them, free space
+	/// is indexed by size so allocating does not scan the buffer linearly,
+	/// adjacent free space is coalesced on release.
 	class BufferAlloc : public Alloc {
 	protected:
 		std::atomic_size_t _ref_count = 0;
@@ -31,9 +36,79 @@ namespace peff {
 			PEFF_FORCEINLINE AllocDesc(void *ptr) : Node(std::move(ptr)) {}
 		};
 
+		using FreeExtentAddrTree = RBTree<void *, AllocDescComparator, true>;
+
+		struct FreeExtentSizeKey {
+			size_t size;
+			char *base;
+		};
+
+		struct FreeExtentSizeKeyComparator {
+			PEFF_FORCEINLINE int operator()(const FreeExtentSizeKey &lhs, const FreeExtentSizeKey &rhs) const {
+				if (lhs.size < rhs.size)
+					return -1;
+				if (lhs.size > rhs.size)
+					return 1;
+				if (lhs.base < rhs.base)
+					return -1;
+				if (lhs.base > rhs.base)
+					return 1;
+				return 0;
+			}
+		};
+
+		using FreeExtentSizeTree = RBTree<FreeExtentSizeKey, FreeExtentSizeKeyComparator, true>;
+
+		/// @brief Descriptor of a free extent, which is stored inside the free extent itself.
+		///
+		/// Every maximal gap between the allocations which is large enough to
+		/// hold the descriptor has exactly one free extent, indexed by both
+		/// its base address (for coalescing) and its size (for best-fit lookups).
+		struct FreeExtent {
+			FreeExtentAddrTree::Node addr_node;
+			FreeExtentSizeTree::Node size_node;
+
+			PEFF_FORCEINLINE FreeExtent(char *base, size_t size) : addr_node((void *)base), size_node(FreeExtentSizeKey{ size, base }) {}
+
+			PEFF_FORCEINLINE char *base() const noexcept {
+				return size_node.rb_value.base;
+			}
+
+			PEFF_FORCEINLINE size_t size() const noexcept {
+				return size_node.rb_value.size;
+			}
+		};
+
+		/// @brief Callback which is called by compact() before a block is moved.
+		/// @param user_data User data which was registered with the callback.
+		/// @param old_ptr Current address of the block.
+		/// @param new_ptr Address which the block is to be moved to, the data is moved after the callback returns.
+		/// @param size Size of the block.
+		/// @return Whether the block can be moved, the block is kept where it is if false.
+		/// @note The callback must not call the allocator.
+		using RelocationCallback = bool (*)(void *user_data, void *old_ptr, void *new_ptr, size_t size) noexcept;
+
+		struct FragmentationStats {
+			/// @brief Space taken by the allocations, including the allocation descriptors and the alignment paddings.
+			size_t used_size = 0;
+			/// @brief Total size of the free extents, gaps which are too small to be indexed are not counted.
+			size_t free_size = 0;
+			size_t largest_free_extent_size = 0;
+			size_t num_allocs = 0;
+			size_t num_free_extents = 0;
+			/// @brief 1 - largest_free_extent_size / free_size, 0 means all free space is contiguous.
+			double fragmentation = 0;
+		};
+
 		char *buffer;
 		size_t buffer_size;
 		RBTree<void *, AllocDescComparator, true> alloc_descs;
+		FreeExtentAddrTree free_extents_by_addr;
+		FreeExtentSizeTree free_extents_by_size;
+		RelocationCallback relocation_callback = nullptr;
+		void *relocation_user_data = nullptr;
+		/// @brief Whether to compact the buffer and retry when an allocation fails, takes effect only if there is a relocation callback.
+		bool compact_on_alloc_failure = false;
 
 		PEFF_ADVUTILS_API BufferAlloc(char *buffer, size_t buffer_size);
 		PEFF_ADVUTILS_API BufferAlloc(BufferAlloc &&rhs) noexcept;
@@ -48,11 +123,33 @@ namespace peff {
 		PEFF_ADVUTILS_API virtual void *realloc(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override;
 		PEFF_ADVUTILS_API virtual void *realloc_in_place(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override;
 		PEFF_ADVUTILS_API virtual void release(void *ptr, size_t size, size_t alignment) noexcept override;
+		/// @brief Purge the pages of the free extents, the largest extents first.
+		PEFF_ADVUTILS_API virtual size_t trim(size_t keep_bytes, PurgePolicy policy = PurgePolicy::Lazy) noexcept override;
 
 		PEFF_ADVUTILS_API virtual bool is_replaceable(const Alloc *rhs) const noexcept override;
 
 		PEFF_ADVUTILS_API virtual UUID type_identity() const noexcept override;
 
+		/// @brief Register the callback which decides whether the blocks can be moved by compact() and updates their owners.
+		/// @param callback Callback to be registered, nullptr to disable the compaction.
+		PEFF_ADVUTILS_API void set_relocation_callback(RelocationCallback callback, void *user_data) noexcept;
+		/// @brief Slide the live blocks towards the beginning of the buffer to merge the free space.
+		///
+		/// The blocks are visited by address and each of them is moved to
+		/// the lowest suitably aligned address after the previous one if the
+		/// relocation callback agrees, blocks which are refused are pinned
+		/// and the following blocks slide up to them.
+		///
+		/// @return Number of the moved blocks.
+		/// @note The data is moved bitwise, nothing happens if there is no relocation callback.
+		PEFF_ADVUTILS_API size_t compact() noexcept;
+		PEFF_ADVUTILS_API FragmentationStats get_fragmentation_stats() noexcept;
+
+		/// @brief Calculate the upper bound of the space which an allocation takes in the buffer.
+		/// @param size Size of the allocation.
+		/// @param alignment Alignment of the allocation.
+		/// @param desc_off_out Where to store the offset of the allocation descriptor.
+		/// @return Space the allocation takes, including the allocation descriptor.
 		PEFF_FORCEINLINE constexpr static size_t calc_alloc_size(size_t size, size_t alignment, size_t *desc_off_out = nullptr) noexcept {
 			size_t user_data_size = size;
 
@@ -70,6 +167,33 @@ namespace peff {
 
 			return desc_off + sizeof(AllocDesc);
 		}
+	protected:
+		PEFF_FORCEINLINE static char *_align_ptr(char *ptr, size_t alignment) noexcept {
+			if (size_t aligned_diff = ((uintptr_t)ptr) % alignment; aligned_diff)
+				return ptr + (alignment - aligned_diff);
+			return ptr;
+		}
+
+		PEFF_FORCEINLINE static char *_get_alloc_end(const AllocDesc *desc) noexcept {
+			return ((char *)desc->desc_base) + sizeof(AllocDesc);
+		}
+
+		PEFF_FORCEINLINE static FreeExtent *_get_free_extent_by_base(char *base) noexcept {
+			return (FreeExtent *)_align_ptr(base, alignof(FreeExtent));
+		}
+
+		/// @brief Calculate the end of an allocation with the allocation descriptor if it is placed at the specified address.
+		PEFF_FORCEINLINE static char *_calc_alloc_end(char *ptr, size_t size) noexcept {
+			return _align_ptr(ptr + size, alignof(AllocDesc)) + sizeof(AllocDesc);
+		}
+
+		/// @brief Allocate without compacting the buffer on failure.
+		PEFF_ADVUTILS_API void *_alloc(size_t size, size_t alignment) noexcept;
+		PEFF_ADVUTILS_API void _insert_free_extent(char *base, char *end) noexcept;
+		PEFF_ADVUTILS_API void _remove_free_extent(FreeExtent *extent) noexcept;
+		PEFF_ADVUTILS_API FreeExtent *_lookup_free_extent(char *base) noexcept;
+		PEFF_ADVUTILS_API FreeExtent *_find_free_extent(size_t size, size_t alignment) noexcept;
+		PEFF_ADVUTILS_API AllocDesc *_place_alloc_desc(char *ptr, size_t size, size_t alignment) noexcept;
 	};
 
 	class UpstreamedBufferAlloc : public Alloc {
@@ -93,6 +217,7 @@ namespace peff {
 		PEFF_ADVUTILS_API virtual void *realloc(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override;
 		PEFF_ADVUTILS_API virtual void *realloc_in_place(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override;
 		PEFF_ADVUTILS_API virtual void release(void *ptr, size_t size, size_t alignment) noexcept override;
+		PEFF_ADVUTILS_API virtual size_t trim(size_t keep_bytes, PurgePolicy policy = PurgePolicy::Lazy) noexcept override;
 
 		PEFF_ADVUTILS_API virtual bool is_replaceable(const Alloc *rhs) const noexcept override;
 
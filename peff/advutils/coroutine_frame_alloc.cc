@@ -0,0 +1,169 @@
+#include "coroutine_frame_alloc.h"
+#include "size_class.h"
+#include <cstring>
+
+using namespace peff;
+
+static thread_local char t_thread_tag;
+
+PEFF_ADVUTILS_API CoroutineFrameAlloc::CoroutineFrameAlloc(peff::Alloc *upstream, size_t max_cached_frames) : upstream(upstream), max_cached_frames(max_cached_frames), owner_thread_tag(get_current_thread_tag()) {
+}
+
+PEFF_ADVUTILS_API CoroutineFrameAlloc::~CoroutineFrameAlloc() {
+	flush();
+}
+
+PEFF_ADVUTILS_API size_t CoroutineFrameAlloc::dec_ref(size_t global_ref_count) noexcept {
+	if (!--_ref_count) {
+		on_ref_zero();
+		return 0;
+	}
+	return _ref_count;
+}
+
+PEFF_ADVUTILS_API size_t CoroutineFrameAlloc::inc_ref(size_t global_ref_count) noexcept {
+	return ++_ref_count;
+}
+
+PEFF_ADVUTILS_API void CoroutineFrameAlloc::on_ref_zero() noexcept {
+}
+
+PEFF_ADVUTILS_API const void *CoroutineFrameAlloc::get_current_thread_tag() noexcept {
+	// Addresses of the thread-local variables are unique among the running threads.
+	return &t_thread_tag;
+}
+
+PEFF_ADVUTILS_API void CoroutineFrameAlloc::flush() noexcept {
+	for (size_t i = 0; i < NUM_FRAME_LISTS; ++i) {
+		FrameList &list = frame_lists[i];
+
+		while (list.frames) {
+			void *frame = list.frames;
+			list.frames = read_free_slot_link(frame);
+
+			upstream->release(frame, get_frame_size(i), FRAME_ALIGNMENT);
+		}
+
+		list.num_frames = 0;
+	}
+}
+
+PEFF_ADVUTILS_API void *CoroutineFrameAlloc::alloc(size_t size, size_t alignment) noexcept {
+	const size_t index = get_frame_list_index(size, alignment);
+
+	if (index == SIZE_MAX)
+		return upstream->alloc(size, alignment);
+
+	if (is_owner_thread()) {
+		FrameList &list = frame_lists[index];
+
+		if (list.frames) {
+			void *frame = list.frames;
+			list.frames = read_free_slot_link(frame);
+			--list.num_frames;
+
+			return frame;
+		}
+	}
+
+	// Allocate the frame in the same way as the cached ones, so it can be cached on release.
+	return upstream->alloc(get_frame_size(index), FRAME_ALIGNMENT);
+}
+
+PEFF_ADVUTILS_API void *CoroutineFrameAlloc::realloc(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept {
+	void *p;
+
+	if ((p = realloc_in_place(ptr, size, alignment, new_size, new_alignment)))
+		return p;
+
+	if ((get_frame_list_index(size, alignment) == SIZE_MAX) && (get_frame_list_index(new_size, new_alignment) == SIZE_MAX))
+		return upstream->realloc(ptr, size, alignment, new_size, new_alignment);
+
+	if (!(p = alloc(new_size, new_alignment)))
+		return nullptr;
+
+	memcpy(p, ptr, size < new_size ? size : new_size);
+
+	release(ptr, size, alignment);
+
+	return p;
+}
+
+PEFF_ADVUTILS_API void *CoroutineFrameAlloc::realloc_in_place(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept {
+	const size_t index = get_frame_list_index(size, alignment),
+				 new_index = get_frame_list_index(new_size, new_alignment);
+
+	if (index == SIZE_MAX) {
+		if (new_index == SIZE_MAX)
+			return upstream->realloc_in_place(ptr, size, alignment, new_size, new_alignment);
+		return nullptr;
+	}
+
+	if (index == new_index)
+		return ptr;
+
+	return nullptr;
+}
+
+PEFF_ADVUTILS_API void CoroutineFrameAlloc::release(void *ptr, size_t size, size_t alignment) noexcept {
+	const size_t index = get_frame_list_index(size, alignment);
+
+	if (index == SIZE_MAX) {
+		upstream->release(ptr, size, alignment);
+		return;
+	}
+
+	if (is_owner_thread()) {
+		FrameList &list = frame_lists[index];
+
+		if (list.num_frames < max_cached_frames) {
+			write_free_slot_link(ptr, list.frames);
+			list.frames = ptr;
+			++list.num_frames;
+
+			return;
+		}
+	}
+
+	upstream->release(ptr, get_frame_size(index), FRAME_ALIGNMENT);
+}
+
+PEFF_ADVUTILS_API size_t CoroutineFrameAlloc::trim(size_t keep_bytes, PurgePolicy policy) noexcept {
+	size_t trimmed_size = 0;
+
+	if (is_owner_thread()) {
+		size_t cached_size = 0;
+		for (size_t i = 0; i < NUM_FRAME_LISTS; ++i)
+			cached_size += frame_lists[i].num_frames * get_frame_size(i);
+
+		for (size_t i = NUM_FRAME_LISTS; i && (cached_size > keep_bytes); --i) {
+			FrameList &list = frame_lists[i - 1];
+			const size_t frame_size = get_frame_size(i - 1);
+
+			while (list.frames && (cached_size > keep_bytes)) {
+				void *frame = list.frames;
+				list.frames = read_free_slot_link(frame);
+				--list.num_frames;
+
+				upstream->release(frame, frame_size, FRAME_ALIGNMENT);
+
+				cached_size -= frame_size;
+				trimmed_size += frame_size;
+			}
+		}
+	}
+
+	return trimmed_size + upstream->trim(keep_bytes, policy);
+}
+
+PEFF_ADVUTILS_API bool CoroutineFrameAlloc::is_replaceable(const Alloc *rhs) const noexcept {
+	if (rhs->type_identity() != type_identity()) {
+		return false;
+	}
+
+	return upstream->is_replaceable(((const CoroutineFrameAlloc *)rhs)->upstream.get());
+}
+
+PEFF_ADVUTILS_API UUID CoroutineFrameAlloc::type_identity() const noexcept {
+	return PEFF_UUID(50140679, b8fd, 4ed7, b58d, 580556849d16);
+}
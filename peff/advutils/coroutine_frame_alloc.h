@@ -0,0 +1,136 @@
+#ifndef _PEFF_ADVUTILS_COROUTINE_FRAME_ALLOC_H_
+#define _PEFF_ADVUTILS_COROUTINE_FRAME_ALLOC_H_
+
+#include "basedefs.h"
+#include <peff/base/alloc.h>
+
+namespace peff {
+	/// @brief Allocator which recycles coroutine frames.
+	///
+	/// Frames of the same coroutine always have the same size, so freed
+	/// frames are kept in LIFO lists by size and handed out again without
+	/// touching the upstream allocator. The lists are only used by the
+	/// thread which created the allocator, other threads allocate from and
+	/// release to the upstream allocator directly, which must be thread-safe
+	/// if the frames are used by multiple threads.
+	///
+	/// @note The allocator must be destructed by the thread which created it.
+	class CoroutineFrameAlloc : public Alloc {
+	protected:
+		std::atomic_size_t _ref_count = 0;
+
+	public:
+		struct FrameList {
+			void *frames = nullptr;
+			size_t num_frames = 0;
+		};
+
+		/// @brief Granularity of the sizes of the frame lists.
+		constexpr static size_t FRAME_SIZE_GRANULARITY = 16;
+		/// @brief Larger frames are not recycled.
+		constexpr static size_t MAX_CACHED_FRAME_SIZE = 4096;
+		constexpr static size_t NUM_FRAME_LISTS = MAX_CACHED_FRAME_SIZE / FRAME_SIZE_GRANULARITY;
+		constexpr static size_t DEFAULT_MAX_CACHED_FRAMES = 64;
+		/// @brief Frames are always allocated with this alignment, requests with larger alignments are not recycled.
+		constexpr static size_t FRAME_ALIGNMENT = alignof(std::max_align_t);
+
+		peff::RcObjectPtr<peff::Alloc> upstream;
+		/// @brief Maximum number of the cached frames of each size.
+		size_t max_cached_frames;
+		/// @brief Identifies the thread which created the allocator.
+		const void *owner_thread_tag;
+		FrameList frame_lists[NUM_FRAME_LISTS];
+
+		PEFF_ADVUTILS_API CoroutineFrameAlloc(peff::Alloc *upstream, size_t max_cached_frames = DEFAULT_MAX_CACHED_FRAMES);
+		CoroutineFrameAlloc(const CoroutineFrameAlloc &) = delete;
+		PEFF_ADVUTILS_API virtual ~CoroutineFrameAlloc();
+
+		CoroutineFrameAlloc &operator=(const CoroutineFrameAlloc &) = delete;
+
+		PEFF_ADVUTILS_API virtual size_t inc_ref(size_t global_ref_count) noexcept override;
+		PEFF_ADVUTILS_API virtual size_t dec_ref(size_t global_ref_count) noexcept override;
+		PEFF_ADVUTILS_API virtual void on_ref_zero() noexcept;
+
+		PEFF_ADVUTILS_API virtual void *alloc(size_t size, size_t alignment = 0) noexcept override;
+		PEFF_ADVUTILS_API virtual void *realloc(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override;
+		PEFF_ADVUTILS_API virtual void *realloc_in_place(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override;
+		PEFF_ADVUTILS_API virtual void release(void *ptr, size_t size, size_t alignment) noexcept override;
+		/// @brief Release the cached frames down to `keep_bytes`, only if called by the thread which created the allocator.
+		PEFF_ADVUTILS_API virtual size_t trim(size_t keep_bytes, PurgePolicy policy = PurgePolicy::Lazy) noexcept override;
+
+		PEFF_ADVUTILS_API virtual bool is_replaceable(const Alloc *rhs) const noexcept override;
+
+		PEFF_ADVUTILS_API virtual UUID type_identity() const noexcept override;
+
+		/// @brief Release all cached frames to the upstream allocator.
+		/// @note Must be called by the thread which created the allocator.
+		PEFF_ADVUTILS_API void flush() noexcept;
+
+		PEFF_ADVUTILS_API static const void *get_current_thread_tag() noexcept;
+
+		PEFF_FORCEINLINE bool is_owner_thread() const noexcept {
+			return owner_thread_tag == get_current_thread_tag();
+		}
+
+		/// @brief Get index of the frame list for a request.
+		/// @return Index of the frame list, SIZE_MAX if the request is not recycled.
+		PEFF_FORCEINLINE static size_t get_frame_list_index(size_t size, size_t alignment) noexcept {
+			if ((!size) || (size > MAX_CACHED_FRAME_SIZE) || (alignment > FRAME_ALIGNMENT))
+				return SIZE_MAX;
+
+			return (size - 1) / FRAME_SIZE_GRANULARITY;
+		}
+
+		PEFF_FORCEINLINE constexpr static size_t get_frame_size(size_t index) noexcept {
+			return (index + 1) * FRAME_SIZE_GRANULARITY;
+		}
+	};
+
+	/// @brief Mixin for the coroutine promise types, which allocates the coroutine frames with peff allocators.
+	///
+	/// The frame is allocated with the allocator passed as the first
+	/// parameter of the coroutine, or the default allocator if the first
+	/// parameter is not an allocator. The allocator is held by the frame
+	/// until the frame is destroyed.
+	///
+	/// @note The allocation functions return nullptr on failure, so the promise type must provide get_return_object_on_allocation_failure().
+	struct CoroutineFramePromiseMixin {
+		PEFF_FORCEINLINE static size_t calc_allocator_offset(size_t size) noexcept {
+			return (size + alignof(peff::RcObjectPtr<peff::Alloc>) - 1) & ~(alignof(peff::RcObjectPtr<peff::Alloc>) - 1);
+		}
+
+		PEFF_FORCEINLINE static size_t calc_frame_size(size_t size) noexcept {
+			return calc_allocator_offset(size) + sizeof(peff::RcObjectPtr<peff::Alloc>);
+		}
+
+		PEFF_FORCEINLINE static void *alloc_frame(size_t size, peff::Alloc *allocator) noexcept {
+			char *p = (char *)allocator->alloc(calc_frame_size(size), CoroutineFrameAlloc::FRAME_ALIGNMENT);
+			if (!p)
+				return nullptr;
+
+			peff::construct_at<peff::RcObjectPtr<peff::Alloc>>((peff::RcObjectPtr<peff::Alloc> *)(p + calc_allocator_offset(size)), allocator);
+
+			return p;
+		}
+
+		template <typename... Args>
+		PEFF_FORCEINLINE static void *operator new(size_t size, peff::Alloc *allocator, Args &&...) noexcept {
+			return alloc_frame(size, allocator);
+		}
+
+		PEFF_FORCEINLINE static void *operator new(size_t size) noexcept {
+			return alloc_frame(size, peff::default_allocator());
+		}
+
+		PEFF_FORCEINLINE static void operator delete(void *ptr, size_t size) noexcept {
+			peff::RcObjectPtr<peff::Alloc> *allocator_slot = (peff::RcObjectPtr<peff::Alloc> *)(((char *)ptr) + calc_allocator_offset(size));
+			peff::RcObjectPtr<peff::Alloc> allocator = std::move(*allocator_slot);
+
+			std::destroy_at<peff::RcObjectPtr<peff::Alloc>>(allocator_slot);
+
+			allocator->release(ptr, calc_frame_size(size), CoroutineFrameAlloc::FRAME_ALIGNMENT);
+		}
+	};
+}
+
+#endif
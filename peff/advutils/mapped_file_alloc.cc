@@ -0,0 +1,375 @@
+#include "mapped_file_alloc.h"
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace peff;
+
+static_assert(MappedFileAlloc::get_alloc_offset() + sizeof(MappedFileAlloc) <= MappedFileAlloc::PAGE_SIZE, "The metadata must fit into the first page");
+
+PEFF_ADVUTILS_API MappedFileAlloc::MappedFileAlloc(FileHeader *header, int fd) : header(header), fd(fd) {
+}
+
+PEFF_ADVUTILS_API MappedFileAlloc::~MappedFileAlloc() {
+}
+
+/// @brief Reserve an address range without committing any memory.
+static char *_reserve_address_range(void *address, size_t size) noexcept {
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+#if defined(MAP_FIXED_NOREPLACE)
+	if (address)
+		flags |= MAP_FIXED_NOREPLACE;
+#endif
+
+	void *ptr = mmap(address, size, PROT_NONE, flags, -1, 0);
+	if (ptr == MAP_FAILED)
+		return nullptr;
+
+	// Without MAP_FIXED_NOREPLACE the address is only a hint.
+	if (address && (ptr != address)) {
+		munmap(ptr, size);
+		return nullptr;
+	}
+
+	return (char *)ptr;
+}
+
+PEFF_ADVUTILS_API MappedFileAlloc *MappedFileAlloc::open(const char *path, size_t max_size, void *base_address) noexcept {
+	int fd = ::open(path, O_RDWR | O_CREAT, 0644);
+	if (fd < 0)
+		return nullptr;
+
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) < 0) {
+		::close(fd);
+		return nullptr;
+	}
+
+	const bool is_new = !file_stat.st_size;
+	FileHeader h;
+
+	if (is_new) {
+		max_size = calc_run_size(max_size);
+		if (max_size < PAGE_SIZE * 2) {
+			::close(fd);
+			return nullptr;
+		}
+
+		memset(&h, 0, sizeof(h));
+		h.max_size = max_size;
+		h.file_size = max_size < MIN_GROWTH_SIZE ? max_size : MIN_GROWTH_SIZE;
+		h.bump_offset = PAGE_SIZE;
+	} else {
+		if ((pread(fd, &h, sizeof(h), 0) != sizeof(h)) ||
+			(h.magic != FILE_MAGIC) ||
+			(h.version != FILE_VERSION) ||
+			(h.header_size != sizeof(FileHeader)) ||
+			(h.file_size > (size_t)file_stat.st_size)) {
+			::close(fd);
+			return nullptr;
+		}
+
+		// The objects in the file refer to each other by their addresses.
+		base_address = h.base;
+	}
+
+	char *base = _reserve_address_range(base_address, h.max_size);
+	if (!base) {
+		::close(fd);
+		return nullptr;
+	}
+
+	if ((is_new && (ftruncate(fd, h.file_size) < 0)) ||
+		(mmap(base, h.file_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)) {
+		// Leave the new file empty, so that it is initialized on the next opening.
+		if (is_new)
+			ftruncate(fd, 0);
+		munmap(base, h.max_size);
+		::close(fd);
+		return nullptr;
+	}
+
+	FileHeader *header = (FileHeader *)base;
+
+	if (is_new) {
+		h.magic = FILE_MAGIC;
+		h.version = FILE_VERSION;
+		h.header_size = sizeof(FileHeader);
+		h.base = base;
+		memcpy(header, &h, sizeof(h));
+	}
+
+	// Construct the allocator over the previous one, which only has a stale vtable and file descriptor.
+	MappedFileAlloc *allocator = (MappedFileAlloc *)(base + get_alloc_offset());
+	peff::construct_at<MappedFileAlloc>(allocator, header, fd);
+
+	return allocator;
+}
+
+PEFF_ADVUTILS_API void MappedFileAlloc::close() noexcept {
+	char *base = header->base;
+	const size_t max_size = header->max_size;
+	const int fd = this->fd;
+
+	std::destroy_at<MappedFileAlloc>(this);
+
+	munmap(base, max_size);
+	::close(fd);
+}
+
+PEFF_ADVUTILS_API bool MappedFileAlloc::sync() noexcept {
+	return !msync(header->base, header->file_size, MS_SYNC);
+}
+
+PEFF_ADVUTILS_API bool MappedFileAlloc::_grow(size_t min_file_size) noexcept {
+	if (min_file_size > header->max_size)
+		return false;
+
+	const size_t file_size = header->file_size;
+
+	size_t new_file_size = file_size + (file_size > MIN_GROWTH_SIZE ? file_size : MIN_GROWTH_SIZE);
+	if (new_file_size < min_file_size)
+		new_file_size = min_file_size;
+	if (new_file_size > header->max_size)
+		new_file_size = header->max_size;
+
+	if (ftruncate(fd, new_file_size) < 0)
+		return false;
+
+	// Map the new part over the reserved range, so that the existing part never moves.
+	if (mmap(header->base + file_size, new_file_size - file_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, file_size) == MAP_FAILED) {
+		ftruncate(fd, file_size);
+		return false;
+	}
+
+	header->file_size = new_file_size;
+
+	return true;
+}
+
+PEFF_ADVUTILS_API size_t MappedFileAlloc::trim(size_t keep_bytes, PurgePolicy policy) noexcept {
+	size_t free_size = 0, trimmed_size = 0;
+
+	for (LargeFreeBlock *i = header->large_free_blocks; i; i = i->next)
+		free_size += i->size;
+
+#if defined(MADV_REMOVE)
+	// Pages of a shared mapping cannot be freed lazily, punch them out of the file instead, except the first page which holds the link of the run.
+	for (LargeFreeBlock *i = header->large_free_blocks; i && (free_size > keep_bytes); i = i->next) {
+		if ((i->size > PAGE_SIZE) && (!madvise(((char *)i) + PAGE_SIZE, i->size - PAGE_SIZE, MADV_REMOVE)))
+			trimmed_size += i->size - PAGE_SIZE;
+		free_size -= i->size;
+	}
+#endif
+
+	// Shrink the file down to the allocated space, the rest of the range is reserved again.
+	const size_t file_size = header->file_size;
+	size_t new_file_size = header->bump_offset + (keep_bytes < file_size ? keep_bytes : file_size);
+	new_file_size = calc_run_size(new_file_size);
+
+	if (new_file_size < file_size) {
+		if (mmap(header->base + new_file_size, file_size - new_file_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) == MAP_FAILED)
+			return trimmed_size;
+
+		// The file is grown again by _grow() even if truncating fails.
+		header->file_size = new_file_size;
+		ftruncate(fd, new_file_size);
+
+		trimmed_size += file_size - new_file_size;
+	}
+
+	return trimmed_size;
+}
+
+PEFF_ADVUTILS_API void *MappedFileAlloc::_alloc_run(size_t run_size) noexcept {
+	// First fit from the free runs.
+	for (LargeFreeBlock **i = &header->large_free_blocks; *i; i = &(*i)->next) {
+		LargeFreeBlock *block = *i;
+
+		if (block->size < run_size)
+			continue;
+
+		if (block->size == run_size) {
+			*i = block->next;
+		} else {
+			LargeFreeBlock *rest = (LargeFreeBlock *)(((char *)block) + run_size);
+			rest->next = block->next;
+			rest->size = block->size - run_size;
+			*i = rest;
+		}
+
+		return block;
+	}
+
+	if (run_size > header->max_size - header->bump_offset)
+		return nullptr;
+
+	if ((header->bump_offset + run_size > header->file_size) && (!_grow(header->bump_offset + run_size)))
+		return nullptr;
+
+	char *ptr = header->base + header->bump_offset;
+	header->bump_offset += run_size;
+
+	return ptr;
+}
+
+PEFF_ADVUTILS_API void MappedFileAlloc::_release_run(void *ptr, size_t run_size) noexcept {
+	char *const begin = (char *)ptr;
+
+	LargeFreeBlock *prev = nullptr, **slot = &header->large_free_blocks;
+	while (*slot && ((char *)*slot < begin)) {
+		prev = *slot;
+		slot = &(*slot)->next;
+	}
+
+	LargeFreeBlock *next = *slot;
+
+	if (prev && (((char *)prev) + prev->size == begin)) {
+		prev->size += run_size;
+
+		if (next && (((char *)prev) + prev->size == (char *)next)) {
+			prev->size += next->size;
+			prev->next = next->next;
+		}
+	} else {
+		LargeFreeBlock *block = (LargeFreeBlock *)begin;
+		block->size = run_size;
+
+		if (next && (begin + run_size == (char *)next)) {
+			block->size += next->size;
+			block->next = next->next;
+		} else
+			block->next = next;
+
+		*slot = block;
+		prev = block;
+	}
+
+	// Give the run at the end back to the never-allocated space.
+	if ((!prev->next) && (((char *)prev) + prev->size == header->base + header->bump_offset)) {
+		header->bump_offset -= prev->size;
+
+		LargeFreeBlock **i = &header->large_free_blocks;
+		while (*i != prev)
+			i = &(*i)->next;
+		*i = nullptr;
+	}
+}
+
+PEFF_ADVUTILS_API bool MappedFileAlloc::_refill_slots(size_t size_class) noexcept {
+	const size_t slot_size = size_class_to_size(size_class),
+				 run_size = calc_run_size(slot_size * 8 > SLOT_RUN_SIZE ? slot_size * 8 : SLOT_RUN_SIZE);
+
+	// The runs are page-aligned, so the slots satisfy the maximum alignment of the size class.
+	char *run = (char *)_alloc_run(run_size);
+	if (!run)
+		return false;
+
+	void *&free_slots = header->free_slots[size_class];
+	for (size_t i = run_size / slot_size; i; --i) {
+		void *slot = run + (i - 1) * slot_size;
+		write_free_slot_link(slot, free_slots);
+		free_slots = slot;
+	}
+
+	return true;
+}
+
+PEFF_ADVUTILS_API void *MappedFileAlloc::alloc(size_t size, size_t alignment) noexcept {
+	if (const size_t size_class = size_to_size_class(size, alignment); size_class != INVALID_SIZE_CLASS) {
+		void *&free_slots = header->free_slots[size_class];
+
+		if ((!free_slots) && (!_refill_slots(size_class)))
+			return nullptr;
+
+		void *ptr = free_slots;
+		free_slots = read_free_slot_link(ptr);
+
+		return ptr;
+	}
+
+	if (alignment > PAGE_SIZE)
+		return nullptr;
+
+	return _alloc_run(calc_run_size(size));
+}
+
+PEFF_ADVUTILS_API void *MappedFileAlloc::realloc(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept {
+	void *p;
+
+	if ((p = realloc_in_place(ptr, size, alignment, new_size, new_alignment)))
+		return p;
+
+	if (!(p = alloc(new_size, new_alignment)))
+		return nullptr;
+
+	memcpy(p, ptr, size < new_size ? size : new_size);
+
+	release(ptr, size, alignment);
+
+	return p;
+}
+
+PEFF_ADVUTILS_API void *MappedFileAlloc::realloc_in_place(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept {
+	const size_t size_class = size_to_size_class(size, alignment),
+				 new_size_class = size_to_size_class(new_size, new_alignment);
+
+	if ((size_class == INVALID_SIZE_CLASS) != (new_size_class == INVALID_SIZE_CLASS))
+		return nullptr;
+
+	// The slot is big enough, the request can be fulfilled without moving.
+	if (size_class != INVALID_SIZE_CLASS)
+		return size_class == new_size_class ? ptr : nullptr;
+
+	if (new_alignment && (((uintptr_t)ptr) % new_alignment))
+		return nullptr;
+
+	const size_t run_size = calc_run_size(size), new_run_size = calc_run_size(new_size);
+
+	if (new_run_size <= run_size) {
+		if (new_run_size < run_size)
+			_release_run(((char *)ptr) + new_run_size, run_size - new_run_size);
+		return ptr;
+	}
+
+	// Only the run at the end of the allocated space can be extended.
+	char *const end = ((char *)ptr) + run_size;
+	if (end != header->base + header->bump_offset)
+		return nullptr;
+
+	const size_t extra_size = new_run_size - run_size;
+	if (extra_size > header->max_size - header->bump_offset)
+		return nullptr;
+
+	if ((header->bump_offset + extra_size > header->file_size) && (!_grow(header->bump_offset + extra_size)))
+		return nullptr;
+
+	header->bump_offset += extra_size;
+
+	return ptr;
+}
+
+PEFF_ADVUTILS_API void MappedFileAlloc::release(void *ptr, size_t size, size_t alignment) noexcept {
+	if (const size_t size_class = size_to_size_class(size, alignment); size_class != INVALID_SIZE_CLASS) {
+		write_free_slot_link(ptr, header->free_slots[size_class]);
+		header->free_slots[size_class] = ptr;
+		return;
+	}
+
+	_release_run(ptr, calc_run_size(size));
+}
+
+PEFF_ADVUTILS_API bool MappedFileAlloc::is_replaceable(const Alloc *rhs) const noexcept {
+	if (rhs->type_identity() != type_identity()) {
+		return false;
+	}
+
+	return rhs == this;
+}
+
+PEFF_ADVUTILS_API UUID MappedFileAlloc::type_identity() const noexcept {
+	return PEFF_UUID(d5d16de8, 5fff, 4f35, b39c, 636c9d376864);
+}
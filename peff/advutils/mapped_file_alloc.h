@@ -0,0 +1,114 @@
+#ifndef _PEFF_ADVUTILS_MAPPED_FILE_ALLOC_H_
+#define _PEFF_ADVUTILS_MAPPED_FILE_ALLOC_H_
+
+#include "basedefs.h"
+#include "size_class.h"
+#include <peff/base/alloc.h>
+
+// The file is grown inside a reserved address range, which needs mmap() with MAP_FIXED over the reservation.
+#if defined(_WIN32)
+	#error MappedFileAlloc is only available on POSIX systems
+#endif
+
+namespace peff {
+	/// @brief Persistent allocator which allocates from a memory-mapped file.
+	///
+	/// The file is mapped into an address range reserved on opening and
+	/// grows inside the range, so the allocations never move. The file is
+	/// always mapped at the address it was created at and the allocator
+	/// object itself is placed in the file, so the objects in the file,
+	/// including the containers which refer to the allocator, stay valid
+	/// after the file is reopened by another process.
+	///
+	/// @note The allocator is not thread-safe, the file must not be opened by multiple processes at the same time.
+	class MappedFileAlloc : public ImmortalAlloc {
+	public:
+		struct LargeFreeBlock {
+			LargeFreeBlock *next;
+			size_t size;
+		};
+
+		/// @brief Persistent state of the allocator, placed at the beginning of the file.
+		struct FileHeader {
+			uint64_t magic;
+			uint32_t version;
+			uint32_t header_size;
+			/// @brief Address the file is mapped at.
+			char *base;
+			/// @brief Size of the reserved address range, which is the maximum size of the file.
+			size_t max_size;
+			size_t file_size;
+			/// @brief Offset of the space which has never been allocated.
+			size_t bump_offset;
+			void *root;
+			void *free_slots[NUM_SIZE_CLASSES];
+			/// @brief Free page runs, sorted by address.
+			LargeFreeBlock *large_free_blocks;
+		};
+
+		constexpr static uint64_t FILE_MAGIC = 0x4c4946504d464650;	// "PFFMPFIL"
+		constexpr static uint32_t FILE_VERSION = 1;
+		constexpr static size_t PAGE_SIZE = 4096;
+		/// @brief Minimum size of the growth of the file.
+		constexpr static size_t MIN_GROWTH_SIZE = 1024 * 1024;
+		/// @brief Minimum size of the page runs to be split into slots of a size class.
+		constexpr static size_t SLOT_RUN_SIZE = 16 * 1024;
+
+		FileHeader *header;
+		int fd;
+
+		PEFF_ADVUTILS_API MappedFileAlloc(FileHeader *header, int fd);
+		MappedFileAlloc(const MappedFileAlloc &) = delete;
+		PEFF_ADVUTILS_API virtual ~MappedFileAlloc();
+
+		MappedFileAlloc &operator=(const MappedFileAlloc &) = delete;
+
+		/// @brief Open a file, the file is created if it does not exist.
+		/// @param path Path to the file.
+		/// @param max_size Maximum size of a new file, existing files keep the maximum size they were created with.
+		/// @param base_address Address to map a new file at, nullptr to let the system choose one. Existing files are mapped at the address they were created at.
+		/// @return The allocator of the file, nullptr if failed, for example if the address of an existing file is occupied.
+		PEFF_ADVUTILS_API static MappedFileAlloc *open(const char *path, size_t max_size, void *base_address = nullptr) noexcept;
+		/// @brief Unmap and close the file, the allocator and all objects in the file are invalidated.
+		PEFF_ADVUTILS_API void close() noexcept;
+		/// @brief Flush the modified pages to the file.
+		PEFF_ADVUTILS_API bool sync() noexcept;
+
+		/// @brief Get the root object, which is used for finding the objects in the file after reopening.
+		PEFF_FORCEINLINE void *root() const noexcept {
+			return header->root;
+		}
+
+		PEFF_FORCEINLINE void set_root(void *root) noexcept {
+			header->root = root;
+		}
+
+		PEFF_ADVUTILS_API virtual void *alloc(size_t size, size_t alignment = 0) noexcept override;
+		PEFF_ADVUTILS_API virtual void *realloc(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override;
+		PEFF_ADVUTILS_API virtual void *realloc_in_place(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override;
+		PEFF_ADVUTILS_API virtual void release(void *ptr, size_t size, size_t alignment) noexcept override;
+		/// @brief Punch the free page runs out of the file and shrink the file, the policy is ignored.
+		PEFF_ADVUTILS_API virtual size_t trim(size_t keep_bytes, PurgePolicy policy = PurgePolicy::Lazy) noexcept override;
+
+		PEFF_ADVUTILS_API virtual bool is_replaceable(const Alloc *rhs) const noexcept override;
+
+		PEFF_ADVUTILS_API virtual UUID type_identity() const noexcept override;
+
+		PEFF_FORCEINLINE constexpr static size_t calc_run_size(size_t size) noexcept {
+			return (size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+		}
+
+		/// @brief Offset of the allocator object in the file.
+		PEFF_FORCEINLINE constexpr static size_t get_alloc_offset() noexcept {
+			return (sizeof(FileHeader) + alignof(MappedFileAlloc) - 1) & ~(alignof(MappedFileAlloc) - 1);
+		}
+
+	protected:
+		PEFF_ADVUTILS_API bool _grow(size_t min_file_size) noexcept;
+		PEFF_ADVUTILS_API void *_alloc_run(size_t run_size) noexcept;
+		PEFF_ADVUTILS_API void _release_run(void *ptr, size_t run_size) noexcept;
+		PEFF_ADVUTILS_API bool _refill_slots(size_t size_class) noexcept;
+	};
+}
+
+#endif
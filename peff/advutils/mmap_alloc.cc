@@ -0,0 +1,234 @@
+#include "mmap_alloc.h"
+#include "page_purge.h"
+#include <cstring>
+
+#if defined(_WIN32)
+	#include <Windows.h>
+#else
+	#include <sys/mman.h>
+	#include <unistd.h>
+#endif
+
+using namespace peff;
+
+PEFF_ADVUTILS_API MmapAlloc::MmapAlloc(peff::Alloc *upstream, size_t threshold, bool use_huge_pages) : upstream(upstream), threshold(threshold), use_huge_pages(use_huge_pages) {
+	// Sizes below a page would waste most of the mapping.
+	if (this->threshold < get_page_size())
+		this->threshold = get_page_size();
+}
+
+PEFF_ADVUTILS_API MmapAlloc::MmapAlloc(MmapAlloc &&rhs) noexcept : upstream(std::move(rhs.upstream)), threshold(rhs.threshold), use_huge_pages(rhs.use_huge_pages) {
+}
+
+PEFF_ADVUTILS_API MmapAlloc::~MmapAlloc() {
+}
+
+PEFF_ADVUTILS_API MmapAlloc &MmapAlloc::operator=(MmapAlloc &&rhs) noexcept {
+	upstream = std::move(rhs.upstream);
+	threshold = rhs.threshold;
+	use_huge_pages = rhs.use_huge_pages;
+
+	return *this;
+}
+
+PEFF_ADVUTILS_API size_t MmapAlloc::dec_ref(size_t global_ref_count) noexcept {
+	if (!--_ref_count) {
+		on_ref_zero();
+		return 0;
+	}
+	return _ref_count;
+}
+
+PEFF_ADVUTILS_API size_t MmapAlloc::inc_ref(size_t global_ref_count) noexcept {
+	return ++_ref_count;
+}
+
+PEFF_ADVUTILS_API void MmapAlloc::on_ref_zero() noexcept {
+}
+
+PEFF_ADVUTILS_API size_t MmapAlloc::get_page_size() noexcept {
+	return get_system_page_size();
+}
+
+PEFF_ADVUTILS_API void *MmapAlloc::_map(size_t size, size_t alignment) noexcept {
+	// Rounding up to whole pages and the extra space for the alignment must not overflow.
+	if (size > SIZE_MAX - get_page_size() - alignment)
+		return nullptr;
+
+	const size_t mapping_size = calc_mapping_size(size);
+
+#if defined(_WIN32)
+	// VirtualAlloc() always returns addresses aligned to the allocation granularity.
+	SYSTEM_INFO system_info;
+	GetSystemInfo(&system_info);
+	if (alignment > system_info.dwAllocationGranularity)
+		return nullptr;
+
+	return VirtualAlloc(nullptr, mapping_size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+	if (alignment <= get_page_size()) {
+		void *ptr = mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (ptr == MAP_FAILED)
+			return nullptr;
+
+		_advise(ptr, mapping_size);
+		return ptr;
+	}
+
+	// Map with some extra space and trim the misaligned parts.
+	char *ptr = (char *)mmap(nullptr, mapping_size + alignment, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ptr == MAP_FAILED)
+		return nullptr;
+
+	char *aligned_ptr = ptr;
+	if (size_t aligned_diff = ((uintptr_t)ptr) % alignment; aligned_diff)
+		aligned_ptr += alignment - aligned_diff;
+
+	if (aligned_ptr != ptr)
+		munmap(ptr, aligned_ptr - ptr);
+	if (size_t tail_size = (ptr + mapping_size + alignment) - (aligned_ptr + mapping_size); tail_size)
+		munmap(aligned_ptr + mapping_size, tail_size);
+
+	_advise(aligned_ptr, mapping_size);
+	return aligned_ptr;
+#endif
+}
+
+PEFF_ADVUTILS_API void MmapAlloc::_unmap(void *ptr, size_t size) noexcept {
+#if defined(_WIN32)
+	VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+	munmap(ptr, calc_mapping_size(size));
+#endif
+}
+
+PEFF_ADVUTILS_API void MmapAlloc::_advise(void *ptr, size_t size) noexcept {
+#if defined(MADV_HUGEPAGE)
+	if (use_huge_pages && (size >= HUGE_PAGE_SIZE))
+		madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+}
+
+PEFF_ADVUTILS_API void *MmapAlloc::alloc(size_t size, size_t alignment) noexcept {
+	if (!is_mapped(size))
+		return upstream->alloc(size, alignment);
+
+	return _map(size, alignment);
+}
+
+PEFF_ADVUTILS_API void *MmapAlloc::realloc(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept {
+	void *p;
+
+	if ((p = realloc_in_place(ptr, size, alignment, new_size, new_alignment)))
+		return p;
+
+	const bool mapped = is_mapped(size), new_mapped = is_mapped(new_size);
+
+	if ((!mapped) && (!new_mapped))
+		return upstream->realloc(ptr, size, alignment, new_size, new_alignment);
+
+#if defined(__linux__)
+	// Let the kernel move the pages instead of copying the data.
+	if (mapped && new_mapped && (new_alignment <= get_page_size()) && (new_size <= SIZE_MAX - get_page_size())) {
+		if ((p = mremap(ptr, calc_mapping_size(size), calc_mapping_size(new_size), MREMAP_MAYMOVE)) == MAP_FAILED)
+			return nullptr;
+
+		_advise(p, calc_mapping_size(new_size));
+		return p;
+	}
+#endif
+
+	if (!(p = alloc(new_size, new_alignment)))
+		return nullptr;
+
+	memcpy(p, ptr, size < new_size ? size : new_size);
+
+	release(ptr, size, alignment);
+
+	return p;
+}
+
+PEFF_ADVUTILS_API void *MmapAlloc::realloc_in_place(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept {
+	const bool mapped = is_mapped(size), new_mapped = is_mapped(new_size);
+
+	if (mapped != new_mapped)
+		return nullptr;
+
+	if (!mapped)
+		return upstream->realloc_in_place(ptr, size, alignment, new_size, new_alignment);
+
+	if (new_alignment && (((uintptr_t)ptr) % new_alignment))
+		return nullptr;
+
+	if (new_size > SIZE_MAX - get_page_size())
+		return nullptr;
+
+	const size_t mapping_size = calc_mapping_size(size), new_mapping_size = calc_mapping_size(new_size);
+
+	if (new_mapping_size == mapping_size)
+		return ptr;
+
+#if defined(_WIN32)
+	return nullptr;
+#else
+	if (new_mapping_size < mapping_size) {
+		munmap(((char *)ptr) + new_mapping_size, mapping_size - new_mapping_size);
+		return ptr;
+	}
+
+	#if defined(__linux__)
+	// Without MREMAP_MAYMOVE the mapping is only extended if the following address space is free.
+	if (mremap(ptr, mapping_size, new_mapping_size, 0) == MAP_FAILED)
+		return nullptr;
+
+	_advise(ptr, new_mapping_size);
+	return ptr;
+	#else
+	return nullptr;
+	#endif
+#endif
+}
+
+PEFF_ADVUTILS_API void MmapAlloc::release(void *ptr, size_t size, size_t alignment) noexcept {
+	if (!is_mapped(size)) {
+		upstream->release(ptr, size, alignment);
+		return;
+	}
+
+	_unmap(ptr, size);
+}
+
+PEFF_ADVUTILS_API size_t MmapAlloc::trim(size_t keep_bytes, PurgePolicy policy) noexcept {
+	// The mappings are unmapped on release, nothing is retained here.
+	return upstream->trim(keep_bytes, policy);
+}
+
+PEFF_ADVUTILS_API AllocCaps MmapAlloc::get_caps() const noexcept {
+	AllocCaps caps = upstream->get_caps();
+
+	caps.is_monotonic = false;
+	caps.zero_initialized = false;
+#if defined(__linux__)
+	// The mappings only grow in place with mremap(), elsewhere only the blocks from the upstream allocator may.
+	caps.supports_realloc_in_place = true;
+#endif
+
+	return caps;
+}
+
+PEFF_ADVUTILS_API bool MmapAlloc::is_replaceable(const Alloc *rhs) const noexcept {
+	if (rhs->type_identity() != type_identity()) {
+		return false;
+	}
+
+	const MmapAlloc *r = (const MmapAlloc *)rhs;
+
+	if (threshold != r->threshold)
+		return false;
+
+	return upstream->is_replaceable(r->upstream.get());
+}
+
+PEFF_ADVUTILS_API UUID MmapAlloc::type_identity() const noexcept {
+	return PEFF_UUID(790850e5, 9242, 44d1, 872f, fe4e2f6d14a5);
+}
@@ -0,0 +1,68 @@
+#ifndef _PEFF_ADVUTILS_MMAP_ALLOC_H_
+#define _PEFF_ADVUTILS_MMAP_ALLOC_H_
+
+#include "basedefs.h"
+#include <peff/base/alloc.h>
+
+namespace peff {
+	/// @brief Allocator which maps large allocations from the system directly.
+	///
+	/// Requests not smaller than the threshold are mapped into whole pages,
+	/// on Linux they are grown with mremap() so that growing does not copy
+	/// the data, and can be grown in place if the address space after the
+	/// mapping is free. Smaller requests are forwarded to the upstream allocator.
+	class MmapAlloc : public Alloc {
+	protected:
+		std::atomic_size_t _ref_count = 0;
+
+	public:
+		constexpr static size_t DEFAULT_THRESHOLD = 256 * 1024;
+		constexpr static size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+		peff::RcObjectPtr<peff::Alloc> upstream;
+		size_t threshold;
+		/// @brief Whether to advise the system to back mappings larger than a huge page with transparent huge pages.
+		bool use_huge_pages;
+
+		PEFF_ADVUTILS_API MmapAlloc(peff::Alloc *upstream, size_t threshold = DEFAULT_THRESHOLD, bool use_huge_pages = false);
+		PEFF_ADVUTILS_API MmapAlloc(MmapAlloc &&rhs) noexcept;
+		PEFF_ADVUTILS_API virtual ~MmapAlloc();
+
+		PEFF_ADVUTILS_API MmapAlloc &operator=(MmapAlloc &&rhs) noexcept;
+
+		PEFF_ADVUTILS_API virtual size_t inc_ref(size_t global_ref_count) noexcept override;
+		PEFF_ADVUTILS_API virtual size_t dec_ref(size_t global_ref_count) noexcept override;
+		PEFF_ADVUTILS_API virtual void on_ref_zero() noexcept;
+
+		PEFF_ADVUTILS_API virtual void *alloc(size_t size, size_t alignment = 0) noexcept override;
+		PEFF_ADVUTILS_API virtual void *realloc(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override;
+		PEFF_ADVUTILS_API virtual void *realloc_in_place(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override;
+		PEFF_ADVUTILS_API virtual void release(void *ptr, size_t size, size_t alignment) noexcept override;
+		PEFF_ADVUTILS_API virtual size_t trim(size_t keep_bytes, PurgePolicy policy = PurgePolicy::Lazy) noexcept override;
+
+		PEFF_ADVUTILS_API virtual AllocCaps get_caps() const noexcept override;
+
+		PEFF_ADVUTILS_API virtual bool is_replaceable(const Alloc *rhs) const noexcept override;
+
+		PEFF_ADVUTILS_API virtual UUID type_identity() const noexcept override;
+
+		/// @brief Get size of the system pages.
+		PEFF_ADVUTILS_API static size_t get_page_size() noexcept;
+
+		PEFF_FORCEINLINE static size_t calc_mapping_size(size_t size) noexcept {
+			const size_t page_size = get_page_size();
+			return (size + page_size - 1) & ~(page_size - 1);
+		}
+
+		PEFF_FORCEINLINE bool is_mapped(size_t size) const noexcept {
+			return size >= threshold;
+		}
+
+	protected:
+		PEFF_ADVUTILS_API void *_map(size_t size, size_t alignment) noexcept;
+		PEFF_ADVUTILS_API void _unmap(void *ptr, size_t size) noexcept;
+		PEFF_ADVUTILS_API void _advise(void *ptr, size_t size) noexcept;
+	};
+}
+
+#endif
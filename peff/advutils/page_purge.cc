@@ -0,0 +1,55 @@
+#include "page_purge.h"
+
+#if defined(_WIN32)
+	#include <Windows.h>
+#else
+	#include <sys/mman.h>
+	#include <unistd.h>
+#endif
+
+using namespace peff;
+
+PEFF_ADVUTILS_API size_t peff::get_system_page_size() noexcept {
+	static const size_t page_size = []() -> size_t {
+#if defined(_WIN32)
+		SYSTEM_INFO system_info;
+		GetSystemInfo(&system_info);
+		return system_info.dwPageSize;
+#else
+		return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+	}();
+
+	return page_size;
+}
+
+PEFF_ADVUTILS_API size_t peff::purge_pages(void *ptr, size_t size, PurgePolicy policy) noexcept {
+	const size_t page_size = get_system_page_size();
+
+	const uintptr_t begin = (((uintptr_t)ptr) + page_size - 1) & ~(uintptr_t)(page_size - 1),
+					end = (((uintptr_t)ptr) + size) & ~(uintptr_t)(page_size - 1);
+
+	if (begin >= end)
+		return 0;
+
+	const size_t purge_size = (size_t)(end - begin);
+
+#if defined(_WIN32)
+	// The pages are reset lazily in both cases, Windows has no way to discard them immediately without decommitting.
+	if (!VirtualAlloc((void *)begin, purge_size, MEM_RESET, PAGE_READWRITE))
+		return 0;
+#else
+	#if defined(MADV_FREE)
+	if (policy == PurgePolicy::Lazy) {
+		if (!madvise((void *)begin, purge_size, MADV_FREE))
+			return purge_size;
+		// Not supported by the kernel or the mapping, fall back to discarding.
+	}
+	#endif
+
+	if (madvise((void *)begin, purge_size, MADV_DONTNEED))
+		return 0;
+#endif
+
+	return purge_size;
+}
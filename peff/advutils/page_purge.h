@@ -0,0 +1,24 @@
+#ifndef _PEFF_ADVUTILS_PAGE_PURGE_H_
+#define _PEFF_ADVUTILS_PAGE_PURGE_H_
+
+#include "basedefs.h"
+#include <peff/base/alloc.h>
+
+namespace peff {
+	/// @brief Get size of the system pages.
+	PEFF_ADVUTILS_API size_t get_system_page_size() noexcept;
+
+	/// @brief Give the physical pages of a free memory range back to the system.
+	///
+	/// Only the pages which are entirely inside the range are purged, the
+	/// range stays mapped and can be reused without any further call, but
+	/// its contents are undefined afterwards.
+	///
+	/// @param ptr Beginning of the range.
+	/// @param size Size of the range.
+	/// @param policy How the pages are given back.
+	/// @return Size of the pages purged, 0 if the range contains no whole page or the system refused.
+	PEFF_ADVUTILS_API size_t purge_pages(void *ptr, size_t size, PurgePolicy policy) noexcept;
+}
+
+#endif
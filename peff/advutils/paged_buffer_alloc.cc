@@ -0,0 +1,509 @@
+#include "paged_buffer_alloc.h"
+#include "page_purge.h"
+#include <cstring>
+
+using namespace peff;
+
+PEFF_ADVUTILS_API PagedBufferAlloc::PagedBufferAlloc(char *buffer, size_t buffer_size, peff::Alloc *metadata_alloc) : buffer(buffer), buffer_size(buffer_size), metadata_alloc(metadata_alloc) {
+}
+
+PEFF_ADVUTILS_API PagedBufferAlloc::PagedBufferAlloc(PagedBufferAlloc &&rhs) noexcept
+	: buffer(rhs.buffer),
+	  buffer_size(rhs.buffer_size),
+	  metadata_alloc(std::move(rhs.metadata_alloc)),
+	  pages_base(rhs.pages_base),
+	  num_pages(rhs.num_pages),
+	  pagemap(rhs.pagemap),
+	  span_chunks(rhs.span_chunks),
+	  free_span_descs(rhs.free_span_descs) {
+	memcpy(free_spans, rhs.free_spans, sizeof(free_spans));
+	memcpy(partial_spans, rhs.partial_spans, sizeof(partial_spans));
+
+	rhs.buffer = nullptr;
+	rhs.buffer_size = 0;
+	rhs.pages_base = nullptr;
+	rhs.num_pages = 0;
+	rhs.pagemap = nullptr;
+	rhs.span_chunks = nullptr;
+	rhs.free_span_descs = nullptr;
+	memset(rhs.free_spans, 0, sizeof(rhs.free_spans));
+	memset(rhs.partial_spans, 0, sizeof(rhs.partial_spans));
+}
+
+PEFF_ADVUTILS_API PagedBufferAlloc::~PagedBufferAlloc() {
+	_release_metadata();
+}
+
+PEFF_ADVUTILS_API PagedBufferAlloc &PagedBufferAlloc::operator=(PagedBufferAlloc &&rhs) noexcept {
+	_release_metadata();
+
+	buffer = rhs.buffer;
+	buffer_size = rhs.buffer_size;
+	metadata_alloc = std::move(rhs.metadata_alloc);
+	pages_base = rhs.pages_base;
+	num_pages = rhs.num_pages;
+	pagemap = rhs.pagemap;
+	span_chunks = rhs.span_chunks;
+	free_span_descs = rhs.free_span_descs;
+	memcpy(free_spans, rhs.free_spans, sizeof(free_spans));
+	memcpy(partial_spans, rhs.partial_spans, sizeof(partial_spans));
+
+	rhs.buffer = nullptr;
+	rhs.buffer_size = 0;
+	rhs.pages_base = nullptr;
+	rhs.num_pages = 0;
+	rhs.pagemap = nullptr;
+	rhs.span_chunks = nullptr;
+	rhs.free_span_descs = nullptr;
+	memset(rhs.free_spans, 0, sizeof(rhs.free_spans));
+	memset(rhs.partial_spans, 0, sizeof(rhs.partial_spans));
+
+	return *this;
+}
+
+PEFF_ADVUTILS_API size_t PagedBufferAlloc::dec_ref(size_t global_ref_count) noexcept {
+	if (!--_ref_count) {
+		on_ref_zero();
+		return 0;
+	}
+	return _ref_count;
+}
+
+PEFF_ADVUTILS_API size_t PagedBufferAlloc::inc_ref(size_t global_ref_count) noexcept {
+	return ++_ref_count;
+}
+
+PEFF_ADVUTILS_API void PagedBufferAlloc::on_ref_zero() noexcept {
+}
+
+PEFF_ADVUTILS_API bool PagedBufferAlloc::_init() noexcept {
+	char *base = buffer;
+	if (size_t aligned_diff = ((uintptr_t)base) % PAGE_SIZE; aligned_diff)
+		base += PAGE_SIZE - aligned_diff;
+
+	if (base >= buffer + buffer_size)
+		return false;
+
+	const size_t n = ((size_t)(buffer + buffer_size - base)) >> PAGE_SHIFT;
+	if (!n)
+		return false;
+
+	if (!(pagemap = (Span **)metadata_alloc->alloc(sizeof(Span *) * n, alignof(Span *))))
+		return false;
+	memset(pagemap, 0, sizeof(Span *) * n);
+
+	pages_base = base;
+	num_pages = n;
+
+	Span *span = _alloc_span_desc();
+	if (!span) {
+		metadata_alloc->release(pagemap, sizeof(Span *) * num_pages, alignof(Span *));
+		pagemap = nullptr;
+		pages_base = nullptr;
+		num_pages = 0;
+		return false;
+	}
+
+	span->first_page = 0;
+	span->num_pages = n;
+	_insert_free_span(span);
+
+	return true;
+}
+
+PEFF_ADVUTILS_API void PagedBufferAlloc::_release_metadata() noexcept {
+	if (pagemap) {
+		metadata_alloc->release(pagemap, sizeof(Span *) * num_pages, alignof(Span *));
+		pagemap = nullptr;
+	}
+
+	while (span_chunks) {
+		SpanChunk *next = span_chunks->next;
+		std::destroy_at<SpanChunk>(span_chunks);
+		metadata_alloc->release(span_chunks, sizeof(SpanChunk), alignof(SpanChunk));
+		span_chunks = next;
+	}
+
+	pages_base = nullptr;
+	num_pages = 0;
+	free_span_descs = nullptr;
+	memset(free_spans, 0, sizeof(free_spans));
+	memset(partial_spans, 0, sizeof(partial_spans));
+}
+
+PEFF_ADVUTILS_API PagedBufferAlloc::Span *PagedBufferAlloc::_alloc_span_desc() noexcept {
+	if (!free_span_descs) {
+		SpanChunk *chunk = (SpanChunk *)metadata_alloc->alloc(sizeof(SpanChunk), alignof(SpanChunk));
+		if (!chunk)
+			return nullptr;
+		peff::construct_at<SpanChunk>(chunk);
+
+		chunk->next = span_chunks;
+		span_chunks = chunk;
+
+		for (size_t i = 0; i < SPANS_PER_CHUNK; ++i) {
+			chunk->spans[i].next = free_span_descs;
+			free_span_descs = &chunk->spans[i];
+		}
+	}
+
+	Span *span = free_span_descs;
+	free_span_descs = span->next;
+
+	*span = Span();
+
+	return span;
+}
+
+PEFF_ADVUTILS_API void PagedBufferAlloc::_release_span_desc(Span *span) noexcept {
+	span->next = free_span_descs;
+	free_span_descs = span;
+}
+
+PEFF_ADVUTILS_API void PagedBufferAlloc::_insert_free_span(Span *span) noexcept {
+	span->state = SpanState::Free;
+
+	// Only the boundary pages of free spans are mapped, which is enough for coalescing.
+	pagemap[span->first_page] = span;
+	pagemap[span->first_page + span->num_pages - 1] = span;
+
+	_link_span(_get_free_span_list(span->num_pages), span);
+}
+
+PEFF_ADVUTILS_API void PagedBufferAlloc::_remove_free_span(Span *span) noexcept {
+	assert(span->state == SpanState::Free);
+	_unlink_span(_get_free_span_list(span->num_pages), span);
+}
+
+PEFF_ADVUTILS_API PagedBufferAlloc::Span *PagedBufferAlloc::_split_span(Span *span, size_t num_pages) noexcept {
+	assert(num_pages < span->num_pages);
+
+	Span *tail = _alloc_span_desc();
+	if (!tail)
+		return nullptr;
+
+	tail->first_page = span->first_page + num_pages;
+	tail->num_pages = span->num_pages - num_pages;
+	tail->state = span->state;
+
+	span->num_pages = num_pages;
+
+	return tail;
+}
+
+PEFF_ADVUTILS_API PagedBufferAlloc::Span *PagedBufferAlloc::_alloc_pages(size_t num_pages) noexcept {
+	Span *span = nullptr;
+
+	for (size_t i = num_pages; i < MAX_EXACT_FREE_PAGES; ++i) {
+		if (free_spans[i]) {
+			span = free_spans[i];
+			break;
+		}
+	}
+
+	if (!span) {
+		// Best-fit in the list of the large free spans.
+		for (Span *i = free_spans[MAX_EXACT_FREE_PAGES]; i; i = i->next) {
+			if ((i->num_pages >= num_pages) && ((!span) || (i->num_pages < span->num_pages)))
+				span = i;
+		}
+
+		if (!span)
+			return nullptr;
+	}
+
+	_remove_free_span(span);
+
+	// The span is handed out as a whole if we ran out of the descriptors.
+	if (span->num_pages > num_pages) {
+		if (Span *tail = _split_span(span, num_pages); tail)
+			_insert_free_span(tail);
+	}
+
+	return span;
+}
+
+PEFF_ADVUTILS_API void PagedBufferAlloc::_release_pages(Span *span) noexcept {
+	if (span->first_page) {
+		Span *prev = pagemap[span->first_page - 1];
+
+		if (prev->state == SpanState::Free) {
+			_remove_free_span(prev);
+
+			span->first_page = prev->first_page;
+			span->num_pages += prev->num_pages;
+
+			_release_span_desc(prev);
+		}
+	}
+
+	if (const size_t end_page = span->first_page + span->num_pages; end_page < num_pages) {
+		Span *next = pagemap[end_page];
+
+		if (next->state == SpanState::Free) {
+			_remove_free_span(next);
+
+			span->num_pages += next->num_pages;
+
+			_release_span_desc(next);
+		}
+	}
+
+	_insert_free_span(span);
+}
+
+PEFF_ADVUTILS_API void PagedBufferAlloc::_map_span(Span *span) noexcept {
+	for (size_t i = 0; i < span->num_pages; ++i)
+		pagemap[span->first_page + i] = span;
+}
+
+PEFF_ADVUTILS_API PagedBufferAlloc::Span *PagedBufferAlloc::_get_partial_span(size_t size_class) noexcept {
+	Span *span = partial_spans[size_class];
+
+	if (!span) {
+		if (!(span = _alloc_pages(calc_small_span_pages(size_class))))
+			return nullptr;
+
+		span->state = SpanState::Small;
+		span->size_class = (uint8_t)size_class;
+		span->free_list = nullptr;
+		span->bump_ptr = get_page_ptr(span->first_page);
+		span->num_used = 0;
+		span->num_slots = (uint32_t)((span->num_pages << PAGE_SHIFT) / size_class_to_size(size_class));
+		_map_span(span);
+
+		_link_span(partial_spans[size_class], span);
+	}
+
+	return span;
+}
+
+PEFF_ADVUTILS_API void *PagedBufferAlloc::_alloc_small(size_t size_class) noexcept {
+	Span *span = _get_partial_span(size_class);
+	if (!span)
+		return nullptr;
+
+	void *ptr;
+	if (span->free_list) {
+		ptr = span->free_list;
+		span->free_list = read_free_slot_link(ptr);
+	} else {
+		ptr = span->bump_ptr;
+		span->bump_ptr += size_class_to_size(size_class);
+	}
+
+	if (++span->num_used == span->num_slots)
+		_unlink_span(partial_spans[size_class], span);
+
+	return ptr;
+}
+
+PEFF_ADVUTILS_API void *PagedBufferAlloc::_alloc_large(size_t size, size_t alignment) noexcept {
+	const size_t n = calc_large_pages(size);
+	// Pages are always page-aligned, over-aligned requests need some extra pages for adjusting.
+	const size_t extra_pages = alignment > PAGE_SIZE ? (alignment >> PAGE_SHIFT) - 1 : 0;
+
+	Span *span = _alloc_pages(n + extra_pages);
+	if (!span)
+		return nullptr;
+	span->state = SpanState::Large;
+	_map_span(span);
+
+	if (extra_pages) {
+		const size_t misaligned_pages = (alignment - ((uintptr_t)get_page_ptr(span->first_page)) % alignment) % alignment >> PAGE_SHIFT;
+
+		if (misaligned_pages) {
+			Span *aligned_span = _split_span(span, misaligned_pages);
+			if (!aligned_span) {
+				_release_pages(span);
+				return nullptr;
+			}
+
+			_map_span(aligned_span);
+			_release_pages(span);
+			span = aligned_span;
+		}
+
+		if (span->num_pages > n) {
+			if (Span *tail = _split_span(span, n); tail)
+				_release_pages(tail);
+		}
+	}
+
+	return get_page_ptr(span->first_page);
+}
+
+PEFF_ADVUTILS_API void *PagedBufferAlloc::alloc(size_t size, size_t alignment) noexcept {
+	if ((!pagemap) && (!_init()))
+		return nullptr;
+
+	if (const size_t size_class = size_to_size_class(size, alignment); size_class != INVALID_SIZE_CLASS)
+		return _alloc_small(size_class);
+
+	return _alloc_large(size, alignment);
+}
+
+PEFF_ADVUTILS_API size_t PagedBufferAlloc::alloc_batch(size_t count, size_t size, size_t alignment, void **out) noexcept {
+	const size_t size_class = size_to_size_class(size, alignment);
+
+	if ((size_class == INVALID_SIZE_CLASS) || ((!pagemap) && (!_init())))
+		return Alloc::alloc_batch(count, size, alignment, out);
+
+	const size_t slot_size = size_class_to_size(size_class);
+	size_t i = 0;
+
+	while (i < count) {
+		Span *span = _get_partial_span(size_class);
+		if (!span)
+			break;
+
+		const size_t num_free_slots = span->num_slots - span->num_used,
+					 n = count - i < num_free_slots ? count - i : num_free_slots;
+
+		size_t j = 0;
+		for (; (j < n) && span->free_list; ++j) {
+			out[i++] = span->free_list;
+			span->free_list = read_free_slot_link(span->free_list);
+		}
+		for (; j < n; ++j) {
+			out[i++] = span->bump_ptr;
+			span->bump_ptr += slot_size;
+		}
+
+		if ((span->num_used += (uint32_t)n) == span->num_slots)
+			_unlink_span(partial_spans[size_class], span);
+	}
+
+	return i;
+}
+
+PEFF_ADVUTILS_API void *PagedBufferAlloc::realloc(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept {
+	void *p;
+
+	if ((p = realloc_in_place(ptr, size, alignment, new_size, new_alignment)))
+		return p;
+
+	if (!(p = alloc(new_size, new_alignment)))
+		return nullptr;
+
+	memcpy(p, ptr, size < new_size ? size : new_size);
+
+	release(ptr, size, alignment);
+
+	return p;
+}
+
+PEFF_ADVUTILS_API void *PagedBufferAlloc::realloc_in_place(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept {
+	const size_t size_class = size_to_size_class(size, alignment),
+				 new_size_class = size_to_size_class(new_size, new_alignment);
+
+	if (size_class != INVALID_SIZE_CLASS) {
+		// The slot is big enough, the request can be fulfilled without moving.
+		if (size_class == new_size_class)
+			return ptr;
+		return nullptr;
+	}
+
+	if (new_size_class != INVALID_SIZE_CLASS)
+		return nullptr;
+
+	if (new_alignment && (((uintptr_t)ptr) % new_alignment))
+		return nullptr;
+
+	Span *span = get_span(ptr);
+	assert(span->state == SpanState::Large);
+
+	const size_t n = calc_large_pages(new_size);
+
+	if (n < span->num_pages) {
+		if (Span *tail = _split_span(span, n); tail)
+			_release_pages(tail);
+		return ptr;
+	}
+
+	if (n > span->num_pages) {
+		const size_t end_page = span->first_page + span->num_pages;
+		if (end_page >= num_pages)
+			return nullptr;
+
+		Span *next = pagemap[end_page];
+		if ((next->state != SpanState::Free) || (span->num_pages + next->num_pages < n))
+			return nullptr;
+
+		_remove_free_span(next);
+
+		if (span->num_pages + next->num_pages > n) {
+			if (Span *tail = _split_span(next, n - span->num_pages); tail)
+				_insert_free_span(tail);
+		}
+
+		span->num_pages += next->num_pages;
+		_release_span_desc(next);
+
+		_map_span(span);
+	}
+
+	return ptr;
+}
+
+PEFF_ADVUTILS_API void PagedBufferAlloc::release(void *ptr, size_t size, size_t alignment) noexcept {
+	Span *span = get_span(ptr);
+
+	if (const size_t size_class = size_to_size_class(size, alignment); size_class != INVALID_SIZE_CLASS) {
+		assert(span->state == SpanState::Small);
+		assert(span->size_class == size_class);
+		assert(span->num_used);
+
+		if (span->num_used == span->num_slots)
+			_link_span(partial_spans[size_class], span);
+
+		write_free_slot_link(ptr, span->free_list);
+		span->free_list = ptr;
+
+		if (!--span->num_used) {
+			_unlink_span(partial_spans[size_class], span);
+			_release_pages(span);
+		}
+
+		return;
+	}
+
+	assert(span->state == SpanState::Large);
+	assert(get_page_ptr(span->first_page) == ptr);
+
+	_release_pages(span);
+}
+
+PEFF_ADVUTILS_API size_t PagedBufferAlloc::trim(size_t keep_bytes, PurgePolicy policy) noexcept {
+	size_t free_size = 0, trimmed_size = 0;
+
+	for (size_t i = 1; i <= MAX_EXACT_FREE_PAGES; ++i) {
+		for (Span *j = free_spans[i]; j; j = j->next)
+			free_size += j->num_pages << PAGE_SHIFT;
+	}
+
+	// The metadata is kept out of the pages, so the free spans can be purged as a whole, the largest ones first.
+	for (size_t i = MAX_EXACT_FREE_PAGES; i && (free_size > keep_bytes); --i) {
+		for (Span *j = free_spans[i]; j && (free_size > keep_bytes); j = j->next) {
+			const size_t span_size = j->num_pages << PAGE_SHIFT,
+						 purge_size = free_size - keep_bytes < span_size ? free_size - keep_bytes : span_size;
+
+			trimmed_size += purge_pages(get_page_ptr(j->first_page) + (span_size - purge_size), purge_size, policy);
+			free_size -= span_size;
+		}
+	}
+
+	return trimmed_size;
+}
+
+PEFF_ADVUTILS_API bool PagedBufferAlloc::is_replaceable(const Alloc *rhs) const noexcept {
+	if (rhs->type_identity() != type_identity()) {
+		return false;
+	}
+
+	return rhs == this;
+}
+
+PEFF_ADVUTILS_API UUID PagedBufferAlloc::type_identity() const noexcept {
+	return PEFF_UUID(c008d6c2, b865, 4a0f, a9b1, 3ac14e8edc2b);
+}
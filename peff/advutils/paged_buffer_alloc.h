@@ -0,0 +1,160 @@
+#ifndef _PEFF_ADVUTILS_PAGED_BUFFER_ALLOC_H_
+#define _PEFF_ADVUTILS_PAGED_BUFFER_ALLOC_H_
+
+#include "basedefs.h"
+#include "size_class.h"
+#include <peff/base/alloc.h>
+
+namespace peff {
+	/// @brief Allocator which allocates from a fixed buffer and keeps the metadata out of the buffer.
+	///
+	/// The buffer is divided into pages which are grouped into spans, a
+	/// pagemap maps each page to its span descriptor so that looking up a
+	/// pointer on release is O(1). Small requests are rounded up to a size
+	/// class and packed into spans without per-object headers, larger ones
+	/// take whole pages. The pagemap and the span descriptors are allocated
+	/// from the metadata allocator lazily on the first allocation.
+	///
+	/// @note The allocator is not thread-safe.
+	class PagedBufferAlloc : public Alloc {
+	protected:
+		std::atomic_size_t _ref_count = 0;
+
+	public:
+		enum class SpanState : uint8_t {
+			Free = 0,
+			Small,
+			Large
+		};
+
+		struct Span {
+			Span *prev = nullptr, *next = nullptr;
+			size_t first_page = 0;
+			size_t num_pages = 0;
+			void *free_list = nullptr;
+			char *bump_ptr = nullptr;
+			uint32_t num_used = 0;
+			uint32_t num_slots = 0;
+			uint8_t size_class = 0;
+			SpanState state = SpanState::Free;
+		};
+
+		constexpr static size_t SPANS_PER_CHUNK = 64;
+
+		/// @brief Chunk of span descriptors, allocated from the metadata allocator.
+		struct SpanChunk {
+			SpanChunk *next;
+			Span spans[SPANS_PER_CHUNK];
+		};
+
+		constexpr static size_t PAGE_SHIFT = 12;
+		constexpr static size_t PAGE_SIZE = (size_t)1 << PAGE_SHIFT;
+		/// @brief Free spans smaller than this number of pages are kept in exact-sized lists.
+		constexpr static size_t MAX_EXACT_FREE_PAGES = 64;
+		constexpr static size_t SPAN_MIN_SLOTS = 8;
+
+		char *buffer;
+		size_t buffer_size;
+		peff::RcObjectPtr<peff::Alloc> metadata_alloc;
+
+		char *pages_base = nullptr;
+		size_t num_pages = 0;
+		Span **pagemap = nullptr;
+
+		SpanChunk *span_chunks = nullptr;
+		Span *free_span_descs = nullptr;
+		/// @brief Free spans, the last list holds all spans with at least MAX_EXACT_FREE_PAGES pages.
+		Span *free_spans[MAX_EXACT_FREE_PAGES + 1] = {};
+		/// @brief Small spans with at least one free slot.
+		Span *partial_spans[NUM_SIZE_CLASSES] = {};
+
+		PEFF_FORCEINLINE constexpr static size_t calc_small_span_pages(size_t size_class) noexcept {
+			return (size_class_to_size(size_class) * SPAN_MIN_SLOTS + PAGE_SIZE - 1) >> PAGE_SHIFT;
+		}
+
+		PEFF_FORCEINLINE constexpr static size_t calc_large_pages(size_t size) noexcept {
+			return size ? (size + PAGE_SIZE - 1) >> PAGE_SHIFT : 1;
+		}
+
+		PEFF_ADVUTILS_API PagedBufferAlloc(char *buffer, size_t buffer_size, peff::Alloc *metadata_alloc);
+		PEFF_ADVUTILS_API PagedBufferAlloc(PagedBufferAlloc &&rhs) noexcept;
+		PEFF_ADVUTILS_API virtual ~PagedBufferAlloc();
+
+		PEFF_ADVUTILS_API PagedBufferAlloc &operator=(PagedBufferAlloc &&rhs) noexcept;
+
+		PEFF_ADVUTILS_API virtual size_t inc_ref(size_t global_ref_count) noexcept override;
+		PEFF_ADVUTILS_API virtual size_t dec_ref(size_t global_ref_count) noexcept override;
+		PEFF_ADVUTILS_API virtual void on_ref_zero() noexcept;
+
+		PEFF_ADVUTILS_API virtual void *alloc(size_t size, size_t alignment = 0) noexcept override;
+		PEFF_ADVUTILS_API virtual void *realloc(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override;
+		PEFF_ADVUTILS_API virtual void *realloc_in_place(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override;
+		PEFF_ADVUTILS_API virtual void release(void *ptr, size_t size, size_t alignment) noexcept override;
+		PEFF_ADVUTILS_API virtual size_t alloc_batch(size_t count, size_t size, size_t alignment, void **out) noexcept override;
+		/// @brief Purge the pages of the free spans, the largest spans first.
+		PEFF_ADVUTILS_API virtual size_t trim(size_t keep_bytes, PurgePolicy policy = PurgePolicy::Lazy) noexcept override;
+
+		PEFF_ADVUTILS_API virtual bool is_replaceable(const Alloc *rhs) const noexcept override;
+
+		PEFF_ADVUTILS_API virtual UUID type_identity() const noexcept override;
+
+		/// @brief Look up the span which contains a pointer.
+		/// @param ptr Pointer to look up, must be in the pages.
+		/// @return The span which contains the pointer.
+		PEFF_FORCEINLINE Span *get_span(const void *ptr) const noexcept {
+			assert(((const char *)ptr) >= pages_base);
+			assert(((const char *)ptr) < pages_base + (num_pages << PAGE_SHIFT));
+
+			return pagemap[((size_t)(((const char *)ptr) - pages_base)) >> PAGE_SHIFT];
+		}
+
+		PEFF_FORCEINLINE char *get_page_ptr(size_t page) const noexcept {
+			return pages_base + (page << PAGE_SHIFT);
+		}
+
+	protected:
+		PEFF_ADVUTILS_API bool _init() noexcept;
+		PEFF_ADVUTILS_API void _release_metadata() noexcept;
+
+		PEFF_ADVUTILS_API Span *_alloc_span_desc() noexcept;
+		PEFF_ADVUTILS_API void _release_span_desc(Span *span) noexcept;
+
+		PEFF_ADVUTILS_API void _insert_free_span(Span *span) noexcept;
+		PEFF_ADVUTILS_API void _remove_free_span(Span *span) noexcept;
+		PEFF_ADVUTILS_API Span *_split_span(Span *span, size_t num_pages) noexcept;
+		PEFF_ADVUTILS_API Span *_alloc_pages(size_t num_pages) noexcept;
+		PEFF_ADVUTILS_API void _release_pages(Span *span) noexcept;
+		PEFF_ADVUTILS_API void _map_span(Span *span) noexcept;
+
+		/// @brief Get a span of the size class which has free slots, allocate a new one if there is none.
+		PEFF_ADVUTILS_API Span *_get_partial_span(size_t size_class) noexcept;
+		PEFF_ADVUTILS_API void *_alloc_small(size_t size_class) noexcept;
+		PEFF_ADVUTILS_API void *_alloc_large(size_t size, size_t alignment) noexcept;
+
+		PEFF_FORCEINLINE Span *&_get_free_span_list(size_t num_pages) noexcept {
+			return free_spans[num_pages < MAX_EXACT_FREE_PAGES ? num_pages : MAX_EXACT_FREE_PAGES];
+		}
+
+		PEFF_FORCEINLINE static void _link_span(Span *&list, Span *span) noexcept {
+			span->prev = nullptr;
+			span->next = list;
+			if (list)
+				list->prev = span;
+			list = span;
+		}
+
+		PEFF_FORCEINLINE static void _unlink_span(Span *&list, Span *span) noexcept {
+			if (span->prev)
+				span->prev->next = span->next;
+			else
+				list = span->next;
+			if (span->next)
+				span->next->prev = span->prev;
+
+			span->prev = nullptr;
+			span->next = nullptr;
+		}
+	};
+}
+
+#endif
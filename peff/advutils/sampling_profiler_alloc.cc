@@ -0,0 +1,371 @@
+#include "sampling_profiler_alloc.h"
+#include <cmath>
+#include <cstring>
+
+#if defined(_WIN32)
+	#include <Windows.h>
+#else
+	#if __has_include(<execinfo.h>)
+		#include <execinfo.h>
+		#define PEFF_HAS_EXECINFO 1
+	#endif
+	#if __has_include(<dlfcn.h>)
+		#include <dlfcn.h>
+		#define PEFF_HAS_DLADDR 1
+	#endif
+	#if __has_include(<cxxabi.h>)
+		#include <cxxabi.h>
+		#define PEFF_HAS_CXXABI 1
+	#endif
+#endif
+
+using namespace peff;
+
+/// @brief Number of the frames on the top of the captured call stacks to be skipped, which is the frame of _record_sample().
+constexpr static size_t NUM_SKIPPED_FRAMES = 1;
+
+namespace {
+	struct SamplingState {
+		uint64_t random_state = 0;
+		/// @brief Bytes to be allocated by the thread before the next sample.
+		int64_t bytes_until_sample = 0;
+	};
+}
+
+static thread_local SamplingState t_sampling_state;
+
+PEFF_FORCEINLINE static uint64_t _next_random(SamplingState &state) noexcept {
+	if (!state.random_state) {
+		// Addresses of the thread-local variables differ among the threads.
+		state.random_state = (((uint64_t)(uintptr_t)&state) * 0x9e3779b97f4a7c15ULL) | 1;
+	}
+
+	// xorshift64*
+	state.random_state ^= state.random_state >> 12;
+	state.random_state ^= state.random_state << 25;
+	state.random_state ^= state.random_state >> 27;
+	return state.random_state * 0x2545f4914f6cdd1dULL;
+}
+
+/// @brief Draw the distance to the next sample from the exponential distribution, which makes the samples a Poisson process over the allocated bytes.
+PEFF_FORCEINLINE static int64_t _next_sample_distance(SamplingState &state, size_t sample_interval) noexcept {
+	// Uniform in (0, 1].
+	const double u = ((double)((_next_random(state) >> 11) + 1)) * (1.0 / 9007199254740992.0);
+	const double distance = -std::log(u) * (double)sample_interval;
+
+	if (distance < 1.0)
+		return 1;
+	if (distance > (double)INT64_MAX / 2)
+		return INT64_MAX / 2;
+	return (int64_t)distance;
+}
+
+PEFF_ADVUTILS_API SamplingProfilerAlloc::SamplingProfilerAlloc(peff::Alloc *upstream, size_t sample_interval) : upstream(upstream), sample_interval(sample_interval ? sample_interval : 1), samples(default_allocator()) {
+}
+
+PEFF_ADVUTILS_API SamplingProfilerAlloc::~SamplingProfilerAlloc() {
+}
+
+PEFF_ADVUTILS_API size_t SamplingProfilerAlloc::dec_ref(size_t global_ref_count) noexcept {
+	if (!--_ref_count) {
+		on_ref_zero();
+		return 0;
+	}
+	return _ref_count;
+}
+
+PEFF_ADVUTILS_API size_t SamplingProfilerAlloc::inc_ref(size_t global_ref_count) noexcept {
+	return ++_ref_count;
+}
+
+PEFF_ADVUTILS_API void SamplingProfilerAlloc::on_ref_zero() noexcept {
+}
+
+PEFF_ADVUTILS_API bool SamplingProfilerAlloc::_count_down(size_t size) noexcept {
+	SamplingState &state = t_sampling_state;
+
+	if (!state.random_state)
+		state.bytes_until_sample = _next_sample_distance(state, sample_interval);
+
+	if ((state.bytes_until_sample -= (int64_t)size) > 0)
+		return false;
+
+	state.bytes_until_sample = _next_sample_distance(state, sample_interval);
+	return true;
+}
+
+PEFF_ADVUTILS_API PEFF_NOINLINE void SamplingProfilerAlloc::_record_sample(void *ptr, size_t size, size_t alignment) noexcept {
+	Sample sample;
+
+	sample.size = size;
+	sample.alignment = alignment;
+	// An allocation of `size` bytes is sampled with the probability of 1 - e^(-size / interval).
+	sample.num_represented = 1.0 / (1.0 - std::exp(-((double)size) / (double)sample_interval));
+
+	void *frames[MAX_FRAMES + NUM_SKIPPED_FRAMES];
+	size_t num_frames = 0;
+
+#if defined(_WIN32)
+	num_frames = CaptureStackBackTrace(0, (DWORD)(MAX_FRAMES + NUM_SKIPPED_FRAMES), frames, nullptr);
+#elif PEFF_HAS_EXECINFO
+	int n = backtrace(frames, (int)(MAX_FRAMES + NUM_SKIPPED_FRAMES));
+	num_frames = n > 0 ? (size_t)n : 0;
+#endif
+
+	if (num_frames > NUM_SKIPPED_FRAMES) {
+		sample.num_frames = num_frames - NUM_SKIPPED_FRAMES;
+		memcpy(sample.frames, frames + NUM_SKIPPED_FRAMES, sizeof(void *) * sample.num_frames);
+	} else
+		sample.num_frames = 0;
+
+	num_samples.fetch_add(1, std::memory_order_relaxed);
+
+	_insert_sample(ptr, std::move(sample));
+}
+
+PEFF_ADVUTILS_API void SamplingProfilerAlloc::_insert_sample(void *ptr, Sample &&sample) noexcept {
+	std::lock_guard<std::mutex> samples_guard(samples_lock);
+
+	// The address has been reused without the previous block being released through the profiler.
+	if (samples.contains((uintptr_t)ptr)) {
+		samples.remove((uintptr_t)ptr);
+		get_sample_filter_counter(ptr).fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	if (!samples.insert((uintptr_t)ptr, std::move(sample))) {
+		num_dropped_samples.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	get_sample_filter_counter(ptr).fetch_add(1, std::memory_order_relaxed);
+}
+
+PEFF_ADVUTILS_API bool SamplingProfilerAlloc::_remove_sample(void *ptr, Sample *sample_out) noexcept {
+	std::lock_guard<std::mutex> samples_guard(samples_lock);
+
+	if (!samples.contains((uintptr_t)ptr))
+		return false;
+
+	if (sample_out)
+		*sample_out = samples.at((uintptr_t)ptr);
+
+	samples.remove((uintptr_t)ptr);
+	get_sample_filter_counter(ptr).fetch_sub(1, std::memory_order_relaxed);
+
+	return true;
+}
+
+PEFF_ADVUTILS_API void *SamplingProfilerAlloc::alloc(size_t size, size_t alignment) noexcept {
+	void *ptr = upstream->alloc(size, alignment);
+
+	if (ptr && _count_down(size))
+		_record_sample(ptr, size, alignment);
+
+	return ptr;
+}
+
+PEFF_ADVUTILS_API void *SamplingProfilerAlloc::realloc(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept {
+	Sample sample;
+	const bool sampled = is_maybe_sampled(ptr) && _remove_sample(ptr, &sample);
+
+	void *p = upstream->realloc(ptr, size, alignment, new_size, new_alignment);
+
+	if (sampled) {
+		if (p) {
+			sample.size = new_size;
+			sample.alignment = new_alignment;
+		}
+
+		_insert_sample(p ? p : ptr, std::move(sample));
+	}
+
+	// The growth counts down like a new allocation, a block which is not sampled yet is sampled as a whole.
+	if (p && (new_size > size) && _count_down(new_size - size) && (!sampled))
+		_record_sample(p, new_size, new_alignment);
+
+	return p;
+}
+
+PEFF_ADVUTILS_API void *SamplingProfilerAlloc::realloc_in_place(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept {
+	void *p = upstream->realloc_in_place(ptr, size, alignment, new_size, new_alignment);
+
+	if (!p)
+		return nullptr;
+
+	bool sampled = false;
+
+	if (is_maybe_sampled(ptr)) {
+		std::lock_guard<std::mutex> samples_guard(samples_lock);
+
+		if (samples.contains((uintptr_t)ptr)) {
+			Sample &sample = samples.at((uintptr_t)ptr);
+
+			sample.size = new_size;
+			sample.alignment = new_alignment;
+			sampled = true;
+		}
+	}
+
+	if ((new_size > size) && _count_down(new_size - size) && (!sampled))
+		_record_sample(p, new_size, new_alignment);
+
+	return p;
+}
+
+PEFF_ADVUTILS_API void SamplingProfilerAlloc::release(void *ptr, size_t size, size_t alignment) noexcept {
+	if (is_maybe_sampled(ptr))
+		_remove_sample(ptr, nullptr);
+
+	upstream->release(ptr, size, alignment);
+}
+
+PEFF_ADVUTILS_API size_t SamplingProfilerAlloc::alloc_batch(size_t count, size_t size, size_t alignment, void **out) noexcept {
+	const size_t n = upstream->alloc_batch(count, size, alignment, out);
+
+	for (size_t i = 0; i < n; ++i) {
+		if (_count_down(size))
+			_record_sample(out[i], size, alignment);
+	}
+
+	return n;
+}
+
+PEFF_ADVUTILS_API void SamplingProfilerAlloc::release_batch(void *const *ptrs, size_t count, size_t size, size_t alignment) noexcept {
+	for (size_t i = 0; i < count; ++i) {
+		if (is_maybe_sampled(ptrs[i]))
+			_remove_sample(ptrs[i], nullptr);
+	}
+
+	upstream->release_batch(ptrs, count, size, alignment);
+}
+
+PEFF_ADVUTILS_API size_t SamplingProfilerAlloc::trim(size_t keep_bytes, PurgePolicy policy) noexcept {
+	return upstream->trim(keep_bytes, policy);
+}
+
+PEFF_ADVUTILS_API AllocCaps SamplingProfilerAlloc::get_caps() const noexcept {
+	return upstream->get_caps();
+}
+
+PEFF_ADVUTILS_API bool SamplingProfilerAlloc::is_replaceable(const Alloc *rhs) const noexcept {
+	if (rhs->type_identity() == type_identity())
+		return upstream->is_replaceable(((const SamplingProfilerAlloc *)rhs)->upstream.get());
+
+	return upstream->is_replaceable(rhs);
+}
+
+PEFF_ADVUTILS_API UUID SamplingProfilerAlloc::type_identity() const noexcept {
+	return PEFF_UUID(81e05327, d6a4, 457d, 9d5d, 88c43d955a40);
+}
+
+PEFF_ADVUTILS_API size_t SamplingProfilerAlloc::estimate_live_size() noexcept {
+	std::lock_guard<std::mutex> samples_guard(samples_lock);
+
+	double live_size = 0;
+	for (auto i = samples.begin(); i != samples.end(); ++i)
+		live_size += (double)i.value().size * i.value().num_represented;
+
+	return (size_t)live_size;
+}
+
+/// @brief Write the name of a frame, the symbol name if it can be resolved, or the module and the offset.
+static bool _write_frame_name(FILE *fp, void *frame) noexcept {
+#if PEFF_HAS_DLADDR
+	Dl_info info;
+
+	if (dladdr(frame, &info)) {
+		if (info.dli_sname) {
+	#if PEFF_HAS_CXXABI
+			int status;
+			if (char *demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status); demangled) {
+				const bool succeeded = fputs(demangled, fp) >= 0;
+				free(demangled);
+				return succeeded;
+			}
+	#endif
+			return fputs(info.dli_sname, fp) >= 0;
+		}
+
+		if (info.dli_fname) {
+			const char *module_name = strrchr(info.dli_fname, '/');
+			return fprintf(fp, "%s+0x%zx", module_name ? module_name + 1 : info.dli_fname, (size_t)((char *)frame - (char *)info.dli_fbase)) >= 0;
+		}
+	}
+#endif
+
+	return fprintf(fp, "%p", frame) >= 0;
+}
+
+PEFF_ADVUTILS_API bool SamplingProfilerAlloc::dump_folded(FILE *fp) noexcept {
+	std::lock_guard<std::mutex> samples_guard(samples_lock);
+
+	for (auto i = samples.begin(); i != samples.end(); ++i) {
+		const Sample &sample = i.value();
+
+		if (!sample.num_frames) {
+			if (fputs("[unknown]", fp) < 0)
+				return false;
+		}
+
+		// Folded stacks start from the outermost frame.
+		for (size_t j = sample.num_frames; j; --j) {
+			if (!_write_frame_name(fp, sample.frames[j - 1]))
+				return false;
+			if ((j > 1) && (fputc(';', fp) == EOF))
+				return false;
+		}
+
+		if (fprintf(fp, " %zu\n", (size_t)((double)sample.size * sample.num_represented)) < 0)
+			return false;
+	}
+
+	return !fflush(fp);
+}
+
+PEFF_ADVUTILS_API bool SamplingProfilerAlloc::dump_pprof(FILE *fp) noexcept {
+	std::lock_guard<std::mutex> samples_guard(samples_lock);
+
+	size_t total_size = 0;
+	for (auto i = samples.begin(); i != samples.end(); ++i)
+		total_size += i.value().size;
+
+	if (fprintf(fp, "heap profile: %zu: %zu [%zu: %zu] @ heap_v2/%zu\n", samples.size(), total_size, samples.size(), total_size, sample_interval) < 0)
+		return false;
+
+	for (auto i = samples.begin(); i != samples.end(); ++i) {
+		const Sample &sample = i.value();
+
+		if (fprintf(fp, "1: %zu [1: %zu] @", sample.size, sample.size) < 0)
+			return false;
+
+		for (size_t j = 0; j < sample.num_frames; ++j) {
+			if (fprintf(fp, " 0x%zx", (size_t)(uintptr_t)sample.frames[j]) < 0)
+				return false;
+		}
+
+		if (fputc('\n', fp) == EOF)
+			return false;
+	}
+
+#if defined(__linux__)
+	// pprof resolves the addresses with the mappings of the process.
+	if (fputs("\nMAPPED_LIBRARIES:\n", fp) < 0)
+		return false;
+
+	if (FILE *maps = fopen("/proc/self/maps", "r"); maps) {
+		char buf[4096];
+		size_t n;
+
+		while ((n = fread(buf, 1, sizeof(buf), maps))) {
+			if (fwrite(buf, 1, n, fp) != n) {
+				fclose(maps);
+				return false;
+			}
+		}
+
+		fclose(maps);
+	}
+#endif
+
+	return !fflush(fp);
+}
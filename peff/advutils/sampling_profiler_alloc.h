@@ -0,0 +1,130 @@
+#ifndef _PEFF_ADVUTILS_SAMPLING_PROFILER_ALLOC_H_
+#define _PEFF_ADVUTILS_SAMPLING_PROFILER_ALLOC_H_
+
+#include "basedefs.h"
+#include <peff/base/alloc.h>
+#include <peff/containers/hashmap.h>
+#include <cstdio>
+#include <mutex>
+
+namespace peff {
+	/// @brief Decorator which samples the allocations by bytes and records their call stacks.
+	///
+	/// Each thread counts down the bytes it allocates, a sample is taken
+	/// when the counter reaches zero and the counter is reset to a random
+	/// distance with the mean of the sampling interval, so an allocation of
+	/// `size` bytes is sampled with the probability of about
+	/// `size / sample_interval`. The samples are kept until the allocations
+	/// are released, the live samples can be dumped as a heap profile.
+	///
+	/// Allocations which are not sampled only cost a thread-local
+	/// subtraction, releasing only costs a lookup in a counting filter of
+	/// the sampled addresses, the lock is only taken for the samples.
+	///
+	/// @note The countdown is shared by all profilers of a thread, the profilers are expected to have the same sampling interval.
+	class SamplingProfilerAlloc : public Alloc {
+	protected:
+		std::atomic_size_t _ref_count = 0;
+
+	public:
+		constexpr static size_t DEFAULT_SAMPLE_INTERVAL = 512 * 1024;
+		constexpr static size_t MAX_FRAMES = 32;
+		/// @brief Number of the counters of the filter of the sampled addresses, must be a power of two.
+		constexpr static size_t SAMPLE_FILTER_SIZE = 4096;
+
+		struct Sample {
+			size_t size;
+			size_t alignment;
+			/// @brief Number of the allocations which the sample stands for, the estimated bytes are `size * num_represented`.
+			double num_represented;
+			size_t num_frames;
+			/// @brief Return addresses of the call stack, the innermost frame first.
+			void *frames[MAX_FRAMES];
+		};
+
+		struct SampleAddressHasher {
+			PEFF_FORCEINLINE size_t operator()(uintptr_t x) const {
+				// The low bits of the addresses are mostly zeros.
+				return (size_t)((x >> 4) * 0x9e3779b97f4a7c15ULL);
+			}
+		};
+
+		using SampleMap = HashMap<uintptr_t, Sample, std::equal_to<uintptr_t>, SampleAddressHasher>;
+
+		peff::RcObjectPtr<peff::Alloc> upstream;
+		size_t sample_interval;
+
+		std::mutex samples_lock;
+		/// @brief Live samples by the addresses, allocated from the default allocator.
+		SampleMap samples;
+		/// @brief Counting filter of the sampled addresses, so that releasing the unsampled ones does not take the lock.
+		std::atomic_uint32_t sample_filter[SAMPLE_FILTER_SIZE] = {};
+
+		std::atomic_size_t num_samples = 0;
+		std::atomic_size_t num_dropped_samples = 0;
+
+		PEFF_ADVUTILS_API SamplingProfilerAlloc(peff::Alloc *upstream, size_t sample_interval = DEFAULT_SAMPLE_INTERVAL);
+		SamplingProfilerAlloc(const SamplingProfilerAlloc &) = delete;
+		PEFF_ADVUTILS_API virtual ~SamplingProfilerAlloc();
+
+		SamplingProfilerAlloc &operator=(const SamplingProfilerAlloc &) = delete;
+
+		PEFF_ADVUTILS_API virtual size_t inc_ref(size_t global_ref_count) noexcept override;
+		PEFF_ADVUTILS_API virtual size_t dec_ref(size_t global_ref_count) noexcept override;
+		PEFF_ADVUTILS_API virtual void on_ref_zero() noexcept;
+
+		PEFF_ADVUTILS_API virtual void *alloc(size_t size, size_t alignment = 0) noexcept override;
+		/// @brief A sampled block keeps its sample and call stack when it is reallocated.
+		/// @note The growth of a block is counted down as allocated bytes, so blocks which grow by small steps are sampled too.
+		PEFF_ADVUTILS_API virtual void *realloc(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override;
+		/// @note The growth is counted down like realloc().
+		PEFF_ADVUTILS_API virtual void *realloc_in_place(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override;
+		PEFF_ADVUTILS_API virtual void release(void *ptr, size_t size, size_t alignment) noexcept override;
+		PEFF_ADVUTILS_API virtual size_t alloc_batch(size_t count, size_t size, size_t alignment, void **out) noexcept override;
+		PEFF_ADVUTILS_API virtual void release_batch(void *const *ptrs, size_t count, size_t size, size_t alignment) noexcept override;
+		PEFF_ADVUTILS_API virtual size_t trim(size_t keep_bytes, PurgePolicy policy = PurgePolicy::Lazy) noexcept override;
+
+		PEFF_ADVUTILS_API virtual AllocCaps get_caps() const noexcept override;
+
+		/// @brief Memory from the profiler is allocated by the upstream allocator.
+		PEFF_ADVUTILS_API virtual bool is_replaceable(const Alloc *rhs) const noexcept override;
+
+		PEFF_ADVUTILS_API virtual UUID type_identity() const noexcept override;
+
+		/// @brief Estimate the total size of the live allocations from the samples.
+		PEFF_ADVUTILS_API size_t estimate_live_size() noexcept;
+
+		/// @brief Write the live samples as folded stacks, one line per sample with the frames from the outermost one and the estimated bytes.
+		/// @return true for succeeded, false if failed to write.
+		/// @note The output can be fed to the flame graph tools directly.
+		PEFF_ADVUTILS_API bool dump_folded(FILE *fp) noexcept;
+		/// @brief Write the live samples as a legacy heap profile, which can be read by pprof.
+		/// @return true for succeeded, false if failed to write.
+		/// @note The raw samples are written, pprof scales them with the sampling interval in the header.
+		PEFF_ADVUTILS_API bool dump_pprof(FILE *fp) noexcept;
+
+		/// @brief Get the counter of the sample filter for an address.
+		PEFF_FORCEINLINE std::atomic_uint32_t &get_sample_filter_counter(const void *ptr) noexcept {
+			return sample_filter[(SampleAddressHasher()((uintptr_t)ptr) >> 20) & (SAMPLE_FILTER_SIZE - 1)];
+		}
+
+		/// @brief Check if an address may be sampled, false positives are possible.
+		PEFF_FORCEINLINE bool is_maybe_sampled(const void *ptr) noexcept {
+			return get_sample_filter_counter(ptr).load(std::memory_order_relaxed);
+		}
+
+	protected:
+		/// @brief Count down the sampling distance of the calling thread.
+		/// @return Whether the allocation is to be sampled.
+		PEFF_ADVUTILS_API bool _count_down(size_t size) noexcept;
+		/// @brief Capture the call stack and record a sample, the frame of this function is not included in the call stack.
+		PEFF_ADVUTILS_API PEFF_NOINLINE void _record_sample(void *ptr, size_t size, size_t alignment) noexcept;
+		/// @brief Remove the sample of an address if there is one.
+		/// @param sample_out Where to store the removed sample, can be nullptr.
+		/// @return Whether a sample has been removed.
+		PEFF_ADVUTILS_API bool _remove_sample(void *ptr, Sample *sample_out) noexcept;
+		PEFF_ADVUTILS_API void _insert_sample(void *ptr, Sample &&sample) noexcept;
+	};
+}
+
+#endif
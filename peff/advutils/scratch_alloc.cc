@@ -0,0 +1,157 @@
+#include "scratch_alloc.h"
+#include "page_purge.h"
+#include <cstring>
+
+using namespace peff;
+
+PEFF_FORCEINLINE static char *_align_ptr(char *ptr, size_t alignment) {
+	if (size_t diff = ((uintptr_t)ptr) % alignment; diff) {
+		return ptr + (alignment - diff);
+	}
+	return ptr;
+}
+
+static thread_local ScratchAlloc t_scratch_alloc(default_allocator());
+
+PEFF_ADVUTILS_API ScratchAlloc::ScratchAlloc(peff::Alloc *upstream, size_t region_size) : upstream(upstream), region_size(region_size) {
+}
+
+PEFF_ADVUTILS_API ScratchAlloc::~ScratchAlloc() {
+	if (region)
+		upstream->release(region, region_size, REGION_ALIGNMENT);
+}
+
+PEFF_ADVUTILS_API size_t ScratchAlloc::dec_ref(size_t global_ref_count) noexcept {
+	if (!--_ref_count) {
+		on_ref_zero();
+		return 0;
+	}
+	return _ref_count;
+}
+
+PEFF_ADVUTILS_API size_t ScratchAlloc::inc_ref(size_t global_ref_count) noexcept {
+	return ++_ref_count;
+}
+
+PEFF_ADVUTILS_API void ScratchAlloc::on_ref_zero() noexcept {
+}
+
+PEFF_ADVUTILS_API ScratchAlloc *ScratchAlloc::get_thread_local() noexcept {
+	return &t_scratch_alloc;
+}
+
+PEFF_ADVUTILS_API bool ScratchAlloc::_ensure_region() noexcept {
+	if (region)
+		return true;
+
+	if (!(region = (char *)upstream->alloc(region_size, REGION_ALIGNMENT)))
+		return false;
+
+	region_end = region + region_size;
+	cur_ptr = region;
+	peak_ptr = region;
+
+	return true;
+}
+
+PEFF_ADVUTILS_API void *ScratchAlloc::alloc(size_t size, size_t alignment) noexcept {
+	if (!alignment)
+		alignment = 1;
+
+	if (_ensure_region()) {
+		char *ptr = _align_ptr(cur_ptr, alignment);
+
+		if ((ptr < region_end) && (size <= (size_t)(region_end - ptr))) {
+			cur_ptr = ptr + size;
+			if (cur_ptr > peak_ptr)
+				peak_ptr = cur_ptr;
+			return ptr;
+		}
+	}
+
+	++num_fallbacks;
+	return upstream->alloc(size, alignment);
+}
+
+PEFF_ADVUTILS_API void *ScratchAlloc::realloc(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept {
+	if (!contains(ptr))
+		return upstream->realloc(ptr, size, alignment, new_size, new_alignment);
+
+	void *p;
+
+	if ((p = realloc_in_place(ptr, size, alignment, new_size, new_alignment)))
+		return p;
+
+	if (!(p = alloc(new_size, new_alignment)))
+		return nullptr;
+
+	memcpy(p, ptr, size < new_size ? size : new_size);
+
+	// Pops the old block if it is still the most recent one in the region, which is when the new one is from the upstream allocator.
+	release(ptr, size, alignment);
+
+	return p;
+}
+
+PEFF_ADVUTILS_API void *ScratchAlloc::realloc_in_place(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept {
+	if (!contains(ptr))
+		return upstream->realloc_in_place(ptr, size, alignment, new_size, new_alignment);
+
+	if (new_alignment && (((uintptr_t)ptr) % new_alignment))
+		return nullptr;
+
+	if (((char *)ptr) + size == cur_ptr) {
+		// The most recent allocation, extend or shrink it by moving the bump pointer.
+		if (new_size <= (size_t)(region_end - (char *)ptr)) {
+			cur_ptr = ((char *)ptr) + new_size;
+			if (cur_ptr > peak_ptr)
+				peak_ptr = cur_ptr;
+			return ptr;
+		}
+		return nullptr;
+	}
+
+	if (new_size <= size)
+		return ptr;
+
+	return nullptr;
+}
+
+PEFF_ADVUTILS_API void ScratchAlloc::release(void *ptr, size_t size, size_t alignment) noexcept {
+	if (!contains(ptr)) {
+		upstream->release(ptr, size, alignment);
+		return;
+	}
+
+	// Pop the most recent allocation, the others are reclaimed by rolling back.
+	if (((char *)ptr) + size == cur_ptr)
+		cur_ptr = (char *)ptr;
+}
+
+PEFF_ADVUTILS_API size_t ScratchAlloc::trim(size_t keep_bytes, PurgePolicy policy) noexcept {
+	size_t trimmed_size = 0;
+
+	if (region) {
+		// Only the part of the region which has been touched is purged.
+		if (const size_t free_size = (size_t)(peak_ptr - cur_ptr); free_size > keep_bytes)
+			trimmed_size = purge_pages(cur_ptr + keep_bytes, free_size - keep_bytes, policy);
+	}
+
+	return trimmed_size + upstream->trim(keep_bytes, policy);
+}
+
+PEFF_ADVUTILS_API AllocCaps ScratchAlloc::get_caps() const noexcept {
+	return AllocCaps();
+}
+
+PEFF_ADVUTILS_API bool ScratchAlloc::is_replaceable(const Alloc *rhs) const noexcept {
+	if (rhs->type_identity() != type_identity()) {
+		return false;
+	}
+
+	return rhs == this;
+}
+
+PEFF_ADVUTILS_API UUID ScratchAlloc::type_identity() const noexcept {
+	return PEFF_UUID(11a16a48, 4eba, 48bf, b90c, 34166b9ada34);
+}
@@ -0,0 +1,116 @@
+#ifndef _PEFF_ADVUTILS_SCRATCH_ALLOC_H_
+#define _PEFF_ADVUTILS_SCRATCH_ALLOC_H_
+
+#include "basedefs.h"
+#include <peff/base/alloc.h>
+
+namespace peff {
+	/// @brief LIFO allocator for the temporary buffers, which bump-allocates from a fixed region.
+	///
+	/// Releasing the most recent allocation pops it from the region, other
+	/// releases in the region are no-ops and the memory is reclaimed when
+	/// the enclosing ScratchScope exits. Requests which do not fit into the
+	/// rest of the region fall back to the upstream allocator, the blocks
+	/// from which are released to the upstream allocator as usual.
+	///
+	/// Each thread has its own instance returned by get_thread_local(),
+	/// whose region is allocated on the first request.
+	///
+	/// @note The allocator is not thread-safe, an instance must only be used by one thread.
+	class ScratchAlloc : public Alloc {
+	protected:
+		std::atomic_size_t _ref_count = 0;
+
+	public:
+		constexpr static size_t DEFAULT_REGION_SIZE = 256 * 1024;
+		constexpr static size_t REGION_ALIGNMENT = alignof(std::max_align_t);
+
+		peff::RcObjectPtr<peff::Alloc> upstream;
+		size_t region_size;
+		char *region = nullptr, *region_end = nullptr;
+		char *cur_ptr = nullptr;
+		/// @brief Highest position of the bump pointer since the region was allocated.
+		char *peak_ptr = nullptr;
+		/// @brief Number of the requests which have fallen back to the upstream allocator.
+		size_t num_fallbacks = 0;
+
+		PEFF_ADVUTILS_API ScratchAlloc(peff::Alloc *upstream, size_t region_size = DEFAULT_REGION_SIZE);
+		ScratchAlloc(const ScratchAlloc &) = delete;
+		PEFF_ADVUTILS_API virtual ~ScratchAlloc();
+
+		ScratchAlloc &operator=(const ScratchAlloc &) = delete;
+
+		PEFF_ADVUTILS_API virtual size_t inc_ref(size_t global_ref_count) noexcept override;
+		PEFF_ADVUTILS_API virtual size_t dec_ref(size_t global_ref_count) noexcept override;
+		PEFF_ADVUTILS_API virtual void on_ref_zero() noexcept;
+
+		PEFF_ADVUTILS_API virtual void *alloc(size_t size, size_t alignment = 0) noexcept override;
+		PEFF_ADVUTILS_API virtual void *realloc(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override;
+		/// @brief Only the most recent allocation in the region can be grown in place.
+		PEFF_ADVUTILS_API virtual void *realloc_in_place(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override;
+		PEFF_ADVUTILS_API virtual void release(void *ptr, size_t size, size_t alignment) noexcept override;
+		PEFF_ADVUTILS_API virtual size_t trim(size_t keep_bytes, PurgePolicy policy = PurgePolicy::Lazy) noexcept override;
+
+		/// @brief The allocator is not monotonic, since the blocks from the upstream allocator must be released.
+		PEFF_ADVUTILS_API virtual AllocCaps get_caps() const noexcept override;
+
+		PEFF_ADVUTILS_API virtual bool is_replaceable(const Alloc *rhs) const noexcept override;
+
+		PEFF_ADVUTILS_API virtual UUID type_identity() const noexcept override;
+
+		/// @brief Get the scratch allocator of the current thread, which allocates its region from the default allocator.
+		PEFF_ADVUTILS_API static ScratchAlloc *get_thread_local() noexcept;
+
+		PEFF_FORCEINLINE bool contains(const void *ptr) const noexcept {
+			return (((const char *)ptr) >= region) && (((const char *)ptr) < region_end);
+		}
+
+		/// @brief Get current position of the bump pointer, used for rolling back.
+		PEFF_FORCEINLINE char *mark() const noexcept {
+			return cur_ptr;
+		}
+
+		/// @brief Roll the region back to a marker, all allocations in the region after the marker are invalidated.
+		/// @param marker Marker returned by mark().
+		PEFF_FORCEINLINE void rewind(char *marker) noexcept {
+			// The marker is null if the region was allocated after it, and may
+			// be above the bump pointer if a block allocated before it has been popped.
+			if (!marker)
+				cur_ptr = region;
+			else if (marker < cur_ptr)
+				cur_ptr = marker;
+		}
+
+		PEFF_FORCEINLINE size_t get_used_size() const noexcept {
+			return (size_t)(cur_ptr - region);
+		}
+
+		PEFF_FORCEINLINE size_t get_peak_used_size() const noexcept {
+			return (size_t)(peak_ptr - region);
+		}
+
+	protected:
+		/// @brief Allocate the region from the upstream allocator if it has not been allocated.
+		PEFF_ADVUTILS_API bool _ensure_region() noexcept;
+	};
+
+	/// @brief RAII marker which rolls a ScratchAlloc back to where it was on construction.
+	///
+	/// Containers using the scratch allocator must be destructed before the
+	/// scope exits, so the scope is usually declared before them.
+	class ScratchScope {
+	public:
+		ScratchAlloc *allocator;
+		char *marker;
+
+		PEFF_FORCEINLINE ScratchScope(ScratchAlloc *allocator = ScratchAlloc::get_thread_local()) noexcept : allocator(allocator), marker(allocator->mark()) {}
+		ScratchScope(const ScratchScope &) = delete;
+		PEFF_FORCEINLINE ~ScratchScope() {
+			allocator->rewind(marker);
+		}
+
+		ScratchScope &operator=(const ScratchScope &) = delete;
+	};
+}
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef _PEFF_ADVUTILS_SIZE_CLASS_H_
+#define _PEFF_ADVUTILS_SIZE_CLASS_H_
+
+#include "basedefs.h"
+#include <cstdint>
+#include <cstring>
+
+namespace peff {
+	/// @brief Size of the smallest size class, also the granularity of the free list links.
+	constexpr size_t SIZE_CLASS_MIN_SIZE = 16;
+	/// @brief Size of the largest size class, larger requests are not served by size classes.
+	constexpr size_t SIZE_CLASS_MAX_SIZE = 2048;
+	/// @brief Number of the size classes, each power of two is divided into 4 classes (1x, 1.25x, 1.5x, 1.75x).
+	constexpr size_t NUM_SIZE_CLASSES = 29;
+	constexpr size_t INVALID_SIZE_CLASS = SIZE_MAX;
+
+	/// @brief Get the slot size of a size class.
+	/// @param size_class Index of the size class.
+	/// @return Slot size of the size class.
+	PEFF_FORCEINLINE constexpr size_t size_class_to_size(size_t size_class) noexcept {
+		if (!size_class)
+			return SIZE_CLASS_MIN_SIZE;
+
+		const size_t p = 4 + ((size_class - 1) >> 2), sub = ((size_class - 1) & 3) + 1;
+
+		return ((size_t)1 << p) + (sub << (p - 2));
+	}
+
+	/// @brief Get the largest alignment that every slot of a size class satisfies.
+	PEFF_FORCEINLINE constexpr size_t size_class_max_alignment(size_t size_class) noexcept {
+		const size_t size = size_class_to_size(size_class);
+		return size & (~size + 1);
+	}
+
+	namespace details {
+		constexpr size_t SIZE_CLASS_TABLE_GRANULARITY_SHIFT = 2;
+
+		PEFF_FORCEINLINE constexpr size_t calc_size_class_slowly(size_t size) noexcept {
+			if (size <= SIZE_CLASS_MIN_SIZE)
+				return 0;
+
+			// Find p that 2^p < size <= 2^(p + 1).
+			size_t p = 4;
+			while (((size_t)1 << (p + 1)) < size)
+				++p;
+
+			const size_t step_shift = p - 2;
+			const size_t sub = (size - ((size_t)1 << p) + ((size_t)1 << step_shift) - 1) >> step_shift;
+
+			return ((p - 4) << 2) + sub;
+		}
+
+		struct SizeClassTable {
+			uint8_t classes[(SIZE_CLASS_MAX_SIZE >> SIZE_CLASS_TABLE_GRANULARITY_SHIFT) + 1];
+
+			constexpr SizeClassTable() : classes() {
+				for (size_t i = 0; i < sizeof(classes); ++i) {
+					classes[i] = (uint8_t)calc_size_class_slowly(i << SIZE_CLASS_TABLE_GRANULARITY_SHIFT);
+				}
+			}
+		};
+
+		inline constexpr SizeClassTable SIZE_CLASS_TABLE = {};
+	}
+
+	/// @brief Map an allocation request to a size class.
+	/// @param size Size of the allocation.
+	/// @param alignment Alignment of the allocation.
+	/// @return Index of the size class, INVALID_SIZE_CLASS if the request cannot be served by any size class.
+	/// @note The mapping is deterministic, allocators can recompute the size class from the size and alignment on release.
+	PEFF_FORCEINLINE size_t size_to_size_class(size_t size, size_t alignment) noexcept {
+		if (size > SIZE_CLASS_MAX_SIZE)
+			return INVALID_SIZE_CLASS;
+
+		size_t size_class = details::SIZE_CLASS_TABLE.classes[(size + ((1 << details::SIZE_CLASS_TABLE_GRANULARITY_SHIFT) - 1)) >> details::SIZE_CLASS_TABLE_GRANULARITY_SHIFT];
+
+		// Slots of the classes are placed at multiples of the slot size,
+		// skip the classes whose slots cannot satisfy the alignment.
+		while (size_class_max_alignment(size_class) < alignment) {
+			if (++size_class >= NUM_SIZE_CLASSES)
+				return INVALID_SIZE_CLASS;
+		}
+
+		return size_class;
+	}
+
+	/// @brief Read the free list link stored in a free slot.
+	/// @note Slots of some size classes are not pointer-aligned, so the links are accessed bytewise.
+	PEFF_FORCEINLINE void *read_free_slot_link(const void *slot) noexcept {
+		void *link;
+		memcpy(&link, slot, sizeof(link));
+		return link;
+	}
+
+	/// @brief Write the free list link into a free slot.
+	PEFF_FORCEINLINE void write_free_slot_link(void *slot, void *link) noexcept {
+		memcpy(slot, &link, sizeof(link));
+	}
+}
+
+#endif
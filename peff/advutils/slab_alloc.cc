@@ -0,0 +1,283 @@
+#include "slab_alloc.h"
+#include <cstring>
+
+using namespace peff;
+
+PEFF_ADVUTILS_API SlabAlloc::SlabAlloc(peff::Alloc *upstream) : upstream(upstream) {
+}
+
+PEFF_ADVUTILS_API SlabAlloc::SlabAlloc(SlabAlloc &&rhs) noexcept : upstream(std::move(rhs.upstream)), slabs(rhs.slabs) {
+	memcpy(size_classes, rhs.size_classes, sizeof(size_classes));
+
+	rhs.slabs = nullptr;
+	for (auto &i : rhs.size_classes)
+		i = {};
+}
+
+PEFF_ADVUTILS_API SlabAlloc::~SlabAlloc() {
+	_release_all_slabs();
+}
+
+PEFF_ADVUTILS_API SlabAlloc &SlabAlloc::operator=(SlabAlloc &&rhs) noexcept {
+	_release_all_slabs();
+
+	upstream = std::move(rhs.upstream);
+	slabs = rhs.slabs;
+	memcpy(size_classes, rhs.size_classes, sizeof(size_classes));
+
+	rhs.slabs = nullptr;
+	for (auto &i : rhs.size_classes)
+		i = {};
+
+	return *this;
+}
+
+PEFF_ADVUTILS_API size_t SlabAlloc::dec_ref(size_t global_ref_count) noexcept {
+	if (!--_ref_count) {
+		on_ref_zero();
+		return 0;
+	}
+	return _ref_count;
+}
+
+PEFF_ADVUTILS_API size_t SlabAlloc::inc_ref(size_t global_ref_count) noexcept {
+	return ++_ref_count;
+}
+
+PEFF_ADVUTILS_API void SlabAlloc::on_ref_zero() noexcept {
+}
+
+PEFF_ADVUTILS_API SlabAlloc::SlabHeader *SlabAlloc::_alloc_slab(size_t size_class) noexcept {
+	const size_t slab_size = calc_slab_size(size_class);
+
+	char *slab = (char *)upstream->alloc(slab_size, slab_size);
+	if (!slab)
+		return nullptr;
+
+	SlabHeader *header = (SlabHeader *)(slab + slab_size - sizeof(SlabHeader));
+	peff::construct_at<SlabHeader>(header);
+
+	header->bump_ptr = slab;
+	header->num_slots = (uint32_t)((slab_size - sizeof(SlabHeader)) / size_class_to_size(size_class));
+	header->size_class = (uint8_t)size_class;
+
+	header->next = slabs;
+	if (slabs)
+		slabs->prev = header;
+	slabs = header;
+
+	_link_partial(header);
+
+	return header;
+}
+
+PEFF_ADVUTILS_API void SlabAlloc::_release_slab(SlabHeader *slab) noexcept {
+	const size_t slab_size = calc_slab_size(slab->size_class);
+
+	if (slab->is_partial)
+		_unlink_partial(slab);
+
+	if (slab->prev)
+		slab->prev->next = slab->next;
+	else
+		slabs = slab->next;
+	if (slab->next)
+		slab->next->prev = slab->prev;
+
+	char *base = ((char *)slab) + sizeof(SlabHeader) - slab_size;
+	std::destroy_at<SlabHeader>(slab);
+
+	upstream->release(base, slab_size, slab_size);
+}
+
+PEFF_ADVUTILS_API void SlabAlloc::_release_all_slabs() noexcept {
+	while (slabs)
+		_release_slab(slabs);
+
+	for (auto &i : size_classes)
+		i = {};
+}
+
+PEFF_ADVUTILS_API void *SlabAlloc::alloc(size_t size, size_t alignment) noexcept {
+	const size_t size_class = size_to_size_class(size, alignment);
+
+	if (size_class == INVALID_SIZE_CLASS)
+		return upstream->alloc(size, alignment);
+
+	SizeClassDesc &desc = size_classes[size_class];
+	SlabHeader *slab = desc.partial_slabs;
+
+	if (!slab) {
+		if (!(slab = _alloc_slab(size_class)))
+			return nullptr;
+	}
+
+	void *ptr;
+	if (slab->free_list) {
+		ptr = slab->free_list;
+		slab->free_list = read_free_slot_link(ptr);
+	} else {
+		ptr = slab->bump_ptr;
+		slab->bump_ptr += size_class_to_size(size_class);
+	}
+
+	if (!slab->num_used++) {
+		if (desc.empty_slab == slab)
+			desc.empty_slab = nullptr;
+	}
+
+	if (slab->num_used == slab->num_slots)
+		_unlink_partial(slab);
+
+	return ptr;
+}
+
+PEFF_ADVUTILS_API void *SlabAlloc::realloc(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept {
+	void *p;
+
+	if ((p = realloc_in_place(ptr, size, alignment, new_size, new_alignment)))
+		return p;
+
+	const size_t size_class = size_to_size_class(size, alignment),
+				 new_size_class = size_to_size_class(new_size, new_alignment);
+
+	if ((size_class == INVALID_SIZE_CLASS) && (new_size_class == INVALID_SIZE_CLASS))
+		return upstream->realloc(ptr, size, alignment, new_size, new_alignment);
+
+	if (!(p = alloc(new_size, new_alignment)))
+		return nullptr;
+
+	memcpy(p, ptr, size < new_size ? size : new_size);
+
+	release(ptr, size, alignment);
+
+	return p;
+}
+
+PEFF_ADVUTILS_API void *SlabAlloc::realloc_in_place(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept {
+	const size_t size_class = size_to_size_class(size, alignment),
+				 new_size_class = size_to_size_class(new_size, new_alignment);
+
+	if (size_class == INVALID_SIZE_CLASS) {
+		if (new_size_class == INVALID_SIZE_CLASS)
+			return upstream->realloc_in_place(ptr, size, alignment, new_size, new_alignment);
+		return nullptr;
+	}
+
+	// The slot is big enough, the request can be fulfilled without moving.
+	if (size_class == new_size_class)
+		return ptr;
+
+	return nullptr;
+}
+
+PEFF_ADVUTILS_API size_t SlabAlloc::alloc_batch(size_t count, size_t size, size_t alignment, void **out) noexcept {
+	const size_t size_class = size_to_size_class(size, alignment);
+
+	if (size_class == INVALID_SIZE_CLASS)
+		return upstream->alloc_batch(count, size, alignment, out);
+
+	const size_t slot_size = size_class_to_size(size_class);
+	SizeClassDesc &desc = size_classes[size_class];
+	size_t i = 0;
+
+	while (i < count) {
+		SlabHeader *slab = desc.partial_slabs;
+
+		if (!slab) {
+			if (!(slab = _alloc_slab(size_class)))
+				break;
+		}
+
+		if ((!slab->num_used) && (desc.empty_slab == slab))
+			desc.empty_slab = nullptr;
+
+		const size_t num_free_slots = slab->num_slots - slab->num_used,
+					 n = count - i < num_free_slots ? count - i : num_free_slots;
+
+		// Take the free slots first, then carve the rest from the untouched part of the slab.
+		size_t j = 0;
+		for (; (j < n) && slab->free_list; ++j) {
+			out[i++] = slab->free_list;
+			slab->free_list = read_free_slot_link(slab->free_list);
+		}
+		for (; j < n; ++j) {
+			out[i++] = slab->bump_ptr;
+			slab->bump_ptr += slot_size;
+		}
+
+		slab->num_used += (uint32_t)n;
+
+		if (slab->num_used == slab->num_slots)
+			_unlink_partial(slab);
+	}
+
+	return i;
+}
+
+PEFF_ADVUTILS_API void SlabAlloc::release(void *ptr, size_t size, size_t alignment) noexcept {
+	const size_t size_class = size_to_size_class(size, alignment);
+
+	if (size_class == INVALID_SIZE_CLASS) {
+		upstream->release(ptr, size, alignment);
+		return;
+	}
+
+	SlabHeader *slab = get_slab_header(ptr, calc_slab_size(size_class));
+
+	assert(slab->size_class == size_class);
+	assert(slab->num_used);
+
+	write_free_slot_link(ptr, slab->free_list);
+	slab->free_list = ptr;
+
+	if (!slab->is_partial)
+		_link_partial(slab);
+
+	if (!--slab->num_used) {
+		// Retain one empty slab for each size class to avoid thrashing.
+		SizeClassDesc &desc = size_classes[size_class];
+
+		if (!desc.empty_slab)
+			desc.empty_slab = slab;
+		else
+			_release_slab(slab);
+	}
+}
+
+PEFF_ADVUTILS_API size_t SlabAlloc::trim(size_t keep_bytes, PurgePolicy policy) noexcept {
+	size_t retained_size = 0, trimmed_size = 0;
+
+	for (size_t i = 0; i < NUM_SIZE_CLASSES; ++i) {
+		SizeClassDesc &desc = size_classes[i];
+
+		if (!desc.empty_slab)
+			continue;
+
+		const size_t slab_size = calc_slab_size(i);
+
+		if (retained_size + slab_size <= keep_bytes) {
+			retained_size += slab_size;
+			continue;
+		}
+
+		_release_slab(desc.empty_slab);
+		desc.empty_slab = nullptr;
+
+		trimmed_size += slab_size;
+	}
+
+	return trimmed_size + upstream->trim(keep_bytes, policy);
+}
+
+PEFF_ADVUTILS_API bool SlabAlloc::is_replaceable(const Alloc *rhs) const noexcept {
+	if (rhs->type_identity() != type_identity()) {
+		return false;
+	}
+
+	return rhs == this;
+}
+
+PEFF_ADVUTILS_API UUID SlabAlloc::type_identity() const noexcept {
+	return PEFF_UUID(71478328, dfa7, 4126, b85d, e0808ad482ad);
+}
@@ -0,0 +1,119 @@
+#ifndef _PEFF_ADVUTILS_SLAB_ALLOC_H_
+#define _PEFF_ADVUTILS_SLAB_ALLOC_H_
+
+#include "basedefs.h"
+#include "size_class.h"
+#include <peff/base/alloc.h>
+
+namespace peff {
+	/// @brief Size-class based slab allocator.
+	///
+	/// Small requests are rounded up to a size class and served from slabs
+	/// carved out of the upstream allocator, requests that do not fit into
+	/// any size class are forwarded to the upstream allocator directly.
+	///
+	/// @note The allocator is not thread-safe.
+	class SlabAlloc : public Alloc {
+	protected:
+		std::atomic_size_t _ref_count = 0;
+
+	public:
+		/// @brief Slab header, placed at the end of each slab so the slots keep the natural alignment of the slab.
+		struct SlabHeader {
+			SlabHeader *prev_partial = nullptr, *next_partial = nullptr;
+			SlabHeader *prev = nullptr, *next = nullptr;
+			void *free_list = nullptr;
+			char *bump_ptr;
+			uint32_t num_used = 0;
+			uint32_t num_slots;
+			uint8_t size_class;
+			bool is_partial = false;
+		};
+
+		struct SizeClassDesc {
+			/// @brief Slabs with at least one free slot.
+			SlabHeader *partial_slabs = nullptr;
+			/// @brief The empty slab which is retained for reusing.
+			SlabHeader *empty_slab = nullptr;
+		};
+
+		constexpr static size_t SLAB_PAGE_SIZE = 4096;
+		constexpr static size_t SLAB_MIN_SLOTS = 8;
+
+		peff::RcObjectPtr<peff::Alloc> upstream;
+		SizeClassDesc size_classes[NUM_SIZE_CLASSES];
+		SlabHeader *slabs = nullptr;
+
+		PEFF_FORCEINLINE constexpr static size_t calc_slab_size(size_t size_class) noexcept {
+			const size_t min_size = size_class_to_size(size_class) * SLAB_MIN_SLOTS + sizeof(SlabHeader);
+
+			size_t slab_size = SLAB_PAGE_SIZE;
+			while (slab_size < min_size)
+				slab_size <<= 1;
+
+			return slab_size;
+		}
+
+		PEFF_FORCEINLINE static SlabHeader *get_slab_header(void *ptr, size_t slab_size) noexcept {
+			// Slabs are aligned to their sizes, so we can find the header by masking.
+			char *slab = (char *)(((uintptr_t)ptr) & ~(uintptr_t)(slab_size - 1));
+
+			return (SlabHeader *)(slab + slab_size - sizeof(SlabHeader));
+		}
+
+		PEFF_ADVUTILS_API SlabAlloc(peff::Alloc *upstream);
+		PEFF_ADVUTILS_API SlabAlloc(SlabAlloc &&rhs) noexcept;
+		PEFF_ADVUTILS_API virtual ~SlabAlloc();
+
+		PEFF_ADVUTILS_API SlabAlloc &operator=(SlabAlloc &&rhs) noexcept;
+
+		PEFF_ADVUTILS_API virtual size_t inc_ref(size_t global_ref_count) noexcept override;
+		PEFF_ADVUTILS_API virtual size_t dec_ref(size_t global_ref_count) noexcept override;
+		PEFF_ADVUTILS_API virtual void on_ref_zero() noexcept;
+
+		PEFF_ADVUTILS_API virtual void *alloc(size_t size, size_t alignment = 0) noexcept override;
+		PEFF_ADVUTILS_API virtual void *realloc(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override;
+		PEFF_ADVUTILS_API virtual void *realloc_in_place(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override;
+		PEFF_ADVUTILS_API virtual void release(void *ptr, size_t size, size_t alignment) noexcept override;
+		PEFF_ADVUTILS_API virtual size_t alloc_batch(size_t count, size_t size, size_t alignment, void **out) noexcept override;
+		/// @brief Release the retained empty slabs which exceed `keep_bytes` to the upstream allocator.
+		PEFF_ADVUTILS_API virtual size_t trim(size_t keep_bytes, PurgePolicy policy = PurgePolicy::Lazy) noexcept override;
+
+		PEFF_ADVUTILS_API virtual bool is_replaceable(const Alloc *rhs) const noexcept override;
+
+		PEFF_ADVUTILS_API virtual UUID type_identity() const noexcept override;
+
+	protected:
+		PEFF_ADVUTILS_API SlabHeader *_alloc_slab(size_t size_class) noexcept;
+		PEFF_ADVUTILS_API void _release_slab(SlabHeader *slab) noexcept;
+		PEFF_ADVUTILS_API void _release_all_slabs() noexcept;
+
+		PEFF_FORCEINLINE void _link_partial(SlabHeader *slab) noexcept {
+			SizeClassDesc &desc = size_classes[slab->size_class];
+
+			slab->prev_partial = nullptr;
+			slab->next_partial = desc.partial_slabs;
+			if (desc.partial_slabs)
+				desc.partial_slabs->prev_partial = slab;
+			desc.partial_slabs = slab;
+			slab->is_partial = true;
+		}
+
+		PEFF_FORCEINLINE void _unlink_partial(SlabHeader *slab) noexcept {
+			SizeClassDesc &desc = size_classes[slab->size_class];
+
+			if (slab->prev_partial)
+				slab->prev_partial->next_partial = slab->next_partial;
+			else
+				desc.partial_slabs = slab->next_partial;
+			if (slab->next_partial)
+				slab->next_partial->prev_partial = slab->prev_partial;
+
+			slab->prev_partial = nullptr;
+			slab->next_partial = nullptr;
+			slab->is_partial = false;
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,354 @@
+#include "thread_caching_alloc.h"
+#include <cstring>
+
+using namespace peff;
+
+/// @brief Protects the cache registries of all allocators and the owners of the caches.
+static std::mutex g_thread_cache_registry_lock;
+
+namespace {
+	struct ThreadCacheList {
+		ThreadCachingAlloc::ThreadCache *caches = nullptr;
+
+		PEFF_FORCEINLINE ~ThreadCacheList() {
+			ThreadCachingAlloc::_release_thread_caches(caches);
+		}
+	};
+}
+
+static thread_local ThreadCacheList t_thread_caches;
+
+PEFF_ADVUTILS_API ThreadCachingAlloc::ThreadCachingAlloc(peff::Alloc *upstream, size_t max_thread_cache_size) : upstream(upstream), max_thread_cache_size(max_thread_cache_size) {
+}
+
+PEFF_ADVUTILS_API ThreadCachingAlloc::~ThreadCachingAlloc() {
+	std::lock_guard<std::mutex> registry_guard(g_thread_cache_registry_lock);
+
+	// The caches are released by their threads on exit, we only detach them here.
+	for (ThreadCache *i = registered_caches, *next; i; i = next) {
+		next = i->next_registered;
+
+		_flush_all(i);
+
+		i->prev_registered = nullptr;
+		i->next_registered = nullptr;
+		i->owner.store(nullptr, std::memory_order_release);
+	}
+
+	registered_caches = nullptr;
+}
+
+PEFF_ADVUTILS_API size_t ThreadCachingAlloc::dec_ref(size_t global_ref_count) noexcept {
+	if (!--_ref_count) {
+		on_ref_zero();
+		return 0;
+	}
+	return _ref_count;
+}
+
+PEFF_ADVUTILS_API size_t ThreadCachingAlloc::inc_ref(size_t global_ref_count) noexcept {
+	return ++_ref_count;
+}
+
+PEFF_ADVUTILS_API void ThreadCachingAlloc::on_ref_zero() noexcept {
+}
+
+PEFF_ADVUTILS_API void ThreadCachingAlloc::_release_thread_caches(ThreadCache *caches) noexcept {
+	while (caches) {
+		ThreadCache *next = caches->next_in_thread;
+
+		{
+			std::lock_guard<std::mutex> registry_guard(g_thread_cache_registry_lock);
+
+			if (ThreadCachingAlloc *owner = caches->owner.load(std::memory_order_acquire); owner) {
+				owner->_flush_all(caches);
+
+				if (caches->prev_registered)
+					caches->prev_registered->next_registered = caches->next_registered;
+				else
+					owner->registered_caches = caches->next_registered;
+				if (caches->next_registered)
+					caches->next_registered->prev_registered = caches->prev_registered;
+			}
+		}
+
+		peff::destroy_and_release<ThreadCache>(default_allocator(), caches, alignof(ThreadCache));
+
+		caches = next;
+	}
+}
+
+PEFF_ADVUTILS_API ThreadCachingAlloc::ThreadCache *ThreadCachingAlloc::_get_thread_cache(bool create) noexcept {
+	ThreadCache **prev_next = &t_thread_caches.caches;
+
+	for (ThreadCache *i = *prev_next; i; prev_next = &i->next_in_thread, i = i->next_in_thread) {
+		if (i->owner.load(std::memory_order_acquire) == this) {
+			// Move the cache to the front, threads usually work with only one allocator.
+			if (prev_next != &t_thread_caches.caches) {
+				*prev_next = i->next_in_thread;
+				i->next_in_thread = t_thread_caches.caches;
+				t_thread_caches.caches = i;
+			}
+			return i;
+		}
+	}
+
+	if (!create)
+		return nullptr;
+
+	ThreadCache *cache = peff::alloc_and_construct<ThreadCache>(default_allocator(), alignof(ThreadCache), this);
+	if (!cache)
+		return nullptr;
+
+	{
+		std::lock_guard<std::mutex> registry_guard(g_thread_cache_registry_lock);
+
+		cache->next_registered = registered_caches;
+		if (registered_caches)
+			registered_caches->prev_registered = cache;
+		registered_caches = cache;
+	}
+
+	cache->next_in_thread = t_thread_caches.caches;
+	t_thread_caches.caches = cache;
+
+	return cache;
+}
+
+PEFF_ADVUTILS_API bool ThreadCachingAlloc::_refill(ThreadCache *cache, size_t size_class) noexcept {
+	const size_t num_blocks = calc_batch_blocks(size_class),
+				 block_size = size_class_to_size(size_class),
+				 block_alignment = calc_block_alignment(size_class);
+	Magazine &magazine = cache->magazines[size_class];
+
+	void *blocks[MAX_BATCH_BLOCKS];
+	size_t n;
+	{
+		std::lock_guard<std::mutex> upstream_guard(upstream_lock);
+		n = upstream->alloc_batch(num_blocks, block_size, block_alignment, blocks);
+	}
+
+	for (size_t i = 0; i < n; ++i) {
+		write_free_slot_link(blocks[i], magazine.blocks);
+		magazine.blocks = blocks[i];
+	}
+
+	magazine.num_blocks += n;
+	cache->cached_size += n * block_size;
+
+	return n;
+}
+
+PEFF_ADVUTILS_API void ThreadCachingAlloc::_flush(ThreadCache *cache, size_t size_class, size_t num_blocks) noexcept {
+	const size_t block_size = size_class_to_size(size_class),
+				 block_alignment = calc_block_alignment(size_class);
+	Magazine &magazine = cache->magazines[size_class];
+
+	if (num_blocks > magazine.num_blocks)
+		num_blocks = magazine.num_blocks;
+
+	if (!num_blocks)
+		return;
+
+	for (size_t i = 0; i < num_blocks;) {
+		void *blocks[MAX_BATCH_BLOCKS];
+		size_t n = 0;
+
+		for (; (n < MAX_BATCH_BLOCKS) && (i < num_blocks); ++n, ++i) {
+			blocks[n] = magazine.blocks;
+			magazine.blocks = read_free_slot_link(blocks[n]);
+		}
+
+		std::lock_guard<std::mutex> upstream_guard(upstream_lock);
+		upstream->release_batch(blocks, n, block_size, block_alignment);
+	}
+
+	magazine.num_blocks -= num_blocks;
+	cache->cached_size -= num_blocks * block_size;
+}
+
+PEFF_ADVUTILS_API void ThreadCachingAlloc::_flush_all(ThreadCache *cache) noexcept {
+	for (size_t i = 0; i < NUM_SIZE_CLASSES; ++i)
+		_flush(cache, i, cache->magazines[i].num_blocks);
+}
+
+PEFF_ADVUTILS_API void ThreadCachingAlloc::flush_thread_cache() noexcept {
+	if (ThreadCache *cache = _get_thread_cache(false); cache)
+		_flush_all(cache);
+}
+
+PEFF_ADVUTILS_API void *ThreadCachingAlloc::alloc(size_t size, size_t alignment) noexcept {
+	const size_t size_class = get_cached_size_class(size, alignment);
+
+	if (size_class == INVALID_SIZE_CLASS) {
+		std::lock_guard<std::mutex> upstream_guard(upstream_lock);
+		return upstream->alloc(size, alignment);
+	}
+
+	ThreadCache *cache = _get_thread_cache(true);
+	if (!cache) {
+		// Allocate the block in the same way as the cached ones, so it can be cached on release.
+		std::lock_guard<std::mutex> upstream_guard(upstream_lock);
+		return upstream->alloc(size_class_to_size(size_class), calc_block_alignment(size_class));
+	}
+
+	Magazine &magazine = cache->magazines[size_class];
+
+	if ((!magazine.blocks) && (!_refill(cache, size_class)))
+		return nullptr;
+
+	void *ptr = magazine.blocks;
+	magazine.blocks = read_free_slot_link(ptr);
+	--magazine.num_blocks;
+	cache->cached_size -= size_class_to_size(size_class);
+
+	return ptr;
+}
+
+PEFF_ADVUTILS_API size_t ThreadCachingAlloc::alloc_batch(size_t count, size_t size, size_t alignment, void **out) noexcept {
+	const size_t size_class = get_cached_size_class(size, alignment);
+
+	if (size_class == INVALID_SIZE_CLASS) {
+		std::lock_guard<std::mutex> upstream_guard(upstream_lock);
+		return upstream->alloc_batch(count, size, alignment, out);
+	}
+
+	ThreadCache *cache = _get_thread_cache(true);
+	if (!cache) {
+		std::lock_guard<std::mutex> upstream_guard(upstream_lock);
+		return upstream->alloc_batch(count, size_class_to_size(size_class), calc_block_alignment(size_class), out);
+	}
+
+	Magazine &magazine = cache->magazines[size_class];
+	size_t i = 0;
+
+	while (i < count) {
+		if ((!magazine.blocks) && (!_refill(cache, size_class)))
+			break;
+
+		out[i++] = magazine.blocks;
+		magazine.blocks = read_free_slot_link(magazine.blocks);
+		--magazine.num_blocks;
+	}
+
+	cache->cached_size -= i * size_class_to_size(size_class);
+
+	return i;
+}
+
+PEFF_ADVUTILS_API void *ThreadCachingAlloc::realloc(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept {
+	void *p;
+
+	if ((p = realloc_in_place(ptr, size, alignment, new_size, new_alignment)))
+		return p;
+
+	if ((get_cached_size_class(size, alignment) == INVALID_SIZE_CLASS) &&
+		(get_cached_size_class(new_size, new_alignment) == INVALID_SIZE_CLASS)) {
+		std::lock_guard<std::mutex> upstream_guard(upstream_lock);
+		return upstream->realloc(ptr, size, alignment, new_size, new_alignment);
+	}
+
+	if (!(p = alloc(new_size, new_alignment)))
+		return nullptr;
+
+	memcpy(p, ptr, size < new_size ? size : new_size);
+
+	release(ptr, size, alignment);
+
+	return p;
+}
+
+PEFF_ADVUTILS_API void *ThreadCachingAlloc::realloc_in_place(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept {
+	const size_t size_class = get_cached_size_class(size, alignment),
+				 new_size_class = get_cached_size_class(new_size, new_alignment);
+
+	if (size_class == INVALID_SIZE_CLASS) {
+		if (new_size_class == INVALID_SIZE_CLASS) {
+			std::lock_guard<std::mutex> upstream_guard(upstream_lock);
+			return upstream->realloc_in_place(ptr, size, alignment, new_size, new_alignment);
+		}
+		return nullptr;
+	}
+
+	// The block is big enough, the request can be fulfilled without moving.
+	if (size_class == new_size_class)
+		return ptr;
+
+	return nullptr;
+}
+
+PEFF_ADVUTILS_API void ThreadCachingAlloc::release(void *ptr, size_t size, size_t alignment) noexcept {
+	const size_t size_class = get_cached_size_class(size, alignment);
+
+	if (size_class == INVALID_SIZE_CLASS) {
+		std::lock_guard<std::mutex> upstream_guard(upstream_lock);
+		upstream->release(ptr, size, alignment);
+		return;
+	}
+
+	ThreadCache *cache = _get_thread_cache(true);
+	if (!cache) {
+		std::lock_guard<std::mutex> upstream_guard(upstream_lock);
+		upstream->release(ptr, size_class_to_size(size_class), calc_block_alignment(size_class));
+		return;
+	}
+
+	Magazine &magazine = cache->magazines[size_class];
+
+	write_free_slot_link(ptr, magazine.blocks);
+	magazine.blocks = ptr;
+	++magazine.num_blocks;
+	cache->cached_size += size_class_to_size(size_class);
+
+	if (const size_t num_batch_blocks = calc_batch_blocks(size_class); magazine.num_blocks > num_batch_blocks * 2)
+		_flush(cache, size_class, num_batch_blocks);
+
+	if (cache->cached_size > max_thread_cache_size) {
+		_flush(cache, size_class, magazine.num_blocks);
+
+		if (cache->cached_size > max_thread_cache_size)
+			_flush_all(cache);
+	}
+}
+
+PEFF_ADVUTILS_API size_t ThreadCachingAlloc::trim(size_t keep_bytes, PurgePolicy policy) noexcept {
+	size_t trimmed_size = 0;
+
+	if (ThreadCache *cache = _get_thread_cache(false); cache) {
+		// Flush the larger blocks first, which gives more memory back with fewer blocks.
+		for (size_t i = NUM_SIZE_CLASSES; i && (cache->cached_size > keep_bytes); --i) {
+			const size_t block_size = size_class_to_size(i - 1),
+						 cached_size = cache->cached_size;
+
+			_flush(cache, i - 1, (cached_size - keep_bytes + block_size - 1) / block_size);
+
+			trimmed_size += cached_size - cache->cached_size;
+		}
+	}
+
+	std::lock_guard<std::mutex> upstream_guard(upstream_lock);
+	return trimmed_size + upstream->trim(keep_bytes, policy);
+}
+
+PEFF_ADVUTILS_API AllocCaps ThreadCachingAlloc::get_caps() const noexcept {
+	AllocCaps caps = upstream->get_caps();
+
+	// Requests to the upstream allocator are serialized.
+	caps.is_thread_safe = true;
+	caps.is_monotonic = false;
+	caps.zero_initialized = false;
+
+	return caps;
+}
+
+PEFF_ADVUTILS_API bool ThreadCachingAlloc::is_replaceable(const Alloc *rhs) const noexcept {
+	if (rhs->type_identity() != type_identity()) {
+		return false;
+	}
+
+	return rhs == this;
+}
+
+PEFF_ADVUTILS_API UUID ThreadCachingAlloc::type_identity() const noexcept {
+	return PEFF_UUID(0bac7ad2, 580b, 477f, b212, 43c281f5735e);
+}
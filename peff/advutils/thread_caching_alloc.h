@@ -0,0 +1,117 @@
+#ifndef _PEFF_ADVUTILS_THREAD_CACHING_ALLOC_H_
+#define _PEFF_ADVUTILS_THREAD_CACHING_ALLOC_H_
+
+#include "basedefs.h"
+#include "size_class.h"
+#include <peff/base/alloc.h>
+#include <mutex>
+
+namespace peff {
+	/// @brief Thread-safe front end which caches freed blocks per thread.
+	///
+	/// Each thread keeps a magazine of free blocks for each size class,
+	/// which are refilled from and flushed to the upstream allocator in
+	/// batches with the upstream lock held, so the upstream allocator does
+	/// not need to be thread-safe. Requests that do not fit into any size
+	/// class are forwarded to the upstream allocator with the lock held.
+	///
+	/// @note The allocator must not be used by any thread while it is being destructed.
+	class ThreadCachingAlloc : public Alloc {
+	protected:
+		std::atomic_size_t _ref_count = 0;
+
+	public:
+		struct Magazine {
+			void *blocks = nullptr;
+			size_t num_blocks = 0;
+		};
+
+		struct ThreadCache {
+			/// @brief The allocator which owns the cache, null if the allocator has been destructed.
+			std::atomic<ThreadCachingAlloc *> owner;
+			/// @brief Next cache of the same thread.
+			ThreadCache *next_in_thread = nullptr;
+			ThreadCache *prev_registered = nullptr, *next_registered = nullptr;
+			/// @brief Total size of the cached blocks.
+			size_t cached_size = 0;
+			Magazine magazines[NUM_SIZE_CLASSES];
+
+			PEFF_FORCEINLINE ThreadCache(ThreadCachingAlloc *owner) : owner(owner) {}
+		};
+
+		constexpr static size_t DEFAULT_MAX_THREAD_CACHE_SIZE = 256 * 1024;
+		/// @brief Approximate size of the blocks transferred in a batch.
+		constexpr static size_t BATCH_TRANSFER_SIZE = 4096;
+		constexpr static size_t MAX_BATCH_BLOCKS = 32;
+		/// @brief Requests with larger alignments are forwarded to the upstream allocator.
+		constexpr static size_t MAX_CACHED_ALIGNMENT = alignof(std::max_align_t);
+
+		peff::RcObjectPtr<peff::Alloc> upstream;
+		std::mutex upstream_lock;
+		size_t max_thread_cache_size;
+		/// @brief Caches of all threads, protected by the global registry lock.
+		ThreadCache *registered_caches = nullptr;
+
+		PEFF_FORCEINLINE constexpr static size_t calc_batch_blocks(size_t size_class) noexcept {
+			const size_t n = BATCH_TRANSFER_SIZE / size_class_to_size(size_class);
+
+			if (n < 2)
+				return 2;
+			if (n > MAX_BATCH_BLOCKS)
+				return MAX_BATCH_BLOCKS;
+			return n;
+		}
+
+		/// @brief Get the alignment of the blocks of a size class that are allocated from the upstream allocator.
+		PEFF_FORCEINLINE constexpr static size_t calc_block_alignment(size_t size_class) noexcept {
+			const size_t alignment = size_class_max_alignment(size_class);
+			return alignment < MAX_CACHED_ALIGNMENT ? alignment : MAX_CACHED_ALIGNMENT;
+		}
+
+		PEFF_FORCEINLINE static size_t get_cached_size_class(size_t size, size_t alignment) noexcept {
+			if (alignment > MAX_CACHED_ALIGNMENT)
+				return INVALID_SIZE_CLASS;
+			return size_to_size_class(size, alignment);
+		}
+
+		PEFF_ADVUTILS_API ThreadCachingAlloc(peff::Alloc *upstream, size_t max_thread_cache_size = DEFAULT_MAX_THREAD_CACHE_SIZE);
+		ThreadCachingAlloc(const ThreadCachingAlloc &) = delete;
+		PEFF_ADVUTILS_API virtual ~ThreadCachingAlloc();
+
+		ThreadCachingAlloc &operator=(const ThreadCachingAlloc &) = delete;
+
+		PEFF_ADVUTILS_API virtual size_t inc_ref(size_t global_ref_count) noexcept override;
+		PEFF_ADVUTILS_API virtual size_t dec_ref(size_t global_ref_count) noexcept override;
+		PEFF_ADVUTILS_API virtual void on_ref_zero() noexcept;
+
+		PEFF_ADVUTILS_API virtual void *alloc(size_t size, size_t alignment = 0) noexcept override;
+		PEFF_ADVUTILS_API virtual void *realloc(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override;
+		PEFF_ADVUTILS_API virtual void *realloc_in_place(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override;
+		PEFF_ADVUTILS_API virtual void release(void *ptr, size_t size, size_t alignment) noexcept override;
+		PEFF_ADVUTILS_API virtual size_t alloc_batch(size_t count, size_t size, size_t alignment, void **out) noexcept override;
+		/// @brief Flush the cache of the calling thread down to `keep_bytes`, the caches of the other threads are not touched.
+		PEFF_ADVUTILS_API virtual size_t trim(size_t keep_bytes, PurgePolicy policy = PurgePolicy::Lazy) noexcept override;
+
+		/// @brief The allocator is thread-safe regardless of the upstream allocator.
+		PEFF_ADVUTILS_API virtual AllocCaps get_caps() const noexcept override;
+
+		PEFF_ADVUTILS_API virtual bool is_replaceable(const Alloc *rhs) const noexcept override;
+
+		PEFF_ADVUTILS_API virtual UUID type_identity() const noexcept override;
+
+		/// @brief Flush the cache of the calling thread to the upstream allocator.
+		PEFF_ADVUTILS_API void flush_thread_cache() noexcept;
+
+		/// @brief Flush and release the caches of an exiting thread.
+		/// @param caches The first cache of the thread.
+		PEFF_ADVUTILS_API static void _release_thread_caches(ThreadCache *caches) noexcept;
+
+	protected:
+		PEFF_ADVUTILS_API ThreadCache *_get_thread_cache(bool create) noexcept;
+		PEFF_ADVUTILS_API bool _refill(ThreadCache *cache, size_t size_class) noexcept;
+		PEFF_ADVUTILS_API void _flush(ThreadCache *cache, size_t size_class, size_t num_blocks) noexcept;
+		PEFF_ADVUTILS_API void _flush_all(ThreadCache *cache) noexcept;
+	};
+}
+
+#endif
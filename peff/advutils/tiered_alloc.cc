@@ -0,0 +1,237 @@
+#include "tiered_alloc.h"
+#include <cstring>
+
+using namespace peff;
+
+PEFF_ADVUTILS_API TieredAlloc::TieredAlloc() {
+}
+
+PEFF_ADVUTILS_API TieredAlloc::~TieredAlloc() {
+}
+
+PEFF_ADVUTILS_API size_t TieredAlloc::dec_ref(size_t global_ref_count) noexcept {
+	if (!--_ref_count) {
+		on_ref_zero();
+		return 0;
+	}
+	return _ref_count;
+}
+
+PEFF_ADVUTILS_API size_t TieredAlloc::inc_ref(size_t global_ref_count) noexcept {
+	return ++_ref_count;
+}
+
+PEFF_ADVUTILS_API void TieredAlloc::on_ref_zero() noexcept {
+}
+
+PEFF_ADVUTILS_API bool TieredAlloc::add_tier(peff::Alloc *alloc, size_t min_size, size_t max_size, size_t max_alignment, const void *range_begin, size_t range_size) noexcept {
+	if (num_tiers >= MAX_TIERS)
+		return false;
+
+	Tier &tier = tiers[num_tiers++];
+
+	tier.alloc = alloc;
+	tier.min_size = min_size;
+	tier.max_size = max_size;
+	tier.max_alignment = max_alignment;
+	tier.range_begin = (const char *)range_begin;
+	tier.range_end = range_begin ? ((const char *)range_begin) + range_size : nullptr;
+
+	return true;
+}
+
+PEFF_ADVUTILS_API TieredAlloc::TierStats TieredAlloc::get_tier_stats(size_t index) const noexcept {
+	const Tier &tier = tiers[index];
+	TierStats stats;
+
+	stats.num_hits = tier.num_hits.load(std::memory_order_relaxed);
+	stats.num_misses = tier.num_misses.load(std::memory_order_relaxed);
+	stats.hit_size = tier.hit_size.load(std::memory_order_relaxed);
+	stats.num_releases = tier.num_releases.load(std::memory_order_relaxed);
+
+	return stats;
+}
+
+PEFF_ADVUTILS_API void TieredAlloc::reset_tier_stats() noexcept {
+	for (size_t i = 0; i < num_tiers; ++i) {
+		Tier &tier = tiers[i];
+
+		tier.num_hits.store(0, std::memory_order_relaxed);
+		tier.num_misses.store(0, std::memory_order_relaxed);
+		tier.hit_size.store(0, std::memory_order_relaxed);
+		tier.num_releases.store(0, std::memory_order_relaxed);
+	}
+}
+
+PEFF_ADVUTILS_API size_t TieredAlloc::_find_final_tier(size_t size, size_t alignment) const noexcept {
+	for (size_t i = 0; i < num_tiers; ++i) {
+		const Tier &tier = tiers[i];
+
+		if ((!tier.is_ranged()) && tier.is_eligible(size, alignment))
+			return i;
+	}
+
+	return SIZE_MAX;
+}
+
+PEFF_ADVUTILS_API size_t TieredAlloc::find_owner(const void *ptr, size_t size, size_t alignment) const noexcept {
+	for (size_t i = 0; i < num_tiers; ++i) {
+		const Tier &tier = tiers[i];
+
+		if (tier.is_ranged() && tier.contains(ptr))
+			return i;
+	}
+
+	return _find_final_tier(size, alignment);
+}
+
+PEFF_ADVUTILS_API bool TieredAlloc::_is_owner_after_realloc(size_t index, size_t new_size, size_t new_alignment) const noexcept {
+	const Tier &tier = tiers[index];
+
+	// Ranged tiers keep the blocks in their ranges.
+	if (tier.is_ranged())
+		return tier.is_eligible(new_size, new_alignment);
+
+	return _find_final_tier(new_size, new_alignment) == index;
+}
+
+PEFF_ADVUTILS_API void *TieredAlloc::alloc(size_t size, size_t alignment) noexcept {
+	for (size_t i = 0; i < num_tiers; ++i) {
+		Tier &tier = tiers[i];
+
+		if (!tier.is_eligible(size, alignment))
+			continue;
+
+		void *ptr = tier.alloc->alloc(size, alignment);
+
+		if (ptr) {
+			tier.num_hits.fetch_add(1, std::memory_order_relaxed);
+			tier.hit_size.fetch_add(size, std::memory_order_relaxed);
+			return ptr;
+		}
+
+		tier.num_misses.fetch_add(1, std::memory_order_relaxed);
+
+		if (!tier.is_ranged())
+			return nullptr;
+	}
+
+	return nullptr;
+}
+
+PEFF_ADVUTILS_API void *TieredAlloc::realloc(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept {
+	const size_t index = find_owner(ptr, size, alignment);
+	if (index == SIZE_MAX)
+		std::terminate();
+
+	void *p;
+
+	if (_is_owner_after_realloc(index, new_size, new_alignment)) {
+		if ((p = tiers[index].alloc->realloc(ptr, size, alignment, new_size, new_alignment)))
+			return p;
+
+		// Only the ranged tiers can pass the requests on to the next tiers.
+		if (!tiers[index].is_ranged())
+			return nullptr;
+	}
+
+	if (!(p = alloc(new_size, new_alignment)))
+		return nullptr;
+
+	memcpy(p, ptr, size < new_size ? size : new_size);
+
+	release(ptr, size, alignment);
+
+	return p;
+}
+
+PEFF_ADVUTILS_API void *TieredAlloc::realloc_in_place(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept {
+	const size_t index = find_owner(ptr, size, alignment);
+	if (index == SIZE_MAX)
+		std::terminate();
+
+	if (!_is_owner_after_realloc(index, new_size, new_alignment))
+		return nullptr;
+
+	return tiers[index].alloc->realloc_in_place(ptr, size, alignment, new_size, new_alignment);
+}
+
+PEFF_ADVUTILS_API void TieredAlloc::release(void *ptr, size_t size, size_t alignment) noexcept {
+	const size_t index = find_owner(ptr, size, alignment);
+	if (index == SIZE_MAX)
+		std::terminate();
+
+	Tier &tier = tiers[index];
+
+	tier.num_releases.fetch_add(1, std::memory_order_relaxed);
+	tier.alloc->release(ptr, size, alignment);
+}
+
+PEFF_ADVUTILS_API size_t TieredAlloc::trim(size_t keep_bytes, PurgePolicy policy) noexcept {
+	size_t trimmed_size = 0;
+
+	for (size_t i = 0; i < num_tiers; ++i)
+		trimmed_size += tiers[i].alloc->trim(keep_bytes, policy);
+
+	return trimmed_size;
+}
+
+PEFF_ADVUTILS_API AllocCaps TieredAlloc::get_caps() const noexcept {
+	AllocCaps caps;
+
+	if (!num_tiers)
+		return caps;
+
+	caps.is_monotonic = true;
+	caps.is_thread_safe = true;
+	caps.supports_realloc_in_place = false;
+	caps.zero_initialized = true;
+	caps.max_alignment = 0;
+
+	for (size_t i = 0; i < num_tiers; ++i) {
+		const Tier &tier = tiers[i];
+		const AllocCaps tier_caps = tier.alloc->get_caps();
+
+		caps.is_monotonic = caps.is_monotonic && tier_caps.is_monotonic;
+		caps.is_thread_safe = caps.is_thread_safe && tier_caps.is_thread_safe;
+		caps.supports_realloc_in_place = caps.supports_realloc_in_place || tier_caps.supports_realloc_in_place;
+		caps.zero_initialized = caps.zero_initialized && tier_caps.zero_initialized;
+
+		const size_t max_alignment = tier.max_alignment < tier_caps.max_alignment ? tier.max_alignment : tier_caps.max_alignment;
+		if (max_alignment > caps.max_alignment)
+			caps.max_alignment = max_alignment;
+	}
+
+	return caps;
+}
+
+PEFF_ADVUTILS_API bool TieredAlloc::is_replaceable(const Alloc *rhs) const noexcept {
+	if (rhs->type_identity() != type_identity()) {
+		return false;
+	}
+
+	const TieredAlloc *r = (const TieredAlloc *)rhs;
+
+	if (num_tiers != r->num_tiers)
+		return false;
+
+	for (size_t i = 0; i < num_tiers; ++i) {
+		const Tier &tier = tiers[i], &rhs_tier = r->tiers[i];
+
+		if ((tier.min_size != rhs_tier.min_size) ||
+			(tier.max_size != rhs_tier.max_size) ||
+			(tier.max_alignment != rhs_tier.max_alignment) ||
+			(tier.range_begin != rhs_tier.range_begin) ||
+			(tier.range_end != rhs_tier.range_end))
+			return false;
+
+		if (!tier.alloc->is_replaceable(rhs_tier.alloc.get()))
+			return false;
+	}
+
+	return true;
+}
+
+PEFF_ADVUTILS_API UUID TieredAlloc::type_identity() const noexcept {
+	return PEFF_UUID(82f8132a, a579, 4ea2, 9dcc, b004c80d289a);
+}
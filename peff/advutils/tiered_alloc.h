@@ -0,0 +1,123 @@
+#ifndef _PEFF_ADVUTILS_TIERED_ALLOC_H_
+#define _PEFF_ADVUTILS_TIERED_ALLOC_H_
+
+#include "basedefs.h"
+#include <peff/base/alloc.h>
+
+namespace peff {
+	/// @brief Allocator which routes the requests through an ordered chain of allocators.
+	///
+	/// Each tier serves the requests within its size and alignment limits.
+	/// Tiers with an address range, such as the ones allocating from fixed
+	/// buffers, may fail and pass the requests on to the next tiers. The
+	/// first eligible tier without an address range is final, which is
+	/// what makes the owner of every pointer known without probing: a
+	/// pointer belongs to the ranged tier which contains it, or else to the
+	/// first eligible tier without a range for its size and alignment.
+	///
+	/// A typical chain is a scratch buffer, a slab pool for the small
+	/// requests, the mmap path for the large ones and the standard
+	/// allocator for the rest. Unlike UpstreamedBufferAlloc, no marker is
+	/// stored with the allocations.
+	///
+	/// @note The tiers must be added before the allocator is used, the allocator is as thread-safe as the tiers.
+	class TieredAlloc : public Alloc {
+	protected:
+		std::atomic_size_t _ref_count = 0;
+
+	public:
+		constexpr static size_t MAX_TIERS = 8;
+
+		struct Tier {
+			peff::RcObjectPtr<peff::Alloc> alloc;
+			size_t min_size = 0;
+			size_t max_size = SIZE_MAX;
+			size_t max_alignment = SIZE_MAX;
+			/// @brief Address range of the memory from the tier, both are nullptr if the tier has no range.
+			const char *range_begin = nullptr, *range_end = nullptr;
+
+			/// @brief Number of the requests which have been served by the tier.
+			std::atomic_size_t num_hits = 0;
+			/// @brief Number of the eligible requests which the tier has failed to serve.
+			std::atomic_size_t num_misses = 0;
+			/// @brief Total size of the requests which have been served by the tier.
+			std::atomic_size_t hit_size = 0;
+			std::atomic_size_t num_releases = 0;
+
+			PEFF_FORCEINLINE bool is_ranged() const noexcept {
+				return range_begin != range_end;
+			}
+
+			PEFF_FORCEINLINE bool is_eligible(size_t size, size_t alignment) const noexcept {
+				return (size >= min_size) && (size <= max_size) && (alignment <= max_alignment);
+			}
+
+			PEFF_FORCEINLINE bool contains(const void *ptr) const noexcept {
+				return (((const char *)ptr) >= range_begin) && (((const char *)ptr) < range_end);
+			}
+		};
+
+		struct TierStats {
+			size_t num_hits = 0;
+			size_t num_misses = 0;
+			size_t hit_size = 0;
+			size_t num_releases = 0;
+		};
+
+		Tier tiers[MAX_TIERS];
+		size_t num_tiers = 0;
+
+		PEFF_ADVUTILS_API TieredAlloc();
+		TieredAlloc(const TieredAlloc &) = delete;
+		PEFF_ADVUTILS_API virtual ~TieredAlloc();
+
+		TieredAlloc &operator=(const TieredAlloc &) = delete;
+
+		PEFF_ADVUTILS_API virtual size_t inc_ref(size_t global_ref_count) noexcept override;
+		PEFF_ADVUTILS_API virtual size_t dec_ref(size_t global_ref_count) noexcept override;
+		PEFF_ADVUTILS_API virtual void on_ref_zero() noexcept;
+
+		PEFF_ADVUTILS_API virtual void *alloc(size_t size, size_t alignment = 0) noexcept override;
+		/// @brief The block is reallocated by its tier if the tier also owns the new size and alignment, or else moved to the tier which does.
+		PEFF_ADVUTILS_API virtual void *realloc(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override;
+		PEFF_ADVUTILS_API virtual void *realloc_in_place(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override;
+		PEFF_ADVUTILS_API virtual void release(void *ptr, size_t size, size_t alignment) noexcept override;
+		/// @brief Trim every tier with the same parameters, like the allocators trimming their upstream allocators.
+		/// @param keep_bytes Size of the free memory to be retained by each tier, so the chain may retain up to keep_bytes times the number of the tiers.
+		PEFF_ADVUTILS_API virtual size_t trim(size_t keep_bytes, PurgePolicy policy = PurgePolicy::Lazy) noexcept override;
+
+		/// @brief The allocator is monotonic, thread-safe or zero-initialized only if all tiers are.
+		PEFF_ADVUTILS_API virtual AllocCaps get_caps() const noexcept override;
+
+		PEFF_ADVUTILS_API virtual bool is_replaceable(const Alloc *rhs) const noexcept override;
+
+		PEFF_ADVUTILS_API virtual UUID type_identity() const noexcept override;
+
+		/// @brief Append a tier to the chain.
+		/// @param alloc Allocator of the tier.
+		/// @param min_size Minimum size of the requests to the tier.
+		/// @param max_size Maximum size of the requests to the tier.
+		/// @param max_alignment Maximum alignment of the requests to the tier.
+		/// @param range_begin Beginning of the address range of the tier, nullptr if the tier has no range.
+		/// @param range_size Size of the address range of the tier.
+		/// @return true for succeeded, false if there are too many tiers.
+		/// @note A tier with a range must not allocate any memory out of the range.
+		PEFF_ADVUTILS_API bool add_tier(peff::Alloc *alloc, size_t min_size = 0, size_t max_size = SIZE_MAX, size_t max_alignment = SIZE_MAX, const void *range_begin = nullptr, size_t range_size = 0) noexcept;
+
+		PEFF_ADVUTILS_API TierStats get_tier_stats(size_t index) const noexcept;
+		PEFF_ADVUTILS_API void reset_tier_stats() noexcept;
+
+		/// @brief Find the tier which owns a block.
+		/// @return Index of the tier, SIZE_MAX if no tier can own the block.
+		PEFF_ADVUTILS_API size_t find_owner(const void *ptr, size_t size, size_t alignment) const noexcept;
+
+	protected:
+		/// @brief Find the first eligible tier without an address range.
+		/// @return Index of the tier, SIZE_MAX if there is no such tier.
+		PEFF_ADVUTILS_API size_t _find_final_tier(size_t size, size_t alignment) const noexcept;
+		/// @brief Check if a tier would also own the block after it is reallocated to the new size and alignment.
+		PEFF_ADVUTILS_API bool _is_owner_after_realloc(size_t index, size_t new_size, size_t new_alignment) const noexcept;
+	};
+}
+
+#endif
@@ -0,0 +1,275 @@
+#include "trace_recorder_alloc.h"
+#include <chrono>
+#include <cstring>
+
+using namespace peff;
+
+static uint64_t _get_time_ns() noexcept {
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+PEFF_ADVUTILS_API TraceRecorderAlloc::TraceRecorderAlloc(peff::Alloc *upstream, FILE *fp) : upstream(upstream), fp(fp), block_ids(default_allocator()), start_time(_get_time_ns()) {
+	memcpy(buffer, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+	buffer_used = sizeof(TRACE_MAGIC);
+	_write_varint(TRACE_VERSION);
+}
+
+PEFF_ADVUTILS_API TraceRecorderAlloc::~TraceRecorderAlloc() {
+	flush();
+}
+
+PEFF_ADVUTILS_API size_t TraceRecorderAlloc::dec_ref(size_t global_ref_count) noexcept {
+	if (!--_ref_count) {
+		on_ref_zero();
+		return 0;
+	}
+	return _ref_count;
+}
+
+PEFF_ADVUTILS_API size_t TraceRecorderAlloc::inc_ref(size_t global_ref_count) noexcept {
+	return ++_ref_count;
+}
+
+PEFF_ADVUTILS_API void TraceRecorderAlloc::on_ref_zero() noexcept {
+}
+
+PEFF_ADVUTILS_API void TraceRecorderAlloc::_flush_buffer() noexcept {
+	if (buffer_used && (fwrite(buffer, 1, buffer_used, fp) != buffer_used))
+		write_failed = true;
+
+	buffer_used = 0;
+}
+
+PEFF_ADVUTILS_API void TraceRecorderAlloc::_write_varint(uint64_t value) noexcept {
+	while (value >= 0x80) {
+		buffer[buffer_used++] = (char)((value & 0x7f) | 0x80);
+		value >>= 7;
+	}
+	buffer[buffer_used++] = (char)value;
+}
+
+PEFF_ADVUTILS_API void TraceRecorderAlloc::_write_record(TraceOp op, uint64_t id, size_t size, size_t alignment) noexcept {
+	if (buffer_used + MAX_RECORD_SIZE > BUFFER_SIZE)
+		_flush_buffer();
+
+	// The clock is monotonic, but the timestamps are clamped in case the records are written out of order.
+	uint64_t timestamp = _get_time_ns() - start_time;
+	if (timestamp < last_timestamp)
+		timestamp = last_timestamp;
+
+	buffer[buffer_used++] = (char)op;
+	_write_varint(timestamp - last_timestamp);
+	_write_varint(id);
+	_write_varint(size);
+	_write_varint(alignment);
+
+	last_timestamp = timestamp;
+}
+
+PEFF_ADVUTILS_API void TraceRecorderAlloc::_record_alloc(void *ptr, size_t size, size_t alignment) noexcept {
+	const uint64_t id = last_id + 1;
+
+	if (!block_ids.insert((uintptr_t)ptr, uint64_t(id))) {
+		++num_untracked_requests;
+		return;
+	}
+
+	last_id = id;
+	_write_record(TraceOp::Alloc, id, size, alignment);
+}
+
+PEFF_ADVUTILS_API void TraceRecorderAlloc::_record_release(void *ptr, size_t size, size_t alignment) noexcept {
+	if (!block_ids.contains((uintptr_t)ptr)) {
+		++num_untracked_requests;
+		return;
+	}
+
+	_write_record(TraceOp::Release, block_ids.at((uintptr_t)ptr), size, alignment);
+	block_ids.remove((uintptr_t)ptr);
+}
+
+PEFF_ADVUTILS_API void *TraceRecorderAlloc::alloc(size_t size, size_t alignment) noexcept {
+	void *ptr = upstream->alloc(size, alignment);
+
+	if (ptr) {
+		std::lock_guard<std::mutex> guard(lock);
+		_record_alloc(ptr, size, alignment);
+	}
+
+	return ptr;
+}
+
+PEFF_ADVUTILS_API void *TraceRecorderAlloc::realloc(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept {
+	// The old block is released by the upstream if the block is moved, the
+	// lock is held across the call, otherwise another thread may get the old
+	// address from the upstream and record it before its id is dropped here.
+	std::lock_guard<std::mutex> guard(lock);
+
+	void *p = upstream->realloc(ptr, size, alignment, new_size, new_alignment);
+
+	if (!p)
+		return nullptr;
+
+	if (!block_ids.contains((uintptr_t)ptr)) {
+		// Record the untracked block as a new one, so it can be released in the replay.
+		++num_untracked_requests;
+		_record_alloc(p, new_size, new_alignment);
+		return p;
+	}
+
+	const uint64_t id = block_ids.at((uintptr_t)ptr);
+
+	if (p != ptr) {
+		block_ids.remove((uintptr_t)ptr);
+
+		if (!block_ids.insert((uintptr_t)p, uint64_t(id))) {
+			// The block cannot be tracked anymore, release it in the replay.
+			++num_untracked_requests;
+			_write_record(TraceOp::Release, id, size, alignment);
+			return p;
+		}
+	}
+
+	_write_record(TraceOp::Realloc, id, new_size, new_alignment);
+
+	return p;
+}
+
+PEFF_ADVUTILS_API void *TraceRecorderAlloc::realloc_in_place(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept {
+	void *p = upstream->realloc_in_place(ptr, size, alignment, new_size, new_alignment);
+
+	if (p) {
+		std::lock_guard<std::mutex> guard(lock);
+
+		if (block_ids.contains((uintptr_t)ptr))
+			_write_record(TraceOp::ReallocInPlace, block_ids.at((uintptr_t)ptr), new_size, new_alignment);
+		else
+			++num_untracked_requests;
+	}
+
+	return p;
+}
+
+PEFF_ADVUTILS_API void TraceRecorderAlloc::release(void *ptr, size_t size, size_t alignment) noexcept {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		_record_release(ptr, size, alignment);
+	}
+
+	upstream->release(ptr, size, alignment);
+}
+
+PEFF_ADVUTILS_API size_t TraceRecorderAlloc::alloc_batch(size_t count, size_t size, size_t alignment, void **out) noexcept {
+	const size_t n = upstream->alloc_batch(count, size, alignment, out);
+
+	if (n) {
+		std::lock_guard<std::mutex> guard(lock);
+
+		for (size_t i = 0; i < n; ++i)
+			_record_alloc(out[i], size, alignment);
+	}
+
+	return n;
+}
+
+PEFF_ADVUTILS_API void TraceRecorderAlloc::release_batch(void *const *ptrs, size_t count, size_t size, size_t alignment) noexcept {
+	if (count) {
+		std::lock_guard<std::mutex> guard(lock);
+
+		for (size_t i = 0; i < count; ++i)
+			_record_release(ptrs[i], size, alignment);
+	}
+
+	upstream->release_batch(ptrs, count, size, alignment);
+}
+
+PEFF_ADVUTILS_API size_t TraceRecorderAlloc::trim(size_t keep_bytes, PurgePolicy policy) noexcept {
+	return upstream->trim(keep_bytes, policy);
+}
+
+PEFF_ADVUTILS_API AllocCaps TraceRecorderAlloc::get_caps() const noexcept {
+	return upstream->get_caps();
+}
+
+PEFF_ADVUTILS_API bool TraceRecorderAlloc::is_replaceable(const Alloc *rhs) const noexcept {
+	if (rhs->type_identity() == type_identity())
+		return upstream->is_replaceable(((const TraceRecorderAlloc *)rhs)->upstream.get());
+
+	return upstream->is_replaceable(rhs);
+}
+
+PEFF_ADVUTILS_API UUID TraceRecorderAlloc::type_identity() const noexcept {
+	return PEFF_UUID(f113b9d4, f408, 4c22, a325, 41df2b0303d9);
+}
+
+PEFF_ADVUTILS_API bool TraceRecorderAlloc::flush() noexcept {
+	std::lock_guard<std::mutex> guard(lock);
+
+	_flush_buffer();
+	if (fflush(fp))
+		write_failed = true;
+
+	return !write_failed;
+}
+
+PEFF_ADVUTILS_API bool TraceReader::_read_varint(uint64_t &value_out) noexcept {
+	uint64_t value = 0;
+
+	for (size_t shift = 0; shift < 64; shift += 7) {
+		const int c = fgetc(fp);
+		if (c == EOF)
+			return false;
+
+		value |= ((uint64_t)(c & 0x7f)) << shift;
+
+		if (!(c & 0x80)) {
+			value_out = value;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+PEFF_ADVUTILS_API bool TraceReader::read_header() noexcept {
+	char magic[sizeof(TraceRecorderAlloc::TRACE_MAGIC)];
+
+	if (fread(magic, 1, sizeof(magic), fp) != sizeof(magic))
+		return false;
+	if (memcmp(magic, TraceRecorderAlloc::TRACE_MAGIC, sizeof(magic)))
+		return false;
+
+	uint64_t version;
+	if (!_read_varint(version))
+		return false;
+
+	return version == TraceRecorderAlloc::TRACE_VERSION;
+}
+
+PEFF_ADVUTILS_API bool TraceReader::read(TraceRecord &record_out) noexcept {
+	const int op = fgetc(fp);
+
+	if (op == EOF)
+		return false;
+
+	if (op > (int)TraceOp::Release) {
+		is_malformed = true;
+		return false;
+	}
+
+	uint64_t timestamp_delta, id, size, alignment;
+	if (!(_read_varint(timestamp_delta) && _read_varint(id) && _read_varint(size) && _read_varint(alignment))) {
+		is_malformed = true;
+		return false;
+	}
+
+	last_timestamp += timestamp_delta;
+
+	record_out.op = (TraceOp)op;
+	record_out.id = id;
+	record_out.size = (size_t)size;
+	record_out.alignment = (size_t)alignment;
+	record_out.timestamp = last_timestamp;
+
+	return true;
+}
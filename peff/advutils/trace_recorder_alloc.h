@@ -0,0 +1,142 @@
+#ifndef _PEFF_ADVUTILS_TRACE_RECORDER_ALLOC_H_
+#define _PEFF_ADVUTILS_TRACE_RECORDER_ALLOC_H_
+
+#include "basedefs.h"
+#include <peff/base/alloc.h>
+#include <peff/containers/hashmap.h>
+#include <cstdio>
+#include <mutex>
+
+namespace peff {
+	enum class TraceOp : uint8_t {
+		Alloc = 0,
+		Realloc,
+		/// @brief Succeeded in-place reallocation, failed ones are not recorded.
+		ReallocInPlace,
+		Release
+	};
+
+	struct TraceRecord {
+		TraceOp op;
+		/// @brief Identifier of the block, assigned sequentially from 1 on allocation and kept by the reallocations.
+		uint64_t id;
+		/// @brief Size of the request, the new size for the reallocations.
+		size_t size;
+		/// @brief Alignment of the request, the new alignment for the reallocations.
+		size_t alignment;
+		/// @brief Nanoseconds since the recorder was created.
+		uint64_t timestamp;
+	};
+
+	/// @brief Decorator which records the requests to the upstream allocator into a trace file, which can be replayed later.
+	///
+	/// Blocks are identified by sequential ids rather than their
+	/// addresses, so the trace can be replayed against any allocator. The
+	/// file starts with TRACE_MAGIC and the format version, followed by the
+	/// records, each one is the opcode byte followed by the varint-encoded
+	/// timestamp delta, id, size and alignment. The records are buffered
+	/// and written when the buffer is full, on flush() and on destruction.
+	///
+	/// The requests are serialized by a lock, so the decorator is as
+	/// thread-safe as the upstream allocator, but the trace does not tell
+	/// the threads apart.
+	///
+	/// @note The file is not owned by the recorder, it must be kept open until the recorder is destructed.
+	class TraceRecorderAlloc : public Alloc {
+	protected:
+		std::atomic_size_t _ref_count = 0;
+
+	public:
+		constexpr static char TRACE_MAGIC[8] = { 'P', 'E', 'F', 'F', 'T', 'R', 'C', 'E' };
+		constexpr static uint32_t TRACE_VERSION = 1;
+		constexpr static size_t BUFFER_SIZE = 65536;
+		/// @brief Maximum size of an encoded record, the opcode and 4 varints of 64-bit integers.
+		constexpr static size_t MAX_RECORD_SIZE = 1 + 4 * 10;
+
+		struct AddressHasher {
+			PEFF_FORCEINLINE size_t operator()(uintptr_t x) const {
+				// The low bits of the addresses are mostly zeros.
+				return (size_t)((x >> 4) * 0x9e3779b97f4a7c15ULL);
+			}
+		};
+
+		peff::RcObjectPtr<peff::Alloc> upstream;
+		FILE *fp;
+
+		std::mutex lock;
+		/// @brief Ids of the live blocks by their addresses, allocated from the default allocator.
+		HashMap<uintptr_t, uint64_t, std::equal_to<uintptr_t>, AddressHasher> block_ids;
+		uint64_t last_id = 0;
+		uint64_t start_time;
+		uint64_t last_timestamp = 0;
+		/// @brief Number of the requests on the blocks which were not allocated through the recorder, they are not recorded.
+		size_t num_untracked_requests = 0;
+		/// @brief Whether any write to the file has failed, the trace is incomplete if so.
+		bool write_failed = false;
+
+		size_t buffer_used = 0;
+		char buffer[BUFFER_SIZE];
+
+		PEFF_ADVUTILS_API TraceRecorderAlloc(peff::Alloc *upstream, FILE *fp);
+		TraceRecorderAlloc(const TraceRecorderAlloc &) = delete;
+		PEFF_ADVUTILS_API virtual ~TraceRecorderAlloc();
+
+		TraceRecorderAlloc &operator=(const TraceRecorderAlloc &) = delete;
+
+		PEFF_ADVUTILS_API virtual size_t inc_ref(size_t global_ref_count) noexcept override;
+		PEFF_ADVUTILS_API virtual size_t dec_ref(size_t global_ref_count) noexcept override;
+		PEFF_ADVUTILS_API virtual void on_ref_zero() noexcept;
+
+		PEFF_ADVUTILS_API virtual void *alloc(size_t size, size_t alignment = 0) noexcept override;
+		PEFF_ADVUTILS_API virtual void *realloc(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override;
+		PEFF_ADVUTILS_API virtual void *realloc_in_place(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override;
+		PEFF_ADVUTILS_API virtual void release(void *ptr, size_t size, size_t alignment) noexcept override;
+		PEFF_ADVUTILS_API virtual size_t alloc_batch(size_t count, size_t size, size_t alignment, void **out) noexcept override;
+		PEFF_ADVUTILS_API virtual void release_batch(void *const *ptrs, size_t count, size_t size, size_t alignment) noexcept override;
+		PEFF_ADVUTILS_API virtual size_t trim(size_t keep_bytes, PurgePolicy policy = PurgePolicy::Lazy) noexcept override;
+
+		PEFF_ADVUTILS_API virtual AllocCaps get_caps() const noexcept override;
+
+		/// @brief Memory from the recorder is allocated by the upstream allocator.
+		PEFF_ADVUTILS_API virtual bool is_replaceable(const Alloc *rhs) const noexcept override;
+
+		PEFF_ADVUTILS_API virtual UUID type_identity() const noexcept override;
+
+		/// @brief Write the buffered records to the file.
+		/// @return true for succeeded, false if any write has failed.
+		PEFF_ADVUTILS_API bool flush() noexcept;
+
+	protected:
+		PEFF_ADVUTILS_API void _flush_buffer() noexcept;
+		PEFF_ADVUTILS_API void _write_varint(uint64_t value) noexcept;
+		/// @brief Append a record to the buffer, must be called with the lock held.
+		PEFF_ADVUTILS_API void _write_record(TraceOp op, uint64_t id, size_t size, size_t alignment) noexcept;
+		/// @brief Assign an id to a new block and record its allocation, must be called with the lock held.
+		PEFF_ADVUTILS_API void _record_alloc(void *ptr, size_t size, size_t alignment) noexcept;
+		/// @brief Record the release of a block and forget its id, must be called with the lock held.
+		PEFF_ADVUTILS_API void _record_release(void *ptr, size_t size, size_t alignment) noexcept;
+	};
+
+	/// @brief Reader of the trace files written by TraceRecorderAlloc.
+	class TraceReader {
+	public:
+		FILE *fp;
+		uint64_t last_timestamp = 0;
+		/// @brief Whether the reader has stopped at a malformed or truncated record rather than the end of the file.
+		bool is_malformed = false;
+
+		PEFF_FORCEINLINE TraceReader(FILE *fp) noexcept : fp(fp) {}
+
+		/// @brief Read and check the magic and the version of the trace.
+		/// @return true if the file is a trace of a supported version.
+		PEFF_ADVUTILS_API bool read_header() noexcept;
+		/// @brief Read the next record.
+		/// @return true if a record has been read, false at the end of the trace or on a malformed record.
+		PEFF_ADVUTILS_API bool read(TraceRecord &record_out) noexcept;
+
+	protected:
+		PEFF_ADVUTILS_API bool _read_varint(uint64_t &value_out) noexcept;
+	};
+}
+
+#endif
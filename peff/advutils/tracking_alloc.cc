@@ -0,0 +1,198 @@
+#include "tracking_alloc.h"
+#include <peff/utils/bitops.h>
+
+using namespace peff;
+
+PEFF_ADVUTILS_API size_t TrackingAlloc::get_size_bin(size_t size) noexcept {
+	if (size_t size_class = size_to_size_class(size, 0); size_class != INVALID_SIZE_CLASS)
+		return size_class;
+
+	// The bins are (2^11, 2^12], (2^12, 2^13], ...
+	const uint64_t value = (uint64_t)(size - 1);
+	const size_t log2 = (value >> 32) ? 63 - count_leading_zero((uint32_t)(value >> 32)) : 31 - count_leading_zero((uint32_t)value);
+
+	const size_t bin = NUM_SIZE_CLASSES + log2 - 11;
+	return bin < NUM_SIZE_BINS ? bin : NUM_SIZE_BINS - 1;
+}
+
+PEFF_ADVUTILS_API size_t TrackingAlloc::get_alignment_bin(size_t alignment) noexcept {
+	if (alignment <= 1)
+		return 0;
+
+	const uint64_t value = (uint64_t)(alignment - 1);
+	const size_t bin = ((value >> 32) ? 64 - count_leading_zero((uint32_t)(value >> 32)) : 32 - count_leading_zero((uint32_t)value));
+	return bin < NUM_ALIGNMENT_BINS ? bin : NUM_ALIGNMENT_BINS - 1;
+}
+
+PEFF_ADVUTILS_API size_t TrackingAlloc::get_size_bin_limit(size_t bin) noexcept {
+	if (bin < NUM_SIZE_CLASSES)
+		return size_class_to_size(bin);
+
+	if (bin == NUM_SIZE_BINS - 1)
+		return SIZE_MAX;
+
+	return (size_t)1 << (bin - NUM_SIZE_CLASSES + 12);
+}
+
+PEFF_ADVUTILS_API TrackingAlloc::TrackingAlloc(peff::Alloc *upstream) : upstream(upstream) {
+}
+
+PEFF_ADVUTILS_API TrackingAlloc::~TrackingAlloc() {
+}
+
+PEFF_ADVUTILS_API size_t TrackingAlloc::dec_ref(size_t global_ref_count) noexcept {
+	if (!--_ref_count) {
+		on_ref_zero();
+		return 0;
+	}
+	return _ref_count;
+}
+
+PEFF_ADVUTILS_API size_t TrackingAlloc::inc_ref(size_t global_ref_count) noexcept {
+	return ++_ref_count;
+}
+
+PEFF_ADVUTILS_API void TrackingAlloc::on_ref_zero() noexcept {
+}
+
+PEFF_ADVUTILS_API void TrackingAlloc::_record_request(size_t size, size_t alignment) noexcept {
+	size_histogram[get_size_bin(size)].fetch_add(1, std::memory_order_relaxed);
+	alignment_histogram[get_alignment_bin(alignment)].fetch_add(1, std::memory_order_relaxed);
+}
+
+PEFF_ADVUTILS_API void TrackingAlloc::_add_live_size(size_t size) noexcept {
+	const size_t new_live_size = live_size.fetch_add(size, std::memory_order_relaxed) + size;
+
+	size_t cur_peak_size = peak_size.load(std::memory_order_relaxed);
+	while (new_live_size > cur_peak_size) {
+		if (peak_size.compare_exchange_weak(cur_peak_size, new_live_size, std::memory_order_relaxed))
+			break;
+	}
+}
+
+PEFF_ADVUTILS_API void TrackingAlloc::_sub_live_size(size_t size) noexcept {
+	// The blocks allocated before the decorator was attached may be released through it.
+	size_t cur_live_size = live_size.load(std::memory_order_relaxed);
+	while (!live_size.compare_exchange_weak(cur_live_size, cur_live_size > size ? cur_live_size - size : 0, std::memory_order_relaxed))
+		;
+}
+
+PEFF_ADVUTILS_API void TrackingAlloc::_record_realloc(void *ptr, size_t size, size_t new_size, void *result) noexcept {
+	num_reallocs.fetch_add(1, std::memory_order_relaxed);
+
+	if (!result) {
+		num_failed_reallocs.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	if (result == ptr) {
+		num_in_place_reallocs.fetch_add(1, std::memory_order_relaxed);
+	} else {
+		num_moving_reallocs.fetch_add(1, std::memory_order_relaxed);
+		realloc_copy_size.fetch_add(size < new_size ? size : new_size, std::memory_order_relaxed);
+	}
+
+	if (new_size > size)
+		_add_live_size(new_size - size);
+	else
+		_sub_live_size(size - new_size);
+}
+
+PEFF_ADVUTILS_API void *TrackingAlloc::alloc(size_t size, size_t alignment) noexcept {
+	void *ptr = upstream->alloc(size, alignment);
+
+	num_allocs.fetch_add(1, std::memory_order_relaxed);
+	_record_request(size, alignment);
+
+	if (!ptr) {
+		num_failed_allocs.fetch_add(1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	_add_live_size(size);
+
+	return ptr;
+}
+
+PEFF_ADVUTILS_API void *TrackingAlloc::realloc(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept {
+	void *p = upstream->realloc(ptr, size, alignment, new_size, new_alignment);
+
+	_record_request(new_size, new_alignment);
+	_record_realloc(ptr, size, new_size, p);
+
+	return p;
+}
+
+PEFF_ADVUTILS_API void *TrackingAlloc::realloc_in_place(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept {
+	void *p = upstream->realloc_in_place(ptr, size, alignment, new_size, new_alignment);
+
+	_record_request(new_size, new_alignment);
+	_record_realloc(ptr, size, new_size, p);
+
+	return p;
+}
+
+PEFF_ADVUTILS_API void TrackingAlloc::release(void *ptr, size_t size, size_t alignment) noexcept {
+	upstream->release(ptr, size, alignment);
+
+	num_releases.fetch_add(1, std::memory_order_relaxed);
+	_sub_live_size(size);
+}
+
+PEFF_ADVUTILS_API size_t TrackingAlloc::trim(size_t keep_bytes, PurgePolicy policy) noexcept {
+	return upstream->trim(keep_bytes, policy);
+}
+
+PEFF_ADVUTILS_API AllocCaps TrackingAlloc::get_caps() const noexcept {
+	return upstream->get_caps();
+}
+
+PEFF_ADVUTILS_API bool TrackingAlloc::is_replaceable(const Alloc *rhs) const noexcept {
+	if (rhs->type_identity() == type_identity())
+		return upstream->is_replaceable(((const TrackingAlloc *)rhs)->upstream.get());
+
+	return upstream->is_replaceable(rhs);
+}
+
+PEFF_ADVUTILS_API UUID TrackingAlloc::type_identity() const noexcept {
+	return PEFF_UUID(2074e225, 626d, 4b3f, 8ae9, 942938eaa3fa);
+}
+
+PEFF_ADVUTILS_API TrackingAlloc::Stats TrackingAlloc::snapshot() const noexcept {
+	Stats stats;
+
+	stats.live_size = live_size.load(std::memory_order_relaxed);
+	stats.peak_size = peak_size.load(std::memory_order_relaxed);
+	stats.num_allocs = num_allocs.load(std::memory_order_relaxed);
+	stats.num_failed_allocs = num_failed_allocs.load(std::memory_order_relaxed);
+	stats.num_reallocs = num_reallocs.load(std::memory_order_relaxed);
+	stats.num_failed_reallocs = num_failed_reallocs.load(std::memory_order_relaxed);
+	stats.num_releases = num_releases.load(std::memory_order_relaxed);
+	stats.num_in_place_reallocs = num_in_place_reallocs.load(std::memory_order_relaxed);
+	stats.num_moving_reallocs = num_moving_reallocs.load(std::memory_order_relaxed);
+	stats.realloc_copy_size = realloc_copy_size.load(std::memory_order_relaxed);
+
+	for (size_t i = 0; i < NUM_SIZE_BINS; ++i)
+		stats.size_histogram[i] = size_histogram[i].load(std::memory_order_relaxed);
+	for (size_t i = 0; i < NUM_ALIGNMENT_BINS; ++i)
+		stats.alignment_histogram[i] = alignment_histogram[i].load(std::memory_order_relaxed);
+
+	return stats;
+}
+
+PEFF_ADVUTILS_API void TrackingAlloc::reset_stats() noexcept {
+	peak_size.store(live_size.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	num_allocs.store(0, std::memory_order_relaxed);
+	num_failed_allocs.store(0, std::memory_order_relaxed);
+	num_reallocs.store(0, std::memory_order_relaxed);
+	num_failed_reallocs.store(0, std::memory_order_relaxed);
+	num_releases.store(0, std::memory_order_relaxed);
+	num_in_place_reallocs.store(0, std::memory_order_relaxed);
+	num_moving_reallocs.store(0, std::memory_order_relaxed);
+	realloc_copy_size.store(0, std::memory_order_relaxed);
+
+	for (auto &i : size_histogram)
+		i.store(0, std::memory_order_relaxed);
+	for (auto &i : alignment_histogram)
+		i.store(0, std::memory_order_relaxed);
+}
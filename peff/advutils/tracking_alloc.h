@@ -0,0 +1,109 @@
+#ifndef _PEFF_ADVUTILS_TRACKING_ALLOC_H_
+#define _PEFF_ADVUTILS_TRACKING_ALLOC_H_
+
+#include "basedefs.h"
+#include "size_class.h"
+#include <peff/base/alloc.h>
+
+namespace peff {
+	/// @brief Decorator which collects the statistics of the requests to the upstream allocator.
+	///
+	/// The counters are updated with relaxed atomic operations, so the
+	/// decorator is as thread-safe as the upstream allocator and cheap
+	/// enough to be kept on, use snapshot() to read the statistics.
+	///
+	/// A container can be attached to the decorator by replace_allocator(),
+	/// the counters are then deltas since the attachment. The blocks are
+	/// not tracked one by one, so releasing the blocks allocated before the
+	/// attachment is counted as usual but the live size is clamped at zero.
+	class TrackingAlloc : public Alloc {
+	protected:
+		std::atomic_size_t _ref_count = 0;
+
+	public:
+		/// @brief Number of the bins for the sizes larger than any size class, one for each power of two.
+		constexpr static size_t NUM_LARGE_SIZE_BINS = sizeof(size_t) * 8 - 11;
+		/// @brief Sizes up to SIZE_CLASS_MAX_SIZE are binned by size classes, others by powers of two.
+		constexpr static size_t NUM_SIZE_BINS = NUM_SIZE_CLASSES + NUM_LARGE_SIZE_BINS;
+		/// @brief Alignments are binned by powers of two, the last bin also holds all larger alignments.
+		constexpr static size_t NUM_ALIGNMENT_BINS = 17;
+
+		struct Stats {
+			/// @brief Total size of the live allocations, clamped at zero, see the notes of the class.
+			size_t live_size = 0;
+			/// @brief Maximum of the total size of the live allocations.
+			size_t peak_size = 0;
+			size_t num_allocs = 0;
+			size_t num_failed_allocs = 0;
+			size_t num_reallocs = 0;
+			size_t num_failed_reallocs = 0;
+			size_t num_releases = 0;
+			/// @brief Number of the reallocations which did not move the data.
+			size_t num_in_place_reallocs = 0;
+			/// @brief Number of the reallocations which moved the data.
+			size_t num_moving_reallocs = 0;
+			/// @brief Total size of the data which had to be preserved by the moving reallocations.
+			size_t realloc_copy_size = 0;
+			size_t size_histogram[NUM_SIZE_BINS] = {};
+			size_t alignment_histogram[NUM_ALIGNMENT_BINS] = {};
+		};
+
+		peff::RcObjectPtr<peff::Alloc> upstream;
+
+		std::atomic_size_t live_size = 0;
+		std::atomic_size_t peak_size = 0;
+		std::atomic_size_t num_allocs = 0;
+		std::atomic_size_t num_failed_allocs = 0;
+		std::atomic_size_t num_reallocs = 0;
+		std::atomic_size_t num_failed_reallocs = 0;
+		std::atomic_size_t num_releases = 0;
+		std::atomic_size_t num_in_place_reallocs = 0;
+		std::atomic_size_t num_moving_reallocs = 0;
+		std::atomic_size_t realloc_copy_size = 0;
+		std::atomic_size_t size_histogram[NUM_SIZE_BINS] = {};
+		std::atomic_size_t alignment_histogram[NUM_ALIGNMENT_BINS] = {};
+
+		PEFF_ADVUTILS_API static size_t get_size_bin(size_t size) noexcept;
+		PEFF_ADVUTILS_API static size_t get_alignment_bin(size_t alignment) noexcept;
+
+		/// @brief Get the largest size of the requests which fall into a size bin.
+		PEFF_ADVUTILS_API static size_t get_size_bin_limit(size_t bin) noexcept;
+
+		PEFF_ADVUTILS_API TrackingAlloc(peff::Alloc *upstream);
+		TrackingAlloc(const TrackingAlloc &) = delete;
+		PEFF_ADVUTILS_API virtual ~TrackingAlloc();
+
+		TrackingAlloc &operator=(const TrackingAlloc &) = delete;
+
+		PEFF_ADVUTILS_API virtual size_t inc_ref(size_t global_ref_count) noexcept override;
+		PEFF_ADVUTILS_API virtual size_t dec_ref(size_t global_ref_count) noexcept override;
+		PEFF_ADVUTILS_API virtual void on_ref_zero() noexcept;
+
+		PEFF_ADVUTILS_API virtual void *alloc(size_t size, size_t alignment = 0) noexcept override;
+		PEFF_ADVUTILS_API virtual void *realloc(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override;
+		PEFF_ADVUTILS_API virtual void *realloc_in_place(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override;
+		PEFF_ADVUTILS_API virtual void release(void *ptr, size_t size, size_t alignment) noexcept override;
+		PEFF_ADVUTILS_API virtual size_t trim(size_t keep_bytes, PurgePolicy policy = PurgePolicy::Lazy) noexcept override;
+
+		PEFF_ADVUTILS_API virtual AllocCaps get_caps() const noexcept override;
+
+		/// @brief The decorator is replaceable with whatever the upstream allocator is replaceable with, or with another decorator around such allocator.
+		PEFF_ADVUTILS_API virtual bool is_replaceable(const Alloc *rhs) const noexcept override;
+
+		PEFF_ADVUTILS_API virtual UUID type_identity() const noexcept override;
+
+		/// @brief Take a snapshot of the statistics.
+		/// @note The counters are read one by one, the snapshot may be slightly inconsistent if the allocator is being used concurrently.
+		PEFF_ADVUTILS_API Stats snapshot() const noexcept;
+		/// @brief Reset all counters except the live size, the peak size is reset to the live size.
+		PEFF_ADVUTILS_API void reset_stats() noexcept;
+
+	protected:
+		PEFF_ADVUTILS_API void _record_request(size_t size, size_t alignment) noexcept;
+		PEFF_ADVUTILS_API void _add_live_size(size_t size) noexcept;
+		PEFF_ADVUTILS_API void _sub_live_size(size_t size) noexcept;
+		PEFF_ADVUTILS_API void _record_realloc(void *ptr, size_t size, size_t new_size, void *result) noexcept;
+	};
+}
+
+#endif
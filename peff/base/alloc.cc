@@ -1,39 +1,58 @@
 #include "alloc.h"
 #include <cstdlib>
+#include <cstring>
+
+#if __APPLE__
+	#include <malloc/malloc.h>
+#elif defined(__linux__)
+	#include <malloc.h>
+#endif
 
 using namespace peff;
 
 PEFF_BASE_API Alloc::~Alloc() {}
 
-PEFF_BASE_API StdAlloc peff::g_std_allocator;
+PEFF_BASE_API size_t Alloc::alloc_batch(size_t count, size_t size, size_t alignment, void **out) noexcept {
+	for (size_t i = 0; i < count; ++i) {
+		if (!(out[i] = alloc(size, alignment)))
+			return i;
+	}
 
-PEFF_BASE_API size_t StdAlloc::inc_ref(size_t global_ref_count) noexcept {
-	return ++_ref_count;
+	return count;
 }
 
-PEFF_BASE_API size_t StdAlloc::dec_ref(size_t global_ref_count) noexcept {
-	if (!--_ref_count) {
-		on_ref_zero();
-		return 0;
-	}
-	return _ref_count;
+PEFF_BASE_API void Alloc::release_batch(void *const *ptrs, size_t count, size_t size, size_t alignment) noexcept {
+	for (size_t i = 0; i < count; ++i)
+		release(ptrs[i], size, alignment);
+}
+
+PEFF_BASE_API size_t Alloc::trim(size_t keep_bytes, PurgePolicy policy) noexcept {
+	return 0;
 }
 
-PEFF_BASE_API void StdAlloc::on_ref_zero() noexcept {
+PEFF_BASE_API AllocCaps Alloc::get_caps() const noexcept {
+	return AllocCaps();
 }
 
+PEFF_BASE_API StdAlloc peff::g_std_allocator;
+
 PEFF_BASE_API void *StdAlloc::alloc(size_t size, size_t alignment) noexcept {
 #ifdef _MSC_VER
-	return _aligned_malloc(size, alignment);
+	return _aligned_malloc(size, alignment ? alignment : 1);
 #else
+	// malloc() already satisfies the fundamental alignment.
+	if (alignment <= alignof(std::max_align_t))
+		return malloc(size);
+
 	#if __ANDROID__
-	return memalign(size, alignment);
+	return memalign(alignment, size);
 	#elif __APPLE__
 	void *ptr;
-	if (posix_memalign(&ptr, std::max(sizeof(void*), alignment), size))
+	if (posix_memalign(&ptr, alignment, size))
 		return nullptr;
 	return ptr;
 	#else
+	// The size must be a multiple of the alignment for aligned_alloc().
 	size_t size_diff = size % alignment;
 	if (size_diff) {
 		size += alignment - size_diff;
@@ -44,26 +63,35 @@ PEFF_BASE_API void *StdAlloc::alloc(size_t size, size_t alignment) noexcept {
 }
 
 PEFF_BASE_API void *StdAlloc::realloc_in_place(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept {
+#if defined(__linux__) || defined(__APPLE__)
+	if (new_alignment && (((uintptr_t)ptr) % new_alignment))
+		return nullptr;
+
+	// The block is usually larger than requested because of the size classes of malloc().
+	#if __APPLE__
+	if (new_size <= malloc_size(ptr))
+		return ptr;
+	#else
+	if (new_size <= malloc_usable_size(ptr))
+		return ptr;
+	#endif
+#endif
 	return nullptr;
 }
 
 PEFF_BASE_API void *StdAlloc::realloc(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept {
 #ifdef _MSC_VER
-	return _aligned_realloc(ptr, new_size, new_alignment);
+	return _aligned_realloc(ptr, new_size, new_alignment ? new_alignment : 1);
 #else
-	if (alignment > 1) {
+	// realloc() only keeps the fundamental alignment.
+	if (new_alignment > alignof(std::max_align_t)) {
 		void *p;
 
-	#if __ANDROID__
-		if (!(p = memalign(new_alignment, new_size)))
-			return nullptr;
-	#elif __APPLE__
-		if (posix_memalign(&p, std::max(sizeof(void*), new_alignment), new_size))
-			return nullptr;
-	#else
-		if (!(p = aligned_alloc(new_alignment, new_size)))
+		if ((p = realloc_in_place(ptr, size, alignment, new_size, new_alignment)))
+			return p;
+
+		if (!(p = alloc(new_size, new_alignment)))
 			return nullptr;
-	#endif
 
 		memcpy(p, ptr, size > new_size ? new_size : size);
 
@@ -83,6 +111,17 @@ PEFF_BASE_API void StdAlloc::release(void *ptr, size_t size, size_t alignment) n
 #endif
 }
 
+PEFF_BASE_API AllocCaps StdAlloc::get_caps() const noexcept {
+	AllocCaps caps;
+
+	caps.is_thread_safe = true;
+#if !(defined(__linux__) || defined(__APPLE__))
+	caps.supports_realloc_in_place = false;
+#endif
+
+	return caps;
+}
+
 PEFF_BASE_API bool StdAlloc::is_replaceable(const Alloc *rhs) const noexcept {
 	return true;
 }
@@ -97,21 +136,6 @@ PEFF_BASE_API StdAlloc *peff::default_allocator() noexcept {
 
 PEFF_BASE_API VoidAlloc peff::g_void_alloc;
 
-PEFF_BASE_API size_t VoidAlloc::inc_ref(size_t global_ref_count) noexcept {
-	return ++_ref_count;
-}
-
-PEFF_BASE_API size_t VoidAlloc::dec_ref(size_t global_ref_count) noexcept {
-	if (!--_ref_count) {
-		on_ref_zero();
-		return 0;
-	}
-	return _ref_count;
-}
-
-PEFF_BASE_API void VoidAlloc::on_ref_zero() noexcept {
-}
-
 PEFF_BASE_API void *VoidAlloc::alloc(size_t size, size_t alignment) noexcept {
 	std::terminate();
 }
@@ -128,6 +152,15 @@ PEFF_BASE_API void VoidAlloc::release(void *ptr, size_t size, size_t alignment)
 	std::terminate();
 }
 
+PEFF_BASE_API AllocCaps VoidAlloc::get_caps() const noexcept {
+	AllocCaps caps;
+
+	caps.is_thread_safe = true;
+	caps.supports_realloc_in_place = false;
+
+	return caps;
+}
+
 PEFF_BASE_API bool VoidAlloc::is_replaceable(const Alloc *rhs) const noexcept {
 	return true;
 }
@@ -138,21 +171,6 @@ PEFF_BASE_API UUID VoidAlloc::type_identity() const noexcept {
 
 PEFF_BASE_API NullAlloc peff::g_null_alloc;
 
-PEFF_BASE_API size_t NullAlloc::inc_ref(size_t global_ref_count) noexcept {
-	return ++_ref_count;
-}
-
-PEFF_BASE_API size_t NullAlloc::dec_ref(size_t global_ref_count) noexcept {
-	if (!--_ref_count) {
-		on_ref_zero();
-		return 0;
-	}
-	return _ref_count;
-}
-
-PEFF_BASE_API void NullAlloc::on_ref_zero() noexcept {
-}
-
 PEFF_BASE_API void *NullAlloc::alloc(size_t size, size_t alignment) noexcept {
 	return nullptr;
 }
@@ -168,6 +186,16 @@ PEFF_BASE_API void *NullAlloc::realloc_in_place(void *ptr, size_t size, size_t a
 PEFF_BASE_API void NullAlloc::release(void *ptr, size_t size, size_t alignment) noexcept {
 }
 
+PEFF_BASE_API AllocCaps NullAlloc::get_caps() const noexcept {
+	AllocCaps caps;
+
+	caps.is_monotonic = true;
+	caps.is_thread_safe = true;
+	caps.supports_realloc_in_place = false;
+
+	return caps;
+}
+
 PEFF_BASE_API bool NullAlloc::is_replaceable(const Alloc *rhs) const noexcept {
 	return true;
 }
@@ -9,6 +9,28 @@
 #include <memory>
 
 namespace peff {
+	/// @brief How the memory returned by trimming is given back to the system.
+	enum class PurgePolicy : uint8_t {
+		/// @brief Let the system reclaim the pages when it is under memory pressure, which is cheaper if the pages are reused soon.
+		Lazy = 0,
+		/// @brief Discard the pages immediately, so that the resident size drops at once.
+		Eager
+	};
+
+	/// @brief Capabilities of an allocator, which let the users skip the work the allocator does not need.
+	struct AllocCaps {
+		/// @brief Whether release() is a no-op, the memory is only reclaimed when the allocator is reset or destructed.
+		bool is_monotonic = false;
+		/// @brief Whether the allocator can be used by multiple threads at the same time.
+		bool is_thread_safe = false;
+		/// @brief Whether realloc_in_place() may succeed, it always fails if false.
+		bool supports_realloc_in_place = true;
+		/// @brief Whether the memory from alloc() is always filled with zeros.
+		bool zero_initialized = false;
+		/// @brief Largest alignment which the allocator supports, SIZE_MAX if there is no limit.
+		size_t max_alignment = SIZE_MAX;
+	};
+
 	class Alloc {
 	public:
 		PEFF_BASE_API virtual ~Alloc();
@@ -21,26 +43,62 @@ namespace peff {
 		virtual void *realloc_in_place(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept = 0;
 		virtual void release(void *ptr, size_t size, size_t alignment) noexcept = 0;
 
+		/// @brief Allocate multiple blocks with the same size and alignment.
+		/// @param count Number of the blocks to be allocated.
+		/// @param size Size of each block.
+		/// @param alignment Alignment of each block.
+		/// @param out Array which receives the blocks, must be able to hold `count` pointers.
+		/// @return Number of the blocks allocated into the front of `out`, less than `count` if the allocator runs out of memory.
+		/// @note The default implementation allocates the blocks one by one.
+		PEFF_BASE_API virtual size_t alloc_batch(size_t count, size_t size, size_t alignment, void **out) noexcept;
+		/// @brief Release multiple blocks with the same size and alignment.
+		/// @param ptrs Blocks to be released.
+		/// @param count Number of the blocks.
+		/// @note The default implementation releases the blocks one by one.
+		PEFF_BASE_API virtual void release_batch(void *const *ptrs, size_t count, size_t size, size_t alignment) noexcept;
+
+		/// @brief Give the memory which is retained by the allocator but not in use back to the system.
+		/// @param keep_bytes Size of the free memory to be retained for the following allocations.
+		/// @param policy How the pages are given back.
+		/// @return Size of the memory released to the upstream allocator or purged, including the size trimmed by the upstream allocators.
+		/// @note Allocators with an upstream allocator trim the upstream allocator after themselves, with the same parameters.
+		/// @note The default implementation does nothing.
+		PEFF_BASE_API virtual size_t trim(size_t keep_bytes, PurgePolicy policy = PurgePolicy::Lazy) noexcept;
+
+		/// @brief Get the capabilities of the allocator.
+		/// @note The capabilities must not change during the lifetime of the allocator.
+		/// @note The default implementation returns the default AllocCaps, which assumes nothing about the allocator.
+		PEFF_BASE_API virtual AllocCaps get_caps() const noexcept;
+
 		virtual bool is_replaceable(const Alloc *rhs) const noexcept = 0;
 
 		virtual UUID type_identity() const noexcept = 0;
 	};
 
-	class StdAlloc : public Alloc {
-	private:
-		std::atomic_size_t _ref_count = 0;
-
+	/// @brief Base of the allocators which live as long as the program, such as the global allocators.
+	///
+	/// Reference counting of the immortal allocators is a no-op, so that
+	/// the containers using the same allocator from different threads do
+	/// not contend on the cache line of its reference counter.
+	class ImmortalAlloc : public Alloc {
 	public:
-		PEFF_BASE_API virtual size_t inc_ref(size_t global_ref_count) noexcept override;
-		PEFF_BASE_API virtual size_t dec_ref(size_t global_ref_count) noexcept override;
-
-		PEFF_BASE_API virtual void on_ref_zero() noexcept;
+		PEFF_FORCEINLINE virtual size_t inc_ref(size_t global_ref_count) noexcept override final {
+			return 1;
+		}
+		PEFF_FORCEINLINE virtual size_t dec_ref(size_t global_ref_count) noexcept override final {
+			return 1;
+		}
+	};
 
+	class StdAlloc : public ImmortalAlloc {
+	public:
 		PEFF_BASE_API virtual void *alloc(size_t size, size_t alignment) noexcept override;
 		PEFF_BASE_API virtual void *realloc(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override;
 		PEFF_BASE_API virtual void *realloc_in_place(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override;
 		PEFF_BASE_API virtual void release(void *ptr, size_t size, size_t alignment) noexcept override;
 
+		PEFF_BASE_API virtual AllocCaps get_caps() const noexcept override;
+
 		PEFF_BASE_API virtual bool is_replaceable(const Alloc *rhs) const noexcept override;
 
 		PEFF_BASE_API virtual UUID type_identity() const noexcept override;
@@ -50,21 +108,15 @@ namespace peff {
 
 	PEFF_BASE_API StdAlloc *default_allocator() noexcept;
 
-	class VoidAlloc : public Alloc {
-	private:
-		std::atomic_size_t _ref_count = 0;
-
+	class VoidAlloc : public ImmortalAlloc {
 	public:
-		PEFF_BASE_API virtual size_t inc_ref(size_t global_ref_count) noexcept override;
-		PEFF_BASE_API virtual size_t dec_ref(size_t global_ref_count) noexcept override;
-
-		PEFF_BASE_API virtual void on_ref_zero() noexcept;
-
 		PEFF_BASE_API virtual void *alloc(size_t size, size_t alignment = 0) noexcept override;
 		PEFF_BASE_API virtual void *realloc(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override;
 		PEFF_BASE_API virtual void *realloc_in_place(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override;
 		PEFF_BASE_API virtual void release(void *ptr, size_t size, size_t alignment) noexcept override;
 
+		PEFF_BASE_API virtual AllocCaps get_caps() const noexcept override;
+
 		PEFF_BASE_API virtual bool is_replaceable(const Alloc *rhs) const noexcept override;
 
 		PEFF_BASE_API virtual UUID type_identity() const noexcept override;
@@ -72,21 +124,15 @@ namespace peff {
 
 	PEFF_BASE_API extern VoidAlloc g_void_alloc;
 
-	class NullAlloc : public Alloc {
-	private:
-		std::atomic_size_t _ref_count = 0;
-
+	class NullAlloc : public ImmortalAlloc {
 	public:
-		PEFF_BASE_API virtual size_t inc_ref(size_t global_ref_count) noexcept override;
-		PEFF_BASE_API virtual size_t dec_ref(size_t global_ref_count) noexcept override;
-
-		PEFF_BASE_API virtual void on_ref_zero() noexcept;
-
 		PEFF_BASE_API virtual void *alloc(size_t size, size_t alignment = 0) noexcept override;
 		PEFF_BASE_API virtual void *realloc(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override;
 		PEFF_BASE_API virtual void *realloc_in_place(void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept override;
 		PEFF_BASE_API virtual void release(void *ptr, size_t size, size_t alignment) noexcept override;
 
+		PEFF_BASE_API virtual AllocCaps get_caps() const noexcept override;
+
 		PEFF_BASE_API virtual bool is_replaceable(const Alloc *rhs) const noexcept override;
 
 		PEFF_BASE_API virtual UUID type_identity() const noexcept override;
@@ -139,21 +185,132 @@ namespace peff {
 		std::destroy_at<T>(ptr);
 	}
 
+	/// @brief Dispatcher of the requests to an allocator type.
+	///
+	/// Requests to Alloc are dispatched through the vtable, requests to a
+	/// concrete allocator type are dispatched statically, so that they can
+	/// be inlined if the definitions are visible.
+	///
+	/// @tparam AllocT Type of the allocator, must be the final type of the allocator objects if it is not Alloc.
+	template <typename AllocT>
+	struct AllocTraits {
+		static_assert(std::is_base_of_v<Alloc, AllocT>, "The allocator type must be derived from Alloc");
+
+		using AllocType = AllocT;
+
+		constexpr static bool IS_STATICALLY_DISPATCHED = !std::is_same_v<AllocT, Alloc>;
+		/// @brief Whether the allocator objects are immortal, which means they need not to be kept alive by the users.
+		constexpr static bool IS_IMMORTAL = std::is_base_of_v<ImmortalAlloc, AllocT>;
+
+		PEFF_FORCEINLINE static void *alloc(AllocT *allocator, size_t size, size_t alignment) noexcept {
+			if constexpr (IS_STATICALLY_DISPATCHED)
+				return allocator->AllocT::alloc(size, alignment);
+			else
+				return allocator->alloc(size, alignment);
+		}
+
+		PEFF_FORCEINLINE static void *realloc(AllocT *allocator, void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept {
+			if constexpr (IS_STATICALLY_DISPATCHED)
+				return allocator->AllocT::realloc(ptr, size, alignment, new_size, new_alignment);
+			else
+				return allocator->realloc(ptr, size, alignment, new_size, new_alignment);
+		}
+
+		PEFF_FORCEINLINE static void *realloc_in_place(AllocT *allocator, void *ptr, size_t size, size_t alignment, size_t new_size, size_t new_alignment) noexcept {
+			if constexpr (IS_STATICALLY_DISPATCHED)
+				return allocator->AllocT::realloc_in_place(ptr, size, alignment, new_size, new_alignment);
+			else
+				return allocator->realloc_in_place(ptr, size, alignment, new_size, new_alignment);
+		}
+
+		PEFF_FORCEINLINE static void release(AllocT *allocator, void *ptr, size_t size, size_t alignment) noexcept {
+			if constexpr (IS_STATICALLY_DISPATCHED)
+				allocator->AllocT::release(ptr, size, alignment);
+			else
+				allocator->release(ptr, size, alignment);
+		}
+
+		PEFF_FORCEINLINE static size_t alloc_batch(AllocT *allocator, size_t count, size_t size, size_t alignment, void **out) noexcept {
+			if constexpr (IS_STATICALLY_DISPATCHED)
+				return allocator->AllocT::alloc_batch(count, size, alignment, out);
+			else
+				return allocator->alloc_batch(count, size, alignment, out);
+		}
+
+		PEFF_FORCEINLINE static void release_batch(AllocT *allocator, void *const *ptrs, size_t count, size_t size, size_t alignment) noexcept {
+			if constexpr (IS_STATICALLY_DISPATCHED)
+				allocator->AllocT::release_batch(ptrs, count, size, alignment);
+			else
+				allocator->release_batch(ptrs, count, size, alignment);
+		}
+
+		PEFF_FORCEINLINE static size_t trim(AllocT *allocator, size_t keep_bytes, PurgePolicy policy) noexcept {
+			if constexpr (IS_STATICALLY_DISPATCHED)
+				return allocator->AllocT::trim(keep_bytes, policy);
+			else
+				return allocator->trim(keep_bytes, policy);
+		}
+
+		PEFF_FORCEINLINE static AllocCaps get_caps(const AllocT *allocator) noexcept {
+			if constexpr (IS_STATICALLY_DISPATCHED)
+				return allocator->AllocT::get_caps();
+			else
+				return allocator->get_caps();
+		}
+	};
+
+	/// @brief Buffer which collects blocks with the same size and alignment and releases them in batches.
+	/// @tparam AllocT Type of the allocator, see AllocTraits.
+	/// @tparam N Maximum number of the blocks to be released in one batch.
+	template <typename AllocT = Alloc, size_t N = 64>
+	class BatchReleaser {
+	private:
+		AllocT *_allocator;
+		size_t _size, _alignment;
+		size_t _num_ptrs = 0;
+		void *_ptrs[N];
+
+	public:
+		PEFF_FORCEINLINE BatchReleaser(AllocT *allocator, size_t size, size_t alignment) noexcept : _allocator(allocator), _size(size), _alignment(alignment) {
+		}
+		BatchReleaser(const BatchReleaser &) = delete;
+		PEFF_FORCEINLINE ~BatchReleaser() {
+			flush();
+		}
+
+		BatchReleaser &operator=(const BatchReleaser &) = delete;
+
+		PEFF_FORCEINLINE void push(void *ptr) noexcept {
+			_ptrs[_num_ptrs++] = ptr;
+			if (_num_ptrs == N)
+				flush();
+		}
+
+		PEFF_FORCEINLINE void flush() noexcept {
+			if (_num_ptrs) {
+				AllocTraits<AllocT>::release_batch(_allocator, _ptrs, _num_ptrs, _size, _alignment);
+				_num_ptrs = 0;
+			}
+		}
+	};
+
+	/// @brief Allocate and construct an object.
+	/// @tparam T The type of the object.
+	/// @tparam AllocT Type of the allocator, see AllocTraits.
 #if __cplusplus >= 202002L
-	template <typename T, typename... Args>
+	template <typename T, typename AllocT = Alloc, typename... Args>
 	requires std::constructible_from<T, Args...>
 #else
-	template <typename T, typename... Args>
+	template <typename T, typename AllocT = Alloc, typename... Args>
 #endif
-		PEFF_FORCEINLINE T *alloc_and_construct(Alloc *allocator, size_t alignment, Args &&...args) {
-		RcObjectPtr<Alloc> allocator_holder(allocator);
-
-		void *ptr = allocator_holder->alloc(sizeof(T), alignment);
+		PEFF_FORCEINLINE T *alloc_and_construct(typename AllocTraits<AllocT>::AllocType *allocator, size_t alignment, Args &&...args) {
+		// The caller keeps the allocator alive during the call, it does not need to be held here.
+		void *ptr = AllocTraits<AllocT>::alloc(allocator, sizeof(T), alignment);
 		if (!ptr)
 			return nullptr;
 
-		ScopeGuard release_ptr_guard([&allocator_holder, ptr, alignment]() noexcept {
-			allocator_holder->release(ptr, sizeof(T), alignment);
+		ScopeGuard release_ptr_guard([allocator, ptr, alignment]() noexcept {
+			AllocTraits<AllocT>::release(allocator, ptr, sizeof(T), alignment);
 		});
 
 		peff::construct_at<T>((T *)ptr, std::forward<Args>(args)...);
@@ -165,12 +322,29 @@ namespace peff {
 
 	/// @brief Destroy and release an object.
 	/// @tparam T The final type of the object
+	/// @tparam AllocT Type of the allocator, see AllocTraits.
 	/// @note T must be the final type of the object, the behavior is undefined if T is not the final type.
-	template <typename T>
-	PEFF_FORCEINLINE void destroy_and_release(Alloc *allocator, T *ptr, size_t alignment) {
-		RcObjectPtr<Alloc> allocator_holder(allocator);
+	/// @note The allocator is held during the destruction, so the object may own the last reference to the allocator.
+	template <typename T, typename AllocT = Alloc>
+	PEFF_FORCEINLINE void destroy_and_release(typename AllocTraits<AllocT>::AllocType *allocator, T *ptr, size_t alignment) {
+		if constexpr (AllocTraits<AllocT>::IS_IMMORTAL) {
+			std::destroy_at<T>(ptr);
+			AllocTraits<AllocT>::release(allocator, (void *)ptr, sizeof(T), alignment);
+		} else {
+			RcObjectPtr<AllocT> allocator_holder(allocator);
+			std::destroy_at<T>(ptr);
+			AllocTraits<AllocT>::release(allocator_holder.get(), (void *)ptr, sizeof(T), alignment);
+		}
+	}
+
+	/// @brief Destroy and release an object with an allocator which is kept alive by the caller.
+	/// @tparam T The final type of the object
+	/// @tparam AllocT Type of the allocator, see AllocTraits.
+	/// @note The object must not own the last reference to the allocator, use destroy_and_release() in that case.
+	template <typename T, typename AllocT = Alloc>
+	PEFF_FORCEINLINE void destroy_and_release_borrowed(typename AllocTraits<AllocT>::AllocType *allocator, T *ptr, size_t alignment) {
 		std::destroy_at<T>(ptr);
-		allocator_holder->release((void *)ptr, sizeof(T), alignment);
+		AllocTraits<AllocT>::release(allocator, (void *)ptr, sizeof(T), alignment);
 	}
 
 	template <typename T>
@@ -23,6 +23,14 @@
 	#endif
 #endif
 
+#if defined(_MSC_VER)
+	#define PEFF_NOINLINE __declspec(noinline)
+#elif defined(__GNUC__) || defined(__clang__)
+	#define PEFF_NOINLINE __attribute__((__noinline__))
+#else
+	#define PEFF_NOINLINE
+#endif
+
 #if defined(_MSC_VER)
 	#define PEFF_ASSUME(...) \
 		assert(__VA_ARGS__); \
@@ -85,6 +93,15 @@
 	#define PEFF_RESTRICT_REF(type, name) type &name
 #endif
 
+#if defined(__GNUC__) || defined(__clang__)
+	#define PEFF_PREFETCH(ptr) __builtin_prefetch(ptr)
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	#include <xmmintrin.h>
+	#define PEFF_PREFETCH(ptr) _mm_prefetch((const char *)(ptr), _MM_HINT_T0)
+#else
+	#define PEFF_PREFETCH(ptr)
+#endif
+
 #if PEFF_DYNAMIC_LINK
 	#if IS_PEFF_BASE_BUILDING
 		#define PEFF_BASE_API PEFF_DLLEXPORT
@@ -9,12 +9,15 @@
 #include <cassert>
 
 namespace peff {
-	class BitArray {
+	/// @brief The dynamic bit array type.
+	/// @tparam AllocT Type of the allocator, see AllocTraits.
+	template <typename AllocT = Alloc>
+	class BitArrayImpl {
 	private:
 		size_t _num_bits = 0;
 		size_t _capacity = 0;
 		uint8_t *_buffer = nullptr;
-		peff::RcObjectPtr<Alloc> _allocator;
+		peff::RcObjectPtr<AllocT> _allocator;
 
 		PEFF_FORCEINLINE bool _auto_resize_capacity(size_t num_bits) {
 			if (num_bits < (_capacity >> 1)) {
@@ -108,11 +111,11 @@ namespace peff {
 		}
 
 	public:
-		PEFF_FORCEINLINE BitArray(Alloc *allocator) : _allocator(allocator) {
+		PEFF_FORCEINLINE BitArrayImpl(AllocT *allocator) : _allocator(allocator) {
 		}
-		PEFF_FORCEINLINE ~BitArray() {
+		PEFF_FORCEINLINE ~BitArrayImpl() {
 			if (_buffer)
-				_allocator->release(_buffer, size(), 1);
+				AllocTraits<AllocT>::release(_allocator.get(), _buffer, size(), 1);
 		}
 
 		PEFF_FORCEINLINE size_t size() const {
@@ -127,7 +130,7 @@ namespace peff {
 			if (num_bits) {
 				const size_t num_bytes = (num_bits + 7) >> 3;
 
-				uint8_t *new_buffer = (uint8_t *)_allocator->alloc(num_bytes, 1);
+				uint8_t *new_buffer = (uint8_t *)AllocTraits<AllocT>::alloc(_allocator.get(), num_bytes, 1);
 				if (!new_buffer)
 					return false;
 
@@ -139,12 +142,12 @@ namespace peff {
 					}
 				}
 				if (_buffer)
-					_allocator->release(_buffer, size(), 1);
+					AllocTraits<AllocT>::release(_allocator.get(), _buffer, size(), 1);
 
 				_buffer = new_buffer;
 			} else {
 				if (_buffer)
-					_allocator->release(_buffer, size(), 1);
+					AllocTraits<AllocT>::release(_allocator.get(), _buffer, size(), 1);
 			}
 			_capacity = ((num_bits + 7) >> 3) << 3;
 
@@ -326,16 +329,23 @@ namespace peff {
 			}
 		}
 
-		PEFF_FORCEINLINE Alloc *allocator() const {
+		PEFF_FORCEINLINE AllocT *allocator() const {
 			return _allocator.get();
 		}
 
-		PEFF_FORCEINLINE void replace_allocator(Alloc *rhs) {
+		PEFF_FORCEINLINE void replace_allocator(AllocT *rhs) {
 			verify_replaceable(_allocator.get(), rhs);
 
 			_allocator = rhs;
 		}
 	};
+
+	/// @brief The dynamic bit array type with the dynamically dispatched allocator.
+	/// @note This is a class rather than an alias so that it can still be forward-declared.
+	class BitArray : public BitArrayImpl<> {
+	public:
+		using BitArrayImpl<>::BitArrayImpl;
+	};
 }
 
 #endif
@@ -13,7 +13,8 @@
 namespace peff {
 	/// @brief The dynamic array type.
 	/// @tparam T Type of the elements.
-	template <typename T>
+	/// @tparam AllocT Type of the allocator, see AllocTraits.
+	template <typename T, typename AllocT = Alloc>
 	class DynArray {
 	public:
 		using Iterator = T *;
@@ -21,7 +22,7 @@ namespace peff {
 
 		size_t _length = 0;
 		size_t _capacity = 0;
-		peff::RcObjectPtr<Alloc> _allocator;
+		peff::RcObjectPtr<AllocT> _allocator;
 		T *_data;
 
 		PEFF_FORCEINLINE static size_t _get_grown_capacity(size_t length, size_t old_capacity) {
@@ -145,7 +146,8 @@ namespace peff {
 		PEFF_FORCEINLINE void _shrink(
 			T *new_data,
 			size_t length) noexcept {
-			assert(length < _length);
+			// The length may be unchanged if only the storage is shrunk.
+			assert(length <= _length);
 
 			if constexpr (!std::is_trivially_destructible_v<T>) {
 				for (size_t i = length; i < _length; ++i) {
@@ -170,50 +172,31 @@ namespace peff {
 
 			if constexpr (std::is_trivially_move_assignable_v<T>) {
 				if (_data) {
-					if (!(new_data = (T *)_allocator->realloc(_data, sizeof(T) * _capacity, alignof(T), new_capacity_total_size, alignof(T))))
+					if (!(new_data = (T *)AllocTraits<AllocT>::realloc(_allocator.get(), _data, sizeof(T) * _capacity, alignof(T), new_capacity_total_size, alignof(T))))
 						return false;
 					clear_old_data = false;
 				} else {
-					if (!(new_data = (T *)_allocator->alloc(new_capacity_total_size, alignof(T))))
+					if (!(new_data = (T *)AllocTraits<AllocT>::alloc(_allocator.get(), new_capacity_total_size, alignof(T))))
 						return false;
 				}
 			} else {
-				if (_data) {
-					if (!(new_data = (T *)_allocator->alloc(new_capacity_total_size, alignof(T))))
+				// Skip the attempt if the allocator never extends the blocks.
+				if (_data && AllocTraits<AllocT>::get_caps(_allocator.get()).supports_realloc_in_place && (new_data = (T *)AllocTraits<AllocT>::realloc_in_place(_allocator.get(), _data, sizeof(T) * _capacity, alignof(T), new_capacity_total_size, alignof(T)))) {
+					assert(new_data == _data);
+					// The block has been extended, the existing elements stay where they are.
+					_capacity = new_capacity;
+					clear_old_data = false;
+
+					_expand_to<construct>(new_data, length);
+				} else {
+					if (!(new_data = (T *)AllocTraits<AllocT>::alloc(_allocator.get(), new_capacity_total_size, alignof(T))))
 						return false;
 					if constexpr (std::is_nothrow_constructible_v<T>) {
 						_expand_to<construct>(new_data, length);
 					} else {
 						ScopeGuard scope_guard(
 							[this, new_capacity_total_size, new_data]() noexcept {
-								_allocator->release(new_data, new_capacity_total_size, alignof(T));
-							});
-						_expand_to<construct>(new_data, length);
-						scope_guard.release();
-					}
-				} else {
-					if constexpr (std::is_nothrow_constructible_v<T>) {
-						if ((new_data = (T *)_allocator->realloc_in_place(
-								 _data,
-								 sizeof(T) * _capacity, alignof(T),
-								 new_capacity_total_size, alignof(T)))) {
-							_expand_to<construct>(new_data, length);
-						} else {
-							if (!(new_data = (T *)_allocator->alloc(new_capacity_total_size, alignof(T))))
-								return false;
-							ScopeGuard scope_guard(
-								[this, new_capacity_total_size, new_data]() noexcept {
-									_allocator->release(new_data, new_capacity_total_size, alignof(T));
-								});
-							_expand_to<construct>(new_data, length);
-							scope_guard.release();
-						}
-					} else {
-						if (!(new_data = (T *)_allocator->alloc(new_capacity_total_size, alignof(T))))
-							return false;
-						ScopeGuard scope_guard(
-							[this, new_capacity_total_size, new_data]() noexcept {
-								_allocator->release(new_data, new_capacity_total_size, alignof(T));
+								AllocTraits<AllocT>::release(_allocator.get(), new_data, new_capacity_total_size, alignof(T));
 							});
 						_expand_to<construct>(new_data, length);
 						scope_guard.release();
@@ -239,15 +222,15 @@ namespace peff {
 
 			if constexpr (std::is_trivially_move_assignable_v<T>) {
 				if (_data) {
-					if (!(new_data = (T *)_allocator->realloc(_data, sizeof(T) * _capacity, alignof(T), new_capacity_total_size, alignof(T))))
+					if (!(new_data = (T *)AllocTraits<AllocT>::realloc(_allocator.get(), _data, sizeof(T) * _capacity, alignof(T), new_capacity_total_size, alignof(T))))
 						return false;
 					clear_old_data = false;
 				} else {
-					if (!(new_data = (T *)_allocator->alloc(new_capacity_total_size, alignof(T))))
+					if (!(new_data = (T *)AllocTraits<AllocT>::alloc(_allocator.get(), new_capacity_total_size, alignof(T))))
 						return false;
 				}
 			} else {
-				if (!(new_data = (T *)_allocator->alloc(new_capacity_total_size, alignof(T))))
+				if (!(new_data = (T *)AllocTraits<AllocT>::alloc(_allocator.get(), new_capacity_total_size, alignof(T))))
 					return false;
 			}
 
@@ -258,6 +241,8 @@ namespace peff {
 			if constexpr (std::is_trivially_move_assignable_v<T>) {
 			} else {
 				_shrink(new_data, length);
+				// The elements after the new length have been destructed, only the moved ones are left.
+				_length = length;
 			}
 
 			if (clear_old_data)
@@ -299,7 +284,7 @@ namespace peff {
 					std::destroy_at<T>(&_data[i]);
 			}
 			if (_capacity) {
-				_allocator->release(_data, sizeof(T) * _capacity, alignof(T));
+				AllocTraits<AllocT>::release(_allocator.get(), _data, sizeof(T) * _capacity, alignof(T));
 			}
 
 			_data = nullptr;
@@ -407,10 +392,10 @@ namespace peff {
 			return gap_start;
 		}
 
-		using ThisType = DynArray<T>;
+		using ThisType = DynArray<T, AllocT>;
 
 	public:
-		PEFF_FORCEINLINE DynArray(Alloc *allocator) : _allocator(allocator), _data(nullptr) {
+		PEFF_FORCEINLINE DynArray(AllocT *allocator) : _allocator(allocator), _data(nullptr) {
 		}
 		PEFF_FORCEINLINE DynArray(ThisType &&rhs) noexcept : _allocator(std::move(rhs._allocator)), _data(std::move(rhs._data)), _length(rhs._length), _capacity(rhs._capacity) {
 			rhs._data = nullptr;
@@ -543,7 +528,11 @@ namespace peff {
 		/// @return PEFF_FORCEINLINE
 		///
 		[[nodiscard]] PEFF_FORCEINLINE bool shrink_to_fit() {
-			if (_length > _capacity)
+			if (!_length) {
+				_clear();
+				return true;
+			}
+			if (_length < _capacity)
 				return _shrink_capacity(_length, _length);
 			return true;
 		}
@@ -742,11 +731,11 @@ namespace peff {
 			assert(result);
 		}
 
-		PEFF_FORCEINLINE Alloc *allocator() const {
+		PEFF_FORCEINLINE AllocT *allocator() const {
 			return _allocator.get();
 		}
 
-		PEFF_FORCEINLINE void replace_allocator(Alloc *rhs) {
+		PEFF_FORCEINLINE void replace_allocator(AllocT *rhs) {
 			verify_replaceable(_allocator.get(), rhs);
 
 			_allocator = rhs;
@@ -760,6 +749,12 @@ namespace peff {
 			return _data;
 		}
 
+		/// @brief Update the data pointer after the allocator has moved the elements, such as by compacting its buffer.
+		/// @note The elements are moved bitwise by the allocator, they must not refer to themselves.
+		PEFF_FORCEINLINE void on_data_relocated(void *new_data) noexcept {
+			_data = (T *)new_data;
+		}
+
 		PEFF_FORCEINLINE Iterator begin() {
 			return _data;
 		}
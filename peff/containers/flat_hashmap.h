@@ -0,0 +1,350 @@
+#ifndef _PEFF_CONTAINERS_FLAT_HASHMAP_H_
+#define _PEFF_CONTAINERS_FLAT_HASHMAP_H_
+
+#include "flat_hashset.h"
+
+namespace peff {
+	/// @brief Open-addressing hash map which stores the pairs inline, see FlatHashSetImpl.
+	template <typename K, typename V, typename Eq, typename Hasher, bool Fallible>
+	PEFF_REQUIRES_CONCEPT(std::invocable<Eq, const K &, const K &>)
+	class FlatHashMapImpl final {
+	private:
+		static_assert(std::is_move_constructible_v<K>, "The key must be move-constructible");
+		static_assert(std::is_move_constructible_v<V>, "The value must be move-constructible");
+
+		struct Pair {
+			K key;
+			V value;
+
+			PEFF_FORCEINLINE Pair(K &&key, V &&value) : key(std::move(key)), value(std::move(value)) {}
+			Pair(Pair &&rhs) = default;
+			Pair &operator=(Pair &&rhs) = default;
+		};
+
+		struct PairKeyOf {
+			PEFF_FORCEINLINE const K &operator()(const Pair &pair) const noexcept {
+				return pair.key;
+			}
+		};
+
+		using SetType = FlatHashSetImpl<Pair, Eq, Hasher, Fallible, K, PairKeyOf>;
+
+		SetType _set;
+
+		using ThisType = FlatHashMapImpl<K, V, Eq, Hasher, Fallible>;
+
+		template <typename R, typename P>
+		PEFF_FORCEINLINE static R _to_value(P &&maybe_pair) {
+			if constexpr (Fallible) {
+				if (!maybe_pair.has_value())
+					return NULL_OPTION;
+
+				return maybe_pair.value().value;
+			} else {
+				return maybe_pair.value;
+			}
+		}
+
+	public:
+		using RemoveResultType = typename SetType::RemoveResultType;
+		using ElementQueryResultType = typename std::conditional_t<Fallible, Option<V &>, V &>;
+		using ConstElementQueryResultType = typename std::conditional_t<Fallible, Option<const V &>, const V &>;
+		using ContainsResultType = typename SetType::ContainsResultType;
+		using BatchQueryResultType = typename SetType::BatchQueryResultType;
+		/// @brief Type of the hash codes accepted by the *_with_hash() functions, which are the ones computed by the hasher.
+		using HashCode = typename SetType::HashCode;
+
+		PEFF_FORCEINLINE FlatHashMapImpl(Alloc *allocator) : _set(allocator) {}
+		PEFF_FORCEINLINE FlatHashMapImpl(ThisType &&rhs) : _set(std::move(rhs._set)) {
+		}
+
+		PEFF_FORCEINLINE ThisType &operator=(ThisType &&rhs) noexcept {
+			_set = std::move(rhs._set);
+
+			return *this;
+		}
+
+		[[nodiscard]] PEFF_FORCEINLINE bool insert_without_resize_buckets(K &&key, V &&value) {
+			return _set.insert_without_resize_buckets(Pair(std::move(key), std::move(value)));
+		}
+
+		[[nodiscard]] PEFF_FORCEINLINE bool insert(K &&key, V &&value) {
+			return _set.insert(Pair(std::move(key), std::move(value)));
+		}
+
+		[[nodiscard]] PEFF_FORCEINLINE RemoveResultType remove(const K &key) {
+			return remove_alt<K>(key);
+		}
+
+		/// @brief Remove a pair by a key of another type, see HashMapImpl::remove_alt().
+		template <typename U>
+		[[nodiscard]] PEFF_FORCEINLINE RemoveResultType remove_alt(const U &key) {
+			if constexpr (Fallible) {
+				return _set.template remove_alt<U>(key);
+			} else {
+				_set.template remove_alt<U>(key);
+			}
+		}
+
+		PEFF_FORCEINLINE ContainsResultType contains(const K &key) const {
+			return _set.contains(key);
+		}
+
+		template <typename U>
+		PEFF_FORCEINLINE ContainsResultType contains_alt(const U &key) const {
+			return _set.template contains_alt<U>(key);
+		}
+
+		/// @brief Check if a key presents with its hash code which has been computed, the key is not hashed again.
+		/// @param key Key to be looked up, which may be of another type like the one of contains_alt().
+		/// @param hash_code Hash code of the key, which must equal to the one computed by the hasher.
+		template <typename U>
+		PEFF_FORCEINLINE ContainsResultType contains_with_hash(const U &key, HashCode hash_code) const {
+			return _set.contains_with_hash(key, hash_code);
+		}
+
+		PEFF_FORCEINLINE ElementQueryResultType at(const K &key) {
+			return _to_value<ElementQueryResultType>(_set.at(key));
+		}
+
+		PEFF_FORCEINLINE ConstElementQueryResultType at(const K &key) const {
+			return _to_value<ConstElementQueryResultType>(_set.at(key));
+		}
+
+		template <typename U>
+		PEFF_FORCEINLINE ElementQueryResultType at_alt(const U &key) {
+			return _to_value<ElementQueryResultType>(_set.template at_alt<U>(key));
+		}
+
+		template <typename U>
+		PEFF_FORCEINLINE ConstElementQueryResultType at_alt(const U &key) const {
+			return _to_value<ConstElementQueryResultType>(_set.template at_alt<U>(key));
+		}
+
+		/// @brief Get the value of a key with its hash code which has been computed, see contains_with_hash().
+		template <typename U>
+		PEFF_FORCEINLINE ElementQueryResultType at_with_hash(const U &key, HashCode hash_code) {
+			return _to_value<ElementQueryResultType>(_set.at_with_hash(key, hash_code));
+		}
+
+		template <typename U>
+		PEFF_FORCEINLINE ConstElementQueryResultType at_with_hash(const U &key, HashCode hash_code) const {
+			return _to_value<ConstElementQueryResultType>(_set.at_with_hash(key, hash_code));
+		}
+
+		/// @brief Check if each of a batch of keys presents, see FlatHashSetImpl::get_batch().
+		/// @param keys Keys to be looked up, which may be of another type like the one of contains_alt().
+		/// @param num_keys Number of the keys.
+		/// @param out_bitmap Where to store the results, bit i is set if keys[i] presents, must have at least (num_keys + 7) / 8 bytes.
+		template <typename U>
+		[[nodiscard]] PEFF_FORCEINLINE BatchQueryResultType contains_batch(const U *keys, size_t num_keys, uint8_t *out_bitmap) const {
+			return _set.contains_batch(keys, num_keys, out_bitmap);
+		}
+
+		/// @brief Get the values of a batch of keys, see FlatHashSetImpl::get_batch().
+		/// @param values_out Where to store the pointers to the values, nullptr for the absent keys.
+		template <typename U>
+		[[nodiscard]] PEFF_FORCEINLINE BatchQueryResultType find_batch(const U *keys, size_t num_keys, V **values_out) {
+			return _set.get_batch(
+				num_keys,
+				[keys](size_t index) -> const U & {
+					return keys[index];
+				},
+				[values_out](size_t index, Pair *pair) {
+					values_out[index] = pair ? &pair->value : nullptr;
+				});
+		}
+
+		template <typename U>
+		[[nodiscard]] PEFF_FORCEINLINE BatchQueryResultType find_batch(const U *keys, size_t num_keys, const V **values_out) const {
+			return const_cast<ThisType *>(this)->find_batch(keys, num_keys, const_cast<V **>(values_out));
+		}
+
+		[[nodiscard]] PEFF_FORCEINLINE bool reserve(size_t size) {
+			return _set.reserve(size);
+		}
+
+		PEFF_FORCEINLINE Alloc *allocator() const {
+			return _set.allocator();
+		}
+
+		PEFF_FORCEINLINE void replace_allocator(Alloc *rhs) noexcept {
+			_set.replace_allocator(rhs);
+		}
+
+		PEFF_FORCEINLINE void clear() {
+			_set.clear();
+		}
+
+		PEFF_FORCEINLINE void clear_and_shrink() {
+			_set.clear_and_shrink();
+		}
+
+		struct Iterator {
+			typename SetType::Iterator _iterator;
+			PEFF_FORCEINLINE Iterator(typename SetType::Iterator &&iterator_in) : _iterator(iterator_in) {
+			}
+			Iterator(const Iterator &rhs) = default;
+			Iterator &operator=(const Iterator &rhs) = default;
+
+			PEFF_FORCEINLINE bool operator==(const Iterator &rhs) const {
+				return _iterator == rhs._iterator;
+			}
+
+			PEFF_FORCEINLINE bool operator!=(const Iterator &rhs) const {
+				return _iterator != rhs._iterator;
+			}
+
+			PEFF_FORCEINLINE Iterator &operator++() {
+				++_iterator;
+				return *this;
+			}
+
+			PEFF_FORCEINLINE Iterator operator++(int) {
+				Iterator it = *this;
+				++*this;
+				return it;
+			}
+
+			PEFF_FORCEINLINE K &key() const {
+				return _iterator->key;
+			}
+
+			PEFF_FORCEINLINE V &value() const {
+				return _iterator->value;
+			}
+
+			PEFF_FORCEINLINE std::pair<K &, V &> operator*() const {
+				return { _iterator->key, _iterator->value };
+			}
+		};
+
+		Iterator begin() {
+			return Iterator(_set.begin());
+		}
+		Iterator end() {
+			return Iterator(_set.end());
+		}
+		Iterator begin_reversed() {
+			return Iterator(_set.begin_reversed());
+		}
+		Iterator end_reversed() {
+			return Iterator(_set.end_reversed());
+		}
+
+		struct ConstIterator {
+			Iterator _iterator;
+			PEFF_FORCEINLINE ConstIterator(Iterator &&iterator_in) : _iterator(iterator_in) {
+			}
+			ConstIterator(const ConstIterator &rhs) = default;
+			ConstIterator &operator=(const ConstIterator &rhs) = default;
+
+			PEFF_FORCEINLINE bool operator==(const ConstIterator &rhs) const {
+				return _iterator == rhs._iterator;
+			}
+
+			PEFF_FORCEINLINE bool operator!=(const ConstIterator &rhs) const {
+				return _iterator != rhs._iterator;
+			}
+
+			PEFF_FORCEINLINE ConstIterator &operator++() {
+				++_iterator;
+				return *this;
+			}
+
+			PEFF_FORCEINLINE const K &key() const {
+				return _iterator.key();
+			}
+
+			PEFF_FORCEINLINE const V &value() const {
+				return _iterator.value();
+			}
+
+			PEFF_FORCEINLINE std::pair<const K &, const V &> operator*() const {
+				return { _iterator.key(), _iterator.value() };
+			}
+		};
+
+		PEFF_FORCEINLINE ConstIterator begin_const() const noexcept {
+			return ConstIterator(const_cast<ThisType *>(this)->begin());
+		}
+		PEFF_FORCEINLINE ConstIterator end_const() const noexcept {
+			return ConstIterator(const_cast<ThisType *>(this)->end());
+		}
+		PEFF_FORCEINLINE ConstIterator begin_const_reversed() const noexcept {
+			return ConstIterator(const_cast<ThisType *>(this)->begin_reversed());
+		}
+		PEFF_FORCEINLINE ConstIterator end_const_reversed() const noexcept {
+			return ConstIterator(const_cast<ThisType *>(this)->end_reversed());
+		}
+		PEFF_FORCEINLINE ConstIterator begin() const {
+			return begin_const();
+		}
+		PEFF_FORCEINLINE ConstIterator end() const {
+			return end_const();
+		}
+		PEFF_FORCEINLINE ConstIterator begin_reversed() const {
+			return begin_const_reversed();
+		}
+		PEFF_FORCEINLINE ConstIterator end_reversed() const {
+			return end_const_reversed();
+		}
+
+		PEFF_FORCEINLINE ConstIterator find(const K &key) const {
+			return ConstIterator(const_cast<ThisType *>(this)->find(key));
+		}
+
+		PEFF_FORCEINLINE Iterator find(const K &key) {
+			return Iterator(_set.find(key));
+		}
+
+		template <typename U>
+		PEFF_FORCEINLINE ConstIterator find_alt(const U &key) const {
+			return ConstIterator(const_cast<ThisType *>(this)->template find_alt<U>(key));
+		}
+
+		template <typename U>
+		PEFF_FORCEINLINE Iterator find_alt(const U &key) {
+			return Iterator(_set.template find_alt<U>(key));
+		}
+
+		/// @brief Find a key with its hash code which has been computed, see contains_with_hash().
+		template <typename U>
+		PEFF_FORCEINLINE ConstIterator find_with_hash(const U &key, HashCode hash_code) const {
+			return ConstIterator(const_cast<ThisType *>(this)->find_with_hash(key, hash_code));
+		}
+
+		template <typename U>
+		PEFF_FORCEINLINE Iterator find_with_hash(const U &key, HashCode hash_code) {
+			return Iterator(_set.find_with_hash(key, hash_code));
+		}
+
+		/// @brief Remove the pair an iterator points to.
+		PEFF_FORCEINLINE void remove(const Iterator &it) {
+			_set.remove(it._iterator);
+		}
+
+		PEFF_FORCEINLINE size_t size() const {
+			return _set.size();
+		}
+
+		PEFF_FORCEINLINE size_t capacity() const {
+			return _set.capacity();
+		}
+
+		[[nodiscard]] PEFF_FORCEINLINE bool shrink_buckets() {
+			return _set.shrink_buckets();
+		}
+
+		[[nodiscard]] PEFF_FORCEINLINE bool shrink_to_fit() {
+			return _set.shrink_to_fit();
+		}
+	};
+
+	template <typename K, typename V, typename Eq = std::equal_to<K>, typename Hasher = peff::Hasher<K>>
+	using FlatHashMap = FlatHashMapImpl<K, V, Eq, Hasher, false>;
+	template <typename K, typename V, typename Eq = peff::FallibleEq<K>, typename Hasher = peff::FallibleHasher<K>>
+	using FallibleFlatHashMap = FlatHashMapImpl<K, V, Eq, Hasher, true>;
+}
+
+#endif
@@ -0,0 +1,935 @@
+#ifndef _PEFF_CONTAINERS_FLAT_HASHSET_H_
+#define _PEFF_CONTAINERS_FLAT_HASHSET_H_
+
+#include "dynarray.h"
+#include "misc.h"
+#include <peff/utils/option.h>
+#include <peff/utils/fallible_cmp.h>
+#include <peff/utils/fallible_hash.h>
+#include <peff/utils/hash.h>
+#include <peff/utils/bitops.h>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+	#include <emmintrin.h>
+	#define _PEFF_FLAT_HASH_USE_SSE2 1
+#endif
+
+#if __cplusplus >= 202002L
+	#include <concepts>
+#endif
+
+namespace peff {
+	namespace details {
+		/// @brief Number of the slots probed at a time.
+		constexpr static size_t FLAT_HASH_GROUP_WIDTH = 16;
+
+		/// @brief Control bytes of the free slots, the ones of the used slots are 7-bit hash tags.
+		constexpr static int8_t FLAT_HASH_CTRL_EMPTY = -128;
+		constexpr static int8_t FLAT_HASH_CTRL_DELETED = -2;
+
+		/// @brief Control bytes of a group of slots, the matches are returned as bit masks of the slots.
+		struct FlatHashGroup {
+#if _PEFF_FLAT_HASH_USE_SSE2
+			__m128i ctrl;
+
+			PEFF_FORCEINLINE FlatHashGroup(const int8_t *ctrl) noexcept : ctrl(_mm_load_si128((const __m128i *)ctrl)) {}
+
+			PEFF_FORCEINLINE uint32_t match(int8_t tag) const noexcept {
+				return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(tag), ctrl));
+			}
+
+			PEFF_FORCEINLINE uint32_t match_empty() const noexcept {
+				return match(FLAT_HASH_CTRL_EMPTY);
+			}
+
+			PEFF_FORCEINLINE uint32_t match_empty_or_deleted() const noexcept {
+				// Only the control bytes of the free slots have the sign bit set.
+				return (uint32_t)_mm_movemask_epi8(ctrl);
+			}
+#else
+			int8_t ctrl[FLAT_HASH_GROUP_WIDTH];
+
+			PEFF_FORCEINLINE FlatHashGroup(const int8_t *ctrl) noexcept {
+				memcpy(this->ctrl, ctrl, FLAT_HASH_GROUP_WIDTH);
+			}
+
+			PEFF_FORCEINLINE uint32_t match(int8_t tag) const noexcept {
+				uint32_t mask = 0;
+				for (size_t i = 0; i < FLAT_HASH_GROUP_WIDTH; ++i) {
+					if (ctrl[i] == tag)
+						mask |= 1U << i;
+				}
+				return mask;
+			}
+
+			PEFF_FORCEINLINE uint32_t match_empty() const noexcept {
+				return match(FLAT_HASH_CTRL_EMPTY);
+			}
+
+			PEFF_FORCEINLINE uint32_t match_empty_or_deleted() const noexcept {
+				uint32_t mask = 0;
+				for (size_t i = 0; i < FLAT_HASH_GROUP_WIDTH; ++i) {
+					if (ctrl[i] < 0)
+						mask |= 1U << i;
+				}
+				return mask;
+			}
+#endif
+		};
+
+		template <typename T>
+		struct FlatHashIdentityKeyOf {
+			PEFF_FORCEINLINE const T &operator()(const T &data) const noexcept {
+				return data;
+			}
+		};
+	}
+
+	/// @brief Open-addressing hash set which stores the elements inline in contiguous slots.
+	///
+	/// Each slot has a control byte, which is either the 7-bit tag of the
+	/// hash code of its element or a marker of a free slot. The slots are
+	/// probed in groups, whose control bytes are matched against the tag
+	/// at a time, so most lookups only touch the control bytes of one group
+	/// and the slot of the element. The table is grown when it is 7/8 full.
+	///
+	/// @tparam T Type of the elements.
+	/// @tparam EqCmp Comparator of the keys.
+	/// @tparam Hasher Hasher of the keys.
+	/// @tparam Fallible Whether the comparator and the hasher are fallible.
+	/// @tparam Key Type of the keys, the elements are looked up by their keys.
+	/// @tparam KeyOf Getter of the key of an element.
+	/// @note Unlike HashSetImpl, the elements are moved when the table is resized.
+	template <
+		typename T,
+		typename EqCmp,
+		typename Hasher,
+		bool Fallible,
+		typename Key = T,
+		typename KeyOf = details::FlatHashIdentityKeyOf<T>>
+	PEFF_REQUIRES_CONCEPT(std::invocable<EqCmp, const Key &, const Key &>)
+	class FlatHashSetImpl {
+	public:
+		static_assert(std::is_move_constructible_v<T>, "The element must be move-constructible");
+
+		constexpr static size_t GROUP_WIDTH = details::FLAT_HASH_GROUP_WIDTH;
+		/// @brief Number of the keys which are hashed and prefetched at a time by the batched lookups.
+		constexpr static size_t BATCH_LOOKUP_GROUP_SIZE = 16;
+
+		using RemoveResultType = typename std::conditional_t<Fallible, bool, void>;
+		using ElementQueryResultType = typename std::conditional_t<Fallible, Option<T &>, T &>;
+		using ElementPtrQueryResultType = typename std::conditional_t<Fallible, Option<T *>, T *>;
+		using ConstElementQueryResultType = typename std::conditional_t<Fallible, Option<const T &>, const T &>;
+		using ContainsResultType = typename std::conditional_t<Fallible, Option<bool>, bool>;
+		using BatchQueryResultType = typename std::conditional_t<Fallible, bool, void>;
+		using HashCode = typename details::HashCodeResultTypeExtractor<decltype(std::declval<Hasher>()(std::declval<Key>()))>::type;
+
+	private:
+		using ThisType = FlatHashSetImpl<T, EqCmp, Hasher, Fallible, Key, KeyOf>;
+
+		peff::RcObjectPtr<Alloc> _allocator;
+		int8_t *_ctrl = nullptr;
+		T *_slots = nullptr;
+		size_t _capacity = 0;
+		size_t _size = 0;
+		/// @brief Number of the empty slots which can be used before the table must be grown.
+		size_t _growth_left = 0;
+		EqCmp _eq_cmp;
+		Hasher _hasher;
+
+		PEFF_FORCEINLINE static size_t _calc_max_size(size_t capacity) {
+			return capacity - (capacity >> 3);
+		}
+
+		PEFF_FORCEINLINE constexpr static size_t _calc_block_alignment() {
+			return alignof(T) > GROUP_WIDTH ? alignof(T) : GROUP_WIDTH;
+		}
+
+		PEFF_FORCEINLINE static size_t _calc_slots_offset(size_t capacity) {
+			return (capacity + alignof(T) - 1) & ~(alignof(T) - 1);
+		}
+
+		PEFF_FORCEINLINE static size_t _calc_block_size(size_t capacity) {
+			return _calc_slots_offset(capacity) + sizeof(T) * capacity;
+		}
+
+		/// @brief Get the least capacity which can hold the elements without growing.
+		PEFF_FORCEINLINE static size_t _calc_capacity_for(size_t size) {
+			size_t capacity = GROUP_WIDTH;
+			while (_calc_max_size(capacity) < size)
+				capacity <<= 1;
+			return capacity;
+		}
+
+		PEFF_FORCEINLINE static int8_t _get_tag(uint64_t mixed_hash) {
+			return (int8_t)(mixed_hash & 0x7f);
+		}
+
+		PEFF_FORCEINLINE static size_t _get_first_group(uint64_t mixed_hash, size_t capacity) {
+			return ((size_t)(mixed_hash >> 7)) & ((capacity / GROUP_WIDTH) - 1);
+		}
+
+		PEFF_FORCEINLINE static uint64_t _mix_hash_code(HashCode hash_code) {
+			return mix_hash64((uint64_t)(size_t)hash_code);
+		}
+
+		template <typename U>
+		[[nodiscard]] PEFF_FORCEINLINE bool _hash_key(const U &key, uint64_t &mixed_hash_out) const {
+			if constexpr (Fallible) {
+				if (auto result = _hasher(key); result.has_value()) {
+					mixed_hash_out = _mix_hash_code(result.value());
+					return true;
+				}
+				return false;
+			} else {
+				mixed_hash_out = _mix_hash_code(_hasher(key));
+				return true;
+			}
+		}
+
+		template <typename U>
+		[[nodiscard]] PEFF_FORCEINLINE bool _is_key_equal(const Key &lhs, const U &rhs, bool &result_out) const {
+			if constexpr (Fallible) {
+				if (auto result = _eq_cmp(lhs, rhs); result.has_value()) {
+					result_out = result.value();
+					return true;
+				}
+				return false;
+			} else {
+				result_out = _eq_cmp(lhs, rhs);
+				return true;
+			}
+		}
+
+		/// @brief Find the slot of an element.
+		/// @param index_out Where to store the index of the slot, SIZE_MAX if there is no such element.
+		/// @return true for succeeded, false if the comparator failed.
+		template <typename U>
+		[[nodiscard]] PEFF_FORCEINLINE bool _find_index(const U &key, uint64_t mixed_hash, size_t &index_out) const {
+			index_out = SIZE_MAX;
+
+			if (!_capacity)
+				return true;
+
+			const int8_t tag = _get_tag(mixed_hash);
+			const size_t group_mask = (_capacity / GROUP_WIDTH) - 1;
+			size_t group = _get_first_group(mixed_hash, _capacity);
+
+			// The groups are probed triangularly, which visits every group once.
+			for (size_t i = 0; i <= group_mask;) {
+				const size_t base = group * GROUP_WIDTH;
+				const details::FlatHashGroup g(_ctrl + base);
+
+				for (uint32_t mask = g.match(tag); mask; mask &= mask - 1) {
+					const size_t index = base + count_trailing_zero(mask);
+
+					bool is_equal;
+					if (!_is_key_equal(KeyOf()(_slots[index]), key, is_equal))
+						return false;
+					if (is_equal) {
+						index_out = index;
+						return true;
+					}
+				}
+
+				if (g.match_empty())
+					return true;
+
+				group = (group + ++i) & group_mask;
+			}
+
+			return true;
+		}
+
+		/// @brief Find the first free slot in the probe sequence of a hash code.
+		/// @return Index of the slot, SIZE_MAX if the table is full.
+		PEFF_FORCEINLINE static size_t _find_free_index(const int8_t *ctrl, size_t capacity, uint64_t mixed_hash) {
+			if (!capacity)
+				return SIZE_MAX;
+
+			const size_t group_mask = (capacity / GROUP_WIDTH) - 1;
+			size_t group = _get_first_group(mixed_hash, capacity);
+
+			for (size_t i = 0; i <= group_mask;) {
+				const size_t base = group * GROUP_WIDTH;
+
+				if (uint32_t mask = details::FlatHashGroup(ctrl + base).match_empty_or_deleted(); mask)
+					return base + count_trailing_zero(mask);
+
+				group = (group + ++i) & group_mask;
+			}
+
+			return SIZE_MAX;
+		}
+
+		PEFF_FORCEINLINE void _destroy_elements() {
+			if constexpr (!std::is_trivially_destructible_v<T>) {
+				for (size_t i = 0; i < _capacity; ++i) {
+					if (_ctrl[i] >= 0)
+						std::destroy_at<T>(&_slots[i]);
+				}
+			}
+		}
+
+		PEFF_FORCEINLINE void _release_table() {
+			if (_ctrl) {
+				_allocator->release(_ctrl, _calc_block_size(_capacity), _calc_block_alignment());
+				_ctrl = nullptr;
+				_slots = nullptr;
+			}
+			_capacity = 0;
+			_growth_left = 0;
+		}
+
+		/// @brief Move the elements into a new table.
+		/// @param new_capacity Capacity of the new table, must be a power of two no less than the group width.
+		/// @return true for succeeded, false if failed, the set is unchanged on failure.
+		[[nodiscard]] PEFF_FORCEINLINE bool _rehash(size_t new_capacity) {
+			// The hash codes from a fallible hasher are computed ahead, so the
+			// elements are moved only if all of them have been hashed.
+			DynArray<uint64_t> mixed_hashes(_allocator.get());
+			if constexpr (Fallible) {
+				if (!mixed_hashes.resize_uninit(_size))
+					return false;
+
+				for (size_t i = 0, j = 0; i < _capacity; ++i) {
+					if (_ctrl[i] >= 0) {
+						if (!_hash_key(KeyOf()(_slots[i]), mixed_hashes.at(j++)))
+							return false;
+					}
+				}
+			}
+
+			int8_t *new_ctrl = (int8_t *)_allocator->alloc(_calc_block_size(new_capacity), _calc_block_alignment());
+			if (!new_ctrl)
+				return false;
+			T *new_slots = (T *)(((char *)new_ctrl) + _calc_slots_offset(new_capacity));
+
+			memset(new_ctrl, (uint8_t)details::FLAT_HASH_CTRL_EMPTY, new_capacity);
+
+			for (size_t i = 0, j = 0; i < _capacity; ++i) {
+				if (_ctrl[i] < 0)
+					continue;
+
+				uint64_t mixed_hash;
+				if constexpr (Fallible) {
+					mixed_hash = mixed_hashes.at(j++);
+				} else {
+					(void)_hash_key(KeyOf()(_slots[i]), mixed_hash);
+				}
+
+				const size_t index = _find_free_index(new_ctrl, new_capacity, mixed_hash);
+
+				peff::construct_at<T>(&new_slots[index], std::move(_slots[i]));
+				std::destroy_at<T>(&_slots[i]);
+				new_ctrl[index] = _get_tag(mixed_hash);
+			}
+
+			_release_table();
+
+			_ctrl = new_ctrl;
+			_slots = new_slots;
+			_capacity = new_capacity;
+			_growth_left = _calc_max_size(new_capacity) - _size;
+
+			return true;
+		}
+
+		/// @brief Get the capacity to rehash into when the table has run out of the empty slots.
+		PEFF_FORCEINLINE size_t _get_grown_capacity() const {
+			if (!_capacity)
+				return GROUP_WIDTH;
+
+			// Rehash in place if most of the used slots are deleted ones.
+			if (_size <= (_calc_max_size(_capacity) >> 1))
+				return _capacity;
+
+			return _capacity << 1;
+		}
+
+		[[nodiscard]] PEFF_FORCEINLINE bool _insert(T &&data, bool force_resize_buckets) {
+			uint64_t mixed_hash;
+			if (!_hash_key(KeyOf()(data), mixed_hash))
+				return false;
+
+			size_t index;
+			if (!_find_index(KeyOf()(data), mixed_hash, index))
+				return false;
+
+			if (index != SIZE_MAX) {
+				move_assign_or_move_construct<T>(_slots[index], std::move(data));
+				return true;
+			}
+
+			index = _find_free_index(_ctrl, _capacity, mixed_hash);
+
+			// Deleted slots can be reused without growing.
+			if ((index == SIZE_MAX) || ((!_growth_left) && (_ctrl[index] != details::FLAT_HASH_CTRL_DELETED))) {
+				if (_rehash(_get_grown_capacity())) {
+					index = _find_free_index(_ctrl, _capacity, mixed_hash);
+				} else {
+					// Exceed the maximum load factor, but keep at least one empty slot.
+					if (force_resize_buckets || (index == SIZE_MAX) || (_size + 2 > _capacity))
+						return false;
+				}
+			}
+
+			if ((_ctrl[index] == details::FLAT_HASH_CTRL_EMPTY) && _growth_left)
+				--_growth_left;
+
+			peff::construct_at<T>(&_slots[index], std::move(data));
+			_ctrl[index] = _get_tag(mixed_hash);
+			++_size;
+
+			return true;
+		}
+
+		PEFF_FORCEINLINE void _erase_at(size_t index) {
+			std::destroy_at<T>(&_slots[index]);
+			--_size;
+
+			// A probe which has reached a group with an empty slot stops in the
+			// group, so the slot can be emptied if the group has empty slots.
+			const size_t base = index & ~(GROUP_WIDTH - 1);
+			if (details::FlatHashGroup(_ctrl + base).match_empty()) {
+				_ctrl[index] = details::FLAT_HASH_CTRL_EMPTY;
+				++_growth_left;
+			} else {
+				_ctrl[index] = details::FLAT_HASH_CTRL_DELETED;
+			}
+		}
+
+		template <typename U>
+		[[nodiscard]] PEFF_FORCEINLINE bool _get(const U &key, size_t &index_out) const {
+			static_assert(std::is_invocable_v<EqCmp, const Key &, const U &>, "The query type is not comparable with the key");
+			static_assert(std::is_invocable_v<Hasher, const U &>, "The query type is not hashable by the hasher");
+			uint64_t mixed_hash;
+
+			if (!_capacity) {
+				index_out = SIZE_MAX;
+				return true;
+			}
+
+			if (!_hash_key(key, mixed_hash))
+				return false;
+
+			return _find_index(key, mixed_hash, index_out);
+		}
+
+		template <typename U>
+		[[nodiscard]] PEFF_FORCEINLINE bool _get_with_hash(const U &key, HashCode hash_code, size_t &index_out) const {
+			static_assert(std::is_invocable_v<EqCmp, const Key &, const U &>, "The query type is not comparable with the key");
+			return _find_index(key, _mix_hash_code(hash_code), index_out);
+		}
+
+		PEFF_FORCEINLINE static ContainsResultType _to_contains_result(bool succeeded, size_t index) {
+			if constexpr (Fallible) {
+				if (!succeeded)
+					return NULL_OPTION;
+			}
+
+			return index != SIZE_MAX;
+		}
+
+		template <typename R>
+		PEFF_FORCEINLINE R _to_element(bool succeeded, size_t index) const {
+			if constexpr (Fallible) {
+				if (!succeeded)
+					return NULL_OPTION;
+			}
+			if (index == SIZE_MAX)
+				throw std::out_of_range("No such element");
+			return _slots[index];
+		}
+
+	public:
+		PEFF_FORCEINLINE FlatHashSetImpl(Alloc *allocator) : _allocator(allocator) {
+		}
+
+		PEFF_FORCEINLINE FlatHashSetImpl(ThisType &&other)
+			: _allocator(std::move(other._allocator)),
+			  _ctrl(other._ctrl),
+			  _slots(other._slots),
+			  _capacity(other._capacity),
+			  _size(other._size),
+			  _growth_left(other._growth_left),
+			  _eq_cmp(std::move(other._eq_cmp)),
+			  _hasher(std::move(other._hasher)) {
+			other._ctrl = nullptr;
+			other._slots = nullptr;
+			other._capacity = 0;
+			other._size = 0;
+			other._growth_left = 0;
+		}
+
+		PEFF_FORCEINLINE ~FlatHashSetImpl() {
+			clear_and_shrink();
+		}
+
+		PEFF_FORCEINLINE ThisType &operator=(ThisType &&other) noexcept {
+			clear_and_shrink();
+
+			_allocator = std::move(other._allocator);
+			_ctrl = other._ctrl;
+			_slots = other._slots;
+			_capacity = other._capacity;
+			_size = other._size;
+			_growth_left = other._growth_left;
+			_eq_cmp = std::move(other._eq_cmp);
+			_hasher = std::move(other._hasher);
+
+			other._ctrl = nullptr;
+			other._slots = nullptr;
+			other._capacity = 0;
+			other._size = 0;
+			other._growth_left = 0;
+
+			return *this;
+		}
+
+		/// @brief Insert a new element, the element is inserted beyond the maximum load factor if the table cannot be grown.
+		[[nodiscard]] PEFF_FORCEINLINE bool insert_without_resize_buckets(T &&data) {
+			return _insert(std::move(data), false);
+		}
+
+		/// @brief Insert a new element, an existing element with the same key is replaced.
+		/// @return true for succeeded, false if failed.
+		[[nodiscard]] PEFF_FORCEINLINE bool insert(T &&data) {
+			return _insert(std::move(data), true);
+		}
+
+		[[nodiscard]] PEFF_FORCEINLINE RemoveResultType remove(const Key &key) {
+			return remove_alt<Key>(key);
+		}
+
+		/// @brief Remove an element by a key of another type, which is hashed and compared with the keys without converting.
+		template <typename U>
+		[[nodiscard]] PEFF_FORCEINLINE RemoveResultType remove_alt(const U &key) {
+			size_t index;
+
+			if constexpr (Fallible) {
+				if (!_get(key, index))
+					return false;
+				if (index != SIZE_MAX)
+					_erase_at(index);
+				return true;
+			} else {
+				(void)_get(key, index);
+				if (index != SIZE_MAX)
+					_erase_at(index);
+			}
+		}
+
+		/// @brief Get pointer to an element.
+		/// @return Pointer to the element, nullptr if there is no such element.
+		[[nodiscard]] PEFF_FORCEINLINE ElementPtrQueryResultType get(const Key &key) {
+			size_t index;
+
+			if (!_get(key, index)) {
+				if constexpr (Fallible) {
+					return NULL_OPTION;
+				}
+			}
+
+			return index != SIZE_MAX ? &_slots[index] : nullptr;
+		}
+
+		[[nodiscard]] PEFF_FORCEINLINE ContainsResultType contains(const Key &key) const {
+			return contains_alt<Key>(key);
+		}
+
+		template <typename U>
+		[[nodiscard]] PEFF_FORCEINLINE ContainsResultType contains_alt(const U &key) const {
+			size_t index;
+			const bool succeeded = _get(key, index);
+			return _to_contains_result(succeeded, index);
+		}
+
+		/// @brief Check if an element presents with the hash code of its key which has been computed.
+		/// @param key Key to be looked up, which may be of another type like the one of contains_alt().
+		/// @param hash_code Hash code of the key, which must equal to the one computed by the hasher.
+		template <typename U>
+		[[nodiscard]] PEFF_FORCEINLINE ContainsResultType contains_with_hash(const U &key, HashCode hash_code) const {
+			size_t index;
+			const bool succeeded = _get_with_hash(key, hash_code, index);
+			return _to_contains_result(succeeded, index);
+		}
+
+		/// @brief Make sure that the elements can be inserted without growing the table.
+		/// @param size Number of the elements.
+		/// @return true for succeeded, false if failed.
+		[[nodiscard]] PEFF_FORCEINLINE bool reserve(size_t size) {
+			if (size <= _size + _growth_left)
+				return true;
+
+			return _rehash(_calc_capacity_for(size));
+		}
+
+		PEFF_FORCEINLINE void clear() {
+			_destroy_elements();
+			if (_ctrl)
+				memset(_ctrl, (uint8_t)details::FLAT_HASH_CTRL_EMPTY, _capacity);
+			_size = 0;
+			_growth_left = _calc_max_size(_capacity);
+		}
+
+		PEFF_FORCEINLINE void clear_and_shrink() {
+			_destroy_elements();
+			_release_table();
+			_size = 0;
+		}
+
+		PEFF_FORCEINLINE Alloc *allocator() const {
+			return _allocator.get();
+		}
+
+		PEFF_FORCEINLINE void replace_allocator(Alloc *rhs) noexcept {
+			verify_replaceable(_allocator.get(), rhs);
+
+			_allocator = rhs;
+		}
+
+		struct Iterator {
+			size_t index;
+			ThisType *hash_set;
+			IteratorDirection direction;
+
+			PEFF_FORCEINLINE Iterator(ThisType *hash_set, size_t index, IteratorDirection direction)
+				: index(index),
+				  hash_set(hash_set),
+				  direction(direction) {}
+
+			Iterator(const Iterator &it) = default;
+			Iterator &operator=(const Iterator &rhs) = default;
+
+			PEFF_FORCEINLINE bool copy(Iterator &dest) noexcept {
+				dest = *this;
+				return true;
+			}
+
+			PEFF_FORCEINLINE Iterator &operator++() {
+				if (index == SIZE_MAX)
+					throw std::logic_error("Increasing the end iterator");
+
+				if (direction == IteratorDirection::Forward)
+					index = hash_set->_next_used_index(index + 1);
+				else
+					index = hash_set->_prev_used_index(index);
+
+				return *this;
+			}
+
+			PEFF_FORCEINLINE Iterator operator++(int) {
+				Iterator it = *this;
+				++(*this);
+				return it;
+			}
+
+			PEFF_FORCEINLINE bool operator==(const Iterator &it) const {
+				if (hash_set != it.hash_set)
+					throw std::logic_error("Cannot compare iterators from different containers");
+				return index == it.index;
+			}
+
+			PEFF_FORCEINLINE bool operator!=(const Iterator &it) const {
+				if (hash_set != it.hash_set)
+					throw std::logic_error("Cannot compare iterators from different containers");
+				return index != it.index;
+			}
+
+			PEFF_FORCEINLINE T &operator*() const {
+				if (index == SIZE_MAX)
+					throw std::logic_error("Deferencing the end iterator");
+				return hash_set->_slots[index];
+			}
+
+			PEFF_FORCEINLINE T *operator->() const {
+				if (index == SIZE_MAX)
+					throw std::logic_error("Deferencing the end iterator");
+				return &hash_set->_slots[index];
+			}
+		};
+
+		/// @brief Get index of the first used slot from a slot on, SIZE_MAX if there is none.
+		PEFF_FORCEINLINE size_t _next_used_index(size_t index) const {
+			for (; index < _capacity; ++index) {
+				if (_ctrl[index] >= 0)
+					return index;
+			}
+			return SIZE_MAX;
+		}
+
+		/// @brief Get index of the last used slot before a slot, SIZE_MAX if there is none.
+		PEFF_FORCEINLINE size_t _prev_used_index(size_t index) const {
+			while (index) {
+				if (_ctrl[--index] >= 0)
+					return index;
+			}
+			return SIZE_MAX;
+		}
+
+		PEFF_FORCEINLINE Iterator begin() {
+			return Iterator(this, _next_used_index(0), IteratorDirection::Forward);
+		}
+		PEFF_FORCEINLINE Iterator end() {
+			return Iterator(this, SIZE_MAX, IteratorDirection::Forward);
+		}
+		PEFF_FORCEINLINE Iterator begin_reversed() {
+			return Iterator(this, _prev_used_index(_capacity), IteratorDirection::Reversed);
+		}
+		PEFF_FORCEINLINE Iterator end_reversed() {
+			return Iterator(this, SIZE_MAX, IteratorDirection::Reversed);
+		}
+
+		struct ConstIterator {
+			Iterator _iterator;
+			PEFF_FORCEINLINE ConstIterator(Iterator &&iterator_in) : _iterator(iterator_in) {
+			}
+			ConstIterator(const ConstIterator &rhs) = default;
+			ConstIterator &operator=(const ConstIterator &rhs) = default;
+
+			PEFF_FORCEINLINE bool operator==(const ConstIterator &rhs) const {
+				return _iterator == rhs._iterator;
+			}
+
+			PEFF_FORCEINLINE bool operator!=(const ConstIterator &rhs) const {
+				return _iterator != rhs._iterator;
+			}
+
+			PEFF_FORCEINLINE const T &operator*() const {
+				return *_iterator;
+			}
+
+			PEFF_FORCEINLINE const T *operator->() const {
+				return &*_iterator;
+			}
+
+			PEFF_FORCEINLINE ConstIterator &operator++() {
+				++_iterator;
+				return *this;
+			}
+		};
+
+		PEFF_FORCEINLINE ConstIterator begin_const() const noexcept {
+			return ConstIterator(const_cast<ThisType *>(this)->begin());
+		}
+		PEFF_FORCEINLINE ConstIterator end_const() const noexcept {
+			return ConstIterator(const_cast<ThisType *>(this)->end());
+		}
+		PEFF_FORCEINLINE ConstIterator begin_const_reversed() const noexcept {
+			return ConstIterator(const_cast<ThisType *>(this)->begin_reversed());
+		}
+		PEFF_FORCEINLINE ConstIterator end_const_reversed() const noexcept {
+			return ConstIterator(const_cast<ThisType *>(this)->end_reversed());
+		}
+
+		PEFF_FORCEINLINE Iterator find(const Key &key) {
+			return find_alt<Key>(key);
+		}
+
+		PEFF_FORCEINLINE ConstIterator find(const Key &key) const {
+			return ConstIterator(const_cast<ThisType *>(this)->find(key));
+		}
+
+		template <typename U>
+		PEFF_FORCEINLINE Iterator find_alt(const U &key) {
+			size_t index;
+			if (!_get(key, index))
+				return end();
+			return Iterator(this, index, IteratorDirection::Forward);
+		}
+
+		template <typename U>
+		PEFF_FORCEINLINE ConstIterator find_alt(const U &key) const {
+			return ConstIterator(const_cast<ThisType *>(this)->template find_alt<U>(key));
+		}
+
+		/// @brief Find an element with the hash code of its key which has been computed, see contains_with_hash().
+		template <typename U>
+		PEFF_FORCEINLINE Iterator find_with_hash(const U &key, HashCode hash_code) {
+			size_t index;
+			if (!_get_with_hash(key, hash_code, index))
+				return end();
+			return Iterator(this, index, IteratorDirection::Forward);
+		}
+
+		template <typename U>
+		PEFF_FORCEINLINE ConstIterator find_with_hash(const U &key, HashCode hash_code) const {
+			return ConstIterator(const_cast<ThisType *>(this)->find_with_hash(key, hash_code));
+		}
+
+		/// @brief Remove the element an iterator points to.
+		PEFF_FORCEINLINE void remove(const Iterator &it) {
+			if (it.index == SIZE_MAX)
+				throw std::logic_error("Removing the end iterator");
+			_erase_at(it.index);
+		}
+
+		PEFF_FORCEINLINE ElementQueryResultType at(const Key &key) {
+			return at_alt<Key>(key);
+		}
+
+		PEFF_FORCEINLINE ConstElementQueryResultType at(const Key &key) const {
+			return at_alt<Key>(key);
+		}
+
+		template <typename U>
+		PEFF_FORCEINLINE ElementQueryResultType at_alt(const U &key) {
+			size_t index;
+			const bool succeeded = _get(key, index);
+			return _to_element<ElementQueryResultType>(succeeded, index);
+		}
+
+		template <typename U>
+		PEFF_FORCEINLINE ConstElementQueryResultType at_alt(const U &key) const {
+			size_t index;
+			const bool succeeded = _get(key, index);
+			return _to_element<ConstElementQueryResultType>(succeeded, index);
+		}
+
+		/// @brief Get an element with the hash code of its key which has been computed, see contains_with_hash().
+		template <typename U>
+		PEFF_FORCEINLINE ElementQueryResultType at_with_hash(const U &key, HashCode hash_code) {
+			size_t index;
+			const bool succeeded = _get_with_hash(key, hash_code, index);
+			return _to_element<ElementQueryResultType>(succeeded, index);
+		}
+
+		template <typename U>
+		PEFF_FORCEINLINE ConstElementQueryResultType at_with_hash(const U &key, HashCode hash_code) const {
+			size_t index;
+			const bool succeeded = _get_with_hash(key, hash_code, index);
+			return _to_element<ConstElementQueryResultType>(succeeded, index);
+		}
+
+		/// @brief Look a batch of keys up, the slots of a group of keys are prefetched before any key of the group is resolved.
+		///
+		/// The keys are processed in groups of BATCH_LOOKUP_GROUP_SIZE, all
+		/// keys of a group are hashed and the control bytes of their first
+		/// probed groups are prefetched, then the slots of the first matched
+		/// tags, so the cache misses of the keys in a group overlap instead of
+		/// stalling the lookups one by one.
+		///
+		/// @param num_keys Number of the keys.
+		/// @param get_key Callable which returns the key of an index, the keys may be of another type like the one of contains_alt().
+		/// @param on_result Callable which is called with the index and the pointer to the element of each key in order, the pointer is nullptr if there is no such element.
+		/// @return (Fallible only) true for succeeded, false if the hasher or the comparator failed.
+		template <typename KeyGetter, typename Callback>
+		[[nodiscard]] PEFF_FORCEINLINE BatchQueryResultType get_batch(size_t num_keys, KeyGetter &&get_key, Callback &&on_result) {
+			if (!_capacity) {
+				for (size_t i = 0; i < num_keys; ++i)
+					on_result(i, (T *)nullptr);
+			} else {
+				uint64_t mixed_hashes[BATCH_LOOKUP_GROUP_SIZE];
+
+				for (size_t i = 0; i < num_keys; i += BATCH_LOOKUP_GROUP_SIZE) {
+					const size_t group_size = num_keys - i < BATCH_LOOKUP_GROUP_SIZE ? num_keys - i : BATCH_LOOKUP_GROUP_SIZE;
+
+					for (size_t j = 0; j < group_size; ++j) {
+						if (!_hash_key(get_key(i + j), mixed_hashes[j])) {
+							if constexpr (Fallible) {
+								return false;
+							}
+						}
+
+						PEFF_PREFETCH(_ctrl + _get_first_group(mixed_hashes[j], _capacity) * GROUP_WIDTH);
+					}
+
+					for (size_t j = 0; j < group_size; ++j) {
+						const size_t base = _get_first_group(mixed_hashes[j], _capacity) * GROUP_WIDTH;
+
+						// Branchless, the last slot of the group is prefetched if no tag matches.
+						const uint32_t mask = details::FlatHashGroup(_ctrl + base).match(_get_tag(mixed_hashes[j]));
+						PEFF_PREFETCH(_slots + base + count_trailing_zero(mask | (1u << (GROUP_WIDTH - 1))));
+					}
+
+					for (size_t j = 0; j < group_size; ++j) {
+						size_t index;
+						if (!_find_index(get_key(i + j), mixed_hashes[j], index)) {
+							if constexpr (Fallible) {
+								return false;
+							}
+						}
+
+						on_result(i + j, index != SIZE_MAX ? &_slots[index] : (T *)nullptr);
+					}
+				}
+			}
+
+			if constexpr (Fallible) {
+				return true;
+			}
+		}
+
+		/// @brief Check if each of a batch of elements presents, see get_batch().
+		/// @param keys Keys to be looked up, which may be of another type like the one of contains_alt().
+		/// @param num_keys Number of the keys.
+		/// @param out_bitmap Where to store the results, bit i is set if keys[i] presents, must have at least (num_keys + 7) / 8 bytes.
+		template <typename U>
+		[[nodiscard]] PEFF_FORCEINLINE BatchQueryResultType contains_batch(const U *keys, size_t num_keys, uint8_t *out_bitmap) const {
+			return const_cast<ThisType *>(this)->get_batch(
+				num_keys,
+				[keys](size_t index) -> const U & {
+					return keys[index];
+				},
+				[out_bitmap](size_t index, T *element) {
+					assign_bitmap_bit(out_bitmap, index, element);
+				});
+		}
+
+		/// @brief Find each of a batch of elements, see get_batch().
+		/// @param elements_out Where to store the pointers to the elements, nullptr for the absent ones.
+		template <typename U>
+		[[nodiscard]] PEFF_FORCEINLINE BatchQueryResultType find_batch(const U *keys, size_t num_keys, T **elements_out) {
+			return get_batch(
+				num_keys,
+				[keys](size_t index) -> const U & {
+					return keys[index];
+				},
+				[elements_out](size_t index, T *element) {
+					elements_out[index] = element;
+				});
+		}
+
+		template <typename U>
+		[[nodiscard]] PEFF_FORCEINLINE BatchQueryResultType find_batch(const U *keys, size_t num_keys, const T **elements_out) const {
+			return const_cast<ThisType *>(this)->find_batch(keys, num_keys, const_cast<T **>(elements_out));
+		}
+
+		PEFF_FORCEINLINE size_t size() const {
+			return _size;
+		}
+
+		/// @brief Get number of the slots of the table.
+		PEFF_FORCEINLINE size_t capacity() const {
+			return _capacity;
+		}
+
+		/// @brief Shrink the table to the least capacity for the current size, the table is released if the set is empty.
+		/// @return true for succeeded, false if failed, the set is unchanged on failure.
+		[[nodiscard]] PEFF_FORCEINLINE bool shrink_buckets() {
+			if (!_size) {
+				clear_and_shrink();
+				return true;
+			}
+
+			if (const size_t new_capacity = _calc_capacity_for(_size); new_capacity < _capacity)
+				return _rehash(new_capacity);
+
+			return true;
+		}
+
+		/// @brief Release all memory which is not used by the elements.
+		[[nodiscard]] PEFF_FORCEINLINE bool shrink_to_fit() {
+			return shrink_buckets();
+		}
+	};
+
+	template <typename T, typename EqCmp = std::equal_to<T>, typename Hasher = peff::Hasher<T>>
+	using FlatHashSet = FlatHashSetImpl<T, EqCmp, Hasher, false>;
+	template <typename T, typename EqCmp = peff::FallibleEq<T>, typename Hasher = peff::FallibleHasher<T>>
+	using FallibleFlatHashSet = FlatHashSetImpl<T, EqCmp, Hasher, true>;
+}
+
+#endif
@@ -4,7 +4,7 @@
 #include "hashset.h"
 
 namespace peff {
-	template <typename K, typename V, typename Eq, typename Hasher, bool Fallible>
+	template <typename K, typename V, typename Eq, typename Hasher, bool Fallible, typename BucketIndexer = ModuloBucketIndexer>
 	PEFF_REQUIRES_CONCEPT(std::invocable<Eq, const K &, const K &>)
 	class HashMapImpl final {
 	private:
@@ -15,11 +15,9 @@ namespace peff {
 			Uninit<V> value;
 			bool key_constructed;
 			bool value_constructed;
-			bool for_query;
 
-			PEFF_FORCEINLINE Pair() : key_constructed(false), value_constructed(false), for_query(true) {}
-			PEFF_FORCEINLINE Pair(K &&key, V &&value, bool for_query) : key(std::move(key)), value(std::move(value)), for_query(for_query), key_constructed(true), value_constructed(true) {}
-			PEFF_FORCEINLINE Pair(Pair &&rhs) noexcept: for_query(false) {
+			PEFF_FORCEINLINE Pair(K &&key, V &&value) : key(std::move(key)), value(std::move(value)), key_constructed(true), value_constructed(true) {}
+			PEFF_FORCEINLINE Pair(Pair &&rhs) noexcept : key_constructed(false), value_constructed(false) {
 				if (rhs.key_constructed) {
 					key = std::move(rhs.key.get());
 					rhs.key_constructed = false;
@@ -40,19 +38,24 @@ namespace peff {
 			}
 		};
 
-		struct QueryPair : public Pair {
-			const K *query_key;
+		/// @brief Reference to a key used for querying, the key may be of another type than K.
+		template <typename U>
+		struct QueryKey {
+			const U *key;
 
-			PEFF_FORCEINLINE QueryPair(const K *query_key): Pair(), query_key(query_key) {}
+			PEFF_FORCEINLINE QueryKey(const U *key) : key(key) {}
 		};
 
 		struct PairComparator {
 			Eq eq_cmp;
 
 			PEFF_FORCEINLINE decltype(std::declval<Eq>()(std::declval<K>(), std::declval<K>())) operator()(const Pair &lhs, const Pair &rhs) const {
-				const K &l = lhs.for_query ? *((const QueryPair &)lhs).query_key : lhs.key.get(),
-						&r = rhs.for_query ? *((const QueryPair &)rhs).query_key : rhs.key.get();
-				return eq_cmp(l, r);
+				return eq_cmp(lhs.key.get(), rhs.key.get());
+			}
+
+			template <typename U>
+			PEFF_FORCEINLINE decltype(std::declval<Eq>()(std::declval<K>(), std::declval<U>())) operator()(const Pair &lhs, const QueryKey<U> &rhs) const {
+				return eq_cmp(lhs.key.get(), *rhs.key);
 			}
 		};
 
@@ -60,24 +63,43 @@ namespace peff {
 			Hasher hasher;
 
 			PEFF_FORCEINLINE decltype(std::declval<Hasher>()(std::declval<K>())) operator()(const Pair &pair) const {
-				const K &k = pair.for_query ? *((const QueryPair &)pair).query_key : pair.key.get();
-				return hasher(k);
+				return hasher(pair.key.get());
+			}
+
+			template <typename U>
+			PEFF_FORCEINLINE decltype(std::declval<Hasher>()(std::declval<U>())) operator()(const QueryKey<U> &query_key) const {
+				return hasher(*query_key.key);
 			}
 		};
 
 		PairComparator comparator;
 
-		using SetType = std::conditional_t<Fallible, FallibleHashSet<Pair, PairComparator, PairHasher>, HashSet<Pair, PairComparator, PairHasher>>;
+		using SetType = HashSetImpl<Pair, PairComparator, PairHasher, Fallible, BucketIndexer>;
 
 		SetType _set;
 
-		using ThisType = HashMapImpl<K, V, Eq, Hasher, Fallible>;
+		using ThisType = HashMapImpl<K, V, Eq, Hasher, Fallible, BucketIndexer>;
+
+		template <typename R, typename P>
+		PEFF_FORCEINLINE static R _to_value(P &&maybe_pair) {
+			if constexpr (Fallible) {
+				if (!maybe_pair.has_value())
+					return NULL_OPTION;
+
+				return maybe_pair.value().value.get();
+			} else {
+				return maybe_pair.value.get();
+			}
+		}
 
 	public:
 		using RemoveResultType = typename SetType::RemoveResultType;
 		using ElementQueryResultType = typename std::conditional_t<Fallible, Option<V &>, V &>;
 		using ConstElementQueryResultType = typename std::conditional_t<Fallible, Option<const V &>, const V &>;
 		using ContainsResultType = typename SetType::ContainsResultType;
+		using BatchQueryResultType = typename SetType::BatchQueryResultType;
+		/// @brief Type of the hash codes accepted by the *_with_hash() functions, which are the ones computed by the hasher.
+		using HashCode = typename SetType::HashCode;
 
 		PEFF_FORCEINLINE HashMapImpl(Alloc *allocator) : _set(allocator) {}
 		PEFF_FORCEINLINE HashMapImpl(ThisType &&rhs) : comparator(std::move(rhs.comparator)), _set(std::move(rhs._set)) {
@@ -92,52 +114,127 @@ namespace peff {
 			return *this;
 		}
 
+		/// @brief Enable or disable the incremental resize, see HashSetImpl::set_incremental_resize().
+		PEFF_FORCEINLINE void set_incremental_resize(bool enabled) {
+			_set.set_incremental_resize(enabled);
+		}
+
+		PEFF_FORCEINLINE bool is_incremental_resize() const {
+			return _set.is_incremental_resize();
+		}
+
+		PEFF_FORCEINLINE bool is_resizing() const {
+			return _set.is_resizing();
+		}
+
 		[[nodiscard]] PEFF_FORCEINLINE bool insert_without_resize_buckets(K &&key, V &&value) {
-			Pair pair = Pair(std::move(key), std::move(value), false);
+			Pair pair = Pair(std::move(key), std::move(value));
 			return _set.insert_without_resize_buckets(std::move(pair));
 		}
 
 		[[nodiscard]] PEFF_FORCEINLINE bool insert(K &&key, V &&value) {
-			Pair pair = Pair(std::move(key), std::move(value), false);
+			Pair pair = Pair(std::move(key), std::move(value));
 			return _set.insert(std::move(pair));
 		}
 
 		[[nodiscard]] PEFF_FORCEINLINE RemoveResultType remove(const K &key) {
+			return remove_alt<K>(key);
+		}
+
+		/// @brief Remove a pair by a key of another type, such as std::string_view for peff::String.
+		///
+		/// Both the comparator and the hasher must accept the query type,
+		/// and the hasher must produce the same hash codes for the equal
+		/// keys of the both types, e.g. std::equal_to<std::string_view> and
+		/// peff::Hasher<std::string_view> for peff::String.
+		template <typename U>
+		[[nodiscard]] PEFF_FORCEINLINE RemoveResultType remove_alt(const U &key) {
 			if constexpr (Fallible) {
-				return _set.remove(QueryPair(&key));
+				return _set.template remove_alt<QueryKey<U>>(QueryKey<U>(&key));
 			} else {
-				_set.remove(QueryPair(&key));
+				_set.template remove_alt<QueryKey<U>>(QueryKey<U>(&key));
 			}
 		}
 
 		PEFF_FORCEINLINE ContainsResultType contains(const K &key) const {
-			return _set.contains(QueryPair(&key));
+			return contains_alt<K>(key);
 		}
 
-		PEFF_FORCEINLINE ElementQueryResultType at(const K &key) {
-			if constexpr (Fallible) {
-				auto maybe_pair = _set.at(QueryPair(&key));
+		template <typename U>
+		PEFF_FORCEINLINE ContainsResultType contains_alt(const U &key) const {
+			return _set.template contains_alt<QueryKey<U>>(QueryKey<U>(&key));
+		}
 
-				if (!maybe_pair.has_value())
-					return NULL_OPTION;
+		/// @brief Check if a key presents with its hash code which has been computed, the key is not hashed again.
+		/// @param key Key to be looked up, which may be of another type like the one of contains_alt().
+		/// @param hash_code Hash code of the key, which must equal to the one computed by the hasher.
+		template <typename U>
+		PEFF_FORCEINLINE ContainsResultType contains_with_hash(const U &key, HashCode hash_code) const {
+			return _set.contains_with_hash(QueryKey<U>(&key), hash_code);
+		}
 
-				return maybe_pair.value().value.get();
-			} else {
-				return _set.at(QueryPair(&key)).value.get();
-			}
+		PEFF_FORCEINLINE ElementQueryResultType at(const K &key) {
+			return at_alt<K>(key);
 		}
 
 		PEFF_FORCEINLINE ConstElementQueryResultType at(const K &key) const {
-			if constexpr (Fallible) {
-				auto maybe_pair = _set.at(QueryPair(&key));
+			return at_alt<K>(key);
+		}
 
-				if (!maybe_pair.has_value())
-					return NULL_OPTION;
+		template <typename U>
+		PEFF_FORCEINLINE ElementQueryResultType at_alt(const U &key) {
+			return _to_value<ElementQueryResultType>(_set.template at_alt<QueryKey<U>>(QueryKey<U>(&key)));
+		}
 
-				return maybe_pair.value().value.get();
-			} else {
-				return _set.at(QueryPair(&key)).value.get();
-			}
+		template <typename U>
+		PEFF_FORCEINLINE ConstElementQueryResultType at_alt(const U &key) const {
+			return _to_value<ConstElementQueryResultType>(_set.template at_alt<QueryKey<U>>(QueryKey<U>(&key)));
+		}
+
+		/// @brief Get the value of a key with its hash code which has been computed, see contains_with_hash().
+		template <typename U>
+		PEFF_FORCEINLINE ElementQueryResultType at_with_hash(const U &key, HashCode hash_code) {
+			return _to_value<ElementQueryResultType>(_set.at_with_hash(QueryKey<U>(&key), hash_code));
+		}
+
+		template <typename U>
+		PEFF_FORCEINLINE ConstElementQueryResultType at_with_hash(const U &key, HashCode hash_code) const {
+			return _to_value<ConstElementQueryResultType>(_set.at_with_hash(QueryKey<U>(&key), hash_code));
+		}
+
+		/// @brief Check if each of a batch of keys presents, see HashSetImpl::get_batch().
+		/// @param keys Keys to be looked up, which may be of another type like the one of contains_alt().
+		/// @param num_keys Number of the keys.
+		/// @param out_bitmap Where to store the results, bit i is set if keys[i] presents, must have at least (num_keys + 7) / 8 bytes.
+		template <typename U>
+		[[nodiscard]] PEFF_FORCEINLINE BatchQueryResultType contains_batch(const U *keys, size_t num_keys, uint8_t *out_bitmap) const {
+			return const_cast<SetType &>(_set).get_batch(
+				num_keys,
+				[keys](size_t index) {
+					return QueryKey<U>(&keys[index]);
+				},
+				[out_bitmap](size_t index, Pair *pair) {
+					assign_bitmap_bit(out_bitmap, index, pair);
+				});
+		}
+
+		/// @brief Get the values of a batch of keys, see HashSetImpl::get_batch().
+		/// @param values_out Where to store the pointers to the values, nullptr for the absent keys.
+		template <typename U>
+		[[nodiscard]] PEFF_FORCEINLINE BatchQueryResultType find_batch(const U *keys, size_t num_keys, V **values_out) {
+			return _set.get_batch(
+				num_keys,
+				[keys](size_t index) {
+					return QueryKey<U>(&keys[index]);
+				},
+				[values_out](size_t index, Pair *pair) {
+					values_out[index] = pair ? &pair->value.get() : nullptr;
+				});
+		}
+
+		template <typename U>
+		[[nodiscard]] PEFF_FORCEINLINE BatchQueryResultType find_batch(const U *keys, size_t num_keys, const V **values_out) const {
+			return const_cast<ThisType *>(this)->find_batch(keys, num_keys, const_cast<V **>(values_out));
 		}
 
 		PEFF_FORCEINLINE Alloc *allocator() const {
@@ -261,14 +358,21 @@ namespace peff {
 			}
 		};
 
+	private:
+		/// @brief Wrap a const iterator of the set, which does not migrate the set during an incremental resize.
+		PEFF_FORCEINLINE static ConstIterator _to_const_iterator(typename SetType::ConstIterator &&iterator_in) {
+			return ConstIterator(Iterator(std::move(iterator_in._iterator)));
+		}
+
+	public:
 		PEFF_FORCEINLINE ConstIterator begin_const() const noexcept {
-			return ConstIterator(const_cast<ThisType *>(this)->begin());
+			return _to_const_iterator(_set.begin_const());
 		}
 		PEFF_FORCEINLINE ConstIterator end_const() const noexcept {
 			return ConstIterator(const_cast<ThisType *>(this)->end());
 		}
 		PEFF_FORCEINLINE ConstIterator begin_const_reversed() const noexcept {
-			return ConstIterator(const_cast<ThisType *>(this)->begin_reversed());
+			return _to_const_iterator(_set.begin_const_reversed());
 		}
 		PEFF_FORCEINLINE ConstIterator end_const_reversed() const noexcept {
 			return ConstIterator(const_cast<ThisType *>(this)->end_reversed());
@@ -287,26 +391,51 @@ namespace peff {
 		}
 
 		PEFF_FORCEINLINE ConstIterator find(const K &key) const {
-			return ConstIterator(const_cast<ThisType *>(this)->find(key));
+			return find_alt<K>(key);
 		}
 
 		PEFF_FORCEINLINE Iterator find(const K &key) {
-			return Iterator(_set.find(QueryPair(&key)));
+			return find_alt<K>(key);
+		}
+
+		template <typename U>
+		PEFF_FORCEINLINE ConstIterator find_alt(const U &key) const {
+			return _to_const_iterator(_set.template find_alt<QueryKey<U>>(QueryKey<U>(&key)));
+		}
+
+		template <typename U>
+		PEFF_FORCEINLINE Iterator find_alt(const U &key) {
+			return Iterator(_set.template find_alt<QueryKey<U>>(QueryKey<U>(&key)));
+		}
+
+		/// @brief Find a key with its hash code which has been computed, see contains_with_hash().
+		template <typename U>
+		PEFF_FORCEINLINE ConstIterator find_with_hash(const U &key, HashCode hash_code) const {
+			return _to_const_iterator(_set.find_with_hash(QueryKey<U>(&key), hash_code));
+		}
+
+		template <typename U>
+		PEFF_FORCEINLINE Iterator find_with_hash(const U &key, HashCode hash_code) {
+			return Iterator(_set.find_with_hash(QueryKey<U>(&key), hash_code));
 		}
 
 		PEFF_FORCEINLINE size_t size() const {
 			return _set.size();
 		}
 
-		PEFF_FORCEINLINE bool shrink_buckets() {
+		[[nodiscard]] PEFF_FORCEINLINE bool shrink_buckets() {
 			return _set.shrink_buckets();
 		}
+
+		[[nodiscard]] PEFF_FORCEINLINE bool shrink_to_fit() {
+			return _set.shrink_to_fit();
+		}
 	};
 
-	template <typename K, typename V, typename Eq = std::equal_to<K>, typename Hasher = peff::Hasher<K>>
-	using HashMap = HashMapImpl<K, V, Eq, Hasher, false>;
-	template <typename K, typename V, typename Eq = std::equal_to<K>, typename Hasher = peff::Hasher<K>>
-	using FallibleHashMap = HashMapImpl<K, V, Eq, Hasher, true>;
+	template <typename K, typename V, typename Eq = std::equal_to<K>, typename Hasher = peff::Hasher<K>, typename BucketIndexer = ModuloBucketIndexer>
+	using HashMap = HashMapImpl<K, V, Eq, Hasher, false, BucketIndexer>;
+	template <typename K, typename V, typename Eq = std::equal_to<K>, typename Hasher = peff::Hasher<K>, typename BucketIndexer = ModuloBucketIndexer>
+	using FallibleHashMap = HashMapImpl<K, V, Eq, Hasher, true, BucketIndexer>;
 }
 
 #endif
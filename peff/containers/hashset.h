@@ -8,6 +8,7 @@
 #include <peff/utils/fallible_hash.h>
 #include "misc.h"
 #include <peff/utils/hash.h>
+#include <peff/utils/bitops.h>
 #include <peff/base/scope_guard.h>
 #include <stdexcept>
 
@@ -16,22 +17,45 @@
 #endif
 
 namespace peff {
-	namespace details {
-		template <typename T, typename V = void>
-		struct HashCodeResultTypeExtractor {
-			using type = T;
-		};
+	/// @brief Bucket indexing policy which takes the remainder of the hash code, the number of the buckets can be arbitrary.
+	struct ModuloBucketIndexer {
+		constexpr static bool POWER_OF_TWO_BUCKETS = false;
+
+		PEFF_FORCEINLINE size_t operator()(size_t hash_code, size_t num_buckets) const noexcept {
+			return hash_code % num_buckets;
+		}
+	};
+
+	/// @brief Bucket indexing policy which takes the low bits of the hash code.
+	/// @note Only suitable for the hashers which mix the bits, such as MixHasher.
+	struct MaskBucketIndexer {
+		constexpr static bool POWER_OF_TWO_BUCKETS = true;
+
+		PEFF_FORCEINLINE size_t operator()(size_t hash_code, size_t num_buckets) const noexcept {
+			return hash_code & (num_buckets - 1);
+		}
+	};
+
+	/// @brief Bucket indexing policy which takes the high bits of the hash code multiplied by 2^64 divided by the golden ratio.
+	///
+	/// The multiplication spreads the low bits of the hash code over the
+	/// high bits, so the identity hashers of the integers also work well.
+	struct FibonacciBucketIndexer {
+		constexpr static bool POWER_OF_TWO_BUCKETS = true;
+
+		PEFF_FORCEINLINE size_t operator()(size_t hash_code, size_t num_buckets) const noexcept {
+			if (num_buckets == 1)
+				return 0;
+			return (size_t)((((uint64_t)hash_code) * 0x9e3779b97f4a7c15ULL) >> (64 - count_trailing_zero((uint64_t)num_buckets)));
+		}
+	};
 
-		template <typename T>
-		struct HashCodeResultTypeExtractor<T, std::void_t<decltype(std::declval<T>().value())>> {
-			using type = typename T::value_type;
-		};
-	}
 	template <
 		typename T,
 		typename EqCmp,
 		typename Hasher,
-		bool Fallible>
+		bool Fallible,
+		typename BucketIndexer = ModuloBucketIndexer>
 	PEFF_REQUIRES_CONCEPT(std::invocable<EqCmp, const T &, const T &>)
 	class HashSetImpl {
 	public:
@@ -56,17 +80,27 @@ namespace peff {
 		using BucketNodeHandleQueryResultType = typename std::conditional_t<Fallible, Option<typename Bucket::NodeHandle>, typename Bucket::NodeHandle>;
 		using ConstElementQueryResultType = typename std::conditional_t<Fallible, Option<const T &>, const T &>;
 		using ContainsResultType = typename std::conditional_t<Fallible, Option<bool>, bool>;
+		using BatchQueryResultType = typename std::conditional_t<Fallible, bool, void>;
 
 	private:
-		using ThisType = HashSetImpl<T, EqCmp, Hasher, Fallible>;
+		using ThisType = HashSetImpl<T, EqCmp, Hasher, Fallible, BucketIndexer>;
 
 		using BucketsType = DynArray<Bucket>;
 		BucketsType _buckets;
+		/// @brief Buckets which are being migrated into the current ones by an incremental resize, empty if there is no migration.
+		BucketsType _old_buckets;
+		/// @brief Index of the next old bucket to be migrated.
+		size_t _idx_next_migrated_bucket = 0;
+		bool _incremental_resize = false;
 
 		size_t _size = 0;
 		EqCmp _eq_cmp;
 		Hasher _hasher;
 
+		PEFF_FORCEINLINE static size_t _index_of(HashCode hash_code, size_t num_buckets) {
+			return BucketIndexer()((size_t)hash_code, num_buckets);
+		}
+
 		PEFF_FORCEINLINE int _check_capacity() {
 			size_t capacity = _buckets.size() << 1;
 
@@ -80,14 +114,19 @@ namespace peff {
 			return 0;
 		}
 
+		[[nodiscard]] PEFF_FORCEINLINE static bool _init_buckets(size_t new_size, BucketsType &new_buckets) {
+			if (!new_buckets.resize_uninit(new_size)) {
+				return false;
+			}
+			for (size_t i = 0; i < new_buckets.size(); ++i) {
+				peff::construct_at<Bucket>(&new_buckets.at(i), new_buckets.allocator());
+			}
+			return true;
+		}
+
 		[[nodiscard]] PEFF_FORCEINLINE static bool _resize_buckets(size_t new_size, BucketsType &old_buckets, BucketsType &new_buckets) {
-			{
-				if (!new_buckets.resize_uninit(new_size)) {
-					return false;
-				}
-				for (size_t i = 0; i < new_buckets.size(); ++i) {
-					peff::construct_at<Bucket>(&new_buckets.at(i), new_buckets.allocator());
-				}
+			if (!_init_buckets(new_size, new_buckets)) {
+				return false;
 			}
 
 			const size_t num_old_buckets = old_buckets.size();
@@ -96,7 +135,7 @@ namespace peff {
 					Bucket &bucket = new_buckets.at(i);
 
 					for (typename Bucket::NodeHandle j = bucket.first_node(); j; j = j->next) {
-						size_t index = ((size_t)j->data.hash_code) % num_old_buckets;
+						size_t index = _index_of(j->data.hash_code, num_old_buckets);
 
 						bucket.detach(j);
 						old_buckets.at(index).push_front(j);
@@ -110,7 +149,7 @@ namespace peff {
 
 				for (typename Bucket::NodeHandle j = bucket.first_node(); j;) {
 					typename Bucket::NodeHandle next = j->next;
-					size_t index = ((size_t)j->data.hash_code) % new_size;
+					size_t index = _index_of(j->data.hash_code, new_size);
 
 					bucket.detach(j);
 					new_buckets.at(index).push_front(j);
@@ -123,13 +162,18 @@ namespace peff {
 			return true;
 		}
 
-		[[nodiscard]] PEFF_FORCEINLINE BucketNodeHandleQueryResultType _get_bucket_slot(const Bucket &bucket, const T &data) const {
+		template <typename U>
+		[[nodiscard]] PEFF_FORCEINLINE BucketNodeHandleQueryResultType _get_bucket_slot(const Bucket &bucket, HashCode hash_code, const U &data) const {
 			for (auto i = bucket.first_node(); i; i = i->next) {
+				// Elements with different hash codes never equal, skip them without calling the comparator.
+				if (i->data.hash_code != hash_code)
+					continue;
+
 				if constexpr (Fallible) {
-					if (auto result = _eq_cmp(i->data.data, data); result.has_value()) {
-						return i;
-					} else {
+					if (auto result = _eq_cmp(i->data.data, data); !result.has_value()) {
 						return NULL_OPTION;
+					} else if (result.value()) {
+						return i;
 					}
 				} else {
 					if (_eq_cmp(i->data.data, data)) {
@@ -141,30 +185,84 @@ namespace peff {
 			return Bucket::null_node_handle();
 		}
 
+		PEFF_FORCEINLINE bool _is_migrating() const {
+			return _old_buckets.size();
+		}
+
+		/// @brief Migrate the nodes of the next old buckets into the current buckets.
+		/// @param num_buckets Maximum number of the old buckets to be migrated.
+		PEFF_FORCEINLINE void _migrate_buckets(size_t num_buckets) {
+			const size_t num_old_buckets = _old_buckets.size(), new_size = _buckets.size();
+			const size_t idx_end = num_buckets < num_old_buckets - _idx_next_migrated_bucket ? _idx_next_migrated_bucket + num_buckets : num_old_buckets;
+
+			for (; _idx_next_migrated_bucket < idx_end; ++_idx_next_migrated_bucket) {
+				Bucket &bucket = _old_buckets.at(_idx_next_migrated_bucket);
+
+				for (typename Bucket::NodeHandle j = bucket.first_node(); j;) {
+					typename Bucket::NodeHandle next = j->next;
+					size_t index = _index_of(j->data.hash_code, new_size);
+
+					bucket.detach(j);
+					_buckets.at(index).push_front(j);
+					j = next;
+				}
+			}
+
+			if (_idx_next_migrated_bucket == num_old_buckets) {
+				_old_buckets.clear_and_shrink();
+				_idx_next_migrated_bucket = 0;
+			}
+		}
+
+		PEFF_FORCEINLINE void _step_migration() {
+			if (_is_migrating())
+				_migrate_buckets(NUM_MIGRATED_BUCKETS_PER_STEP);
+		}
+
+		PEFF_FORCEINLINE void _finish_migration() {
+			if (_is_migrating())
+				_migrate_buckets(SIZE_MAX);
+		}
+
 		[[nodiscard]] PEFF_FORCEINLINE bool _check_and_resize_buckets() {
-			size_t size = _buckets.size();
+			// A new resize is not started until the current migration has finished.
+			if (_is_migrating()) {
+				_migrate_buckets(NUM_MIGRATED_BUCKETS_PER_STEP);
+				return true;
+			}
+
+			size_t size = _buckets.size(), new_size;
 
 			switch (_check_capacity()) {
-				case 1: {
-					BucketsType new_buckets(_buckets.allocator());
-					if (!_resize_buckets(size ? size << 1 : 1, _buckets, new_buckets)) {
-						return false;
-					}
-					_buckets = std::move(new_buckets);
+				case 1:
+					new_size = size ? size << 1 : 1;
 					break;
-				}
 				case 0:
+					return true;
+				case -1:
+					new_size = size >> 1;
 					break;
-				case -1: {
-					BucketsType new_buckets(_buckets.allocator());
-					if (!_resize_buckets(size >> 1, _buckets, new_buckets)) {
-						return false;
-					}
-					_buckets = std::move(new_buckets);
-					break;
+			}
+
+			BucketsType new_buckets(_buckets.allocator());
+
+			if (_incremental_resize && size) {
+				if (!_init_buckets(new_size, new_buckets)) {
+					return false;
 				}
+				_old_buckets = std::move(_buckets);
+				_buckets = std::move(new_buckets);
+				_idx_next_migrated_bucket = 0;
+
+				_migrate_buckets(NUM_MIGRATED_BUCKETS_PER_STEP);
+				return true;
 			}
 
+			if (!_resize_buckets(new_size, _buckets, new_buckets)) {
+				return false;
+			}
+			_buckets = std::move(new_buckets);
+
 			return true;
 		}
 
@@ -172,6 +270,46 @@ namespace peff {
 			return _buckets.size();
 		}
 
+		/// @brief Look an element up in the current buckets, and in the old bucket which may contain it during a migration.
+		/// @param bucket_out Where to store the bucket of the element, may be nullptr.
+		template <typename U>
+		[[nodiscard]] PEFF_FORCEINLINE BucketNodeHandleQueryResultType _get_slot(HashCode hash_code, const U &data, Bucket **bucket_out = nullptr) {
+			return _get_slot_at(_index_of(hash_code, _buckets.size()), hash_code, data, bucket_out);
+		}
+
+		/// @brief Same as _get_slot(), with the index of the current bucket which has been computed.
+		template <typename U>
+		[[nodiscard]] PEFF_FORCEINLINE BucketNodeHandleQueryResultType _get_slot_at(size_t index, HashCode hash_code, const U &data, Bucket **bucket_out = nullptr) {
+			Bucket *bucket = &_buckets.at(index);
+
+			if (bucket_out)
+				*bucket_out = bucket;
+
+			BucketNodeHandleQueryResultType result = _get_bucket_slot(*bucket, hash_code, data);
+
+			if (!_is_migrating())
+				return result;
+
+			if constexpr (Fallible) {
+				if ((!result.has_value()) || result.value())
+					return result;
+			} else {
+				if (result)
+					return result;
+			}
+
+			if (const size_t old_index = _index_of(hash_code, _old_buckets.size()); old_index >= _idx_next_migrated_bucket) {
+				bucket = &_old_buckets.at(old_index);
+
+				if (bucket_out)
+					*bucket_out = bucket;
+
+				return _get_bucket_slot(*bucket, hash_code, data);
+			}
+
+			return result;
+		}
+
 		/// @brief Insert a new element.
 		/// @param buckets Buckets to be operated.
 		/// @param data Element to insert.
@@ -196,19 +334,31 @@ namespace peff {
 			} else {
 				hash_code = _hasher(tmp_data);
 			}
-			size_t index = ((size_t)hash_code) % _buckets.size();
+			size_t index = _index_of(hash_code, _buckets.size());
 			Bucket &bucket = _buckets.at(index);
 
-			for (auto &i : bucket) {
-				if (_eq_cmp(i.data, tmp_data)) {
-					move_assign_or_move_construct<T>(i.data, std::move(tmp_data));
-					goto inserted;
+			typename Bucket::NodeHandle node;
+			if constexpr (Fallible) {
+				BucketNodeHandleQueryResultType maybe_node = _get_slot(hash_code, tmp_data);
+				if (!maybe_node.has_value()) {
+					return false;
 				}
+
+				node = maybe_node.value();
+			} else {
+				node = _get_slot(hash_code, tmp_data);
 			}
+
+			if (node) {
+				// Replace the existing element, the size is unchanged.
+				move_assign_or_move_construct<T>(node->data.data, std::move(tmp_data));
+				_step_migration();
+				return true;
+			}
+
 			if (!bucket.push_front(Element(std::move(tmp_data), hash_code)))
 				return false;
 
-		inserted:
 			if (!_check_and_resize_buckets()) {
 				if (force_resize_buckets) {
 					bucket.pop_front();
@@ -220,7 +370,8 @@ namespace peff {
 			return true;
 		}
 
-		[[nodiscard]] PEFF_FORCEINLINE RemoveResultType _remove(const T &data, bool force_resize_buckets) {
+		template <typename U>
+		[[nodiscard]] PEFF_FORCEINLINE RemoveResultType _remove(const U &data, bool force_resize_buckets) {
 			if (!_buckets.size()) {
 				if constexpr (Fallible) {
 					return true;
@@ -238,38 +389,38 @@ namespace peff {
 			} else {
 				hash_code = _hasher(data);
 			}
-			size_t index = ((size_t)hash_code) % _buckets.size();
-			Bucket &bucket = _buckets.at(index);
-			peff::RcObjectPtr<Alloc> alloc = bucket.allocator();
-
 			typename Bucket::NodeHandle node;
+			Bucket *bucket;
 
 			if constexpr (Fallible) {
-				BucketNodeHandleQueryResultType maybe_node = _get_bucket_slot(bucket, data);
+				BucketNodeHandleQueryResultType maybe_node = _get_slot(hash_code, data, &bucket);
 				if (!maybe_node.has_value()) {
 					return false;
 				}
 
 				node = maybe_node.value();
 			} else {
-				node = _get_bucket_slot(bucket, data);
+				node = _get_slot(hash_code, data, &bucket);
 			}
 
 			if (node) {
-				typename Bucket::NodeHandle next_node = Bucket::next(node, 1);
-
-				bucket.detach(node);
-				bucket.delete_node(node);
+				bucket->detach(node);
+				bucket->delete_node(node);
 
 				--_size;
 			}
 
+			_step_migration();
+
 			if constexpr (Fallible) {
 				return true;
 			}
 		}
 
-		[[nodiscard]] PEFF_FORCEINLINE BucketNodeHandleQueryResultType _get(const T &data, size_t &index) const {
+		template <typename U>
+		[[nodiscard]] PEFF_FORCEINLINE BucketNodeHandleQueryResultType _get(const U &data, size_t &index, bool *is_old_bucket_out = nullptr) const {
+			static_assert(std::is_invocable_v<Hasher, const U &>, "The query type is not hashable by the hasher");
+
 			if (!_buckets.size()) {
 				return Bucket::null_node_handle();
 			}
@@ -283,37 +434,137 @@ namespace peff {
 			} else {
 				hash_code = _hasher(data);
 			}
-			size_t i = ((size_t)hash_code) % _buckets.size();
-			const Bucket &bucket = _buckets.at(i);
 
-			return _get_bucket_slot(bucket, data);
+			return _get_with_hash(data, hash_code, index, is_old_bucket_out);
+		}
+
+		/// @brief Look an element up with its hash code which has been computed, never migrates.
+		/// @param index Where to store the index of the bucket of the element.
+		/// @param is_old_bucket_out Where to store whether the index is in the old buckets, may be nullptr,
+		/// in which case the index is always in the current buckets.
+		template <typename U>
+		[[nodiscard]] PEFF_FORCEINLINE BucketNodeHandleQueryResultType _get_with_hash(const U &data, HashCode hash_code, size_t &index, bool *is_old_bucket_out = nullptr) const {
+			if (!_buckets.size()) {
+				return Bucket::null_node_handle();
+			}
+
+			index = _index_of(hash_code, _buckets.size());
+
+			Bucket *bucket;
+			BucketNodeHandleQueryResultType result = const_cast<ThisType *>(this)->_get_slot_at(index, hash_code, data, &bucket);
+
+			if (is_old_bucket_out) {
+				if ((*is_old_bucket_out = (bucket != &_buckets.at(index))))
+					index = _index_of(hash_code, _old_buckets.size());
+			}
+
+			return result;
+		}
+
+		template <typename U>
+		PEFF_FORCEINLINE static void _check_query_type() {
+			static_assert(std::is_invocable_v<EqCmp, const T &, const U &>, "The query type is not comparable with the element");
+		}
+
+		PEFF_FORCEINLINE static ContainsResultType _to_contains_result(const BucketNodeHandleQueryResultType &node) {
+			if constexpr (Fallible) {
+				if (!node.has_value())
+					return NULL_OPTION;
+
+				return (bool)node.value();
+			} else {
+				return (bool)node;
+			}
+		}
+
+		PEFF_FORCEINLINE void _clear_buckets() {
+			if constexpr (std::is_trivially_destructible_v<Element>) {
+				if (_buckets.size() && _buckets.allocator()->get_caps().is_monotonic) {
+					for (auto &i : _buckets)
+						i.discard_nodes();
+					for (auto &i : _old_buckets)
+						i.discard_nodes();
+					return;
+				}
+			}
+
+			// Release the nodes of all buckets in batches.
+			typename Bucket::NodeReleaser releaser(_buckets.allocator(), sizeof(typename Bucket::Node), alignof(typename Bucket::Node));
+
+			for (auto &i : _buckets)
+				i.clear(releaser);
+			for (auto &i : _old_buckets)
+				i.clear(releaser);
 		}
 
 	public:
-		PEFF_FORCEINLINE HashSetImpl(Alloc *allocator) : _buckets(allocator) {
+		/// @brief Maximum number of the old buckets migrated by each operation during an incremental resize.
+		constexpr static size_t NUM_MIGRATED_BUCKETS_PER_STEP = 8;
+		/// @brief Number of the keys which are hashed and prefetched at a time by the batched lookups.
+		constexpr static size_t BATCH_LOOKUP_GROUP_SIZE = 16;
+
+		PEFF_FORCEINLINE HashSetImpl(Alloc *allocator) : _buckets(allocator), _old_buckets(allocator) {
 		}
 
 		PEFF_FORCEINLINE HashSetImpl(ThisType &&other)
 			: _buckets(std::move(other._buckets)),
+			  _old_buckets(std::move(other._old_buckets)),
+			  _idx_next_migrated_bucket(other._idx_next_migrated_bucket),
+			  _incremental_resize(other._incremental_resize),
 			  _size(other._size),
 			  _eq_cmp(std::move(other._eq_cmp)),
 			  _hasher(std::move(other._hasher)) {
+			other._idx_next_migrated_bucket = 0;
 			other._size = 0;
 		}
 
+		PEFF_FORCEINLINE ~HashSetImpl() {
+			_clear_buckets();
+		}
+
 		PEFF_FORCEINLINE ThisType &operator=(ThisType &&other) noexcept {
 			clear_and_shrink();
 
 			_buckets = std::move(other._buckets);
+			_old_buckets = std::move(other._old_buckets);
+			_idx_next_migrated_bucket = other._idx_next_migrated_bucket;
+			_incremental_resize = other._incremental_resize;
 			_size = other._size;
 			_eq_cmp = std::move(other._eq_cmp);
 			_hasher = std::move(other._hasher);
 
+			other._idx_next_migrated_bucket = 0;
 			other._size = 0;
 
 			return *this;
 		}
 
+		/// @brief Enable or disable the incremental resize.
+		///
+		/// With the incremental resize, the nodes are not moved to the new
+		/// buckets all at once. The old buckets are kept aside and a few of
+		/// them are migrated on each insertion, removal and non-const lookup,
+		/// so no single operation has to move all nodes. Const lookups and
+		/// const iterators consult both bucket arrays but never migrate, so
+		/// the set can still be read by multiple threads. Non-const iterating
+		/// and find() finish the migration first.
+		///
+		/// @note The new bucket array is still allocated and initialized at once when a resize starts.
+		PEFF_FORCEINLINE void set_incremental_resize(bool enabled) {
+			if (!enabled)
+				_finish_migration();
+			_incremental_resize = enabled;
+		}
+
+		PEFF_FORCEINLINE bool is_incremental_resize() const {
+			return _incremental_resize;
+		}
+
+		/// @brief Check if an incremental resize is in progress.
+		PEFF_FORCEINLINE bool is_resizing() const {
+			return _is_migrating();
+		}
+
 		[[nodiscard]] PEFF_FORCEINLINE bool insert_without_resize_buckets(T &&data) {
 			return _insert(std::move(data), false);
 		}
@@ -323,38 +574,61 @@ namespace peff {
 		}
 
 		[[nodiscard]] PEFF_FORCEINLINE RemoveResultType remove(const T &data) {
+			return remove_alt<T>(data);
+		}
+
+		/// @brief Remove an element by a key of another type, which is hashed and compared with the elements without converting.
+		template <typename U>
+		[[nodiscard]] PEFF_FORCEINLINE RemoveResultType remove_alt(const U &key) {
+			_check_query_type<U>();
 			if constexpr (Fallible) {
-				return _remove(data, false).has_value();
+				return _remove(key, false);
 			} else {
-				_remove(data, false);
+				_remove(key, false);
 			}
 		}
 
 		[[nodiscard]] PEFF_FORCEINLINE BucketNodeHandleQueryResultType get(const T &data) {
 			size_t index;
+			_step_migration();
 			return _get(data, index);
 		}
 
 		[[nodiscard]] PEFF_FORCEINLINE ContainsResultType contains(const T &data) const {
-			size_t index;
-			if constexpr (Fallible) {
-				auto maybe_handle = _get(data, index);
+			return contains_alt<T>(data);
+		}
 
-				if (!maybe_handle.has_value())
-					return NULL_OPTION;
+		template <typename U>
+		[[nodiscard]] PEFF_FORCEINLINE ContainsResultType contains_alt(const U &key) const {
+			size_t index;
+			_check_query_type<U>();
+			return _to_contains_result(_get(key, index));
+		}
 
-				return maybe_handle.value();
-			} else {
-				return _get(data, index);
-			}
+		/// @brief Check if an element presents with its hash code which has been computed.
+		/// @param key Key to be looked up, which may be of another type like the one of contains_alt().
+		/// @param hash_code Hash code of the key, which must equal to the one computed by the hasher.
+		template <typename U>
+		[[nodiscard]] PEFF_FORCEINLINE ContainsResultType contains_with_hash(const U &key, HashCode hash_code) const {
+			size_t index;
+			_check_query_type<U>();
+			return _to_contains_result(_get_with_hash(key, hash_code, index));
 		}
 
 		PEFF_FORCEINLINE void clear() {
+			_clear_buckets();
 			_buckets.clear();
+			_old_buckets.clear_and_shrink();
+			_idx_next_migrated_bucket = 0;
+			_size = 0;
 		}
 
 		PEFF_FORCEINLINE void clear_and_shrink() {
+			_clear_buckets();
 			_buckets.clear_and_shrink();
+			_old_buckets.clear_and_shrink();
+			_idx_next_migrated_bucket = 0;
+			_size = 0;
 		}
 
 		PEFF_FORCEINLINE Alloc *allocator() const {
@@ -366,23 +640,82 @@ namespace peff {
 				i.replace_allocator(rhs);
 			}
 			_buckets.replace_allocator(rhs);
+			for (auto &i : _old_buckets) {
+				i.replace_allocator(rhs);
+			}
+			_old_buckets.replace_allocator(rhs);
 		}
 
+	private:
+		/// @brief Find the first node in a bucket and the buckets after it.
+		///
+		/// The current buckets go first, then the old buckets which have not
+		/// been migrated, so the iteration never has to migrate.
+		///
+		/// @param index Index of the bucket to start from, set to the bucket of the node, or SIZE_MAX if there is no more node.
+		/// @param is_old_bucket Whether the index is in the old buckets, updated with the index.
+		PEFF_FORCEINLINE typename Bucket::NodeHandle _seek_first_node(size_t &index, bool &is_old_bucket) const {
+			if (!is_old_bucket) {
+				for (; index < _buckets.size(); ++index) {
+					if (typename Bucket::NodeHandle node = _buckets.at(index).first_node(); node)
+						return node;
+				}
+				is_old_bucket = true;
+				index = _idx_next_migrated_bucket;
+			}
+			for (; index < _old_buckets.size(); ++index) {
+				if (typename Bucket::NodeHandle node = _old_buckets.at(index).first_node(); node)
+					return node;
+			}
+			index = SIZE_MAX;
+			is_old_bucket = false;
+			return Bucket::null_node_handle();
+		}
+
+		/// @brief Find the last node in the buckets before a bucket, in the reversed order of _seek_first_node().
+		/// @param index Index after the bucket to start from, set to the bucket of the node, or SIZE_MAX if there is no more node.
+		/// @param is_old_bucket Whether the index is in the old buckets, updated with the index.
+		PEFF_FORCEINLINE typename Bucket::NodeHandle _seek_last_node(size_t &index, bool &is_old_bucket) const {
+			if (is_old_bucket) {
+				for (; index > _idx_next_migrated_bucket; --index) {
+					if (typename Bucket::NodeHandle node = _old_buckets.at(index - 1).last_node(); node) {
+						--index;
+						return node;
+					}
+				}
+				is_old_bucket = false;
+				index = _buckets.size();
+			}
+			for (; index; --index) {
+				if (typename Bucket::NodeHandle node = _buckets.at(index - 1).last_node(); node) {
+					--index;
+					return node;
+				}
+			}
+			index = SIZE_MAX;
+			return Bucket::null_node_handle();
+		}
+
+	public:
 		struct Iterator {
 			size_t idx_cur_bucket;
 			typename Bucket::NodeHandle bucket_node_handle;
 			ThisType *hash_set;
 			IteratorDirection direction;
+			/// @brief Whether the current bucket is an old bucket which has not been migrated.
+			bool is_old_bucket;
 
 			PEFF_FORCEINLINE Iterator(
 				ThisType *hash_set,
 				size_t idx_cur_bucket,
 				typename Bucket::NodeHandle bucket_node_handle,
-				IteratorDirection direction)
+				IteratorDirection direction,
+				bool is_old_bucket = false)
 				: idx_cur_bucket(idx_cur_bucket),
 				  bucket_node_handle(bucket_node_handle),
 				  hash_set(hash_set),
-				  direction(direction) {}
+				  direction(direction),
+				  is_old_bucket(is_old_bucket) {}
 
 			Iterator(const Iterator &it) = default;
 			PEFF_FORCEINLINE Iterator(Iterator &&it) {
@@ -390,11 +723,13 @@ namespace peff {
 				bucket_node_handle = it.bucket_node_handle;
 				hash_set = it.hash_set;
 				direction = it.direction;
+				is_old_bucket = it.is_old_bucket;
 
 				it.idx_cur_bucket = SIZE_MAX;
 				it.bucket_node_handle = Bucket::null_node_handle();
 				it.hash_set = nullptr;
 				it.direction = IteratorDirection::Invalid;
+				it.is_old_bucket = false;
 			}
 			PEFF_FORCEINLINE Iterator &operator=(const Iterator &rhs) noexcept {
 				if (direction != rhs.direction)
@@ -402,6 +737,7 @@ namespace peff {
 				idx_cur_bucket = rhs.idx_cur_bucket;
 				bucket_node_handle = rhs.bucket_node_handle;
 				hash_set = rhs.hash_set;
+				is_old_bucket = rhs.is_old_bucket;
 				return *this;
 			}
 			PEFF_FORCEINLINE Iterator &operator=(Iterator &&rhs) noexcept {
@@ -423,28 +759,14 @@ namespace peff {
 				if (direction == IteratorDirection::Forward) {
 					typename Bucket::NodeHandle next_node = Bucket::next(bucket_node_handle, 1);
 					if (!next_node) {
-						while ((!next_node) && (idx_cur_bucket != SIZE_MAX)) {
-							if (++idx_cur_bucket >= hash_set->_buckets.size()) {
-								idx_cur_bucket = SIZE_MAX;
-								next_node = nullptr;
-							} else {
-								next_node = hash_set->_buckets.at(idx_cur_bucket).first_node();
-							}
-						}
+						++idx_cur_bucket;
+						next_node = hash_set->_seek_first_node(idx_cur_bucket, is_old_bucket);
 					}
 					bucket_node_handle = next_node;
 				} else {
 					typename Bucket::NodeHandle next_node = Bucket::prev(bucket_node_handle, 1);
 					if (!next_node) {
-						while ((!next_node) && (idx_cur_bucket != SIZE_MAX)) {
-							if (!idx_cur_bucket) {
-								idx_cur_bucket = SIZE_MAX;
-								next_node = nullptr;
-							} else {
-								--idx_cur_bucket;
-								next_node = hash_set->_buckets.at(idx_cur_bucket).last_node();
-							}
-						}
+						next_node = hash_set->_seek_last_node(idx_cur_bucket, is_old_bucket);
 					}
 					bucket_node_handle = next_node;
 				}
@@ -459,43 +781,36 @@ namespace peff {
 			}
 
 			PEFF_FORCEINLINE Iterator &operator--() {
+				size_t index = idx_cur_bucket;
+				bool is_old = is_old_bucket;
+				typename Bucket::NodeHandle next_node;
+
 				if (direction == IteratorDirection::Forward) {
-					if (idx_cur_bucket == SIZE_MAX) {
-						idx_cur_bucket = hash_set->_buckets.size();
-						bucket_node_handle = hash_set->_buckets.at(idx_cur_bucket).last_node();
-					} else {
-						typename Bucket::NodeHandle next_node = Bucket::prev(bucket_node_handle, 1);
-						if (!next_node) {
-							while (!next_node) {
-								if (!idx_cur_bucket) {
-									throw std::logic_error("Decreasing the beginning iterator");
-								} else {
-									--idx_cur_bucket;
-									next_node = hash_set->_buckets.at(idx_cur_bucket).last_node();
-								}
-							}
-						}
-						bucket_node_handle = next_node;
+					if (index == SIZE_MAX) {
+						index = hash_set->_old_buckets.size();
+						is_old = true;
+						next_node = hash_set->_seek_last_node(index, is_old);
+					} else if (!(next_node = Bucket::prev(bucket_node_handle, 1))) {
+						next_node = hash_set->_seek_last_node(index, is_old);
 					}
 				} else {
-					if (idx_cur_bucket == SIZE_MAX) {
-						idx_cur_bucket = 0;
-						bucket_node_handle = hash_set->_buckets.at(0).first_node();
-					} else {
-						typename Bucket::NodeHandle next_node = Bucket::next(bucket_node_handle, 1);
-						if (!next_node) {
-							while (!next_node) {
-								if (++idx_cur_bucket >= hash_set->_buckets.size()) {
-									throw std::logic_error("Decreasing the beginning iterator");
-								} else {
-									next_node = hash_set->_buckets.at(idx_cur_bucket).first_node();
-								}
-							}
-						}
-						bucket_node_handle = next_node;
+					if (index == SIZE_MAX) {
+						index = 0;
+						is_old = false;
+						next_node = hash_set->_seek_first_node(index, is_old);
+					} else if (!(next_node = Bucket::next(bucket_node_handle, 1))) {
+						++index;
+						next_node = hash_set->_seek_first_node(index, is_old);
 					}
 				}
 
+				if (!next_node)
+					throw std::logic_error("Decreasing the beginning iterator");
+
+				idx_cur_bucket = index;
+				is_old_bucket = is_old;
+				bucket_node_handle = next_node;
+
 				return *this;
 			}
 
@@ -552,34 +867,81 @@ namespace peff {
 			}
 		};
 
-		PEFF_FORCEINLINE Iterator begin() {
-			for (size_t i = 0; i < _buckets.size(); ++i) {
-				auto &cur_bucket = _buckets.at(i);
-				typename Bucket::NodeHandle node = cur_bucket.first_node();
-				if (node) {
-					return Iterator(this, i, node, IteratorDirection::Forward);
-				}
+	private:
+		PEFF_FORCEINLINE Iterator _to_iterator(const BucketNodeHandleQueryResultType &node, size_t index, bool is_old_bucket) const {
+			ThisType *self = const_cast<ThisType *>(this);
+			if constexpr (Fallible) {
+				if (!node.has_value())
+					return self->end();
+				if (typename Bucket::NodeHandle handle = node.value(); handle)
+					return Iterator(self, index, handle, IteratorDirection::Forward, is_old_bucket);
+				return self->end();
+			} else {
+				if (!node)
+					return self->end();
+				return Iterator(self, index, node, IteratorDirection::Forward, is_old_bucket);
+			}
+		}
+
+		template <typename R>
+		PEFF_FORCEINLINE static R _to_element(const BucketNodeHandleQueryResultType &maybe_node) {
+			typename Bucket::NodeHandle node;
+			if constexpr (Fallible) {
+				if (!maybe_node.has_value())
+					return NULL_OPTION;
+
+				node = maybe_node.value();
+			} else {
+				node = maybe_node;
 			}
-			return end();
+			if (!node)
+				throw std::out_of_range("No such element");
+			return node->data.data;
+		}
+
+		/// @brief Get the first iterator without migrating, see _seek_first_node().
+		PEFF_FORCEINLINE Iterator _begin() const {
+			size_t index = 0;
+			bool is_old_bucket = false;
+			typename Bucket::NodeHandle node = _seek_first_node(index, is_old_bucket);
+			return Iterator(const_cast<ThisType *>(this), index, node, IteratorDirection::Forward, is_old_bucket);
+		}
+
+		/// @brief Get the first reversed iterator without migrating, see _seek_last_node().
+		PEFF_FORCEINLINE Iterator _begin_reversed() const {
+			size_t index = _old_buckets.size();
+			bool is_old_bucket = true;
+			typename Bucket::NodeHandle node = _seek_last_node(index, is_old_bucket);
+			return Iterator(const_cast<ThisType *>(this), index, node, IteratorDirection::Reversed, is_old_bucket);
+		}
+
+		template <typename U>
+		PEFF_FORCEINLINE Iterator _find(const U &key) const {
+			size_t index;
+			bool is_old_bucket = false;
+			BucketNodeHandleQueryResultType node = _get(key, index, &is_old_bucket);
+			return _to_iterator(node, index, is_old_bucket);
+		}
+
+		template <typename U>
+		PEFF_FORCEINLINE Iterator _find_with_hash(const U &key, HashCode hash_code) const {
+			size_t index;
+			bool is_old_bucket = false;
+			BucketNodeHandleQueryResultType node = _get_with_hash(key, hash_code, index, &is_old_bucket);
+			return _to_iterator(node, index, is_old_bucket);
+		}
+
+	public:
+		PEFF_FORCEINLINE Iterator begin() {
+			_finish_migration();
+			return _begin();
 		}
 		PEFF_FORCEINLINE Iterator end() {
 			return Iterator(this, SIZE_MAX, nullptr, IteratorDirection::Forward);
 		}
 		PEFF_FORCEINLINE Iterator begin_reversed() {
-			for (size_t i = _buckets.size(); i; --i) {
-				auto &cur_bucket = _buckets.at(i);
-				typename Bucket::NodeHandle node = cur_bucket.last_node();
-				if (node) {
-					return Iterator(this, i, node, IteratorDirection::Reversed);
-				}
-			}
-
-			auto &cur_bucket = _buckets.at(0);
-			typename Bucket::NodeHandle node = cur_bucket.last_node();
-			if (node) {
-				return Iterator(this, 0, node, IteratorDirection::Reversed);
-			}
-			return end_reversed();
+			_finish_migration();
+			return _begin_reversed();
 		}
 
 		PEFF_FORCEINLINE Iterator end_reversed() {
@@ -604,11 +966,11 @@ namespace peff {
 			}
 
 			PEFF_FORCEINLINE bool operator!=(const ConstIterator &rhs) const {
-				return _iterator == rhs._iterator;
+				return _iterator != rhs._iterator;
 			}
 
 			PEFF_FORCEINLINE bool operator!=(ConstIterator &&rhs) const {
-				return _iterator == rhs._iterator;
+				return _iterator != rhs._iterator;
 			}
 
 			PEFF_FORCEINLINE T &operator*() {
@@ -633,89 +995,251 @@ namespace peff {
 			}
 		};
 
+		/// @brief Get the first const iterator, which walks the unmigrated old buckets too during an incremental resize.
 		PEFF_FORCEINLINE ConstIterator begin_const() const noexcept {
-			return ConstIterator(const_cast<ThisType *>(this)->begin());
+			return ConstIterator(_begin());
 		}
 		PEFF_FORCEINLINE ConstIterator end_const() const noexcept {
 			return ConstIterator(const_cast<ThisType *>(this)->end());
 		}
 		PEFF_FORCEINLINE ConstIterator begin_const_reversed() const noexcept {
-			return ConstIterator(const_cast<ThisType *>(this)->begin_reversed());
+			return ConstIterator(_begin_reversed());
 		}
 		PEFF_FORCEINLINE ConstIterator end_const_reversed() const noexcept {
 			return ConstIterator(const_cast<ThisType *>(this)->end_reversed());
 		}
 
 		PEFF_FORCEINLINE Iterator find(const T &value) {
-			size_t index;
-			if constexpr (Fallible) {
-				BucketNodeHandleQueryResultType node = _get(value, index);
-				if (!node.has_value())
-					return end();
-				if (typename Bucket::NodeHandle handle = node.value(); handle)
-					return Iterator(this, index, handle, IteratorDirection::Forward);
-				return end();
-			} else {
-				typename Bucket::NodeHandle node = _get(value, index);
-				if (!node)
-					return end();
-				return Iterator(this, index, node, IteratorDirection::Forward);
-			}
+			return find_alt<T>(value);
 		}
 
 		PEFF_FORCEINLINE ConstIterator find(const T &value) const {
-			return ConstIterator(const_cast<ThisType *>(this)->find(value));
+			return find_alt<T>(value);
 		}
 
-		PEFF_FORCEINLINE ElementQueryResultType at(const T &value) {
-			size_t index;
-			typename Bucket::NodeHandle node;
-			if constexpr (Fallible) {
-				auto maybe_node = _get(value, index);
+		template <typename U>
+		PEFF_FORCEINLINE Iterator find_alt(const U &key) {
+			_check_query_type<U>();
+			_finish_migration();
+			return _find(key);
+		}
 
-				if (!maybe_node.has_value())
-					return NULL_OPTION;
+		template <typename U>
+		PEFF_FORCEINLINE ConstIterator find_alt(const U &key) const {
+			_check_query_type<U>();
+			return ConstIterator(_find(key));
+		}
 
-				node = maybe_node.value();
-			} else {
-				node = _get(value, index);
-			}
-			if (!node)
-				throw std::out_of_range("No such element");
-			return node->data.data;
+		/// @brief Find an element with its hash code which has been computed, see contains_with_hash().
+		template <typename U>
+		PEFF_FORCEINLINE Iterator find_with_hash(const U &key, HashCode hash_code) {
+			_check_query_type<U>();
+			_finish_migration();
+			return _find_with_hash(key, hash_code);
+		}
+
+		template <typename U>
+		PEFF_FORCEINLINE ConstIterator find_with_hash(const U &key, HashCode hash_code) const {
+			_check_query_type<U>();
+			return ConstIterator(_find_with_hash(key, hash_code));
+		}
+
+		PEFF_FORCEINLINE ElementQueryResultType at(const T &value) {
+			return at_alt<T>(value);
 		}
 
 		PEFF_FORCEINLINE ConstElementQueryResultType at(const T &value) const {
+			return at_alt<T>(value);
+		}
+
+		template <typename U>
+		PEFF_FORCEINLINE ElementQueryResultType at_alt(const U &key) {
 			size_t index;
-			typename Bucket::NodeHandle node;
-			if constexpr (Fallible) {
-				auto maybe_node = _get(value, index);
+			_check_query_type<U>();
+			_step_migration();
+			return _to_element<ElementQueryResultType>(_get(key, index));
+		}
 
-				if (!maybe_node.has_value())
-					return NULL_OPTION;
+		template <typename U>
+		PEFF_FORCEINLINE ConstElementQueryResultType at_alt(const U &key) const {
+			size_t index;
+			_check_query_type<U>();
+			return _to_element<ConstElementQueryResultType>(_get(key, index));
+		}
 
-				node = maybe_node.value();
+		/// @brief Get an element with its hash code which has been computed, see contains_with_hash().
+		template <typename U>
+		PEFF_FORCEINLINE ElementQueryResultType at_with_hash(const U &key, HashCode hash_code) {
+			size_t index;
+			_check_query_type<U>();
+			_step_migration();
+			return _to_element<ElementQueryResultType>(_get_with_hash(key, hash_code, index));
+		}
+
+		template <typename U>
+		PEFF_FORCEINLINE ConstElementQueryResultType at_with_hash(const U &key, HashCode hash_code) const {
+			size_t index;
+			_check_query_type<U>();
+			return _to_element<ConstElementQueryResultType>(_get_with_hash(key, hash_code, index));
+		}
+
+		/// @brief Look a batch of keys up, the buckets of a group of keys are prefetched before any key of the group is resolved.
+		///
+		/// The keys are processed in groups of BATCH_LOOKUP_GROUP_SIZE, all
+		/// keys of a group are hashed and their buckets and the first nodes
+		/// of the buckets are prefetched first, so the cache misses of the
+		/// keys in a group overlap instead of stalling the lookups one by one.
+		///
+		/// @param num_keys Number of the keys.
+		/// @param get_key Callable which returns the key of an index, the keys may be of another type like the one of contains_alt().
+		/// @param on_result Callable which is called with the index and the pointer to the element of each key in order, the pointer is nullptr if there is no such element.
+		/// @return (Fallible only) true for succeeded, false if the hasher or the comparator failed.
+		template <typename KeyGetter, typename Callback>
+		[[nodiscard]] PEFF_FORCEINLINE BatchQueryResultType get_batch(size_t num_keys, KeyGetter &&get_key, Callback &&on_result) {
+			const size_t num_buckets = _buckets.size();
+
+			if (!num_buckets) {
+				for (size_t i = 0; i < num_keys; ++i)
+					on_result(i, (T *)nullptr);
 			} else {
-				node = _get(value, index);
+				HashCode hash_codes[BATCH_LOOKUP_GROUP_SIZE];
+				size_t indices[BATCH_LOOKUP_GROUP_SIZE];
+
+				for (size_t i = 0; i < num_keys; i += BATCH_LOOKUP_GROUP_SIZE) {
+					const size_t group_size = num_keys - i < BATCH_LOOKUP_GROUP_SIZE ? num_keys - i : BATCH_LOOKUP_GROUP_SIZE;
+
+					for (size_t j = 0; j < group_size; ++j) {
+						if constexpr (Fallible) {
+							if (auto result = _hasher(get_key(i + j)); result.has_value()) {
+								hash_codes[j] = result.value();
+							} else
+								return false;
+						} else {
+							hash_codes[j] = _hasher(get_key(i + j));
+						}
+
+						indices[j] = _index_of(hash_codes[j], num_buckets);
+						PEFF_PREFETCH(&_buckets.data()[indices[j]]);
+					}
+
+					for (size_t j = 0; j < group_size; ++j)
+						PEFF_PREFETCH(_buckets.data()[indices[j]].first_node());
+
+					for (size_t j = 0; j < group_size; ++j) {
+						typename Bucket::NodeHandle node;
+						if constexpr (Fallible) {
+							BucketNodeHandleQueryResultType maybe_node = _get_slot_at(indices[j], hash_codes[j], get_key(i + j));
+							if (!maybe_node.has_value())
+								return false;
+
+							node = maybe_node.value();
+						} else {
+							node = _get_slot_at(indices[j], hash_codes[j], get_key(i + j));
+						}
+
+						on_result(i + j, node ? &node->data.data : (T *)nullptr);
+					}
+				}
 			}
-			if (!node)
-				throw std::out_of_range("No such element");
-			return node->data.data;
+
+			if constexpr (Fallible) {
+				return true;
+			}
+		}
+
+		/// @brief Check if each of a batch of elements presents, see get_batch().
+		/// @param keys Keys to be looked up, which may be of another type like the one of contains_alt().
+		/// @param num_keys Number of the keys.
+		/// @param out_bitmap Where to store the results, bit i is set if keys[i] presents, must have at least (num_keys + 7) / 8 bytes.
+		template <typename U>
+		[[nodiscard]] PEFF_FORCEINLINE BatchQueryResultType contains_batch(const U *keys, size_t num_keys, uint8_t *out_bitmap) const {
+			_check_query_type<U>();
+			return const_cast<ThisType *>(this)->get_batch(
+				num_keys,
+				[keys](size_t index) -> const U & {
+					return keys[index];
+				},
+				[out_bitmap](size_t index, T *element) {
+					assign_bitmap_bit(out_bitmap, index, element);
+				});
+		}
+
+		/// @brief Find each of a batch of elements, see get_batch().
+		/// @param elements_out Where to store the pointers to the elements, nullptr for the absent ones.
+		template <typename U>
+		[[nodiscard]] PEFF_FORCEINLINE BatchQueryResultType find_batch(const U *keys, size_t num_keys, T **elements_out) {
+			_check_query_type<U>();
+			return get_batch(
+				num_keys,
+				[keys](size_t index) -> const U & {
+					return keys[index];
+				},
+				[elements_out](size_t index, T *element) {
+					elements_out[index] = element;
+				});
+		}
+
+		template <typename U>
+		[[nodiscard]] PEFF_FORCEINLINE BatchQueryResultType find_batch(const U *keys, size_t num_keys, const T **elements_out) const {
+			_check_query_type<U>();
+			return const_cast<ThisType *>(this)->get_batch(
+				num_keys,
+				[keys](size_t index) -> const U & {
+					return keys[index];
+				},
+				[elements_out](size_t index, T *element) {
+					elements_out[index] = element;
+				});
 		}
 
 		PEFF_FORCEINLINE size_t size() const {
 			return _size;
 		}
 
-		PEFF_FORCEINLINE bool shrink_buckets() {
+		/// @brief Get number of the buckets, the old buckets of an incremental resize are not counted.
+		PEFF_FORCEINLINE size_t bucket_count() const {
+			return _buckets.size();
+		}
+
+		/// @brief Shrink the buckets to the least number for the current size, the bucket array is released if the set is empty.
+		/// @return true for succeeded, false if failed, the set is unchanged on failure.
+		[[nodiscard]] PEFF_FORCEINLINE bool shrink_buckets() {
+			_finish_migration();
+
+			if (!_size) {
+				clear_and_shrink();
+				return true;
+			}
+
+			// The buckets are only grown if there are more than two elements per bucket.
+			size_t new_size = (_size + 1) >> 1;
+			if constexpr (BucketIndexer::POWER_OF_TWO_BUCKETS) {
+				size_t n = 1;
+				while (n < new_size)
+					n <<= 1;
+				new_size = n;
+			}
+
+			if (new_size < _buckets.size()) {
+				BucketsType new_buckets(_buckets.allocator());
+				if (!_resize_buckets(new_size, _buckets, new_buckets))
+					return false;
+				_buckets = std::move(new_buckets);
+			}
+
 			return _buckets.shrink_to_fit();
 		}
+
+		/// @brief Release all memory which is not used by the elements.
+		[[nodiscard]] PEFF_FORCEINLINE bool shrink_to_fit() {
+			return shrink_buckets();
+		}
 	};
 
-	template <typename T, typename EqCmp = std::equal_to<T>, typename Hasher = peff::Hasher<T>>
-	using HashSet = HashSetImpl<T, EqCmp, Hasher, false>;
-	template <typename T, typename EqCmp = peff::FallibleEq<T>, typename Hasher = peff::FallibleHasher<T>>
-	using FallibleHashSet = HashSetImpl<T, EqCmp, Hasher, true>;
+	template <typename T, typename EqCmp = std::equal_to<T>, typename Hasher = peff::Hasher<T>, typename BucketIndexer = ModuloBucketIndexer>
+	using HashSet = HashSetImpl<T, EqCmp, Hasher, false, BucketIndexer>;
+	template <typename T, typename EqCmp = peff::FallibleEq<T>, typename Hasher = peff::FallibleHasher<T>, typename BucketIndexer = ModuloBucketIndexer>
+	using FallibleHashSet = HashSetImpl<T, EqCmp, Hasher, true, BucketIndexer>;
 }
 
 #endif
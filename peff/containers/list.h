@@ -12,7 +12,10 @@
 #include <stdexcept>
 
 namespace peff {
-	template <typename T>
+	/// @brief The doubly linked list type.
+	/// @tparam T Type of the elements.
+	/// @tparam AllocT Type of the allocator, see AllocTraits.
+	template <typename T, typename AllocT = Alloc>
 	class List {
 	public:
 		struct Node {
@@ -24,25 +27,26 @@ namespace peff {
 		};
 
 		using NodeHandle = Node *;
+		using NodeReleaser = BatchReleaser<AllocT>;
 
 		static PEFF_FORCEINLINE NodeHandle null_node_handle() {
 			return nullptr;
 		}
 
 	private:
-		using ThisType = List<T>;
+		using ThisType = List<T, AllocT>;
 
 		Node *_first = nullptr, *_last = nullptr;
 		size_t _length = 0;
-		RcObjectPtr<Alloc> _allocator;
+		RcObjectPtr<AllocT> _allocator;
 
 		[[nodiscard]] PEFF_FORCEINLINE Node *_alloc_node(T &&data) {
-			Node *node = (Node *)_allocator->alloc(sizeof(Node), alignof(Node));
+			Node *node = (Node *)AllocTraits<AllocT>::alloc(_allocator.get(), sizeof(Node), alignof(Node));
 			if (!node)
 				return nullptr;
 
 			ScopeGuard scope_guard([this, node]() noexcept {
-				_allocator->release(node, sizeof(Node), alignof(Node));
+				AllocTraits<AllocT>::release(_allocator.get(), node, sizeof(Node), alignof(Node));
 			});
 			peff::construct_at<Node>(node, std::move(data));
 			scope_guard.release();
@@ -53,7 +57,7 @@ namespace peff {
 		PEFF_FORCEINLINE void _delete_node(Node *node) {
 			std::destroy_at<Node>(node);
 
-			_allocator->release(node, sizeof(Node), alignof(Node));
+			AllocTraits<AllocT>::release(_allocator.get(), node, sizeof(Node), alignof(Node));
 		}
 
 		PEFF_FORCEINLINE void _prepend(Node *dest, Node *node) noexcept {
@@ -112,8 +116,16 @@ namespace peff {
 			--_length;
 		}
 
+		/// @brief Check if the nodes can be dropped without being destroyed and released.
+		PEFF_FORCEINLINE bool _is_node_release_skippable() const noexcept {
+			if constexpr (std::is_trivially_destructible_v<T>)
+				return AllocTraits<AllocT>::get_caps(_allocator.get()).is_monotonic;
+			else
+				return false;
+		}
+
 	public:
-		PEFF_FORCEINLINE List(Alloc *allocator) : _allocator(allocator) {}
+		PEFF_FORCEINLINE List(AllocT *allocator) : _allocator(allocator) {}
 		List(const ThisType &other) = delete;
 		PEFF_FORCEINLINE List(ThisType &&other) : _first(other._first), _last(other._last), _length(other._length), _allocator(std::move(other._allocator)) {
 			other._first = nullptr;
@@ -127,12 +139,9 @@ namespace peff {
 		}
 		PEFF_FORCEINLINE ThisType &operator=(const ThisType &other) = delete;
 		PEFF_FORCEINLINE ~List() {
-			for (Node *i = _first; i != nullptr;) {
-				Node *next = i->next;
-
-				_delete_node(i);
-
-				i = next;
+			if (_first && !_is_node_release_skippable()) {
+				NodeReleaser releaser(_allocator.get(), sizeof(Node), alignof(Node));
+				clear(releaser);
 			}
 		}
 
@@ -250,10 +259,34 @@ namespace peff {
 		}
 
 		PEFF_FORCEINLINE void clear() {
+			if (!_first)
+				return;
+
+			if (_is_node_release_skippable()) {
+				discard_nodes();
+				return;
+			}
+
+			NodeReleaser releaser(_allocator.get(), sizeof(Node), alignof(Node));
+			clear(releaser);
+		}
+
+		/// @brief Empty the list without destroying and releasing the nodes.
+		/// @note Only for the nodes which need not to be destroyed with an allocator which does not need the blocks to be released, see AllocCaps::is_monotonic.
+		PEFF_FORCEINLINE void discard_nodes() noexcept {
+			_length = 0;
+			_first = nullptr;
+			_last = nullptr;
+		}
+
+		/// @brief Clear the list and release the nodes through a releaser, which can be shared by lists with the same allocator.
+		/// @param releaser Releaser of the nodes, the blocks may not be released until the releaser is flushed.
+		PEFF_FORCEINLINE void clear(NodeReleaser &releaser) {
 			for (Node *i = _first; i;) {
 				Node *next_node = i->next;
 
-				_delete_node(i);
+				std::destroy_at<Node>(i);
+				releaser.push(i);
 
 				i = next_node;
 			}
@@ -415,12 +448,12 @@ namespace peff {
 
 		struct ConstIterator {
 			const Node *node;
-			const List<T> *list;
+			const ThisType *list;
 			IteratorDirection direction;
 
 			PEFF_FORCEINLINE ConstIterator(
 				const Node *node,
-				const List<T> *list,
+				const ThisType *list,
 				IteratorDirection direction)
 				: node(node),
 				  list(list),
@@ -587,11 +620,11 @@ namespace peff {
 			return end_const();
 		}
 
-		PEFF_FORCEINLINE Alloc *allocator() const {
+		PEFF_FORCEINLINE AllocT *allocator() const {
 			return _allocator.get();
 		}
 
-		PEFF_FORCEINLINE void replace_allocator(Alloc *rhs) noexcept {
+		PEFF_FORCEINLINE void replace_allocator(AllocT *rhs) noexcept {
 			verify_replaceable(_allocator.get(), rhs);
 
 			_allocator = rhs;
@@ -99,6 +99,34 @@ namespace peff {
 			return _set.insert(std::move(pair));
 		}
 
+		/// @brief Insert multiple key-value pairs, the nodes are allocated in batches.
+		/// @param keys Keys to be inserted, which will be moved into the map.
+		/// @param values Values to be inserted, which will be moved into the map.
+		/// @param num_pairs Number of the pairs.
+		/// @return Whether all pairs are inserted successfully.
+		[[nodiscard]] PEFF_FORCEINLINE bool insert_batch(K *keys, V *values, size_t num_pairs) {
+			constexpr size_t BATCH_SIZE = SetType::NODE_BATCH_SIZE;
+			alignas(Pair) char pair_buf[sizeof(Pair) * BATCH_SIZE];
+			Pair *pairs = (Pair *)pair_buf;
+
+			for (size_t i = 0; i < num_pairs; i += BATCH_SIZE) {
+				const size_t n = num_pairs - i < BATCH_SIZE ? num_pairs - i : BATCH_SIZE;
+
+				for (size_t j = 0; j < n; ++j)
+					peff::construct_at<Pair>(&pairs[j], std::move(keys[i + j]), std::move(values[i + j]), false);
+
+				const bool succeeded = _set.insert_batch(pairs, n);
+
+				for (size_t j = 0; j < n; ++j)
+					std::destroy_at<Pair>(&pairs[j]);
+
+				if (!succeeded)
+					return false;
+			}
+
+			return true;
+		}
+
 		PEFF_FORCEINLINE RemoveResultType remove(const K &key) {
 			return _set.remove(QueryPair(&key));
 		}
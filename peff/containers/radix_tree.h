@@ -13,11 +13,11 @@
 #include <stdexcept>
 
 namespace peff {
-	template <typename K, typename V>
+	template <typename K, typename V, typename AllocT = Alloc>
 	class RadixTree final {
 	public:
 		static_assert(std::is_integral_v<K>, "The key must be integral type");
-		using ThisType = RadixTree<K, V>;
+		using ThisType = RadixTree<K, V, AllocT>;
 
 		constexpr static uintmax_t HEIGHT_MAX = std::numeric_limits<K>::digits;
 		using Height = typename ::peff::AutoSizeUInteger<HEIGHT_MAX>::type;
@@ -35,13 +35,13 @@ namespace peff {
 		};
 
 	private:
-		peff::RcObjectPtr<peff::Alloc> _allocator;
+		peff::RcObjectPtr<AllocT> _allocator;
 		Height _height;
 		size_t _num_nodes;
 		Node *_root;
 
 		[[nodiscard]] PEFF_FORCEINLINE Node *_alloc_single_node() {
-			Node *node = alloc_and_construct<Node>(_allocator.get(), alignof(Node));
+			Node *node = alloc_and_construct<Node, AllocT>(_allocator.get(), alignof(Node));
 			if (!node)
 				return nullptr;
 
@@ -49,7 +49,7 @@ namespace peff {
 		}
 
 		PEFF_FORCEINLINE void _delete_single_node(Node *node) {
-			destroy_and_release<Node>(_allocator.get(), node, alignof(Node));
+			destroy_and_release_borrowed<Node, AllocT>(_allocator.get(), node, alignof(Node));
 		}
 
 		[[nodiscard]] inline bool _grow_height(Height height) {
@@ -359,7 +359,7 @@ namespace peff {
 		}
 
 	public:
-		PEFF_FORCEINLINE RadixTree(peff::Alloc *allocator) : _allocator(allocator), _height(0), _num_nodes(0), _root(nullptr) {}
+		PEFF_FORCEINLINE RadixTree(AllocT *allocator) : _allocator(allocator), _height(0), _num_nodes(0), _root(nullptr) {}
 		PEFF_FORCEINLINE ~RadixTree() {
 			Node *cur_node = (Node *)_get_min_node(_root);
 			Node *parent = (Node *)_root->p;
@@ -63,7 +63,8 @@ namespace peff {
 	template <typename T,
 		typename Comparator,
 		bool Fallible,
-		bool IsThreeway>
+		bool IsThreeway,
+		typename AllocT = Alloc>
 	PEFF_REQUIRES_CONCEPT(std::invocable<Comparator, const T &, const T &> &&std::strict_weak_order<Comparator, T, T>)
 	class RBTreeImpl final : protected RBTreeBase {
 	public:
@@ -78,16 +79,19 @@ namespace peff {
 		using NodeType = Node;
 		using ComparatorType = Comparator;
 
+		/// @brief Maximum number of the nodes to be allocated in one batch.
+		constexpr static size_t NODE_BATCH_SIZE = 64;
+
 	private:
 		using NodeQueryResultType = typename std::conditional<Fallible, Option<Node *>, Node *>::type;
 
-		using ThisType = RBTreeImpl<T, Comparator, Fallible, IsThreeway>;
+		using ThisType = RBTreeImpl<T, Comparator, Fallible, IsThreeway, AllocT>;
 
 		Comparator _comparator;
-		RcObjectPtr<Alloc> _allocator;
+		RcObjectPtr<AllocT> _allocator;
 
 		[[nodiscard]] PEFF_FORCEINLINE Node *_alloc_single_node(T &&value) {
-			Node *node = (Node *)alloc_and_construct<Node>(_allocator.get(), alignof(Node), std::move(value));
+			Node *node = (Node *)alloc_and_construct<Node, AllocT>(_allocator.get(), alignof(Node), std::move(value));
 			if (!node)
 				return nullptr;
 
@@ -95,13 +99,19 @@ namespace peff {
 		}
 
 		PEFF_FORCEINLINE void _delete_single_node(Node *node) {
-			destroy_and_release<Node>(_allocator.get(), node, alignof(Node));
+			destroy_and_release_borrowed<Node, AllocT>(_allocator.get(), node, alignof(Node));
 		}
 
 		PEFF_FORCEINLINE void _delete_node_tree(Node *node) {
+			// Nothing has to be done for each node if the nodes need not to be destroyed and released.
+			if constexpr (std::is_trivially_destructible_v<T>) {
+				if (AllocTraits<AllocT>::get_caps(_allocator.get()).is_monotonic)
+					return;
+			}
+
+			BatchReleaser<AllocT> releaser(_allocator.get(), sizeof(Node), alignof(Node));
 			Node *cur_node = (Node *)_get_min_node(node);
 			Node *parent = (Node *)node->p;
-			bool walked_root_node = false;
 
 			while (cur_node != parent) {
 				if (cur_node->r) {
@@ -112,12 +122,14 @@ namespace peff {
 					while (cur_node->p && (cur_node == cur_node->p->r)) {
 						node_to_delete = cur_node;
 						cur_node = (Node *)cur_node->p;
-						_delete_single_node(node_to_delete);
+						std::destroy_at<Node>(node_to_delete);
+						releaser.push(node_to_delete);
 					}
 
 					node_to_delete = cur_node;
 					cur_node = (Node *)cur_node->p;
-					_delete_single_node(node_to_delete);
+					std::destroy_at<Node>(node_to_delete);
+					releaser.push(node_to_delete);
 				}
 			}
 		}
@@ -343,6 +355,72 @@ namespace peff {
 			return max_node;
 		}
 
+		template <typename U>
+		PEFF_FORCEINLINE NodeQueryResultType _get_min_gteq(const U &data) {
+			Node *cur_node = (Node *)_root, *min_node = NULL;
+
+			if constexpr (Fallible) {
+				while (cur_node) {
+					if constexpr (IsThreeway) {
+						auto &&result = _comparator(cur_node->rb_value, data);
+
+						if (!result.has_value())
+							return NULL_OPTION;
+
+						if (result.value() < 0)
+							cur_node = (Node *)cur_node->r;
+						else if (result.value() > 0) {
+							min_node = cur_node;
+							cur_node = (Node *)cur_node->l;
+						} else
+							return cur_node;
+					} else {
+						Option<bool> result;
+
+						if ((result = _comparator(cur_node->rb_value, data)).has_value()) {
+							if (result.value()) {
+								cur_node = (Node *)cur_node->r;
+							} else if ((result = _comparator(data, cur_node->rb_value)).has_value()) {
+								if (result.value()) {
+									min_node = cur_node;
+									cur_node = (Node *)cur_node->l;
+								} else
+									return cur_node;
+							} else {
+								return NULL_OPTION;
+							}
+						} else {
+							return NULL_OPTION;
+						}
+					}
+				}
+			} else {
+				while (cur_node) {
+					if constexpr (IsThreeway) {
+						auto &&result = _comparator(cur_node->rb_value, data);
+						if (result < 0)
+							cur_node = (Node *)cur_node->r;
+						else if (result > 0) {
+							min_node = cur_node;
+							cur_node = (Node *)cur_node->l;
+						} else
+							return cur_node;
+					} else {
+						if (_comparator(cur_node->rb_value, data)) {
+							assert(!_comparator(data, cur_node->rb_value));
+							cur_node = (Node *)cur_node->r;
+						} else if (_comparator(data, cur_node->rb_value)) {
+							min_node = cur_node;
+							cur_node = (Node *)cur_node->l;
+						} else
+							return cur_node;
+					}
+				}
+			}
+
+			return min_node;
+		}
+
 		PEFF_FORCEINLINE bool _insert(Node *parent, Node *node) {
 			assert(!node->l);
 			assert(!node->r);
@@ -406,6 +484,36 @@ namespace peff {
 			return true;
 		}
 
+		/// @brief Link a node at a free slot found by _get_slot() and rebalance the tree, the key is not compared again.
+		/// @param slot Free slot of the node.
+		/// @param parent Parent of the slot, nullptr if the slot is the root.
+		PEFF_FORCEINLINE void _insert_at(NodeBase **slot, NodeBase *parent, Node *node) {
+			assert(!*slot);
+			assert(!node->l);
+			assert(!node->r);
+
+			*slot = node;
+			node->p = parent;
+
+			if (!parent) {
+				node->color = RBColor::Black;
+				_cached_min_node = node;
+				_cached_max_node = node;
+			} else {
+				node->color = RBColor::Red;
+
+				// The rotations keep the order of the nodes, so only the new node can become the minimum or the maximum.
+				if ((parent == _cached_min_node) && (slot == &parent->l))
+					_cached_min_node = node;
+				if ((parent == _cached_max_node) && (slot == &parent->r))
+					_cached_max_node = node;
+
+				_insert_fix_up(node);
+			}
+
+			++_num_nodes;
+		}
+
 		PEFF_FORCEINLINE Node *_remove(Node *node) {
 			Node *y = (Node *)_remove_fix_up(node);
 
@@ -418,7 +526,7 @@ namespace peff {
 		}
 
 	public:
-		PEFF_FORCEINLINE RBTreeImpl(Alloc *allocator, Comparator &&comparator) : _allocator(allocator), _comparator(std::move(comparator)) {}
+		PEFF_FORCEINLINE RBTreeImpl(AllocT *allocator, Comparator &&comparator) : _allocator(allocator), _comparator(std::move(comparator)) {}
 
 		PEFF_FORCEINLINE RBTreeImpl(ThisType &&other)
 			: _comparator(std::move(other._comparator)),
@@ -469,6 +577,15 @@ namespace peff {
 			return _get_max_lteq<U>(data);
 		}
 
+		PEFF_FORCEINLINE NodeQueryResultType get_min_gteq(const T &data) {
+			return _get_min_gteq<T>(data);
+		}
+
+		template <typename U>
+		PEFF_FORCEINLINE NodeQueryResultType get_min_gteq_alt(const U &data) {
+			return _get_min_gteq<U>(data);
+		}
+
 		PEFF_FORCEINLINE NodeQueryResultType get(const T &key) const {
 			return _get<T>(key);
 		}
@@ -519,6 +636,61 @@ namespace peff {
 			return node;
 		}
 
+		/// @brief Insert multiple keys, the nodes are allocated in batches.
+		/// @param keys Keys to be inserted, which will be moved into the tree.
+		/// @param num_keys Number of the keys.
+		/// @return Whether all keys are inserted successfully, the keys before the failed one are kept inserted.
+		[[nodiscard]] PEFF_FORCEINLINE bool insert_batch(T *keys, size_t num_keys) {
+			void *blocks[NODE_BATCH_SIZE];
+			size_t num_blocks = 0, idx_block = 0;
+			bool succeeded = true;
+
+			for (size_t i = 0; i < num_keys; ++i) {
+				NodeBase *parent = nullptr, **slot = _get_slot(keys[i], parent);
+
+				if constexpr (Fallible) {
+					if (!slot) {
+						succeeded = false;
+						break;
+					}
+				}
+
+				// The key presents, the fallible search returns the slot of the node, the infallible one returns the node as the parent.
+				if ((!slot) || (*slot)) {
+					Node *node = static_cast<Node *>(slot ? *slot : parent);
+					move_assign_or_move_construct<T>(node->rb_value, std::move(keys[i]));
+					continue;
+				}
+
+				if (idx_block == num_blocks) {
+					const size_t num_rest_keys = num_keys - i;
+
+					num_blocks = AllocTraits<AllocT>::alloc_batch(
+						_allocator.get(),
+						num_rest_keys < NODE_BATCH_SIZE ? num_rest_keys : NODE_BATCH_SIZE,
+						sizeof(Node), alignof(Node),
+						blocks);
+					idx_block = 0;
+
+					if (!num_blocks) {
+						succeeded = false;
+						break;
+					}
+				}
+
+				// The allocation does not change the tree, so the slot found above is still free.
+				Node *node = (Node *)blocks[idx_block++];
+				peff::construct_at<Node>(node, std::move(keys[i]));
+
+				_insert_at(slot, parent, node);
+			}
+
+			if (idx_block < num_blocks)
+				AllocTraits<AllocT>::release_batch(_allocator.get(), blocks + idx_block, num_blocks - idx_block, sizeof(Node), alignof(Node));
+
+			return succeeded;
+		}
+
 		PEFF_FORCEINLINE peff::Option<T> remove(Node *node, bool delete_node = true) {
 			Node *y = _remove(node);
 			if (delete_node) {
@@ -546,11 +718,11 @@ namespace peff {
 			return _num_nodes;
 		}
 
-		PEFF_FORCEINLINE Alloc *allocator() const {
+		PEFF_FORCEINLINE AllocT *allocator() const {
 			return const_cast<ThisType *>(this)->_allocator.get();
 		}
 
-		PEFF_FORCEINLINE void replace_allocator(Alloc *rhs) {
+		PEFF_FORCEINLINE void replace_allocator(AllocT *rhs) {
 			verify_replaceable(_allocator.get(), rhs);
 
 			_allocator = rhs;
@@ -854,10 +1026,10 @@ namespace peff {
 		}
 	};
 
-	template <typename T, typename Comparator = std::less<T>, bool IsThreeway = false>
-	using RBTree = RBTreeImpl<T, Comparator, false, IsThreeway>;
-	template <typename T, typename Comparator = peff::FallibleLt<T>, bool IsThreeway = false>
-	using FallibleRBTree = RBTreeImpl<T, Comparator, true, IsThreeway>;
+	template <typename T, typename Comparator = std::less<T>, bool IsThreeway = false, typename AllocT = Alloc>
+	using RBTree = RBTreeImpl<T, Comparator, false, IsThreeway, AllocT>;
+	template <typename T, typename Comparator = peff::FallibleLt<T>, bool IsThreeway = false, typename AllocT = Alloc>
+	using FallibleRBTree = RBTreeImpl<T, Comparator, true, IsThreeway, AllocT>;
 }
 
 #endif
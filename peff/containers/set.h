@@ -20,6 +20,8 @@ namespace peff {
 
 		using NodeType = typename Tree::NodeType;
 
+		constexpr static size_t NODE_BATCH_SIZE = Tree::NODE_BATCH_SIZE;
+
 		PEFF_FORCEINLINE SetImpl(Alloc *allocator, Comparator &&comparator = {}) : _tree(allocator, std::move(comparator)) {
 		}
 		PEFF_FORCEINLINE SetImpl(ThisType &&rhs) : _tree(std::move(rhs._tree)) {
@@ -41,6 +43,11 @@ namespace peff {
 			return true;
 		}
 
+		/// @brief Insert multiple values, see RBTreeImpl::insert_batch().
+		[[nodiscard]] PEFF_FORCEINLINE bool insert_batch(T *values, size_t num_values) {
+			return _tree.insert_batch(values, num_values);
+		}
+
 		PEFF_FORCEINLINE RemoveResultType remove(const T &key) {
 			return remove_alt<T>(key);
 		}
@@ -0,0 +1,7 @@
+#ifndef _PEFF_GENERATED_CONFIG_H_
+#define _PEFF_GENERATED_CONFIG_H_
+
+#define PEFF_ENABLE_ASSERTION 0
+#define PEFF_ENABLE_RCOBJ_DEBUGGING 0
+
+#endif
@@ -165,6 +165,64 @@ namespace peff {
 		return count_leading_zero((uint64_t)value);
 	}
 
+	PEFF_FORCEINLINE uint8_t count_trailing_zero(uint32_t value) {
+#if (defined(_M_IX86) || defined(_M_X64) || __i386__ || __x86_64__)
+	#ifdef _MSC_VER
+		unsigned long index;
+		if (!_BitScanForward(&index, value))
+			return 32;
+		return (uint8_t)index;
+	#elif defined(__GNUC__) || defined(__clang__)
+		if (!value)
+			return 32;
+		return __builtin_ctz(value);
+	#else
+		#define _PEFF_USE_DEFAULT_COUNT_TRAILING_ZERO_U32 1
+	#endif
+#else
+	#define _PEFF_USE_DEFAULT_COUNT_TRAILING_ZERO_U32 1
+#endif
+#if _PEFF_USE_DEFAULT_COUNT_TRAILING_ZERO_U32
+		if (!value)
+			return 32;
+		uint8_t cnt = 0;
+		while (!(value & 1)) {
+			value >>= 1;
+			++cnt;
+		}
+		return cnt;
+#endif
+	}
+
+	PEFF_FORCEINLINE uint8_t count_trailing_zero(uint64_t value) {
+#if (defined(_M_X64) || __x86_64__)
+	#ifdef _MSC_VER
+		unsigned long index;
+		if (!_BitScanForward64(&index, value))
+			return 64;
+		return (uint8_t)index;
+	#elif defined(__GNUC__) || defined(__clang__)
+		if (!value)
+			return 64;
+		return __builtin_ctzll(value);
+	#else
+		#define _PEFF_USE_DEFAULT_COUNT_TRAILING_ZERO_U64 1
+	#endif
+#else
+	#define _PEFF_USE_DEFAULT_COUNT_TRAILING_ZERO_U64 1
+#endif
+#if _PEFF_USE_DEFAULT_COUNT_TRAILING_ZERO_U64
+		if (!value)
+			return 64;
+		uint8_t cnt = 0;
+		while (!(value & 1)) {
+			value >>= 1;
+			++cnt;
+		}
+		return cnt;
+#endif
+	}
+
 	PEFF_FORCEINLINE uint8_t r_rot(uint8_t value, uint_fast8_t shift) {
 #if (defined(_M_IX86) || defined(_M_X64) || __i386__ || __x86_64__)
 	#ifdef _MSVC
@@ -316,6 +374,12 @@ namespace peff {
 	PEFF_FORCEINLINE int64_t l_rot(int64_t value, uint_fast8_t shift) {
 		return l_rot((uint64_t)value, shift);
 	}
+
+	/// @brief Set or clear a bit of a bitmap, the bits are laid out like the ones of BitArray.
+	PEFF_FORCEINLINE void assign_bitmap_bit(uint8_t *bitmap, size_t index, bool value) {
+		// Branchless, the values of the batched lookups are hardly predictable.
+		bitmap[index >> 3] = (uint8_t)((bitmap[index >> 3] & ~(1 << (index & 7))) | ((uint8_t)value << (index & 7)));
+	}
 }
 
 #endif
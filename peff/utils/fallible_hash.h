@@ -5,6 +5,19 @@
 #include "option.h"
 
 namespace peff {
+	namespace details {
+		/// @brief Extract the type of the hash codes from the result type of a hasher, which may be fallible.
+		template <typename T, typename V = void>
+		struct HashCodeResultTypeExtractor {
+			using type = T;
+		};
+
+		template <typename T>
+		struct HashCodeResultTypeExtractor<T, std::void_t<decltype(std::declval<T>().value())>> {
+			using type = typename T::value_type;
+		};
+	}
+
 	template <typename T>
 	struct FallibleHasher {
 		static_assert(!std::is_same_v<T, T>, "Hasher was not found");
@@ -89,6 +89,43 @@ namespace peff {
 		}
 	};
 
+	/// @brief Finalizer of MurmurHash3, every bit of the input affects every bit of the result.
+	PEFF_FORCEINLINE constexpr uint64_t mix_hash64(uint64_t x) noexcept {
+		x ^= x >> 33;
+		x *= 0xff51afd7ed558ccdULL;
+		x ^= x >> 33;
+		x *= 0xc4ceb9fe1a85ec53ULL;
+		x ^= x >> 33;
+		return x;
+	}
+
+	/// @brief Hasher which mixes the bits of the keys.
+	///
+	/// Unlike Hasher, whose specializations for the integers are identity
+	/// functions, keys which only differ in a few bits, such as sequential
+	/// ids or multiples of a stride, are spread over the whole hash code,
+	/// so any bits of the hash code can be used for indexing.
+	template <typename T, typename = void>
+	struct MixHasher {
+		static_assert(!std::is_same_v<T, T>, "Mix hasher not found");
+	};
+
+	template <typename T>
+	struct MixHasher<T, std::enable_if_t<std::is_integral_v<T>>> {
+		PEFF_FORCEINLINE size_t operator()(T x) const {
+			return (size_t)mix_hash64((uint64_t)x);
+		}
+	};
+
+	template <>
+	struct MixHasher<peff::UUID> {
+		PEFF_FORCEINLINE size_t operator()(const peff::UUID &x) const {
+			// The fields are mixed separately, the padding bytes of the UUID are indeterminate.
+			const uint64_t head = (((uint64_t)x.a) << 32) | (((uint64_t)x.b) << 16) | ((uint64_t)x.c);
+			return (size_t)mix_hash64(mix_hash64(head) ^ x.e ^ (((uint64_t)x.d) * 0x9e3779b97f4a7c15ULL));
+		}
+	};
+
 	PEFF_UTILS_API uint32_t djb_hash32(const char *data, size_t size);
 	PEFF_UTILS_API uint64_t djb_hash64(const char *data, size_t size);
 	PEFF_UTILS_API uint32_t city_hash32(const char *s, size_t len);	 // FIXME: Fix hash inequality bug.